@@ -1,6 +1,8 @@
 TEMPLATE = subdirs
 
-SUBDIRS = editor
+SUBDIRS = editor ptrectool ptloadtest pttest
 
 editor.file = src/editor.pro
-
+ptrectool.file = src/ptrectool.pro
+ptloadtest.file = src/ptloadtest.pro
+pttest.file = src/pttest.pro
@@ -24,6 +24,9 @@ CONFIG += c++17
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 DEFINES += pxINCLUDE_OGGVORBIS
+# qmake CONFIG+=check_allocations aborts on any heap allocation in a steady
+# state KeyboardView paint. See editor/views/NoAllocations.h.
+check_allocations:DEFINES += PTCOLLAB_CHECK_ALLOCATIONS
 # You can make your code fail to compile if you use deprecated APIs.
 # In order to do so, uncomment the following line.
 # Please consult the documentation of the deprecated API in order to know
@@ -33,8 +36,10 @@ DEFINES += pxINCLUDE_OGGVORBIS
 
 # Input
 HEADERS += \
+           editor/ActionLog.h \
            editor/ConnectDialog.h \
            editor/ConnectionStatusLabel.h \
+           editor/HistoryReplay.h \
            editor/HostDialog.h \
            editor/InputEvent.h \
            editor/MidiWrapper.h \
@@ -49,19 +54,25 @@ HEADERS += \
            editor/sidemenu/UserListModel.h \
            editor/sidemenu/WoiceListModel.h \
            editor/views/Animation.h \
+           editor/views/AsyncTileCache.h \
            editor/audio/AudioFormat.h \
+           editor/views/BackgroundCache.h \
            editor/Clipboard.h \
            editor/ComboOptions.h \
            editor/DummySyncServer.h \
            editor/EditState.h \
            editor/EditorScrollArea.h \
            editor/EditorWindow.h \
+           editor/views/EventCheckpoints.h \
+           editor/views/FrameProfiler.h \
            editor/Interval.h \
            editor/views/KeyboardView.h \
            editor/audio/NotePreview.h \
            editor/views/MeasureView.h \
            editor/views/MooClock.h \
+           editor/views/NoAllocations.h \
            editor/views/ParamView.h \
+           editor/ProjectSnapshot.h \
            editor/PxtoneClient.h \
            editor/PxtoneController.h \
            editor/audio/PxtoneIODevice.h \
@@ -75,10 +86,16 @@ HEADERS += \
            network/Client.h \
            network/LocalServerSession.h \
            network/ServerSession.h \
+           network/SessionThreadPool.h \
+           network/WoiceCache.h \
+           protocol/ActionTiming.h \
            protocol/Data.h \
+           protocol/Frame.h \
            protocol/Hello.h \
            protocol/NoIdMap.h \
+           protocol/ProjectTransfer.h \
            protocol/PxtoneEditAction.h \
+           protocol/Recording.h \
            protocol/RemoteAction.h \
            protocol/SerializeVariant.h \
            pxtone/pxtn.h \
@@ -112,8 +129,10 @@ FORMS += \
     editor/sidemenu/SelectWoiceDialog.ui \
     editor/sidemenu/SideMenu.ui
 SOURCES += main.cpp \
+           editor/ActionLog.cpp \
            editor/ConnectDialog.cpp \
            editor/ConnectionStatusLabel.cpp \
+           editor/HistoryReplay.cpp \
            editor/HostDialog.cpp \
            editor/InputEvent.cpp \
            editor/MidiWrapper.cpp \
@@ -128,18 +147,23 @@ SOURCES += main.cpp \
            editor/sidemenu/UserListModel.cpp \
            editor/sidemenu/WoiceListModel.cpp \
            editor/views/Animation.cpp \
+           editor/views/AsyncTileCache.cpp \
            editor/audio/AudioFormat.cpp \
+           editor/views/BackgroundCache.cpp \
            editor/Clipboard.cpp \
            editor/DummySyncServer.cpp \
            editor/EditState.cpp \
            editor/EditorScrollArea.cpp \
            editor/EditorWindow.cpp \
+           editor/views/FrameProfiler.cpp \
            editor/Interval.cpp \
            editor/views/KeyboardView.cpp \
            editor/audio/NotePreview.cpp \
            editor/views/MeasureView.cpp \
            editor/views/MooClock.cpp \
+           editor/views/NoAllocations.cpp \
            editor/views/ParamView.cpp \
+           editor/ProjectSnapshot.cpp \
            editor/PxtoneClient.cpp \
            editor/PxtoneController.cpp \
            editor/audio/PxtoneIODevice.cpp \
@@ -153,10 +177,16 @@ SOURCES += main.cpp \
            network/Client.cpp \
            network/LocalServerSession.cpp \
            network/ServerSession.cpp \
+           network/SessionThreadPool.cpp \
+           network/WoiceCache.cpp \
+           protocol/ActionTiming.cpp \
            protocol/Data.cpp \
+           protocol/Frame.cpp \
            protocol/Hello.cpp \
            protocol/NoIdMap.cpp \
+           protocol/ProjectTransfer.cpp \
            protocol/PxtoneEditAction.cpp \
+           protocol/Recording.cpp \
            protocol/RemoteAction.cpp \
            pxtone/pxtnDelay.cpp \
            pxtone/pxtnDescriptor.cpp \
@@ -0,0 +1,308 @@
+#include "ActionLog.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <set>
+#include <tuple>
+
+// Don't bother compacting the spill file until it has at least this much
+// unused space.
+static constexpr qint64 MIN_SPILL_WASTE = 1 << 20;
+
+ActionLog::ActionLog(size_t max_resident_primitives)
+    : m_max_resident_primitives(max_resident_primitives),
+      m_resident_primitives(0),
+      m_spill_file(nullptr),
+      m_spill_claimed(0),
+      m_spill_failed(false) {}
+
+void ActionLog::push(qint64 uid, qint64 idx,
+                     const std::list<Action::Primitive> &reverse) {
+  size_t i = m_entries.size();
+  m_entries.emplace_back(uid, idx, reverse);
+  m_users[uid].done.push_back(i);
+  m_resident.push_back(i);
+  m_touched.push_back(i);
+  trim();
+}
+
+bool ActionLog::loadFrom(size_t first) {
+  bool ok = true;
+  for (size_t i = first; i < m_entries.size(); ++i)
+    if (m_entries[i].spilled && !load(i)) ok = false;
+  return ok;
+}
+
+bool ActionLog::loadForUndo(size_t target) {
+  bool ok = !m_entries.at(target).spilled || load(target);
+  for (size_t i = target + 1; i < m_entries.size(); ++i) {
+    const LoggedAction &a = m_entries[i];
+    if (a.state == LoggedAction::DONE && a.spilled && !load(i)) ok = false;
+  }
+  return ok;
+}
+
+LoggedAction &ActionLog::at(size_t i) {
+  LoggedAction &a = m_entries.at(i);
+  if (a.spilled) load(i);
+  // The caller might change the reverse, so recount it on the next trim.
+  m_touched.push_back(i);
+  return a;
+}
+
+void ActionLog::moveToThread(QThread *thread) {
+  if (m_spill_file != nullptr) m_spill_file->moveToThread(thread);
+}
+
+qint64 ActionLog::spillFileSize() const {
+  return m_spill_file == nullptr ? 0 : m_spill_file->size();
+}
+
+std::optional<size_t> ActionLog::lastDone(qint64 uid) const {
+  auto it = m_users.find(uid);
+  if (it == m_users.end() || it->second.done.empty()) return std::nullopt;
+  return it->second.done.back();
+}
+
+std::optional<size_t> ActionLog::firstUndone(qint64 uid) const {
+  auto it = m_users.find(uid);
+  if (it == m_users.end() || it->second.undone.empty()) return std::nullopt;
+  return it->second.undone.back();
+}
+
+void ActionLog::flip(size_t i) {
+  LoggedAction &a = m_entries.at(i);
+  UserStacks &stacks = m_users[a.uid];
+  switch (a.state) {
+    case LoggedAction::DONE:
+      if (stacks.done.empty() || stacks.done.back() != i) {
+        qWarning() << "Flipping a done action that isn't the user's last";
+        return;
+      }
+      stacks.done.pop_back();
+      stacks.undone.push_back(i);
+      a.state = LoggedAction::UNDONE;
+      break;
+    case LoggedAction::UNDONE:
+      if (stacks.undone.empty() || stacks.undone.back() != i) {
+        qWarning() << "Flipping an undone action that isn't the user's first";
+        return;
+      }
+      stacks.undone.pop_back();
+      stacks.done.push_back(i);
+      a.state = LoggedAction::DONE;
+      break;
+    case LoggedAction::GONE:
+      qWarning() << "Flipping an action that's gone";
+      break;
+  }
+}
+
+void ActionLog::invalidateUndone(qint64 uid) {
+  auto it = m_users.find(uid);
+  if (it == m_users.end()) return;
+  for (size_t i : it->second.undone) {
+    LoggedAction &a = m_entries[i];
+    a.state = LoggedAction::GONE;
+    // Gone actions are never applied again, so their reverses can go.
+    a.reverse.clear();
+    a.spilled = false;
+    releaseSpillSpace(a);
+    m_touched.push_back(i);
+  }
+  it->second.undone.clear();
+}
+
+bool ActionLog::writeTail(QDataStream &out, size_t max_entries) {
+  size_t first = m_entries.size() - std::min(max_entries, m_entries.size());
+  if (!loadFrom(first)) return false;
+  std::set<qint64> unredoable;
+  for (const auto &[uid, stacks] : m_users)
+    if (!stacks.undone.empty() && stacks.undone.back() < first)
+      unredoable.insert(uid);
+
+  out << quint32(m_entries.size() - first);
+  for (size_t i = first; i < m_entries.size(); ++i) {
+    const LoggedAction &a = m_entries[i];
+    LoggedAction::UndoState state = a.state;
+    if (state == LoggedAction::UNDONE && unredoable.count(a.uid) > 0)
+      state = LoggedAction::GONE;
+    out << a.uid << a.idx << qint8(state);
+    if (state != LoggedAction::GONE) Action::writeCompact(out, a.reverse);
+  }
+  // Whatever was loaded for this can go back out.
+  trim();
+  return out.status() == QDataStream::Ok;
+}
+
+bool ActionLog::readTail(QDataStream &in) {
+  ActionLog log(m_max_resident_primitives);
+  quint32 size;
+  in >> size;
+  for (quint32 i = 0; i < size && in.status() == QDataStream::Ok; ++i) {
+    qint64 uid, idx;
+    qint8 state;
+    std::list<Action::Primitive> reverse;
+    in >> uid >> idx >> state;
+    if (state < LoggedAction::DONE || state > LoggedAction::GONE) {
+      qWarning() << "Unknown undo state in action log" << state;
+      return false;
+    }
+    try {
+      if (state != LoggedAction::GONE) Action::readCompact(in, reverse);
+    } catch (const std::runtime_error &e) {
+      qWarning("Could not decode action log entry. Error: %s", e.what());
+      return false;
+    }
+    log.push(uid, idx, reverse);
+    if (state == LoggedAction::DONE) continue;
+    // Entries are read oldest first, and the first undone one has to end up
+    // at the back of the undone stack.
+    LoggedAction &a = log.m_entries.back();
+    UserStacks &stacks = log.m_users[uid];
+    stacks.done.pop_back();
+    a.state = LoggedAction::UndoState(state);
+    if (a.state == LoggedAction::UNDONE)
+      stacks.undone.insert(stacks.undone.begin(), log.m_entries.size() - 1);
+  }
+  if (in.status() != QDataStream::Ok) return false;
+  *this = std::move(log);
+  return true;
+}
+
+void ActionLog::trim() {
+  for (size_t i : m_touched) {
+    LoggedAction &a = m_entries[i];
+    if (a.spilled) continue;
+    m_resident_primitives += a.reverse.size();
+    m_resident_primitives -= a.accounted_size;
+    a.accounted_size = a.reverse.size();
+  }
+  m_touched.clear();
+
+  // Always keep the newest entry resident, since it's the likeliest to be
+  // undone.
+  while (m_resident_primitives > m_max_resident_primitives &&
+         m_resident.size() > 1 && !m_spill_failed) {
+    size_t i = m_resident.front();
+    m_resident.pop_front();
+    LoggedAction &a = m_entries[i];
+    if (a.spilled || a.accounted_size == 0) continue;
+    if (!spill(i)) m_resident.push_front(i);
+  }
+
+  if (m_spill_file != nullptr && !m_spill_failed) {
+    qint64 waste = m_spill_file->size() - m_spill_claimed;
+    if (waste > MIN_SPILL_WASTE && waste > m_spill_claimed) compactSpillFile();
+  }
+}
+
+bool ActionLog::spill(size_t i) {
+  if (m_spill_file == nullptr) {
+    m_spill_file = std::make_unique<QTemporaryFile>();
+    if (!m_spill_file->open()) {
+      qWarning() << "Could not open a temp file for the action log. Keeping "
+                    "it all in memory.";
+      m_spill_failed = true;
+      return false;
+    }
+  }
+
+  LoggedAction &a = m_entries[i];
+  QByteArray encoded;
+  {
+    QDataStream out(&encoded, QIODevice::WriteOnly);
+    Action::writeCompact(out, a.reverse);
+  }
+  // Reverses usually come back the same size after being undone and redone,
+  // so the entry's old space is likely to fit.
+  bool reuse = a.spill_offset.has_value() && encoded.size() <= a.spill_capacity;
+  qint64 pos = reuse ? a.spill_offset.value() : m_spill_file->size();
+  if (!m_spill_file->seek(pos) ||
+      m_spill_file->write(encoded) != encoded.size()) {
+    qWarning() << "Could not spill action log entry" << qint64(i)
+               << ". Keeping it in memory.";
+    m_spill_failed = true;
+    return false;
+  }
+  if (!reuse) {
+    releaseSpillSpace(a);
+    a.spill_offset = pos;
+    a.spill_capacity = encoded.size();
+    m_spill_claimed += a.spill_capacity;
+  }
+
+  a.spilled = true;
+  a.reverse.clear();
+  m_resident_primitives -= a.accounted_size;
+  a.accounted_size = 0;
+  return true;
+}
+
+bool ActionLog::load(size_t i) {
+  LoggedAction &a = m_entries[i];
+  bool ok = m_spill_file->seek(a.spill_offset.value());
+  QDataStream in(m_spill_file.get());
+  try {
+    if (ok) Action::readCompact(in, a.reverse);
+  } catch (const std::runtime_error &e) {
+    qWarning("Could not decode action log entry. Error: %s", e.what());
+    ok = false;
+  }
+  if (!ok || in.status() != QDataStream::Ok) {
+    // The entry stays marked as spilled so that every undo that needs it
+    // fails, rather than silently doing nothing. Whatever went wrong could
+    // happen to other entries too, so stop spilling.
+    qWarning() << "Could not read back action log entry" << qint64(i)
+               << ". Keeping the rest of the log in memory.";
+    a.reverse.clear();
+    m_spill_failed = true;
+    return false;
+  }
+  a.spilled = false;
+  m_resident.push_back(i);
+  m_touched.push_back(i);
+  return true;
+}
+
+void ActionLog::releaseSpillSpace(LoggedAction &a) {
+  if (!a.spill_offset.has_value()) return;
+  m_spill_claimed -= a.spill_capacity;
+  a.spill_offset.reset();
+  a.spill_capacity = 0;
+}
+
+// Copies the entries that are still spilled to a new file, back to back. The
+// space of entries that have since been loaded isn't kept.
+void ActionLog::compactSpillFile() {
+  auto compacted = std::make_unique<QTemporaryFile>();
+  if (!compacted->open()) {
+    qWarning() << "Could not open a temp file to compact the action log into";
+    return;
+  }
+  // (entry, new offset, size)
+  std::vector<std::tuple<size_t, qint64, qint64>> moved;
+  for (size_t i = 0; i < m_entries.size(); ++i) {
+    const LoggedAction &a = m_entries[i];
+    if (!a.spilled) continue;
+    QByteArray bytes;
+    if (m_spill_file->seek(a.spill_offset.value()))
+      bytes = m_spill_file->read(a.spill_capacity);
+    qint64 pos = compacted->pos();
+    if (bytes.size() != a.spill_capacity ||
+        compacted->write(bytes) != bytes.size()) {
+      qWarning() << "Could not compact the action log. Leaving it as it is.";
+      return;
+    }
+    moved.push_back({i, pos, bytes.size()});
+  }
+
+  for (LoggedAction &a : m_entries) releaseSpillSpace(a);
+  for (const auto &[i, pos, size] : moved) {
+    LoggedAction &a = m_entries[i];
+    a.spill_offset = pos;
+    a.spill_capacity = size;
+    m_spill_claimed += size;
+  }
+  m_spill_file = std::move(compacted);
+}
@@ -0,0 +1,127 @@
+#ifndef ACTIONLOG_H
+#define ACTIONLOG_H
+#include <QDataStream>
+#include <QTemporaryFile>
+#include <QThread>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "protocol/PxtoneEditAction.h"
+
+struct LoggedAction {
+  enum UndoState : qint8 { DONE, UNDONE, GONE };
+  UndoState state;
+  qint64 uid;
+  qint64 idx;
+  // Whatever takes the project to the other state: the action's undo while
+  // it's done, and the action itself while it's undone. Empty once it's gone.
+  std::list<Action::Primitive> reverse;
+  LoggedAction(qint64 uid, qint64 idx,
+               const std::list<Action::Primitive> &reverse)
+      : state(DONE), uid(uid), idx(idx), reverse(reverse) {}
+
+ private:
+  friend class ActionLog;
+  friend class ActionLogTest;
+  // Whether the reverse is in the spill file rather than in memory.
+  bool spilled = false;
+  // Where in the spill file the entry last went. Kept after it's loaded back
+  // so that the next spill can reuse the space if it fits.
+  std::optional<qint64> spill_offset;
+  qint64 spill_capacity = 0;
+  size_t accounted_size = 0;
+};
+
+// The log of committed actions. It never shrinks, so to avoid scanning it on
+// every undo / redo, each user's done / undone entries are tracked as stacks
+// of indices into the log.
+//
+// Per user, undone entries are always a suffix of their non-gone entries
+// (a new action invalidates them), so the last undone entry pushed is also the
+// first in log order, which is the one a redo targets.
+//
+// The reverses of old entries are rarely needed, so once the number of
+// resident primitives goes over a budget, the oldest are spilled to a temp
+// file and read back only when accessed. An entry keeps its place in the file
+// for the next time it's spilled, and the file is compacted once more of it
+// is unused than used. If the file can't be written, or a read back fails,
+// nothing more is spilled.
+class ActionLog {
+ public:
+  ActionLog(size_t max_resident_primitives = 1 << 20);
+  size_t size() const { return m_entries.size(); }
+  bool empty() const { return m_entries.empty(); }
+
+  void push(qint64 uid, qint64 idx,
+            const std::list<Action::Primitive> &reverse);
+  // Loads the reverses of entries [first] onwards back into memory, e.g.
+  // before an undo that might need them. Returns false if one couldn't be
+  // read back, in which case its reverse is lost and the undo can't be done.
+  bool loadFrom(size_t first);
+  // Loads just what an undo / redo of entry [target] needs: its reverse, and
+  // those of the done entries after it, which are temporarily undone around
+  // it. Returns false like loadFrom.
+  bool loadForUndo(size_t target);
+  // Loads the reverse back into memory if it was spilled (see loadFrom for
+  // finding out whether that worked). References stay valid until the next
+  // push or trim.
+  LoggedAction &at(size_t i);
+  LoggedAction::UndoState state(size_t i) const {
+    return m_entries.at(i).state;
+  }
+
+  std::optional<size_t> lastDone(qint64 uid) const;
+  std::optional<size_t> firstUndone(qint64 uid) const;
+  // Flips the entry that's the target of [lastDone] or [firstUndone].
+  void flip(size_t i);
+  // Marks all of a user's undone entries as gone.
+  void invalidateUndone(qint64 uid);
+
+  // Spill old reverses until we're back under budget.
+  void trim();
+
+  // Writes the newest [max_entries] entries, for a snapshot of the session
+  // (see PxtoneController::saveState). Undos and redos of those work the same
+  // after readTail, except that a user's redos are dropped if their first
+  // undone entry isn't in the tail, since a redo has to start there.
+  bool writeTail(QDataStream &out, size_t max_entries);
+  // Replaces the log with one written by writeTail.
+  bool readTail(QDataStream &in);
+
+  size_t residentPrimitives() const { return m_resident_primitives; }
+  // Moves the spill file, a QObject, to [thread]. Must be called from the
+  // thread it was made on, i.e. the one that last pushed or trimmed.
+  void moveToThread(QThread *thread);
+  qint64 spillFileSize() const;
+
+ private:
+  friend class ActionLogTest;
+  struct UserStacks {
+    std::vector<size_t> done;
+    std::vector<size_t> undone;
+  };
+  bool spill(size_t i);
+  bool load(size_t i);
+  void releaseSpillSpace(LoggedAction &a);
+  void compactSpillFile();
+
+  std::vector<LoggedAction> m_entries;
+  std::map<qint64, UserStacks> m_users;
+
+  size_t m_max_resident_primitives;
+  size_t m_resident_primitives;
+  // Resident entries, oldest first. May contain stale indices of entries
+  // that have since been spilled or cleared; they're skipped.
+  std::deque<size_t> m_resident;
+  std::vector<size_t> m_touched;
+  std::unique_ptr<QTemporaryFile> m_spill_file;
+  // The bytes of the spill file that entries have a claim on.
+  qint64 m_spill_claimed;
+  bool m_spill_failed;
+};
+
+#endif  // ACTIONLOG_H
@@ -1,6 +1,7 @@
 #include "ConnectDialog.h"
 
 #include <QSettings>
+#include <algorithm>
 
 #include "Settings.h"
 #include "ui_ConnectDialog.h"
@@ -8,6 +9,7 @@
 ConnectDialog::ConnectDialog(QWidget *parent)
     : QDialog(parent), ui(new Ui::ConnectDialog) {
   ui->setupUi(this);
+  ui->progressBar->hide();
 }
 
 QString ConnectDialog::username() { return ui->usernameInput->text(); }
@@ -24,9 +26,43 @@ int ConnectDialog::exec() {
   ui->usernameInput->setText(
       settings.value(DISPLAY_NAME_KEY, "Anonymous").toString());
 
+  hideProgress();
   return QDialog::exec();
 }
 
+void ConnectDialog::showProgress(qint64 received, qint64 total) {
+  showProgressBar();
+  // QProgressBar only takes ints, so go by KB.
+  ui->progressBar->setMaximum(std::max(total / 1024, qint64(1)));
+  ui->progressBar->setValue(received / 1024);
+  ui->progressBar->setFormat(tr("Downloading project: %v / %m KB"));
+}
+
+void ConnectDialog::showReplayProgress(qint64 applied, qint64 total) {
+  showProgressBar();
+  ui->progressBar->setMaximum(std::max(total, qint64(1)));
+  ui->progressBar->setValue(applied);
+  ui->progressBar->setFormat(tr("Loading history: %v / %m actions"));
+}
+
+void ConnectDialog::showProgressBar() {
+  if (ui->progressBar->isVisible()) return;
+  ui->usernameInput->setEnabled(false);
+  ui->addressInput->setEnabled(false);
+  ui->buttonBox->hide();
+  ui->progressBar->show();
+  show();
+}
+
+void ConnectDialog::hideProgress() {
+  if (!ui->progressBar->isVisible()) return;
+  ui->progressBar->hide();
+  ui->buttonBox->show();
+  ui->usernameInput->setEnabled(true);
+  ui->addressInput->setEnabled(true);
+  hide();
+}
+
 void ConnectDialog::persistSettings() {
   QSettings settings;
   settings.setValue(DISPLAY_NAME_KEY, username());
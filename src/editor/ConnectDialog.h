@@ -16,9 +16,16 @@ class ConnectDialog : public QDialog {
   QString address();
   void persistSettings();
   int exec();
+  // Shows the dialog again, without its inputs, while the project is
+  // downloading after it was accepted.
+  void showProgress(qint64 received, qint64 total);
+  // Likewise while the session's history is replayed.
+  void showReplayProgress(qint64 applied, qint64 total);
+  void hideProgress();
   ~ConnectDialog();
 
  private:
+  void showProgressBar();
   Ui::ConnectDialog *ui;
 };
 
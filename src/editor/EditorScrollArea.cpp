@@ -40,7 +40,10 @@ EditorScrollArea::EditorScrollArea(QWidget *parent, bool match_scale)
     // scrolling.
     if (!(QApplication::mouseButtons() & (Qt::LeftButton | Qt::RightButton)))
       mouseDown = false;
-    if (mouseDown) scrollWithMouseX();
+    if (mouseDown)
+      scrollWithMouseX();
+    else
+      anim->setRunning(false);
   });
 }
 
@@ -49,6 +52,7 @@ void EditorScrollArea::mousePressEvent(QMouseEvent *event) {
   // the event. Similarly in release.
   mouseDown =
       event->buttons() & Qt::LeftButton || event->buttons() & Qt::RightButton;
+  anim->setRunning(mouseDown);
   // double ratioH = double(lastPos.x()) / viewport()->width();
 
   /*qDebug() << horizontalScrollBar()->pageStep()
@@ -98,6 +102,7 @@ bool EditorScrollArea::event(QEvent *e) {
 
 void EditorScrollArea::updateMouseDownState(QMouseEvent *e) {
   mouseDown = (e->buttons() & Qt::LeftButton || e->buttons() & Qt::RightButton);
+  anim->setRunning(mouseDown);
 }
 
 void EditorScrollArea::mouseReleaseEvent(QMouseEvent *event) {
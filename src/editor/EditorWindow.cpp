@@ -7,34 +7,33 @@
 #include <QMessageBox>
 #include <QMimeData>
 #include <QProgressDialog>
+#include <QRandomGenerator>
 #include <QSaveFile>
 #include <QScrollBar>
 #include <QSettings>
 #include <QSplitter>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QtMultimedia/QAudioDeviceInfo>
 #include <QtMultimedia/QAudioFormat>
 #include <QtMultimedia/QAudioOutput>
+#include <cmath>
 
 #include "ComboOptions.h"
 #include "InputEvent.h"
 #include "Settings.h"
 #include "pxtone/pxtnDescriptor.h"
 #include "ui_EditorWindow.h"
+#include "views/FrameProfiler.h"
 #include "views/MeasureView.h"
 #include "views/MooClock.h"
 #include "views/ParamView.h"
 
-// TODO: Maybe we could not hard-code this and change the engine to be dynamic
-// w/ smart pointers.
-static constexpr int EVENT_MAX = 1000000;
-
 EditorWindow::EditorWindow(QWidget *parent)
     : QMainWindow(parent),
       m_server(nullptr),
       m_filename(std::nullopt),
       m_connection_status(new ConnectionStatusLabel(this)),
-      m_fps_status(new QLabel("FPS", this)),
       m_ping_status(new QLabel("", this)),
       m_modified(false),
       m_host_dialog(new HostDialog(this)),
@@ -60,7 +59,6 @@ EditorWindow::EditorWindow(QWidget *parent)
 
   m_keyboard_view = new KeyboardView(m_client, m_moo_clock, nullptr);
 
-  statusBar()->addPermanentWidget(m_fps_status);
   statusBar()->addPermanentWidget(m_ping_status);
   statusBar()->addPermanentWidget(m_connection_status);
 
@@ -131,13 +129,20 @@ EditorWindow::EditorWindow(QWidget *parent)
             } else
               m_ping_status->setText("");
           });
+  connect(m_client, &PxtoneClient::connectionProgress, m_connect_dialog,
+          &ConnectDialog::showProgress);
+  connect(m_client, &PxtoneClient::replayProgress, m_connect_dialog,
+          &ConnectDialog::showReplayProgress);
+  connect(m_client, &PxtoneClient::replayingChanged,
+          [this](bool replaying) { m_splitter->setEnabled(!replaying); });
+  connect(m_client, &PxtoneClient::connected, m_connect_dialog,
+          &ConnectDialog::hideProgress);
+  connect(m_client, &PxtoneClient::disconnected, m_connect_dialog,
+          &ConnectDialog::hideProgress);
   m_scroll_area->setBackgroundRole(QPalette::Dark);
   m_scroll_area->setVisible(true);
   m_scroll_area->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
   m_scroll_area->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-  connect(m_keyboard_view, &KeyboardView::fpsUpdated, [this](qreal fps) {
-    m_fps_status->setText(QString("%1 FPS").arg(fps, 0, 'f', 0));
-  });
 
   m_param_scroll_area = new EditorScrollArea(m_key_splitter, false);
   m_param_scroll_area->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
@@ -181,16 +186,45 @@ EditorWindow::EditorWindow(QWidget *parent)
   connect(ui->actionRender, &QAction::triggered, this, &EditorWindow::render);
   connect(ui->actionConnect, &QAction::triggered, this,
           &EditorWindow::connectToHost);
+  // Applies to the recording being played back, and to ones opened later.
+  m_playback_speeds = new QActionGroup(this);
+  for (double speed :
+       {0.5, 1.0, 2.0, 4.0, 16.0, PLAYBACK_AS_FAST_AS_POSSIBLE}) {
+    QAction *action = ui->menuPlaybackSpeed->addAction(
+        std::isinf(speed) ? tr("As fast as possible") : tr("%1x").arg(speed));
+    action->setCheckable(true);
+    action->setChecked(speed == 1);
+    action->setData(speed);
+    m_playback_speeds->addAction(action);
+  }
+  connect(m_playback_speeds, &QActionGroup::triggered, [this](QAction *action) {
+    if (m_server && m_server->isReadingHistory())
+      m_server->setPlaybackSpeed(action->data().toDouble());
+  });
   connect(ui->actionClear_Settings, &QAction::triggered, [this]() {
     if (QMessageBox::question(this, tr("Clear settings"),
                               tr("Are you sure you want to clear your app "
                                  "settings?")))
       QSettings().clear();
   });
-  connect(ui->actionDecrease_font_size, &QAction::triggered,
-          &Settings::TextSize::decrease);
-  connect(ui->actionIncrease_font_size, &QAction::triggered,
-          &Settings::TextSize::increase);
+  connect(ui->actionSave_frame_profile, &QAction::triggered, [this]() {
+    QString filename = QFileDialog::getSaveFileName(
+        this, tr("Save frame profile"), "", tr("CSV files (*.csv)"));
+    if (filename.isEmpty()) return;
+    if (QFileInfo(filename).suffix() != "csv") filename += ".csv";
+    if (!FrameProfiler::dump(filename))
+      QMessageBox::warning(this, tr("Could not save frame profile"),
+                           tr("Could not open %1 for writing.").arg(filename));
+  });
+  // The views only repaint when something changes, so nudge them.
+  connect(ui->actionDecrease_font_size, &QAction::triggered, [this]() {
+    Settings::TextSize::decrease();
+    update();
+  });
+  connect(ui->actionIncrease_font_size, &QAction::triggered, [this]() {
+    Settings::TextSize::increase();
+    update();
+  });
   connect(ui->actionShortcuts, &QAction::triggered, m_shortcuts_dialog,
           &QDialog::exec);
   connect(ui->actionExit, &QAction::triggered,
@@ -240,6 +274,8 @@ void EditorWindow::keyReleaseEvent(QKeyEvent *event) {
 }
 
 void EditorWindow::keyPressEvent(QKeyEvent *event) {
+  // Like the views, which are disabled meanwhile.
+  if (m_client->isReplaying()) return;
   int key = event->key();
   switch (key) {
     case Qt::Key_A:
@@ -345,6 +381,10 @@ void EditorWindow::keyPressEvent(QKeyEvent *event) {
         recordInput(Input::Event::On{EVENTDEFAULT_KEY + 256, 127});
 #endif
       break;
+    case Qt::Key_P:
+      if (event->modifiers() & Qt::ShiftModifier)
+        m_keyboard_view->toggleProfiler();
+      break;
     case Qt::Key_Q:
       if (event->modifiers() & Qt::AltModifier)
         m_keyboard_view->quantizeSelection();
@@ -470,6 +510,7 @@ void applyOn(const Input::State::On &v, int end, PxtoneClient *client) {
 }
 
 void EditorWindow::recordInput(const Input::Event::Event &e) {
+  if (m_client->isReplaying()) return;
   std::visit(
       overloaded{
           [this](const Input::Event::On &e) {
@@ -639,12 +680,72 @@ void EditorWindow::hostDirectly(std::optional<QString> filename,
           .arg(m_server->address().toString())
           .arg(m_server->port()));
   m_filename = (m_server->isReadingHistory() ? std::nullopt : filename);
+  if (m_server->isReadingHistory())
+    m_server->setPlaybackSpeed(
+        m_playback_speeds->checkedAction()->data().toDouble());
   m_modified = false;
   m_side_menu->setModified(false);
 
   m_client->connectToLocalServer(m_server, username);
 }
 
+void EditorWindow::traceLatency(const QString &filename) {
+  m_client->traceLatency(filename);
+}
+
+// Replaces every unit's notes with [notes] of them, round robin across the
+// units and spread evenly over the song, each an ON and a KEY event. The
+// pitches come from a fixed seed, so the same song always gets the same notes.
+static std::list<Action::Primitive> generatedNotes(const pxtnService *pxtn,
+                                                   const NoIdMap &unit_ids,
+                                                   int notes) {
+  std::list<Action::Primitive> actions;
+  int unit_num = pxtn->Unit_Num();
+  if (unit_num == 0) return actions;
+  qint32 end =
+      pxtn->master->get_this_clock(pxtn->master->get_play_meas(), 0, 0);
+  qint32 spacing = std::max(1, end / std::max(1, notes / unit_num));
+  qint32 length = std::max(1, spacing / 2);
+  qint32 delete_end = std::max(end, pxtn->evels->get_Max_Clock() + 1);
+  for (int unit_no = 0; unit_no < unit_num; ++unit_no)
+    for (EVENTKIND kind : {EVENTKIND_ON, EVENTKIND_KEY})
+      actions.push_back(
+          {kind, unit_ids.noToId(unit_no), 0, Action::Delete{delete_end}});
+  QRandomGenerator random(1);
+  for (int i = 0; i < notes; ++i) {
+    qint32 unit_id = unit_ids.noToId(i % unit_num);
+    qint32 clock = (i / unit_num) * spacing;
+    qint32 pitch =
+        EVENTDEFAULT_KEY + (qint32(random.bounded(24)) - 12) * PITCH_PER_KEY;
+    actions.push_back({EVENTKIND_KEY, unit_id, clock, Action::Add{pitch}});
+    actions.push_back({EVENTKIND_ON, unit_id, clock, Action::Add{length}});
+  }
+  return actions;
+}
+
+void EditorWindow::profileFrames(const QString &filename, int notes,
+                                 double secs) {
+  auto once = std::make_shared<QMetaObject::Connection>();
+  *once = connect(m_client, &PxtoneClient::connected, this, [=]() {
+    disconnect(*once);
+    if (notes > 0) {
+      std::list<Action::Primitive> actions =
+          generatedNotes(m_client->pxtn(), m_client->unitIdMap(), notes);
+      if (actions.empty())
+        qWarning() << "The project has no units to generate notes for";
+      else
+        m_client->applyAction(actions);
+    }
+    if (!FrameProfiler::enabled()) m_keyboard_view->toggleProfiler();
+    m_client->seekMoo(0);
+    if (!m_client->isPlaying()) m_client->togglePlayState();
+    QTimer::singleShot(int(secs * 1000), this, [filename]() {
+      qInfo() << "Writing frame profile to" << filename;
+      QApplication::exit(FrameProfiler::dump(filename) ? 0 : 1);
+    });
+  });
+}
+
 bool EditorWindow::saveToFile(QString filename) {
 #ifdef _WIN32
   FILE *f_raw;
@@ -1,6 +1,7 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QActionGroup>
 #include <QFile>
 #include <QLabel>
 #include <QMainWindow>
@@ -42,6 +43,12 @@ class EditorWindow : public QMainWindow {
   void hostDirectly(std::optional<QString> filename, QHostAddress host,
                     int port, std::optional<QString> recording_save_file,
                     QString username);
+  void traceLatency(const QString &filename);
+  // Once the project's loaded, replaces its notes with [notes] generated ones
+  // (unless it's 0), plays it from the start with the frame profiler on, and
+  // after [secs] dumps every view's frames to [filename] and quits. Gives
+  // numbers that can be compared between builds.
+  void profileFrames(const QString &filename, int notes, double secs);
  private slots:
   void connectToHost();
 
@@ -60,11 +67,13 @@ class EditorWindow : public QMainWindow {
   QFrame* m_measure_splitter;
   PxtoneSideMenu* m_side_menu;
   BroadcastServer* m_server;
+  // The speed to play back recordings at, one of the actions in the menu.
+  QActionGroup* m_playback_speeds;
   PxtoneClient* m_client;
   MooClock* m_moo_clock;
   std::optional<QString> m_filename;
   ConnectionStatusLabel* m_connection_status;
-  QLabel *m_fps_status, *m_ping_status;
+  QLabel* m_ping_status;
   bool m_modified;
   HostDialog* m_host_dialog;
   ConnectDialog* m_connect_dialog;
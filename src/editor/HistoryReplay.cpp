@@ -0,0 +1,66 @@
+#include "HistoryReplay.h"
+
+#include <QElapsedTimer>
+
+static constexpr int PROGRESS_INTERVAL_MS = 50;
+
+HistoryReplay::HistoryReplay(const QByteArray &data,
+                             QList<ServerAction> history, qint64 uid,
+                             const pxtnService *like, QObject *parent)
+    : QObject(parent),
+      m_data(data),
+      m_history(std::move(history)),
+      m_controller(nullptr),
+      m_thread(QThread::create([this]() { run(); })),
+      m_cancelled(0),
+      m_succeeded(false) {
+  m_pxtn.init_collage(EVENT_MAX);
+  int channel_num, sample_rate;
+  like->get_destination_quality(&channel_num, &sample_rate);
+  m_pxtn.set_destination_quality(channel_num, sample_rate);
+  m_controller = new PxtoneController(uid, &m_pxtn, &m_moo_state, this);
+  // Emitted on [m_thread]. There's no point replaying the rest.
+  connect(
+      m_controller, &PxtoneController::historyLost, this,
+      [this]() { m_cancelled.storeRelease(1); }, Qt::DirectConnection);
+
+  m_thread->setObjectName("history-replay");
+  connect(m_thread, &QThread::finished, this, &HistoryReplay::finished);
+}
+
+HistoryReplay::~HistoryReplay() {
+  m_cancelled.storeRelease(1);
+  m_thread->wait();
+  delete m_thread;
+  // Before [m_pxtn] goes.
+  delete m_controller;
+}
+
+void HistoryReplay::start() { m_thread->start(); }
+
+void HistoryReplay::run() {
+  m_succeeded = replay();
+  // The controller is handed back to this object's thread, so anything it
+  // created on this one has to go too.
+  m_controller->moveLogToThread(thread());
+}
+
+bool HistoryReplay::replay() {
+  // An empty desc is interpreted as an empty file so we don't error.
+  pxtnDescriptor desc;
+  desc.set_memory_r(m_data.constData(), m_data.size());
+  if (!m_controller->loadDescriptor(desc)) return false;
+
+  QElapsedTimer since_progress;
+  since_progress.start();
+  int total = m_history.size();
+  for (int i = 0; i < total; ++i) {
+    if (m_cancelled.loadAcquire()) return false;
+    m_controller->applyProjectAction(m_history[i]);
+    if (since_progress.elapsed() >= PROGRESS_INTERVAL_MS) {
+      emit progress(i + 1, total);
+      since_progress.restart();
+    }
+  }
+  return true;
+}
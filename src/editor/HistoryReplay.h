@@ -0,0 +1,47 @@
+#ifndef HISTORYREPLAY_H
+#define HISTORYREPLAY_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QThread>
+
+#include "PxtoneController.h"
+
+// Loads a session's project and replays its history on a background thread,
+// against a private pxtnService, so that joining a session with a long
+// history doesn't freeze the editor. Once it's finished, the result is
+// swapped into the editor's controller with PxtoneController::adoptProject.
+class HistoryReplay : public QObject {
+  Q_OBJECT
+ public:
+  // The new project is set up with the same output settings as [like].
+  HistoryReplay(const QByteArray &data, QList<ServerAction> history,
+                qint64 uid, const pxtnService *like, QObject *parent);
+  // Stops the replay early if it's still going.
+  ~HistoryReplay();
+  void start();
+  bool succeeded() const { return m_succeeded; }
+  int size() const { return m_history.size(); }
+  // Only to be touched once it's finished.
+  PxtoneController *controller() { return m_controller; }
+
+ signals:
+  void progress(qint64 applied, qint64 total);
+  void finished();
+
+ private:
+  // Run on [m_thread].
+  void run();
+  bool replay();
+
+  QByteArray m_data;
+  QList<ServerAction> m_history;
+  pxtnService m_pxtn;
+  mooState m_moo_state;
+  PxtoneController *m_controller;
+  QThread *m_thread;
+  QAtomicInt m_cancelled;
+  bool m_succeeded;
+};
+
+#endif  // HISTORYREPLAY_H
@@ -0,0 +1,70 @@
+#include "ProjectSnapshot.h"
+
+#include <QDebug>
+#include <cstdio>
+
+// How far back undos in the history after a snapshot can reach. Each entry
+// holds its reverse, so this bounds the size of the snapshot's log.
+static constexpr size_t SNAPSHOT_UNDO_DEPTH = 1000;
+
+// pxtnDescriptor can only write to a file, so this goes through a temp one.
+static std::optional<QByteArray> writeProject(pxtnService &pxtn) {
+  std::unique_ptr<std::FILE, decltype(&fclose)> f(std::tmpfile(), &fclose);
+  if (!f) return std::nullopt;
+  pxtnDescriptor desc;
+  int version_from_pxtn_service = 5;
+  if (!desc.set_file_w(f.get()) ||
+      pxtn.write(&desc, false, version_from_pxtn_service) != pxtnOK)
+    return std::nullopt;
+  long size = std::ftell(f.get());
+  if (size < 0) return std::nullopt;
+  std::rewind(f.get());
+  QByteArray data(int(size), Qt::Uninitialized);
+  if (std::fread(data.data(), 1, size_t(size), f.get()) != size_t(size))
+    return std::nullopt;
+  return data;
+}
+
+ProjectSnapshotter::ProjectSnapshotter(const QByteArray &data)
+    : m_lost(false) {
+  m_pxtn.init_collage(EVENT_MAX);
+  int channel_num = 2;
+  int sample_rate = 44100;
+  m_pxtn.set_destination_quality(channel_num, sample_rate);
+  // A uid nobody has, so every action is treated as someone else's.
+  m_controller =
+      std::make_unique<PxtoneController>(-1, &m_pxtn, &m_moo_state, nullptr);
+  QObject::connect(m_controller.get(), &PxtoneController::historyLost,
+                   [this]() { m_lost = true; });
+
+  pxtnDescriptor desc;
+  desc.set_memory_r(data.constData(), data.size());
+  if (!m_controller->loadDescriptor(desc))
+    throw QString("Could not load the project to snapshot");
+}
+
+void ProjectSnapshotter::apply(const ServerAction &a) {
+  std::visit(overloaded{[this, &a](const NewSession &s) {
+                          m_sessions.insert(a.uid, s.username);
+                        },
+                        [this, &a](const DeleteSession &) {
+                          m_sessions.remove(a.uid);
+                        },
+                        [this, &a](const auto &) {
+                          m_controller->applyProjectAction(a);
+                        }},
+             a.action);
+}
+
+std::optional<ProjectSnapshot> ProjectSnapshotter::take() {
+  if (m_lost) return std::nullopt;
+  std::optional<QByteArray> data = writeProject(m_pxtn);
+  if (!data.has_value()) {
+    qWarning() << "Could not write out the project for a snapshot";
+    return std::nullopt;
+  }
+  std::optional<QByteArray> state =
+      m_controller->saveState(SNAPSHOT_UNDO_DEPTH);
+  if (!state.has_value()) return std::nullopt;
+  return ProjectSnapshot{data.value(), state.value(), m_sessions};
+}
@@ -0,0 +1,52 @@
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QMap>
+#include <memory>
+#include <optional>
+
+#include "PxtoneController.h"
+
+// A session as of some point in its history: enough to carry on from there
+// without replaying everything before it.
+struct ProjectSnapshot {
+  // A .ptcop file.
+  QByteArray data;
+  // See PxtoneController::saveState.
+  QByteArray controller_state;
+  // Username by uid, of everyone connected at the time.
+  QMap<qint64, QString> sessions;
+};
+inline QDataStream &operator<<(QDataStream &out, const ProjectSnapshot &s) {
+  out << s.data << s.controller_state << s.sessions;
+  return out;
+}
+inline QDataStream &operator>>(QDataStream &in, ProjectSnapshot &s) {
+  in >> s.data >> s.controller_state >> s.sessions;
+  return in;
+}
+
+// Keeps a private copy of a session's project up to date with its history so
+// that it can take snapshots, e.g. for a recording's checkpoints. The server
+// itself doesn't have the project, only the actions.
+class ProjectSnapshotter {
+ public:
+  // Throws a QString if [data] can't be loaded.
+  ProjectSnapshotter(const QByteArray &data);
+  // For actions that should be recorded.
+  void apply(const ServerAction &a);
+  // nullopt if the project has stopped matching the history or can't be
+  // written out.
+  std::optional<ProjectSnapshot> take();
+
+ private:
+  pxtnService m_pxtn;
+  mooState m_moo_state;
+  std::unique_ptr<PxtoneController> m_controller;
+  QMap<qint64, QString> m_sessions;
+  bool m_lost;
+};
+
+#endif  // PROJECTSNAPSHOT_H
@@ -3,10 +3,12 @@
 #include <QMessageBox>
 #include <QSettings>
 #include <QTimer>
+#include <algorithm>
 
 #include "ComboOptions.h"
 #include "Settings.h"
 #include "audio/AudioFormat.h"
+#include "views/NoAllocations.h"
 
 QList<UserListEntry> getUserList(
     const std::map<qint64, RemoteEditState> &users) {
@@ -18,6 +20,7 @@ QList<UserListEntry> getUserList(
 }
 
 const static int PING_INTERVAL = 2000;
+const static int LATENCY_DUMP_INTERVAL = 10000;
 
 PxtoneClient::PxtoneClient(pxtnService *pxtn,
                            ConnectionStatusLabel *connection_status,
@@ -25,10 +28,23 @@ PxtoneClient::PxtoneClient(pxtnService *pxtn,
     : QObject(parent),
       m_controller(new PxtoneController(0, pxtn, &m_moo_state, this)),
       m_client(new Client(this)),
+      m_remote_overlays_stale(true),
       m_following_user(std::nullopt),
       m_ping_timer(new QTimer(this)),
       m_last_seek(0),
-      m_clipboard(new Clipboard(this)) {
+      m_clipboard(new Clipboard(this)),
+      m_replay(nullptr) {
+  // Quantization is in fractions of a beat.
+  for (auto signal : {&PxtoneController::tempoBeatChanged,
+                      &PxtoneController::newSong})
+    connect(m_controller, signal,
+            [this]() { m_remote_overlays_stale = true; });
+  connect(m_controller, &PxtoneController::historyLost, this, [this]() {
+    m_client->disconnectWithError(
+        tr("Part of the undo history was lost, so your copy of the project "
+           "no longer matches everyone else's. Please reconnect."));
+  });
+
   QAudioDeviceInfo info(QAudioDeviceInfo::defaultOutputDevice());
   if (!info.isFormatSupported(pxtoneAudioFormat())) {
     qWarning()
@@ -55,24 +71,26 @@ PxtoneClient::PxtoneClient(pxtnService *pxtn,
       [this, connection_status](const QByteArray &data,
                                 const QList<ServerAction> &history,
                                 qint64 uid) {
-        pxtnDescriptor desc;
-        desc.set_memory_r(data.constData(), data.size());
-
         HostAndPort host_and_port = m_client->currentlyConnectedTo();
         connection_status->setClientConnectionState(host_and_port.toString());
         qDebug() << "Connected to server" << host_and_port.toString();
-        loadDescriptor(desc);
-        emit connected();
         m_controller->setUid(uid);
-        for (const ServerAction &a : history) processRemoteAction(a);
-        sendAction(Ping{QDateTime::currentMSecsSinceEpoch(), m_last_ping});
-        m_ping_timer->start(PING_INTERVAL);
+        m_remote_overlays_stale = true;
+        startReplay(data, history, uid);
       });
   connect(m_client, &Client::disconnected,
           [this, connection_status](bool suppress_alert) {
+            if (m_replay != nullptr) {
+              delete m_replay;
+              m_replay = nullptr;
+              emit replayingChanged(false);
+            }
+            m_held_actions.clear();
+            emit disconnected();
             connection_status->setClientConnectionState(std::nullopt);
             emit beginUserListRefresh();
             m_remote_edit_states.clear();
+            m_remote_overlays_stale = true;
             emit endUserListRefresh();
             if (!suppress_alert)
               QMessageBox::information(nullptr, "Disconnected",
@@ -84,13 +102,73 @@ PxtoneClient::PxtoneClient(pxtnService *pxtn,
     QMessageBox::information(nullptr, "Connection error",
                              tr("Connection error: %1").arg(error));
   });
-  connect(m_client, &Client::receivedAction, this,
-          &PxtoneClient::processRemoteAction);
+  connect(m_client, &Client::receivedAction, [this](const ServerAction &a) {
+    if (m_replay != nullptr)
+      m_held_actions.push_back(a);
+    else
+      processRemoteAction(a);
+  });
+  connect(m_client, &Client::helloProgress, this,
+          &PxtoneClient::connectionProgress);
+}
+
+void PxtoneClient::startReplay(const QByteArray &data,
+                               const QList<ServerAction> &history,
+                               qint64 uid) {
+  // Sessions coming and going don't touch the project, so they're taken care
+  // of now. Only the edits (and the state they start from, if any) are
+  // replayed.
+  QList<ServerAction> edits;
+  for (const ServerAction &a : history) {
+    if (std::holds_alternative<ClientAction>(a.action) ||
+        std::holds_alternative<ControllerState>(a.action))
+      edits.push_back(a);
+    else
+      processRemoteAction(a);
+  }
+
+  m_pxtn_device->setPlaying(false);
+  delete m_replay;
+  m_held_actions.clear();
+  m_replay = new HistoryReplay(data, edits, uid, pxtn(), this);
+  connect(m_replay, &HistoryReplay::progress, this,
+          &PxtoneClient::replayProgress);
+  connect(m_replay, &HistoryReplay::finished, this,
+          &PxtoneClient::finishReplay);
+  m_replay_time.start();
+  m_replay->start();
+  emit replayingChanged(true);
 }
 
-void PxtoneClient::loadDescriptor(pxtnDescriptor &desc) {
-  // An empty desc is interpreted as an empty file so we don't error.
-  m_controller->loadDescriptor(desc);
+void PxtoneClient::finishReplay() {
+  bool succeeded = m_replay->succeeded();
+  if (succeeded) {
+    m_controller->adoptProject(*m_replay->controller());
+    qInfo() << "Replayed" << m_replay->size() << "actions in"
+            << m_replay_time.elapsed() << "ms";
+  }
+  m_replay->deleteLater();
+  m_replay = nullptr;
+  emit replayingChanged(false);
+  if (!succeeded) {
+    // Carrying on with a half-loaded project would only diverge from
+    // everyone else's.
+    m_held_actions.clear();
+    m_client->disconnectWithError(
+        tr("Could not load the project sent by the server."));
+    return;
+  }
+  startSong();
+  emit connected();
+
+  std::vector<ServerAction> held;
+  held.swap(m_held_actions);
+  for (const ServerAction &a : held) processRemoteAction(a);
+  sendAction(Ping{QDateTime::currentMSecsSinceEpoch(), m_last_ping});
+  m_ping_timer->start(PING_INTERVAL);
+}
+
+void PxtoneClient::startSong() {
   changeEditState([](EditState &e) { e.m_current_unit_id = 0; }, false);
   m_following_user.reset();
   m_pxtn_device->setPlaying(false);
@@ -110,6 +188,7 @@ void PxtoneClient::loadDescriptor(pxtnDescriptor &desc) {
     if (ok) setBufferSize(v);
   }
   m_pxtn_device->setPlaying(false);
+  m_pxtn_device->resetPosition();
   m_audio->start(m_pxtn_device);
   qDebug() << "Actual" << m_audio->bufferSize();
 }
@@ -129,7 +208,10 @@ void PxtoneClient::setBufferSize(double secs) {
   qDebug() << "Setting buffer size: " << secs;
   m_audio->setBufferSize(fmt.bytesForDuration(secs * 1e6));
 
-  if (started) m_audio->start(m_pxtn_device);
+  if (started) {
+    m_pxtn_device->resetPosition();
+    m_audio->start(m_pxtn_device);
+  }
 }
 
 bool PxtoneClient::isPlaying() { return m_pxtn_device->playing(); }
@@ -160,7 +242,13 @@ void PxtoneClient::resetAndSuspendAudio() {
 }
 
 void PxtoneClient::setFollowing(std::optional<qint64> following) {
+  std::optional<qint64> previous = m_following_user;
   m_following_user = following;
+  if (previous != following) {
+    m_remote_overlays_stale = true;
+    if (previous.has_value()) emit remoteEditStateChanged(previous.value());
+    if (following.has_value()) emit remoteEditStateChanged(following.value());
+  }
 
   if (following.has_value() && following != m_controller->uid()) {
     sendAction(WatchUser{following.value()});
@@ -203,7 +291,49 @@ qint32 PxtoneClient::quantizePitch() {
 
 qint32 PxtoneClient::lastSeek() const { return m_last_seek; }
 
+RemoteOverlay PxtoneClient::remoteOverlay(qint64 uid,
+                                          const RemoteEditState &remote) {
+  const EditState &s = remote.state.value();
+  return RemoteOverlay{
+      uid, remote.user, s,
+      quantizeClock(quantizeXOptions[s.m_quantize_clock_idx].second),
+      quantizePitch(quantizeYOptions[s.m_quantize_pitch_idx].second)};
+}
+
+const std::vector<RemoteOverlay> &PxtoneClient::remoteOverlays() {
+  if (m_remote_overlays_stale) {
+    NoAllocations::Allow allow;
+    m_remote_overlays.clear();
+    for (const auto &[uid, remote] : m_remote_edit_states)
+      if (uid != following_uid() && uid != this->uid() &&
+          remote.state.has_value())
+        m_remote_overlays.push_back(remoteOverlay(uid, remote));
+    m_remote_overlays_stale = false;
+  }
+  return m_remote_overlays;
+}
+
+void PxtoneClient::updateRemoteOverlay(qint64 uid) {
+  if (m_remote_overlays_stale || uid == following_uid() || uid == this->uid())
+    return;
+  auto it = std::lower_bound(
+      m_remote_overlays.begin(), m_remote_overlays.end(), uid,
+      [](const RemoteOverlay &o, qint64 uid) { return o.uid < uid; });
+  if (it != m_remote_overlays.end() && it->uid == uid)
+    *it = remoteOverlay(uid, m_remote_edit_states.at(uid));
+  else
+    // Their first edit state.
+    m_remote_overlays_stale = true;
+}
+
 void PxtoneClient::applyAction(const std::list<Action::Primitive> &as) {
+  // Edits to the old project would be lost when the replayed one is swapped
+  // in, and their indices would be off. The editor's disabled meanwhile, so
+  // this is only a backstop.
+  if (m_replay != nullptr) {
+    qWarning() << "Not applying an edit made while replaying the history";
+    return;
+  }
   m_client->sendAction(m_controller->applyLocalAction(as));
 }
 
@@ -246,7 +376,27 @@ void PxtoneClient::changeEditState(std::function<void(EditState &)> f,
   emit editStateChanged(m_edit_state);
 }
 
+void PxtoneClient::traceLatency(const QString &filename) {
+  m_client->setTraceLatency(true);
+  QTimer *timer = new QTimer(this);
+  connect(timer, &QTimer::timeout, [this, filename]() {
+    const LatencyStats &stats = m_client->latencyStats();
+    if (!stats.empty() && !stats.writeJson(filename))
+      qWarning() << "Could not write latency stats to" << filename;
+  });
+  timer->start(LATENCY_DUMP_INTERVAL);
+}
+
+void PxtoneClient::notePainted() {
+  if (!m_unpainted_since.has_value()) return;
+  m_client->latencyStats().add("client.repaint",
+                               timingNowUs() - m_unpainted_since.value());
+  m_unpainted_since.reset();
+}
+
 void PxtoneClient::processRemoteAction(const ServerAction &a) {
+  bool trace = m_client->isTracingLatency() && a.shouldBeRecorded();
+  qint64 start = (trace ? timingNowUs() : 0);
   qint64 uid = a.uid;
   std::visit(
       overloaded{
@@ -260,9 +410,11 @@ void PxtoneClient::processRemoteAction(const ServerAction &a) {
                             << "Received edit state for unknown session" << uid;
                       else {
                         it->second.state.emplace(s);
+                        updateRemoteOverlay(uid);
                         if (uid != m_controller->uid() &&
                             m_following_user == uid)
                           emit followActivity(s);
+                        emit remoteEditStateChanged(uid);
                       }
                     },
                     [this, uid](const WatchUser &) {
@@ -273,6 +425,11 @@ void PxtoneClient::processRemoteAction(const ServerAction &a) {
                         qWarning()
                             << "Received watch user for unknown session" << uid;
                       it->second.state.reset();
+                      m_remote_overlays_stale = true;
+                      emit remoteEditStateChanged(uid);
+                    },
+                    [](const FetchWoice &) {
+                      // Only the server is meant to get these.
                     },
                     [this, uid](const Ping &s) {
                       auto it = m_remote_edit_states.find(uid);
@@ -428,6 +585,7 @@ void PxtoneClient::processRemoteAction(const ServerAction &a) {
             }
             m_remote_edit_states[uid] =
                 RemoteEditState{std::nullopt, std::nullopt, s.username};
+            m_remote_overlays_stale = true;
             if (!overwriting) emit endAddUser();
           },
           [this, uid](const DeleteSession &s) {
@@ -440,11 +598,25 @@ void PxtoneClient::processRemoteAction(const ServerAction &a) {
             emit beginRemoveUser(
                 std::distance(m_remote_edit_states.begin(), pos));
             m_remote_edit_states.erase(pos);
+            m_remote_overlays_stale = true;
             if (following_uid() == uid) setFollowing(std::nullopt);
             emit endRemoveUser();
           },
+          [](const WoiceData &) {
+            // Taken care of by the client before it gets here.
+          },
+          [](const ControllerState &) {
+            // Only ever at the start of the history, which the replay takes
+            // care of.
+          },
       },
       a.action);
+
+  if (trace) {
+    qint64 now = timingNowUs();
+    m_client->latencyStats().add("client.apply", now - start);
+    if (!m_unpainted_since.has_value()) m_unpainted_since = now;
+  }
 }
 
 void PxtoneClient::setCurrentUnitNo(int unit_no, bool preserveFollow) {
@@ -2,11 +2,14 @@
 #define PXTONECLIENT_H
 
 #include <QAudioOutput>
+#include <QElapsedTimer>
 #include <QLabel>
 #include <QObject>
+#include <vector>
 
 #include "Clipboard.h"
 #include "ConnectionStatusLabel.h"
+#include "HistoryReplay.h"
 #include "PxtoneController.h"
 #include "network/Client.h"
 
@@ -16,6 +19,18 @@ struct RemoteEditState {
   QString user;
 };
 
+// A remote user whose edit state the views show (everyone else's but the
+// followed user's), with what drawing it needs worked out once when it
+// arrives instead of by each view on every paint.
+struct RemoteOverlay {
+  qint64 uid;
+  QString user;
+  EditState state;
+  // Their quantization, for drawing their ongoing edits.
+  qint32 quantize_clock;
+  qint32 quantize_pitch;
+};
+
 struct UserListEntry {
   qint64 id;
   std::optional<quint64> last_ping;
@@ -31,6 +46,10 @@ class PxtoneClient : public QObject {
   PxtoneController *m_controller;
   Client *m_client;
   std::map<qint64, RemoteEditState> m_remote_edit_states;
+  // In uid order. Rebuilt when users come and go or who's followed changes;
+  // kept up to date in place as their edit states arrive.
+  std::vector<RemoteOverlay> m_remote_overlays;
+  bool m_remote_overlays_stale;
   std::optional<qint64> m_following_user;
   mooState m_moo_state;
   EditState m_edit_state;
@@ -40,13 +59,31 @@ class PxtoneClient : public QObject {
   QTimer *m_ping_timer;
   qint32 m_last_seek;
   Clipboard *m_clipboard;
+  // When a remote edit was first applied since the last repaint, if tracing.
+  std::optional<qint64> m_unpainted_since;
+  // While joining, the session's history being replayed in the background,
+  // and the actions that have come in since, to apply once it's done.
+  HistoryReplay *m_replay;
+  std::vector<ServerAction> m_held_actions;
+  QElapsedTimer m_replay_time;
 
  signals:
   void editStateChanged(const EditState &m_edit_state);
   void playStateChanged(bool playing);
   void followActivity(const EditState &r);
+  // A remote user's edit state changed, or whether it's shown did (it isn't
+  // while they're being followed).
+  void remoteEditStateChanged(qint64 uid);
   void updatePing(std::optional<qint64> ping_length);
   void connected();
+  void disconnected();
+  // Bytes of the project etc. received so far while connecting.
+  void connectionProgress(qint64 received, qint64 total);
+  // Actions in the session's history replayed so far while connecting.
+  void replayProgress(qint64 applied, qint64 total);
+  // Whether the history is being replayed. Nothing can be edited meanwhile,
+  // since the project being shown is about to be replaced.
+  void replayingChanged(bool replaying);
 
   void beginAddUser(int index);
   void endAddUser();
@@ -75,11 +112,13 @@ class PxtoneClient : public QObject {
   const EditState &editState() const { return m_edit_state; }
   const mooState *moo() { return m_controller->moo(); }
   const QAudioOutput *audioState() { return m_audio; }
+  PxtoneIODevice *audioDevice() { return m_pxtn_device; }
 
   const NoIdMap &unitIdMap() { return m_controller->unitIdMap(); }
   const std::map<qint64, RemoteEditState> &remoteEditStates() {
     return m_remote_edit_states;
   }
+  const std::vector<RemoteOverlay> &remoteOverlays();
   qint64 uid() const;
   qint64 following_uid() const;
   qint32 quantizeClock(int idx);
@@ -97,15 +136,29 @@ class PxtoneClient : public QObject {
 
   void setBufferSize(double secs);
   bool isPlaying();
+  bool isReplaying() const { return m_replay != nullptr; }
 
   void setUnitPlayed(int unit_no, bool played);
   void setUnitVisible(int unit_no, bool visible);
   void setUnitOperated(int unit_no, bool operated);
   void toggleSolo(int unit_no);
 
+  // Time actions end to end, and periodically write the stats to [filename]
+  // as JSON.
+  void traceLatency(const QString &filename);
+  // Called by the keyboard view after painting, to time how long remote edits
+  // take to show up.
+  void notePainted();
+
  private:
   void processRemoteAction(const ServerAction &a);
-  void loadDescriptor(pxtnDescriptor &desc);
+  RemoteOverlay remoteOverlay(qint64 uid, const RemoteEditState &remote);
+  void updateRemoteOverlay(qint64 uid);
+  void startReplay(const QByteArray &data, const QList<ServerAction> &history,
+                   qint64 uid);
+  void finishReplay();
+  // Resets the edit state and audio for a newly loaded project.
+  void startSong();
   void sendPlayState(bool from_action);
 };
 
@@ -1,10 +1,13 @@
 #include "PxtoneController.h"
 
 #include <QDebug>
-#include <QDialog>
 #include <QTextCodec>
+#include <algorithm>
+#include <limits>
 
 const QTextCodec *shift_jis_codec = QTextCodec::codecForName("Shift-JIS");
+static const Interval ALL_CLOCKS{std::numeric_limits<qint32>::min(),
+                                 std::numeric_limits<qint32>::max()};
 
 PxtoneController::PxtoneController(int uid, pxtnService *pxtn,
                                    mooState *moo_state, QObject *parent)
@@ -14,20 +17,48 @@ PxtoneController::PxtoneController(int uid, pxtnService *pxtn,
       m_moo_state(moo_state),
       m_unit_id_map(pxtn->Unit_Num()),
       m_woice_id_map(pxtn->Woice_Num()),
-      m_remote_index(0) {}
+      m_remote_index(0),
+      m_always_roll_back(false) {}
 
 EditAction PxtoneController::applyLocalAction(
     const std::list<Action::Primitive> &action) {
   bool widthChanged = false;
-  m_uncommitted.push_back(Action::apply_and_get_undo(
-      action, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map));
+  UncommittedAction uncommitted{
+      Action::apply_and_get_undo(action, m_pxtn, &widthChanged, m_unit_id_map,
+                                 m_woice_id_map),
+      Action::Footprint(action)};
+  uncommitted.footprint.add(uncommitted.reverse);
+  m_uncommitted.push_back(uncommitted);
   if (widthChanged) emit measureNumChanged();
   // qDebug() << "Remote" << m_remote_index << "Local" << m_local_index;
   // qDebug() << "New action";
   emit edited();
+  emit editedClocks(uncommitted.footprint.clocks());
   return EditAction{qint64(m_remote_index + m_uncommitted.size() - 1), action};
 }
 
+// Undo each of the uncommitted actions, latest first.
+void PxtoneController::undoUncommitted(bool *widthChanged) {
+  for (auto uncommitted = m_uncommitted.rbegin();
+       uncommitted != m_uncommitted.rend(); ++uncommitted)
+    uncommitted->reverse =
+        Action::apply_and_get_undo(uncommitted->reverse, m_pxtn, widthChanged,
+                                   m_unit_id_map, m_woice_id_map);
+}
+
+// Redo each of the uncommitted actions forwards. Their reverses might have
+// changed, so the footprints are recomputed too.
+void PxtoneController::redoUncommitted(bool *widthChanged) {
+  for (UncommittedAction &uncommitted : m_uncommitted) {
+    Action::Footprint footprint(uncommitted.reverse);
+    uncommitted.reverse =
+        Action::apply_and_get_undo(uncommitted.reverse, m_pxtn, widthChanged,
+                                   m_unit_id_map, m_woice_id_map);
+    footprint.add(uncommitted.reverse);
+    uncommitted.footprint = footprint;
+  }
+}
+
 void PxtoneController::setUid(qint64 uid) { m_uid = uid; }
 qint64 PxtoneController::uid() { return m_uid; }
 
@@ -65,42 +96,55 @@ void PxtoneController::applyRemoteAction(const EditAction &action, qint64 uid) {
   }
 
   // Invalidate any previous undone actions by this user
-  for (auto it = m_log.rbegin(); it != m_log.rend(); ++it) {
-    if (it->uid == uid) switch (it->state) {
-        case LoggedAction::UNDONE:
-          it->state = LoggedAction::GONE;
-          break;
-        case LoggedAction::GONE:
-          break;
-        case LoggedAction::DONE:
-          // break out of the outer for with a goto
-          goto exit_loop;
-      }
+  m_log.invalidateUndone(uid);
+
+  // What changed in the project, for repainting. Nothing does if it's just
+  // our own action coming back.
+  Action::Footprint changed;
+  // If neither the remote action nor its reverse touch what the pending local
+  // actions do, the order they're applied in doesn't matter, so skip the
+  // rollback. Like for local actions the reverse has to be included, e.g. a
+  // delete that shortens a note touches the note's start too. The reverse is
+  // only known once it's applied, so it's tried on top of the local actions
+  // and taken back out if it turns out to conflict.
+  bool applied = false;
+  std::list<Action::Primitive> reverse;
+  if (need_to_undo && local_actions_to_drop == 0 && !m_always_roll_back) {
+    reverse = Action::apply_and_get_undo(action.action, m_pxtn, &widthChanged,
+                                         m_unit_id_map, m_woice_id_map);
+    Action::Footprint footprint(action.action);
+    footprint.add(reverse);
+    applied = std::none_of(m_uncommitted.begin(), m_uncommitted.end(),
+                           [&footprint](const UncommittedAction &u) {
+                             return u.footprint.intersects(footprint);
+                           });
+    if (applied)
+      changed.add(footprint);
+    else
+      Action::apply_and_get_undo(reverse, m_pxtn, &widthChanged,
+                                 m_unit_id_map, m_woice_id_map);
   }
-exit_loop:
 
   if (!need_to_undo) {
     // The server told us that our local action was applied! Put it in the
     // log, but no need to apply any actions since that was already
     // presumptuously applied.
-    m_log.emplace_back(uid, action.idx, m_uncommitted.front());
+    m_log.push(uid, action.idx, m_uncommitted.front().reverse);
     m_uncommitted.pop_front();
+  } else if (applied) {
+    m_log.push(uid, action.idx, reverse);
   } else {
-    // Undo each of the uncommitted actions
-    // TODO: This is probably where you could be smarter and avoid undoing
-    // things that don't intersect in bbox
-    for (auto uncommitted = m_uncommitted.rbegin();
-         uncommitted != m_uncommitted.rend(); ++uncommitted) {
-      // int start_size = uncommitted->size();
-      *uncommitted = Action::apply_and_get_undo(
-          *uncommitted, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
-      // qDebug() << "undoing local size(" << start_size << uncommitted->size()
-      //         << ") index(" << i-- << ")";
-    }
+    // Dropped local actions are undone for good and the rest are redone on top
+    // of the remote one, so any of them could look different.
+    for (const UncommittedAction &uncommitted : m_uncommitted)
+      changed.add(uncommitted.footprint);
+    undoUncommitted(&widthChanged);
 
     // apply the committed action
-    std::list<Action::Primitive> reverse = Action::apply_and_get_undo(
-        action.action, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
+    reverse = Action::apply_and_get_undo(action.action, m_pxtn, &widthChanged,
+                                         m_unit_id_map, m_woice_id_map);
+    changed.add(action.action);
+    changed.add(reverse);
 
     if (local_actions_to_drop >= m_uncommitted.size())
       m_uncommitted.clear();
@@ -109,16 +153,11 @@ exit_loop:
       advance(it_end, local_actions_to_drop);
       m_uncommitted.erase(m_uncommitted.begin(), it_end);
     }
-    // redo each of the uncommitted actions forwards
-    for (std::list<Action::Primitive> &uncommitted : m_uncommitted) {
-      // int start_size = uncommitted.size();
-      uncommitted = Action::apply_and_get_undo(
-          uncommitted, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
-      // qDebug() << "redoing local size(" << start_size << uncommitted.size()
-      //         << ") index(" << i++ << ")";
-    }
+    redoUncommitted(&widthChanged);
+    for (const UncommittedAction &uncommitted : m_uncommitted)
+      changed.add(uncommitted.footprint);
 
-    m_log.emplace_back(uid, action.idx, reverse);
+    m_log.push(uid, action.idx, reverse);
   }
 
   m_remote_index += int(local_actions_to_drop);
@@ -127,78 +166,64 @@ exit_loop:
 
   if (widthChanged) emit measureNumChanged();
   emit edited();
+  if (!changed.empty()) emit editedClocks(changed.clocks());
 }
 
 void PxtoneController::applyUndoRedo(const UndoRedo &r, qint64 uid) {
   qDebug() << "Applying undo / redo";
-  if (m_log.size() == 0) {
+  if (m_log.empty()) {
     qDebug() << "No actions in the log. Doing nothing.";
     return;
   }
 
-  auto target = m_log.rend();
   // If we're redoing, we're eventually going to want to find the first
-  // undone item by this user.
-  switch (r) {
-    case REDO:
-      for (auto it = m_log.begin(); it != m_log.end(); ++it)
-        if (it->state == LoggedAction::UNDONE && it->uid == uid) {
-          target = std::reverse_iterator(it + 1);
-          break;
-        }
-      break;
-    case UNDO:
-      // Likewise, if undoing, find the last done item.
-      for (auto it = m_log.rbegin(); it != m_log.rend(); ++it)
-        if (it->state == LoggedAction::DONE && it->uid == uid) {
-          target = it;
-          break;
-        }
-  };
-  if (target == m_log.rend()) {
+  // undone item by this user. Likewise, if undoing, find the last done item.
+  std::optional<size_t> target =
+      (r == REDO ? m_log.firstUndone(uid) : m_log.lastDone(uid));
+  if (!target.has_value()) {
     qDebug() << "User has no more actions to undo / redo in this direction.";
     return;
   }
 
-  bool widthChanged = false;
-  for (auto uncommitted = m_uncommitted.rbegin();
-       uncommitted != m_uncommitted.rend(); ++uncommitted) {
-    *uncommitted = Action::apply_and_get_undo(
-        *uncommitted, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
+  if (!m_log.loadForUndo(target.value())) {
+    qWarning() << "Part of the undo history couldn't be read back. Not "
+                  "applying the undo / redo.";
+    emit historyLost();
+    return;
   }
 
+  bool widthChanged = false;
+  undoUncommitted(&widthChanged);
+
   // Go back to the target action by user, temporarily undoing
   // done actions by other users. Flip. Then redo the done actions by
   // other users.
   {
     std::list<LoggedAction *> temporarily_undone;
-    auto it = m_log.rbegin();
-    while (it != target) {
-      if (it->state == LoggedAction::UndoState::DONE) {
-        qDebug() << "Temporarily undoing " << it->uid << it->idx;
-        it->reverse = Action::apply_and_get_undo(
-            it->reverse, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
-        temporarily_undone.push_front(&(*it));
+    for (size_t i = m_log.size() - 1; i > target.value(); --i) {
+      if (m_log.state(i) == LoggedAction::UndoState::DONE) {
+        LoggedAction &a = m_log.at(i);
+        qDebug() << "Temporarily undoing " << a.uid << a.idx;
+        a.reverse = Action::apply_and_get_undo(
+            a.reverse, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
+        temporarily_undone.push_front(&a);
       }
-      ++it;
     }
-    it->reverse = Action::apply_and_get_undo(it->reverse, m_pxtn, &widthChanged,
-                                             m_unit_id_map, m_woice_id_map);
-    it->state = (it->state == LoggedAction::UNDONE ? LoggedAction::DONE
-                                                   : LoggedAction::UNDONE);
-    ;
+    LoggedAction &a = m_log.at(target.value());
+    a.reverse = Action::apply_and_get_undo(a.reverse, m_pxtn, &widthChanged,
+                                           m_unit_id_map, m_woice_id_map);
+    m_log.flip(target.value());
     for (LoggedAction *it : temporarily_undone)
       it->reverse = Action::apply_and_get_undo(
           it->reverse, m_pxtn, &widthChanged, m_unit_id_map, m_woice_id_map);
   }
+  m_log.trim();
 
-  for (std::list<Action::Primitive> &uncommitted : m_uncommitted) {
-    uncommitted = Action::apply_and_get_undo(uncommitted, m_pxtn, &widthChanged,
-                                             m_unit_id_map, m_woice_id_map);
-  }
+  redoUncommitted(&widthChanged);
 
   if (widthChanged) emit measureNumChanged();
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
 }
 
 bool auxSetUnitName(pxtnUnit *unit, QString name) {
@@ -237,6 +262,7 @@ bool PxtoneController::applyAddUnit(const AddUnit &a, qint64 uid) {
   emit endAddUnit();
 
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
   return true;
 }
 
@@ -260,6 +286,7 @@ void PxtoneController::applyRemoveUnit(const RemoveUnit &a, qint64 uid) {
   emit endRemoveUnit();
 
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
 }
 
 void PxtoneController::applySetUnitName(const SetUnitName &a, qint64 uid) {
@@ -294,6 +321,7 @@ void PxtoneController::applyMoveUnit(const MoveUnit &a, qint64 uid) {
   m_unit_id_map.swapAdjacent(unit_no, new_unit_no);
   emit endMoveUnit();
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
 }
 
 bool PxtoneController::applyTempoChange(const TempoChange &a, qint64 uid) {
@@ -304,6 +332,7 @@ bool PxtoneController::applyTempoChange(const TempoChange &a, qint64 uid) {
     m_pxtn->Delay_ReadyTone(i, *m_moo_state);
   emit tempoBeatChanged();
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
   return true;
 }
 
@@ -315,6 +344,7 @@ bool PxtoneController::applyBeatChange(const BeatChange &a, qint64 uid) {
     m_pxtn->Delay_ReadyTone(i, *m_moo_state);
   emit tempoBeatChanged();
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
   return true;
 }
 
@@ -325,6 +355,7 @@ void PxtoneController::applySetRepeatMeas(const SetRepeatMeas &a, qint64 uid) {
     m_pxtn->master->set_last_meas(m + 1);
   m_pxtn->master->set_repeat_meas(m);
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
 }
 
 void PxtoneController::applySetLastMeas(const SetLastMeas &a, qint64 uid) {
@@ -334,6 +365,7 @@ void PxtoneController::applySetLastMeas(const SetLastMeas &a, qint64 uid) {
     m_pxtn->master->set_repeat_meas(m - 1);
   m_pxtn->master->set_last_meas(a.meas.value_or(0));
   emit edited();
+  emit editedClocks(ALL_CLOCKS);
 }
 
 void PxtoneController::applyAddOverdrive(const Overdrive::Add &, qint64 uid) {
@@ -425,6 +457,88 @@ bool PxtoneController::loadDescriptor(pxtnDescriptor &desc) {
   return true;
 }
 
+void PxtoneController::adoptProject(PxtoneController &other) {
+  emit beginRefresh();
+  if (!m_pxtn->swap_project(*other.m_pxtn))
+    qWarning() << "Could not swap in project";
+  m_pxtn->delays_ready(*m_moo_state);
+  m_log = std::move(other.m_log);
+  m_uncommitted = std::move(other.m_uncommitted);
+  m_unit_id_map = other.m_unit_id_map;
+  m_woice_id_map = other.m_woice_id_map;
+  m_remote_index = other.m_remote_index;
+  emit endRefresh();
+  emit measureNumChanged();
+  emit tempoBeatChanged();
+  emit newSong();
+}
+
+std::optional<QByteArray> PxtoneController::saveState(size_t undo_depth) {
+  if (!m_uncommitted.empty()) {
+    qWarning() << "Not saving a controller state with uncommitted actions";
+    return std::nullopt;
+  }
+  QByteArray state;
+  QDataStream out(&state, QIODevice::WriteOnly);
+  out << m_unit_id_map << m_woice_id_map;
+  if (!m_log.writeTail(out, undo_depth)) return std::nullopt;
+  return state;
+}
+
+bool PxtoneController::restoreState(const QByteArray &state) {
+  QDataStream in(state);
+  NoIdMap unit_id_map(0), woice_id_map(0);
+  in >> unit_id_map >> woice_id_map;
+  if (in.status() != QDataStream::Ok ||
+      unit_id_map.numUnits() != size_t(m_pxtn->Unit_Num()) ||
+      woice_id_map.numUnits() != size_t(m_pxtn->Woice_Num()) ||
+      !m_log.readTail(in)) {
+    qWarning() << "Could not restore the controller state";
+    return false;
+  }
+  m_unit_id_map = std::move(unit_id_map);
+  m_woice_id_map = std::move(woice_id_map);
+  m_uncommitted.clear();
+  return true;
+}
+
+void PxtoneController::applyProjectAction(const ServerAction &a) {
+  qint64 uid = a.uid;
+  if (const ControllerState *s = std::get_if<ControllerState>(&a.action)) {
+    // Nothing after it would line up.
+    if (!restoreState(s->data)) emit historyLost();
+    return;
+  }
+  const ClientAction *s = std::get_if<ClientAction>(&a.action);
+  if (s == nullptr) return;
+  std::visit(
+      overloaded{
+          [&](const EditAction &s) { applyRemoteAction(s, uid); },
+          [&](const UndoRedo &s) { applyUndoRedo(s, uid); },
+          [&](const AddUnit &s) { applyAddUnit(s, uid); },
+          [&](const RemoveUnit &s) { applyRemoveUnit(s, uid); },
+          [&](const MoveUnit &s) { applyMoveUnit(s, uid); },
+          [&](const AddWoice &s) { applyAddWoice(s, uid); },
+          [&](const RemoveWoice &s) {
+            if (applyRemoveWoice(s, uid)) refreshMoo();
+          },
+          [&](const ChangeWoice &s) {
+            if (applyChangeWoice(s, uid)) refreshMoo();
+          },
+          [&](const TempoChange &s) { applyTempoChange(s, uid); },
+          [&](const BeatChange &s) { applyBeatChange(s, uid); },
+          [&](const SetRepeatMeas &s) { applySetRepeatMeas(s, uid); },
+          [&](const SetLastMeas &s) { applySetLastMeas(s, uid); },
+          [&](const SetUnitName &s) { applySetUnitName(s, uid); },
+          [&](const Overdrive::Add &s) { applyAddOverdrive(s, uid); },
+          [&](const Overdrive::Set &s) { applySetOverdrive(s, uid); },
+          [&](const Overdrive::Remove &s) { applyRemoveOverdrive(s, uid); },
+          [&](const Delay::Set &s) { applySetDelay(s, uid); },
+          [&](const Woice::Set &s) { applyWoiceSet(s, uid); },
+          [](const auto &) {}},
+      *s);
+}
+
 bool PxtoneController::applyAddWoice(const AddWoice &a, qint64 uid) {
   (void)uid;
   pxtnDescriptor d;
@@ -572,6 +686,7 @@ void PxtoneController::setUnitVisible(int unit_no, bool visible) {
   pxtnUnit *u = m_pxtn->Unit_Get_variable(unit_no);
   if (!u) return;
   u->set_visible(visible);
+  emit visibleToggled(unit_no);
 }
 void PxtoneController::setUnitOperated(int unit_no, bool operated) {
   pxtnUnit *u = m_pxtn->Unit_Get_variable(unit_no);
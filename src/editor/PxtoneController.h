@@ -4,23 +4,27 @@
 #include <QTextCodec>
 #include <list>
 
+#include "ActionLog.h"
 #include "audio/PxtoneIODevice.h"
 #include "protocol/PxtoneEditAction.h"
 #include "protocol/RemoteAction.h"
 
+// How many events a project can hold. Every copy of a session's project has to
+// have the same limit, or an edit that fits in one might not in another.
+// TODO: Maybe we could not hard-code this and change the engine to be dynamic
+// w/ smart pointers.
+constexpr int EVENT_MAX = 1000000;
+
 // Okay, I give up on eager undo. It's just way too hard to roll back an undo
 // from the local branch.
 
-struct LoggedAction {
-  enum UndoState : qint8 { DONE, UNDONE, GONE };
-  UndoState state;
-  qint64 uid;
-  qint64 idx;
-  // TODO: Figure out where to call sth undo vs. reverse
+// A local action that's been applied but not yet echoed back by the server.
+struct UncommittedAction {
+  // Alternates between the reverse of the action while it's applied and the
+  // action itself while it's temporarily rolled back.
   std::list<Action::Primitive> reverse;
-  LoggedAction(qint64 uid, qint64 idx,
-               const std::list<Action::Primitive> &reverse)
-      : state(DONE), uid(uid), idx(idx), reverse(reverse) {}
+  // Covers both the action and its reverse.
+  Action::Footprint footprint;
 };
 
 class PxtoneController : public QObject {
@@ -33,9 +37,31 @@ class PxtoneController : public QObject {
   EditAction applyLocalAction(const std::list<Action::Primitive> &action);
   void setUid(qint64 uid);
   qint64 uid();
+  // Makes every remote action roll back the pending local ones, even if they
+  // don't interact. Slower, but it's what the fast path has to agree with.
+  void setAlwaysRollBack(bool always) { m_always_roll_back = always; }
   const NoIdMap &unitIdMap() const { return m_unit_id_map; }
   const NoIdMap &woiceIdMap() const { return m_woice_id_map; }
   bool loadDescriptor(pxtnDescriptor &desc);
+  // Takes the project and undo history of [other], which isn't otherwise in
+  // use (e.g., it replayed a session's history on another thread). [other]
+  // is left with this one's old project.
+  void adoptProject(PxtoneController &other);
+  // What replaying the history has built up besides the project file: the
+  // unit / woice id maps and the newest [undo_depth] entries of the log. With
+  // the project file, it's enough to carry on applying the history from here,
+  // except for undos that go back further than that. There must be no
+  // uncommitted local actions. Returns nullopt if the log can't be read back.
+  std::optional<QByteArray> saveState(size_t undo_depth);
+  // Takes on a state from saveState. The project must already be the one it
+  // was saved with.
+  bool restoreState(const QByteArray &state);
+  // The log's spill file is created on whichever thread first needs it. Call
+  // from that thread before the controller's used from [thread].
+  void moveLogToThread(QThread *thread) { m_log.moveToThread(thread); }
+  // Applies the parts of an action that affect the project. Edit states,
+  // pings etc. only matter to a live editor.
+  void applyProjectAction(const ServerAction &a);
   bool applyAddUnit(const AddUnit &a, qint64 uid);
   bool applyAddWoice(const AddWoice &a, qint64 uid);
   bool applyRemoveWoice(const RemoveWoice &a, qint64 uid);
@@ -77,9 +103,18 @@ class PxtoneController : public QObject {
   void measureNumChanged();
   void tempoBeatChanged();
   void playedToggled(int unit_no);
+  void visibleToggled(int unit_no);
   void soloToggled();
   void newSong();
   void edited();
+  // The clocks an edit could have changed the look of, so views can repaint
+  // just those. Edits that aren't tied to a span (e.g., moving a unit) cover
+  // all of them.
+  void editedClocks(const Interval &clocks);
+  // An undo / redo couldn't be applied because part of the log couldn't be
+  // read back, or a ControllerState couldn't be restored, so the project no
+  // longer matches everyone else's.
+  void historyLost();
 
   void seeked(qint32 clock);
 
@@ -110,15 +145,19 @@ class PxtoneController : public QObject {
   void endMoveUnit();
 
  private:
+  void undoUncommitted(bool *widthChanged);
+  void redoUncommitted(bool *widthChanged);
+
   qint64 m_uid;
   pxtnService *m_pxtn;
   mooState *m_moo_state;
   PxtoneIODevice *m_moo_io_device;
 
-  std::vector<LoggedAction> m_log;
-  std::list<std::list<Action::Primitive>> m_uncommitted;
+  ActionLog m_log;
+  std::list<UncommittedAction> m_uncommitted;
   NoIdMap m_unit_id_map, m_woice_id_map;
   int m_remote_index;
+  bool m_always_roll_back;
 };
 
 const extern QTextCodec *shift_jis_codec;
@@ -31,20 +31,26 @@ int default_size = 6;
 int max_size = 18;
 int min_size = 4;
 
+// Views ask for this on every paint, so it's only read from the settings
+// once, and kept in step after that.
+static int cached_size = -1;
+
 int get() {
+  if (cached_size >= 0) return cached_size;
   bool ok;
   int value = QSettings().value(TEXT_SIZE_KEY, default_size).toInt(&ok);
-  if (!ok) return default_size;
-  return std::clamp(value, min_size, max_size);
+  cached_size = (ok ? std::clamp(value, min_size, max_size) : default_size);
+  return cached_size;
 }
 
-void increase() {
-  QSettings().setValue(TEXT_SIZE_KEY, std::min(get() + 1, max_size));
+static void set(int size) {
+  cached_size = size;
+  QSettings().setValue(TEXT_SIZE_KEY, size);
 }
 
-void decrease() {
-  QSettings().setValue(TEXT_SIZE_KEY, std::max(get() - 1, min_size));
-}
+void increase() { set(std::min(get() + 1, max_size)); }
+
+void decrease() { set(std::max(get() - 1, min_size)); }
 }  // namespace TextSize
 
 namespace CustomStyle {
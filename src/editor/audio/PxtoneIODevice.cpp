@@ -2,9 +2,15 @@
 
 #include <QDebug>
 
+#include "AudioFormat.h"
+
 PxtoneIODevice::PxtoneIODevice(QObject *parent, const pxtnService *pxtn,
                                mooState *moo_state)
-    : QIODevice(parent), pxtn(pxtn), moo_state(moo_state), m_playing(false) {}
+    : QIODevice(parent),
+      pxtn(pxtn),
+      moo_state(moo_state),
+      m_playing(false),
+      m_bytes(0) {}
 
 void PxtoneIODevice::setPlaying(bool playing) {
   bool changed = playing != m_playing;
@@ -14,16 +20,51 @@ void PxtoneIODevice::setPlaying(bool playing) {
 
 bool PxtoneIODevice::playing() { return m_playing; }
 
+void PxtoneIODevice::resetPosition() {
+  m_bytes = 0;
+  m_chunks.clear();
+}
+
+std::optional<PxtoneIODevice::Position> PxtoneIODevice::positionAt(
+    qint64 byte) {
+  while (m_chunks.size() > 1 && m_chunks[1].byte <= byte)
+    m_chunks.pop_front();
+  if (m_chunks.empty() || m_chunks.front().byte > byte) return std::nullopt;
+  const Chunk &chunk = m_chunks.front();
+  if (!chunk.playing) return Position{chunk.clock, false};
+  // Not past what's been handed over, in case the output's ahead of us.
+  byte = std::min(byte, m_bytes);
+  qint64 frames = (byte - chunk.byte) / pxtoneAudioFormat().bytesPerFrame();
+  return Position{chunk.clock + frames / chunk.clock_rate, true};
+}
+
 qint64 PxtoneIODevice::readData(char *data, qint64 maxlen) {
+  const pxtnMaster *master = pxtn->master;
+  Chunk chunk{m_bytes,
+              moo_state->smp_count / moo_state->params.clock_rate +
+                  qreal(MasterExtended::last_clock(master) -
+                        MasterExtended::repeat_clock(master)) *
+                      moo_state->num_loop,
+              moo_state->params.clock_rate, m_playing};
+  qint64 len;
   if (m_playing) {
     int32_t filled_len = 0;
     if (!pxtn->Moo(*moo_state, data, int32_t(maxlen), &filled_len))
       emit MooError();
-    return filled_len;
+    len = filled_len;
   } else {
     memset(data, 0, maxlen);
-    return maxlen;
+    len = maxlen;
+  }
+  if (len > 0) {
+    // Consecutive silent reads at the same spot are all one chunk.
+    if (m_chunks.empty() || chunk.playing || m_chunks.back().playing ||
+        m_chunks.back().clock != chunk.clock)
+      m_chunks.push_back(chunk);
+    if (m_chunks.size() > MAX_CHUNKS) m_chunks.pop_front();
+    m_bytes += len;
   }
+  return len;
 }
 qint64 PxtoneIODevice::writeData(const char *data, qint64 len) {
   (void)data;
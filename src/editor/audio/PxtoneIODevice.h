@@ -2,6 +2,8 @@
 #define PXTONEIODEVICE_H
 
 #include <QIODevice>
+#include <deque>
+#include <optional>
 
 #include "pxtone/pxtnService.h"
 
@@ -16,14 +18,43 @@ class PxtoneIODevice : public QIODevice {
   void setPlaying(bool playing);
   bool playing();
 
+  // Where the song was when the [byte]th byte handed to the output was made,
+  // counting from when the output was last started. [byte] shouldn't go
+  // backwards between calls. Like reads, only from the output's thread.
+  struct Position {
+    // Unwrapped, i.e., counting every loop so far.
+    qreal clock;
+    bool playing;
+  };
+  std::optional<Position> positionAt(qint64 byte);
+  // Bytes handed to the output since it was last started.
+  qint64 bytesHandedOver() const { return m_bytes; }
+  // Call when the output is (re)started, which restarts its count of what
+  // it's played.
+  void resetPosition();
+
  signals:
   void MooError();
   void playingChanged(bool);
 
  private:
+  // A read's worth of audio, which plays at a steady rate from [clock].
+  struct Chunk {
+    qint64 byte;
+    qreal clock;
+    qreal clock_rate;
+    bool playing;
+  };
+  // Enough for a few seconds of buffer at the smallest reads.
+  static constexpr size_t MAX_CHUNKS = 4096;
+
   const pxtnService *pxtn;
   mooState *moo_state;
   bool m_playing;
+  qint64 m_bytes;
+  // From oldest to newest. The ones that have been played are dropped as
+  // positions past them are asked for, or if there are too many.
+  std::deque<Chunk> m_chunks;
   qint64 readData(char *data, qint64 maxlen);
   qint64 writeData(const char *data, qint64 len);
 };
@@ -5,6 +5,7 @@
 #include "BasicWoiceListModel.h"
 #include "editor/ComboOptions.h"
 #include "editor/Settings.h"
+#include "protocol/Frame.h"
 
 // TODO: Put this somewhere else, like in remote action or sth.
 AddWoice make_addWoice_from_path(const QString &path) {
@@ -29,9 +30,14 @@ AddWoice make_addWoice_from_path(const QString &path) {
   QFile file(path);
   if (!file.open(QIODevice::ReadOnly))
     throw QString("Could not open file (%1)").arg(filename);
+  // Anything bigger wouldn't make it through to the server.
+  if (file.size() > MAX_WOICE_SIZE)
+    throw QString("Voice file (%1) is over the limit of %2 MB")
+        .arg(filename)
+        .arg(MAX_WOICE_SIZE / 1024 / 1024);
 
   QString name = fileinfo.baseName();
-  return AddWoice{type, name, file.readAll()};
+  return AddWoice{type, name, file.readAll(), {}};
 }
 
 // The model parents are the menu's parents because otherwise there's an init
@@ -6,7 +6,13 @@ Animation::Animation(QObject *parent) : QVariantAnimation(parent) {
   setEndValue(360);
   setEasingCurve(QEasingCurve::Linear);
   setLoopCount(-1);
-  start();
 
   connect(this, &QVariantAnimation::valueChanged, this, &Animation::nextFrame);
 }
+
+void Animation::setRunning(bool running) {
+  if (running && state() != QAbstractAnimation::Running)
+    start();
+  else if (!running && state() != QAbstractAnimation::Stopped)
+    stop();
+}
@@ -3,11 +3,14 @@
 
 #include <QVariantAnimation>
 
+// Ticks nextFrame once a frame while running. Nothing starts it by default,
+// so views only repaint every frame while something on them is moving.
 class Animation : public QVariantAnimation {
   Q_OBJECT
  public:
   explicit Animation(QObject *parent = nullptr);
   void updateCurrentValue(const QVariant &) {}
+  void setRunning(bool running);
  signals:
   void nextFrame();
 };
@@ -0,0 +1,136 @@
+#include "AsyncTileCache.h"
+
+#include <QThread>
+#include <algorithm>
+
+#include "NoAllocations.h"
+
+AsyncTileCache::AsyncTileCache(QObject *parent)
+    : QObject(parent),
+      m_dpr(0),
+      m_generation(0),
+      m_layout_version(1),
+      m_version(1) {
+  // Leave a core for the GUI thread.
+  m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+AsyncTileCache::~AsyncTileCache() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+bool AsyncTileCache::draw(QPainter &painter, const QRect &rect,
+                          const QRect &visible,
+                          std::initializer_list<qreal> layout,
+                          quint64 generation) {
+  qreal dpr = painter.device()->devicePixelRatioF();
+  if (!std::equal(layout.begin(), layout.end(), m_layout.begin(),
+                  m_layout.end()) ||
+      dpr != m_dpr) {
+    NoAllocations::Allow allow;
+    m_tiles.clear();
+    m_layout.assign(layout);
+    m_dpr = dpr;
+    m_layout_version.fetchAndAddRelaxed(1);
+  }
+  if (generation != m_generation) {
+    m_generation = generation;
+    ++m_version;
+    for (auto &[pos, tile] : m_tiles) tile.wanted = m_version;
+  }
+
+  // Paint rects are within the widget, so never negative.
+  int first_x = rect.left() / TILE_SIZE, last_x = rect.right() / TILE_SIZE;
+  int first_y = rect.top() / TILE_SIZE, last_y = rect.bottom() / TILE_SIZE;
+  // Drop what's out of view rather than grow without bound while scrolling.
+  // Paints can be much smaller than the view, so keep all of it, not just
+  // what's being painted.
+  size_t needed = size_t(last_x - first_x + 1) * (last_y - first_y + 1);
+  if (m_tiles.size() + needed > MAX_TILES) {
+    QRect keep = rect.united(visible);
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+      const auto &[x, y] = it->first;
+      if (!keep.intersects(
+              QRect(x * TILE_SIZE, y * TILE_SIZE, TILE_SIZE, TILE_SIZE)))
+        it = m_tiles.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  m_missing.clear();
+  for (int ty = first_y; ty <= last_y; ++ty)
+    for (int tx = first_x; tx <= last_x; ++tx) {
+      auto it = m_tiles.find({tx, ty});
+      if (it == m_tiles.end()) {
+        NoAllocations::Allow allow;
+        it = m_tiles.try_emplace({tx, ty}).first;
+        it->second.wanted = m_version;
+      }
+      Tile &tile = it->second;
+      if (!tile.image.isNull())
+        painter.drawImage(QPoint(tx * TILE_SIZE, ty * TILE_SIZE), tile.image);
+      if (tile.version < tile.wanted && tile.requested < tile.wanted) {
+        NoAllocations::Allow allow;
+        m_missing.push_back({tx, ty});
+      }
+    }
+  return !m_missing.empty();
+}
+
+void AsyncTileCache::render(const RenderFn &render) {
+  // Only called when something's missing.
+  NoAllocations::Allow allow;
+  quint64 layout_version = m_layout_version.loadRelaxed();
+  quint64 version = m_version;
+  qreal dpr = m_dpr;
+  for (const TilePos &pos : m_missing) {
+    auto it = m_tiles.find(pos);
+    if (it == m_tiles.end()) continue;
+    it->second.requested = version;
+    QRect tile_rect(pos.first * TILE_SIZE, pos.second * TILE_SIZE, TILE_SIZE,
+                    TILE_SIZE);
+    m_pool.start([this, render, pos, tile_rect, dpr, layout_version,
+                  version]() {
+      if (m_layout_version.loadRelaxed() != layout_version) return;
+      QImage image(TILE_SIZE * dpr, TILE_SIZE * dpr,
+                   QImage::Format_ARGB32_Premultiplied);
+      image.setDevicePixelRatio(dpr);
+      image.fill(Qt::transparent);
+      {
+        QPainter tile_painter(&image);
+        tile_painter.setClipRect(0, 0, TILE_SIZE, TILE_SIZE);
+        tile_painter.translate(-tile_rect.topLeft());
+        render(tile_painter, tile_rect);
+      }
+      QMetaObject::invokeMethod(
+          this,
+          [this, pos, layout_version, version, image]() {
+            finish(pos, layout_version, version, image);
+          },
+          Qt::QueuedConnection);
+    });
+  }
+  m_missing.clear();
+}
+
+void AsyncTileCache::invalidate(const QRect &rect) {
+  ++m_version;
+  for (auto &[pos, tile] : m_tiles)
+    if (rect.intersects(QRect(pos.first * TILE_SIZE, pos.second * TILE_SIZE,
+                              TILE_SIZE, TILE_SIZE)))
+      tile.wanted = m_version;
+}
+
+void AsyncTileCache::finish(TilePos pos, quint64 layout_version,
+                            quint64 version, const QImage &image) {
+  if (layout_version != m_layout_version.loadRelaxed()) return;
+  auto it = m_tiles.find(pos);
+  // Renders can finish out of order, and a newer one might be in already.
+  if (it == m_tiles.end() || it->second.version >= version) return;
+  it->second.image = image;
+  it->second.version = version;
+  emit tileReady(QRect(pos.first * TILE_SIZE, pos.second * TILE_SIZE,
+                       TILE_SIZE, TILE_SIZE));
+}
@@ -0,0 +1,80 @@
+#ifndef ASYNCTILECACHE_H
+#define ASYNCTILECACHE_H
+
+#include <QAtomicInteger>
+#include <QImage>
+#include <QObject>
+#include <QPainter>
+#include <QThreadPool>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <vector>
+
+// Like BackgroundCache, but for layers too slow to draw on the GUI thread: the
+// tiles are rendered on a pool of worker threads and drawn once they arrive.
+//
+// Tiles go out of date either a few at a time, when the part of the layer
+// they cover is invalidated, or all at once, when the generation number that
+// identifies what the whole layer looks like goes up. Either way the tiles
+// already on screen keep being drawn until their replacements are ready, so
+// scrolling and editing don't flash, and a replacement that arrives after the
+// tile has gone out of date again is still shown until the next one's ready.
+// Changes to the layout (the scale, say) make old tiles useless instead, so
+// they're dropped.
+class AsyncTileCache : public QObject {
+  Q_OBJECT
+ public:
+  // Draws the layer over [rect], in widget coordinates. It's called on a worker
+  // thread, so it must only use what it owns (e.g., copies it captured).
+  using RenderFn = std::function<void(QPainter &painter, const QRect &rect)>;
+
+  explicit AsyncTileCache(QObject *parent = nullptr);
+  ~AsyncTileCache();
+  // Draws the tiles over [rect] that are ready. Returns whether any were
+  // missing or stale, in which case render() should be called to queue them.
+  // That's separate so that a paint with nothing to render doesn't have to
+  // build a RenderFn. [visible] is the part of the widget that's on screen,
+  // whose tiles are kept.
+  bool draw(QPainter &painter, const QRect &rect, const QRect &visible,
+            std::initializer_list<qreal> layout, quint64 generation);
+  // Queues the tiles that the last draw() found missing to be rendered with
+  // [render].
+  void render(const RenderFn &render);
+  // Marks the tiles over [rect], in widget coordinates, as out of date.
+  void invalidate(const QRect &rect);
+
+ signals:
+  // A tile over [rect] has been rendered and should be repainted.
+  void tileReady(const QRect &rect);
+
+ private:
+  struct Tile {
+    QImage image;
+    // Of what's in [image], what it'd have to be at least to be up to date,
+    // and of the last render queued.
+    quint64 version = 0;
+    quint64 wanted = 1;
+    quint64 requested = 0;
+  };
+  using TilePos = std::pair<int, int>;
+  void finish(TilePos pos, quint64 layout_version, quint64 version,
+              const QImage &image);
+
+  static constexpr int TILE_SIZE = 256;
+  static constexpr size_t MAX_TILES = 256;
+
+  std::vector<qreal> m_layout;
+  qreal m_dpr;
+  quint64 m_generation;
+  // Goes up with every change to the layout. Workers check it to skip tiles
+  // that would be thrown away.
+  QAtomicInteger<quint64> m_layout_version;
+  // Goes up with every invalidation.
+  quint64 m_version;
+  std::map<TilePos, Tile> m_tiles;
+  std::vector<TilePos> m_missing;
+  QThreadPool m_pool;
+};
+
+#endif  // ASYNCTILECACHE_H
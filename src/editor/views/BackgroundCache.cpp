@@ -0,0 +1,57 @@
+#include "BackgroundCache.h"
+
+#include <algorithm>
+
+#include "NoAllocations.h"
+
+void BackgroundCache::draw(QPainter &painter, const QRect &rect,
+                           const QRect &visible,
+                           std::initializer_list<qreal> key,
+                           const DrawFn &draw) {
+  qreal dpr = painter.device()->devicePixelRatioF();
+  // Compared in place, since this is every paint.
+  if (!std::equal(key.begin(), key.end(), m_key.begin(), m_key.end()) ||
+      dpr != m_dpr) {
+    NoAllocations::Allow allow;
+    m_tiles.clear();
+    m_key.assign(key);
+    m_dpr = dpr;
+  }
+
+  // Paint rects are within the widget, so never negative.
+  int first_x = rect.left() / TILE_SIZE, last_x = rect.right() / TILE_SIZE;
+  int first_y = rect.top() / TILE_SIZE, last_y = rect.bottom() / TILE_SIZE;
+  // Drop what's out of view rather than grow without bound while scrolling.
+  // Paints can be much smaller than the view, so keep all of it, not just
+  // what's being painted.
+  size_t needed = size_t(last_x - first_x + 1) * (last_y - first_y + 1);
+  if (m_tiles.size() + needed > MAX_TILES) {
+    QRect keep = rect.united(visible);
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+      const auto &[x, y] = it->first;
+      if (!keep.intersects(
+              QRect(x * TILE_SIZE, y * TILE_SIZE, TILE_SIZE, TILE_SIZE)))
+        it = m_tiles.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  for (int ty = first_y; ty <= last_y; ++ty)
+    for (int tx = first_x; tx <= last_x; ++tx) {
+      QRect tile_rect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+      auto it = m_tiles.find({tx, ty});
+      if (it == m_tiles.end()) {
+        NoAllocations::Allow allow;
+        QPixmap tile(TILE_SIZE * dpr, TILE_SIZE * dpr);
+        tile.setDevicePixelRatio(dpr);
+        QPainter tile_painter(&tile);
+        tile_painter.setClipRect(0, 0, TILE_SIZE, TILE_SIZE);
+        tile_painter.translate(-tile_rect.topLeft());
+        draw(tile_painter, tile_rect);
+        tile_painter.end();
+        it = m_tiles.emplace(std::make_pair(tx, ty), tile).first;
+      }
+      painter.drawPixmap(tile_rect.topLeft(), it->second);
+    }
+}
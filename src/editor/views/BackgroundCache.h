@@ -0,0 +1,38 @@
+#ifndef BACKGROUNDCACHE_H
+#define BACKGROUNDCACHE_H
+
+#include <QPainter>
+#include <QPixmap>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <vector>
+
+// A view's background (grid lines, key rows etc.), rendered once into tiles
+// and blitted on each paint. Whatever the background depends on (scale, beat
+// settings, theme...) goes in the key; the tiles are redrawn when it changes.
+//
+// Tiles are fixed-size and at fixed positions, so a wide or tall view only
+// renders the parts that are actually shown. Once there are too many, the ones
+// out of view are dropped, however many it takes to cover the view.
+class BackgroundCache {
+ public:
+  // Draws the background over [rect], in widget coordinates.
+  using DrawFn = std::function<void(QPainter &painter, const QRect &rect)>;
+
+  // Paints the background over [rect]. [visible] is the part of the widget
+  // that's on screen, whose tiles are kept.
+  void draw(QPainter &painter, const QRect &rect, const QRect &visible,
+            std::initializer_list<qreal> key, const DrawFn &draw);
+
+ private:
+  static constexpr int TILE_SIZE = 256;
+  // About two 4K screens' worth, beyond what's in view.
+  static constexpr size_t MAX_TILES = 256;
+
+  std::vector<qreal> m_key;
+  qreal m_dpr = 0;
+  std::map<std::pair<int, int>, QPixmap> m_tiles;
+};
+
+#endif  // BACKGROUNDCACHE_H
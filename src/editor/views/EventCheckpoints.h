@@ -0,0 +1,60 @@
+#ifndef EVENTCHECKPOINTS_H
+#define EVENTCHECKPOINTS_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "pxtone/pxtnEvelist.h"
+
+// Snapshots of some per-unit state derived from an event list, taken every so
+// many events, so that a view can start walking the events just before the
+// part it's drawing instead of from the top of the song. [State] needs a
+// default constructor and an apply(const EVERECORD *) that folds in an event.
+//
+// The snapshots point into the list, so they're only good until it changes.
+// They're never modified once taken, so they can be read from any thread.
+template <typename State>
+class EventCheckpoints {
+ public:
+  struct Checkpoint {
+    qint32 clock;
+    // The first event at or after [clock].
+    const EVERECORD *first;
+    // Each unit's state after all the events before [first].
+    std::vector<State> states;
+  };
+
+  EventCheckpoints(const EVERECORD *records, int unit_num) {
+    std::vector<State> states(unit_num);
+    const EVERECORD *e = records;
+    m_checkpoints.push_back({std::numeric_limits<qint32>::min(), e, states});
+    int since_checkpoint = 0;
+    for (; e != nullptr; e = e->next) {
+      // Only between clocks, so nothing before [first] is at [clock].
+      if (since_checkpoint >= EVENTS_PER_CHECKPOINT &&
+          e->clock > e->prev->clock) {
+        m_checkpoints.push_back({e->clock, e, states});
+        since_checkpoint = 0;
+      }
+      if (e->unit_no < unit_num) states[e->unit_no].apply(e);
+      ++since_checkpoint;
+    }
+  }
+
+  // The last checkpoint at or before [clock].
+  const Checkpoint &before(qint32 clock) const {
+    auto it = std::upper_bound(
+        m_checkpoints.begin(), m_checkpoints.end(), clock,
+        [](qint32 clock, const Checkpoint &c) { return clock < c.clock; });
+    return *std::prev(it);
+  }
+
+ private:
+  static constexpr int EVENTS_PER_CHECKPOINT = 1024;
+
+  std::vector<Checkpoint> m_checkpoints;
+};
+
+#endif  // EVENTCHECKPOINTS_H
@@ -0,0 +1,188 @@
+#include "FrameProfiler.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFontMetrics>
+#include <algorithm>
+
+#include "ViewHelper.h"
+
+static bool profiling = false;
+static std::vector<FrameProfiler *> profilers;
+
+static const char *STAGE_NAMES[FrameProfiler::NUM_STAGES] = {
+    "background", "content", "remote", "playhead", "other"};
+
+// Frame times, in ms, that the histogram's buckets start at.
+constexpr int BUCKETS[] = {0, 1, 2, 4, 8, 16, 33};
+constexpr int NUM_BUCKETS = sizeof(BUCKETS) / sizeof(BUCKETS[0]);
+constexpr int OVERLAY_WIDTH = 320;
+constexpr int HISTOGRAM_WIDTH = 84;
+constexpr int PADDING = 4;
+
+FrameProfiler::FrameProfiler(const QString &name)
+    : m_name(name),
+      m_in_frame(false),
+      m_last_mark_ns(0),
+      m_current(),
+      m_frames(MAX_FRAMES),
+      m_next(0),
+      m_count(0) {
+  m_sorted.reserve(MAX_FRAMES);
+  m_timer.start();
+  profilers.push_back(this);
+}
+
+FrameProfiler::~FrameProfiler() {
+  profilers.erase(std::remove(profilers.begin(), profilers.end(), this),
+                  profilers.end());
+}
+
+bool FrameProfiler::enabled() { return profiling; }
+
+void FrameProfiler::setEnabled(bool enabled) {
+  profiling = enabled;
+  if (enabled)
+    for (FrameProfiler *profiler : profilers) {
+      profiler->m_count = 0;
+      profiler->m_next = 0;
+    }
+}
+
+void FrameProfiler::beginFrame(const QRect &paint_rect, const QRect &overlay) {
+  m_in_frame = profiling && !overlay.contains(paint_rect);
+  if (!m_in_frame) return;
+  m_current = Frame();
+  m_last_mark_ns = m_timer.nsecsElapsed();
+  m_current.total_ns = -m_last_mark_ns;
+}
+
+void FrameProfiler::mark(Stage stage) {
+  if (!m_in_frame) return;
+  qint64 now = m_timer.nsecsElapsed();
+  m_current.stage_ns[stage] += now - m_last_mark_ns;
+  m_last_mark_ns = now;
+}
+
+void FrameProfiler::endFrame() {
+  if (!m_in_frame) return;
+  mark(Other);
+  m_current.total_ns += m_last_mark_ns;
+  m_frames[m_next] = m_current;
+  m_next = (m_next + 1) % MAX_FRAMES;
+  m_count = std::min(m_count + 1, MAX_FRAMES);
+  m_in_frame = false;
+}
+
+FrameProfiler::Percentiles FrameProfiler::percentiles(int stage) {
+  if (m_count == 0) return {0, 0, 0};
+  m_sorted.clear();
+  for (int i = 0; i < m_count; ++i)
+    m_sorted.push_back(stage < 0 ? m_frames[i].total_ns
+                                 : m_frames[i].stage_ns[stage]);
+  std::sort(m_sorted.begin(), m_sorted.end());
+  auto at = [this](qreal p) {
+    return m_sorted[std::min(m_count - 1, int(p * m_count))] / 1e6;
+  };
+  return {at(0.5), at(0.95), at(0.99)};
+}
+
+int FrameProfiler::drawSummary(QPainter &painter, int x, int y,
+                               int line_height) {
+  int top = y;
+  int label_width = (OVERLAY_WIDTH - HISTOGRAM_WIDTH) / 3;
+  int values_width = OVERLAY_WIDTH - HISTOGRAM_WIDTH - label_width;
+  auto drawRow = [&](const QString &label, const QString &values) {
+    painter.drawText(x, y, label_width, line_height, Qt::AlignLeft, label);
+    painter.drawText(x + label_width, y, values_width, line_height,
+                     Qt::AlignLeft, values);
+    y += line_height;
+  };
+  auto drawPercentiles = [&](const QString &label, const Percentiles &p) {
+    drawRow(label, QString("%1 %2 %3")
+                       .arg(p.p50, 6, 'f', 2)
+                       .arg(p.p95, 6, 'f', 2)
+                       .arg(p.p99, 6, 'f', 2));
+  };
+  drawRow(QString("%1 (%2)").arg(m_name).arg(m_count),
+          "   p50    p95    p99 ms");
+  drawPercentiles("total", percentiles(-1));
+  for (int stage = 0; stage < NUM_STAGES; ++stage)
+    drawPercentiles(STAGE_NAMES[stage], percentiles(stage));
+
+  // A histogram of frame totals beside the numbers, the last two buckets
+  // (missing a 60Hz frame) in red.
+  std::array<int, NUM_BUCKETS> counts{};
+  int max_count = 1;
+  for (int i = 0; i < m_count; ++i) {
+    qreal ms = m_frames[i].total_ns / 1e6;
+    int bucket =
+        std::upper_bound(BUCKETS, BUCKETS + NUM_BUCKETS, ms) - BUCKETS - 1;
+    max_count = std::max(max_count, ++counts[bucket]);
+  }
+  int bar_width = HISTOGRAM_WIDTH / NUM_BUCKETS;
+  int histogram_x = x + OVERLAY_WIDTH - HISTOGRAM_WIDTH - PADDING * 2;
+  int bottom = y - line_height;
+  int max_height = bottom - top - line_height;
+  for (int bucket = 0; bucket < NUM_BUCKETS; ++bucket) {
+    int h = max_height * counts[bucket] / max_count;
+    int bar_x = histogram_x + bucket * bar_width;
+    painter.fillRect(bar_x, bottom - h, bar_width - 2, h,
+                     bucket >= NUM_BUCKETS - 2 ? Qt::red : Qt::green);
+    painter.drawText(bar_x, bottom, bar_width, line_height, Qt::AlignLeft,
+                     QString::number(BUCKETS[bucket]));
+  }
+  return y - top;
+}
+
+QRect FrameProfiler::overlayRect(const QRect &visible) {
+  int line_height = QFontMetrics(textFont()).height();
+  int height = profilers.size() * (2 + NUM_STAGES) * line_height +
+               (profilers.size() + 1) * PADDING;
+  return QRect(visible.right() - OVERLAY_WIDTH, visible.top(), OVERLAY_WIDTH,
+               height);
+}
+
+QRect FrameProfiler::drawOverlay(QPainter &painter, const QRect &visible) {
+  const QFont &font = textFont();
+  int line_height = QFontMetrics(font).height();
+  QRect rect = overlayRect(visible);
+
+  painter.save();
+  painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+  painter.fillRect(rect, QColor::fromRgb(0, 0, 0, 192));
+  painter.setPen(Qt::white);
+  painter.setFont(font);
+  int y = rect.top() + PADDING;
+  for (FrameProfiler *profiler : profilers)
+    y += profiler->drawSummary(painter, rect.left() + PADDING, y,
+                               line_height) +
+         PADDING;
+  painter.restore();
+  return rect;
+}
+
+void FrameProfiler::writeCsv(QTextStream &out) {
+  // Oldest first.
+  int start = (m_count < MAX_FRAMES ? 0 : m_next);
+  for (int i = 0; i < m_count; ++i) {
+    const Frame &frame = m_frames[(start + i) % MAX_FRAMES];
+    out << m_name << "," << i << "," << frame.total_ns / 1e6;
+    for (qint64 ns : frame.stage_ns) out << "," << ns / 1e6;
+    out << "\n";
+  }
+}
+
+bool FrameProfiler::dump(const QString &filename) {
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    qWarning() << "Could not open frame profile for writing" << filename;
+    return false;
+  }
+  QTextStream out(&file);
+  out << "view,frame,total_ms";
+  for (const char *name : STAGE_NAMES) out << "," << name << "_ms";
+  out << "\n";
+  for (FrameProfiler *profiler : profilers) profiler->writeCsv(out);
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QTextStream>
+#include <array>
+#include <vector>
+
+// Times each of a view's paints, split into stages, and keeps the last few
+// hundred so that their spread can be seen: as an overlay with percentiles
+// and a histogram of frame times, or as a CSV dump for comparing builds.
+//
+// All the views' profilers are switched on and off together. While off, the
+// calls in paintEvent do nothing but check a flag.
+class FrameProfiler {
+ public:
+  // Content is the view's notes or events. Whatever's painted between the
+  // last mark and the end of the frame counts as Other.
+  enum Stage { Background, Content, Remote, Playhead, Other, NUM_STAGES };
+
+  explicit FrameProfiler(const QString &name);
+  ~FrameProfiler();
+
+  static bool enabled();
+  static void setEnabled(bool enabled);
+  // Writes every view's frames to [filename]. Returns false if it couldn't
+  // be opened.
+  static bool dump(const QString &filename);
+  // Where the overlay goes: the top right of [visible].
+  static QRect overlayRect(const QRect &visible);
+  // Draws every view's numbers there, and returns where that was.
+  static QRect drawOverlay(QPainter &painter, const QRect &visible);
+
+  // Paints entirely inside [overlay] are only refreshing it, so they're left
+  // out.
+  void beginFrame(const QRect &paint_rect, const QRect &overlay = QRect());
+  // Counts the time since the last mark (or the start) towards [stage].
+  void mark(Stage stage);
+  void endFrame();
+
+ private:
+  struct Frame {
+    std::array<qint64, NUM_STAGES> stage_ns;
+    qint64 total_ns;
+  };
+  struct Percentiles {
+    qreal p50, p95, p99;
+  };
+  // Of the kept frames' times in [stage], or their totals if it's -1.
+  Percentiles percentiles(int stage);
+  // Returns the height drawn.
+  int drawSummary(QPainter &painter, int x, int y, int line_height);
+  void writeCsv(QTextStream &out);
+
+  static constexpr int MAX_FRAMES = 600;
+
+  QString m_name;
+  QElapsedTimer m_timer;
+  bool m_in_frame;
+  qint64 m_last_mark_ns;
+  Frame m_current;
+  // A ring buffer of the last MAX_FRAMES frames.
+  std::vector<Frame> m_frames;
+  int m_next;
+  int m_count;
+  // Scratch space for percentiles.
+  std::vector<qint64> m_sorted;
+};
+
+#endif  // FRAMEPROFILER_H
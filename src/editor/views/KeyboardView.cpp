@@ -1,6 +1,7 @@
 #include "KeyboardView.h"
 
 #include <QDebug>
+#include <QFontMetrics>
 #include <QMessageBox>
 #include <QPaintEvent>
 #include <QPainter>
@@ -8,6 +9,7 @@
 #include <QScrollArea>
 #include <QTime>
 
+#include "NoAllocations.h"
 #include "ViewHelper.h"
 #include "editor/ComboOptions.h"
 #include "editor/Settings.h"
@@ -40,13 +42,19 @@ KeyboardView::KeyboardView(PxtoneClient *client, MooClock *moo_clock,
       m_anim(new Animation(this)),
       m_client(client),
       m_moo_clock(moo_clock),
+      m_note_style(nullptr),
+      m_note_generation(0),
+      m_remote_rects_stale(true),
+      m_playhead_x(0),
+      m_profiler("keyboard"),
+      m_profiler_refresh(new QTimer(this)),
       m_test_activity(false) {
   setFocusPolicy(Qt::StrongFocus);
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
   updateGeometry();
   setMouseTracking(true);
   m_timer->restart();
-  connect(m_anim, &Animation::nextFrame, [this]() { update(); });
+  connect(m_anim, &Animation::nextFrame, this, &KeyboardView::updatePlayhead);
   connect(m_anim, &Animation::nextFrame, [this]() {
     // This is not part of paintEvent because it causes some widgets to get
     // rendered outside their viewport, prob. because it causes a repaint in a
@@ -62,13 +70,177 @@ KeyboardView::KeyboardView(PxtoneClient *client, MooClock *moo_clock,
     }
   });
 
+  m_profiler_refresh->setInterval(500);
+  connect(m_profiler_refresh, &QTimer::timeout, [this]() {
+    update(m_profiler_rect);
+    update(FrameProfiler::overlayRect(visibleRegion().boundingRect()));
+  });
+  connect(&m_note_tiles, &AsyncTileCache::tileReady,
+          [this](const QRect &rect) { update(rect); });
+
   connect(m_client, &PxtoneClient::editStateChanged,
           [this](const EditState &s) {
             if (!(m_edit_state.scale == s.scale)) updateGeometry();
             m_edit_state.update(m_pxtn, s);
+            m_remote_rects_stale = true;
+            // Velocity tooltips fade in near the mouse, so it's simplest to
+            // repaint everything when our own state changes.
+            update();
+          });
+  connect(m_client, &PxtoneClient::remoteEditStateChanged, this,
+          &KeyboardView::updateRemoteEditState);
+  connect(m_client, &PxtoneClient::playStateChanged,
+          [this]() { m_anim->setRunning(true); });
+  connect(m_client->controller(), &PxtoneController::seeked,
+          [this]() { update(); });
+  connect(m_client->controller(), &PxtoneController::editedClocks,
+          [this](const Interval &clocks) {
+            QRect rect = clockRect(clocks, m_edit_state.scale.clockPerPx,
+                                   height(), WINDOW_BOUND_SLACK);
+            m_note_tiles.invalidate(rect);
+            update(rect);
           });
   connect(m_client->controller(), &PxtoneController::measureNumChanged, this,
           &QWidget::updateGeometry);
+  // A new project doesn't come with edited clocks.
+  connect(m_client->controller(), &PxtoneController::endRefresh, [this]() {
+    ++m_note_generation;
+    update();
+  });
+  for (auto signal :
+       {&PxtoneController::tempoBeatChanged, &PxtoneController::soloToggled})
+    connect(m_client->controller(), signal, [this]() { update(); });
+  for (auto signal :
+       {&PxtoneController::playedToggled, &PxtoneController::visibleToggled})
+    connect(m_client->controller(), signal, [this]() { update(); });
+  for (auto signal :
+       {&PxtoneClient::endRemoveUser, &PxtoneClient::endUserListRefresh})
+    connect(m_client, signal, [this]() {
+      m_remote_rects_stale = true;
+      update();
+    });
+}
+
+void KeyboardView::updatePlayhead() {
+  int x = m_moo_clock->now() / m_client->editState().scale.clockPerPx;
+  if (x != m_playhead_x) {
+    update(playheadRect(m_playhead_x, height()));
+    update(playheadRect(x, height()));
+  }
+  updatePlayingNotes();
+  // Notes being recorded grow with the playhead.
+  if (m_client->editState().m_input_state.has_value())
+    updateRow(m_client->editState().m_input_state.value().on.key);
+
+  m_anim->setRunning(m_client->isPlaying());
+}
+
+void KeyboardView::updateRow(int pitch) {
+  const Scale &scale = m_client->editState().scale;
+  int y = scale.pitchToY(pitch);
+  update(0, y, width(), PITCH_PER_KEY / scale.pitchPerPx + 1);
+}
+
+void KeyboardView::updatePlayingNotes() {
+  qint32 clock = m_moo_clock->now();
+
+  // Goes by the events as of the last paint rather than take a new snapshot,
+  // which is left to the paint an edit causes. That paint calls this again
+  // once it has the new one.
+  if (m_note_events == nullptr) return;
+  const NoteEvents &events = *m_note_events;
+  std::vector<DrawState> &states = m_playing_states;
+  std::vector<std::pair<int, int>> &start_pitches = m_start_pitches;
+
+  // Like the first pass in paintEvent, start from the earliest note that's
+  // still going.
+  qint32 start = clock;
+  events.seek(clock, states);
+  for (const DrawState &state : states)
+    if (state.ongoingOnEvent.has_value() &&
+        state.ongoingOnEvent.value().end > clock)
+      start = std::min(start, state.ongoingOnEvent.value().start);
+  NoteEvents::Position position = events.seek(start, states);
+  start_pitches.assign(states.size(), {0, 0});
+  events.forEach(position, clock, [&](const EVERECORD *e) {
+    DrawState &state = states[e->unit_no];
+    if (e->kind == EVENTKIND_ON)
+      start_pitches[e->unit_no] = {state.pitch.value, state.pitch.value};
+    state.apply(e);
+    if (e->kind == EVENTKIND_KEY && state.ongoingOnEvent.has_value() &&
+        state.ongoingOnEvent.value().start == e->clock)
+      start_pitches[e->unit_no].second = e->value;
+  });
+
+  std::vector<PlayingNote> &notes = m_next_playing_notes;
+  notes.clear();
+  for (uint unit_no = 0; unit_no < states.size(); ++unit_no) {
+    const std::optional<Interval> &on = states[unit_no].ongoingOnEvent;
+    if (on.has_value() && on.value().contains(clock))
+      notes.push_back({int(unit_no), on.value(), start_pitches[unit_no].first,
+                       start_pitches[unit_no].second});
+  }
+
+  auto updateChanged = [this](const std::vector<PlayingNote> &from,
+                              const std::vector<PlayingNote> &to) {
+    for (const PlayingNote &note : from) {
+      if (std::find(to.begin(), to.end(), note) != to.end()) continue;
+      update(clockRect(note.on, m_client->editState().scale.clockPerPx,
+                       height(), 2));
+      updateRow(note.pitch_before);
+      updateRow(note.pitch_after);
+    }
+  };
+  updateChanged(m_playing_notes, notes);
+  updateChanged(notes, m_playing_notes);
+  std::swap(m_playing_notes, notes);
+}
+
+QRect KeyboardView::remoteEditStateRect(const EditState &state,
+                                        const Scale &scale,
+                                        const QString &username, qint64 uid) {
+  const MouseEditState &mouse = state.mouse_edit_state;
+  LocalEditState local(m_pxtn, state);
+  QRect rect;
+  if (mouse.selection.has_value())
+    rect |= clockRect(mouse.selection.value(), scale.clockPerPx, height(), 1);
+  switch (mouse.type) {
+    case MouseEditState::Type::Seek:
+      rect |= playheadRect(mouse.current_clock / scale.clockPerPx, height());
+      break;
+    case MouseEditState::Type::Select:
+      rect |= clockRect(mouse.clock_int(local.m_quantize_clock),
+                        scale.clockPerPx, height(), 1);
+      break;
+    default:
+      break;
+  }
+  if (std::holds_alternative<MouseKeyboardEdit>(mouse.kind)) {
+    const auto &keyboard = std::get<MouseKeyboardEdit>(mouse.kind);
+    // The ghost note's row, and its velocity tooltip above.
+    int pitch = quantize(keyboard.start_pitch, local.m_quantize_pitch) +
+                local.m_quantize_pitch;
+    int y = scale.pitchToY(pitch);
+    int text_height = QFontMetrics(textFont()).height();
+    rect |= QRect(0, y - text_height, width(),
+                  text_height + PITCH_PER_KEY / scale.pitchPerPx + 1);
+    QPoint position(mouse.current_clock / scale.clockPerPx,
+                    scale.pitchToY(keyboard.current_pitch));
+    rect |= cursorRect(position, username, uid);
+  }
+  return rect;
+}
+
+void KeyboardView::updateRemoteEditState(qint64 uid) {
+  auto it = m_remote_rects.find(uid);
+  if (it != m_remote_rects.end()) update(it->second);
+  auto remote = m_client->remoteEditStates().find(uid);
+  if (remote != m_client->remoteEditStates().end() &&
+      remote->second.state.has_value())
+    update(remoteEditStateRect(remote->second.state.value(),
+                               m_client->editState().scale,
+                               remote->second.user, uid));
+  m_remote_rects_stale = true;
 }
 
 void KeyboardView::ensurePlayheadFollowed() {
@@ -77,30 +249,246 @@ void KeyboardView::ensurePlayheadFollowed() {
       m_client->editState().m_follow_playhead == FollowPlayhead::Follow);
 }
 
-void KeyboardView::toggleTestActivity() { m_test_activity = !m_test_activity; }
+void KeyboardView::toggleTestActivity() {
+  m_test_activity = !m_test_activity;
+  update();
+}
+
+// Big enough that walking the regions is nothing next to walking the events,
+// small enough that recopying one for an edit is cheap.
+static constexpr size_t EVENTS_PER_REGION = 8192;
 
-struct LastEvent {
-  int clock;
-  int value;
+static bool isNoteEvent(const EVERECORD *e, int unit_num) {
+  return (e->kind == EVENTKIND_ON || e->kind == EVENTKIND_KEY ||
+          e->kind == EVENTKIND_VELOCITY) &&
+         e->unit_no < unit_num;
+}
 
-  LastEvent(int value) : clock(0), value(value) {}
+static bool sameEvent(const EVERECORD &a, const EVERECORD &b) {
+  return a.clock == b.clock && a.kind == b.kind && a.unit_no == b.unit_no &&
+         a.value == b.value;
+}
 
-  void set(EVERECORD const *e) {
-    clock = e->clock;
-    value = e->value;
+static std::vector<EVERECORD> linkRecords(std::vector<EVERECORD> records) {
+  for (size_t i = 0; i < records.size(); ++i) {
+    records[i].prev = (i > 0 ? &records[i - 1] : nullptr);
+    records[i].next = (i + 1 < records.size() ? &records[i + 1] : nullptr);
   }
-};
+  return records;
+}
 
-struct DrawState {
-  LastEvent pitch;
-  LastEvent velocity;
-  std::optional<Interval> ongoingOnEvent;
+NoteRegion::NoteRegion(std::vector<EVERECORD> records, int unit_num)
+    : records(linkRecords(std::move(records))),
+      changes(first(), unit_num),
+      total(unit_num),
+      ons(0) {
+  for (const EVERECORD &e : this->records) {
+    total[e.unit_no].apply(&e);
+    if (e.kind == EVENTKIND_ON) ++ons;
+  }
+}
 
-  DrawState()
-      : pitch(EVENTDEFAULT_KEY),
-        velocity(EVENTDEFAULT_VELOCITY),
-        ongoingOnEvent(std::nullopt) {}
-};
+NoteEvents::NoteEvents(const pxtnService *pxtn, const NoteEvents *previous)
+    : evels(pxtn->evels),
+      revision(pxtn->evels->get_Revision()),
+      unit_num(pxtn->Unit_Num()),
+      ons_per_clock(0) {
+  // The regions' states are for a particular set of units.
+  if (previous != nullptr &&
+      (previous->evels != evels || previous->unit_num != unit_num))
+    previous = nullptr;
+
+  // Changed regions are gathered here, along with any unchanged ones after
+  // them while there are too few events to stand alone, then split up.
+  std::vector<EVERECORD> pending;
+  std::optional<qint32> pending_start;
+  auto flush = [&]() {
+    // Split evenly, so that a region that's grown just past the limit doesn't
+    // leave a sliver.
+    size_t num = std::max(size_t(1), (pending.size() + EVENTS_PER_REGION - 1) /
+                                         EVENTS_PER_REGION);
+    qint32 start = pending_start.value();
+    size_t begin = 0, i = 0;
+    do {
+      size_t end = std::max(begin, pending.size() * ++i / num);
+      // Only between clocks, so that regions don't overlap.
+      while (end > begin && end < pending.size() &&
+             pending[end].clock == pending[end - 1].clock)
+        ++end;
+      std::vector<EVERECORD> records(pending.begin() + begin,
+                                     pending.begin() + end);
+      m_regions.push_back(
+          {start,
+           std::make_shared<const NoteRegion>(std::move(records), unit_num),
+           {}});
+      begin = end;
+      if (begin < pending.size()) start = pending[begin].clock;
+    } while (begin < pending.size());
+    pending.clear();
+    pending_start.reset();
+  };
+
+  const EVERECORD *e = evels->get_Records();
+  if (previous == nullptr) {
+    pending_start = std::numeric_limits<qint32>::min();
+    for (; e != nullptr; e = e->next)
+      if (isNoteEvent(e, unit_num)) pending.push_back(*e);
+  } else
+    for (size_t r = 0; r < previous->m_regions.size(); ++r) {
+      const Region &region = previous->m_regions[r];
+      bool last = (r + 1 == previous->m_regions.size());
+      qint32 end = (last ? 0 : previous->m_regions[r + 1].start);
+      const std::vector<EVERECORD> &records = region.events->records;
+
+      const EVERECORD *region_first = e;
+      bool same = !pending_start.has_value();
+      size_t i = 0;
+      for (; e != nullptr && (last || e->clock < end); e = e->next) {
+        if (!same || !isNoteEvent(e, unit_num)) continue;
+        same = (i < records.size() && sameEvent(*e, records[i]));
+        ++i;
+      }
+      if (same && i == records.size()) {
+        m_regions.push_back({region.start, region.events, {}});
+        continue;
+      }
+
+      if (!pending_start.has_value()) pending_start = region.start;
+      for (const EVERECORD *f = region_first; f != e; f = f->next)
+        if (isNoteEvent(f, unit_num)) pending.push_back(*f);
+      if (pending.size() >= EVENTS_PER_REGION / 2) flush();
+    }
+  if (pending_start.has_value()) flush();
+
+  std::vector<DrawState> states(unit_num);
+  size_t ons = 0;
+  std::optional<qint32> first_clock;
+  qint32 last_clock = 0;
+  for (Region &region : m_regions) {
+    region.states = states;
+    for (int unit_no = 0; unit_no < unit_num; ++unit_no)
+      region.events->total[unit_no].applyTo(states[unit_no]);
+    const std::vector<EVERECORD> &records = region.events->records;
+    if (records.empty()) continue;
+    ons += region.events->ons;
+    if (!first_clock.has_value()) first_clock = records.front().clock;
+    last_clock = records.back().clock;
+  }
+  if (first_clock.has_value())
+    ons_per_clock = ons / double(std::max(1, last_clock - *first_clock));
+}
+
+NoteEvents::Position NoteEvents::seek(qint32 clock,
+                                      std::vector<DrawState> &states) const {
+  auto it = std::upper_bound(
+      m_regions.begin(), m_regions.end(), clock,
+      [](qint32 clock, const Region &r) { return clock < r.start; });
+  // The first region starts before any clock.
+  const Region &region = *std::prev(it);
+  const auto &checkpoint = region.events->changes.before(clock);
+  states = region.states;
+  for (size_t unit_no = 0; unit_no < states.size(); ++unit_no)
+    checkpoint.states[unit_no].applyTo(states[unit_no]);
+  return {size_t(std::prev(it) - m_regions.begin()), checkpoint.first};
+}
+
+std::shared_ptr<const NoteEvents> KeyboardView::noteEvents() {
+  if (m_note_events == nullptr || m_note_events->evels != m_pxtn->evels ||
+      m_note_events->unit_num != m_pxtn->Unit_Num()) {
+    NoAllocations::Allow allow;
+    m_note_events = std::make_shared<const NoteEvents>(m_pxtn, nullptr);
+    ++m_note_generation;
+  } else if (m_note_events->revision != m_pxtn->evels->get_Revision()) {
+    // The tiles over the edit were invalidated when it was made.
+    NoAllocations::Allow allow;
+    m_note_events =
+        std::make_shared<const NoteEvents>(m_pxtn, m_note_events.get());
+  }
+  return m_note_events;
+}
+
+std::shared_ptr<const NoteStyle> KeyboardView::noteStyle(
+    const NoteEvents &events, const Scale &scale) {
+  // More notes than pixel columns means they'd mostly be overdrawn.
+  bool spans = events.ons_per_clock * scale.clockPerPx > 1;
+  // Checked against the units in place, so an unchanged style costs nothing.
+  auto unchanged = [this, spans](const NoteStyle &style) {
+    if (style.dark != m_dark || style.spans != spans ||
+        style.current_unit_id != m_client->editState().m_current_unit_id ||
+        style.units.size() != size_t(m_pxtn->Unit_Num()))
+      return false;
+    for (int unit_no = 0; unit_no < m_pxtn->Unit_Num(); ++unit_no) {
+      const NoteStyle::Unit &s = style.units[unit_no];
+      const pxtnUnit *unit = m_pxtn->Unit_Get(unit_no);
+      if (s.id != m_client->unitIdMap().noToId(unit_no) ||
+          s.visible != unit->get_visible() || s.played != unit->get_played())
+        return false;
+    }
+    return true;
+  };
+  if (m_note_style != nullptr && unchanged(*m_note_style)) return m_note_style;
+
+  NoAllocations::Allow allow;
+  auto style = std::make_shared<NoteStyle>();
+  style->dark = m_dark;
+  style->spans = spans;
+  style->current_unit_id = m_client->editState().m_current_unit_id;
+  for (int unit_no = 0; unit_no < m_pxtn->Unit_Num(); ++unit_no) {
+    const pxtnUnit *unit = m_pxtn->Unit_Get(unit_no);
+    style->units.push_back({m_client->unitIdMap().noToId(unit_no),
+                            unit->get_visible(), unit->get_played()});
+  }
+  m_note_style = style;
+  ++m_note_generation;
+  return m_note_style;
+}
+
+void DrawState::apply(const EVERECORD *e) {
+  switch (e->kind) {
+    case EVENTKIND_ON:
+      ongoingOnEvent.emplace(Interval{e->clock, e->value + e->clock});
+      break;
+    case EVENTKIND_VELOCITY:
+      velocity.set(e);
+      break;
+    case EVENTKIND_KEY:
+      if (ongoingOnEvent.has_value() && e->clock > ongoingOnEvent.value().end)
+        ongoingOnEvent.reset();
+      pitch.set(e);
+      break;
+    default:
+      break;
+  }
+}
+
+void DrawStateChange::apply(const EVERECORD *e) {
+  after.apply(e);
+  switch (e->kind) {
+    case EVENTKIND_ON:
+      on_set = true;
+      break;
+    case EVENTKIND_VELOCITY:
+      velocity_set = true;
+      break;
+    case EVENTKIND_KEY:
+      pitch_set = true;
+      break;
+    default:
+      break;
+  }
+}
+
+void DrawStateChange::applyTo(DrawState &state) const {
+  // An on event replaces whatever was ongoing. Otherwise a key event past the
+  // end of the ongoing one ends it, and the last key event is the latest.
+  if (on_set)
+    state.ongoingOnEvent = after.ongoingOnEvent;
+  else if (pitch_set && state.ongoingOnEvent.has_value() &&
+           after.pitch.clock > state.ongoingOnEvent.value().end)
+    state.ongoingOnEvent.reset();
+  if (pitch_set) state.pitch = after.pitch;
+  if (velocity_set) state.velocity = after.velocity;
+}
 
 struct KeyBlock {
   int pitch;
@@ -108,13 +496,20 @@ struct KeyBlock {
   Interval onEvent;
 };
 
+// These take colours rather than brushes: a QBrush made from a colour is a
+// heap allocation, and there's a fill per block.
+static void paintAtXPitch(int x, int pitch, int widthInPx, QPainter &painter,
+                          const QColor &color, const Scale &scale) {
+  int rowHeight = PITCH_PER_KEY / scale.pitchPerPx;
+  painter.fillRect(x, scale.pitchToY(pitch) + rowHeight / 6, widthInPx,
+                   rowHeight * 2 / 3, color);
+}
+
 static void paintAtClockPitch(int clock, int pitch, int widthInPx,
-                              QPainter &painter, const QBrush &brush,
+                              QPainter &painter, const QColor &color,
                               const Scale &scale) {
-  int rowHeight = PITCH_PER_KEY / scale.pitchPerPx;
-  painter.fillRect(clock / scale.clockPerPx,
-                   scale.pitchToY(pitch) + rowHeight / 6, widthInPx,
-                   rowHeight * 2 / 3, brush);
+  paintAtXPitch(clock / scale.clockPerPx, pitch, widthInPx, painter, color,
+                scale);
 }
 
 static void drawAtClockPitch(int clock, int pitch, int widthInPx,
@@ -126,9 +521,9 @@ static void drawAtClockPitch(int clock, int pitch, int widthInPx,
 }
 
 static void paintBlock(int pitch, const Interval &segment, QPainter &painter,
-                       const QBrush &brush, const Scale &scale) {
+                       const QColor &color, const Scale &scale) {
   paintAtClockPitch(segment.start, pitch, segment.length() / scale.clockPerPx,
-                    painter, brush, scale);
+                    painter, color, scale);
 }
 
 static void drawBlock(int pitch, const Interval &segment, QPainter &painter,
@@ -138,8 +533,8 @@ static void drawBlock(int pitch, const Interval &segment, QPainter &painter,
 }
 
 static void paintHighlight(int pitch, int clock, QPainter &painter,
-                           const QBrush &brush, const Scale &scale) {
-  paintAtClockPitch(clock, pitch, 2, painter, brush, scale);
+                           const QColor &color, const Scale &scale) {
+  paintAtClockPitch(clock, pitch, 2, painter, color, scale);
 }
 
 int pixelsPerVelocity = 3;
@@ -165,9 +560,11 @@ static qint32 arbitrarily_tall = 512;
 void drawVelTooltip(QPainter &painter, qint32 vel, qint32 clock, qint32 pitch,
                     const Brush &brush, const Scale &scale, qint32 alpha) {
   if (alpha == 0) return;
+  // Qt lays the text out each time.
+  NoAllocations::Allow allow;
   qint32 draw_vel = (EVENTMAX_VELOCITY + vel) / 2;
   painter.setPen(brush.toQColor(draw_vel, true, alpha));
-  painter.setFont(QFont("Sans serif", Settings::TextSize::get()));
+  painter.setFont(textFont());
   painter.drawText(clock / scale.clockPerPx,
                    scale.pitchToY(pitch) - arbitrarily_tall, arbitrarily_tall,
                    arbitrarily_tall, Qt::AlignBottom, QString("%1").arg(vel));
@@ -197,6 +594,8 @@ void drawOngoingAction(const EditState &state, const LocalEditState &localState,
   const Brush &brush =
       brushes[nonnegative_modulo(state.m_current_unit_id, NUM_BRUSHES)];
   const MouseEditState &mouse_edit_state = state.mouse_edit_state;
+  // Theirs, if it's someone else's state, but positioned on our scale.
+  const Scale &scale = localState.scale;
 
   switch (mouse_edit_state.type) {
     case MouseEditState::Type::Nothing:
@@ -208,7 +607,7 @@ void drawOngoingAction(const EditState &state, const LocalEditState &localState,
         break;
       const auto &keyboard_edit_state =
           std::get<MouseKeyboardEdit>(mouse_edit_state.kind);
-      int velocity = impliedVelocity(mouse_edit_state, state.scale);
+      int velocity = impliedVelocity(mouse_edit_state, scale);
       // TODO: maybe factor out this quantization logic
       Interval interval(
           mouse_edit_state.clock_int(localState.m_quantize_clock));
@@ -219,23 +618,23 @@ void drawOngoingAction(const EditState &state, const LocalEditState &localState,
           (mouse_edit_state.type == MouseEditState::Nothing ? 128 : 255);
 
       bool rowHighlight = (mouse_edit_state.type != MouseEditState::Nothing);
-      drawGhostOnNote(painter, interval, state.scale, width, brush, velocity,
-                      alpha, alphaMultiplier, rowHighlight, pitch);
+      drawGhostOnNote(painter, interval, scale, width, brush, velocity, alpha,
+                      alphaMultiplier, rowHighlight, pitch);
 
       if (mouse_edit_state.type == MouseEditState::SetOn)
-        drawVelTooltip(painter, velocity, interval.start, pitch, brush,
-                       state.scale, 255 * alphaMultiplier);
+        drawVelTooltip(painter, velocity, interval.start, pitch, brush, scale,
+                       255 * alphaMultiplier);
 
     } break;
     case MouseEditState::Type::Seek:
-      painter.fillRect(mouse_edit_state.current_clock / state.scale.clockPerPx,
-                       0, 1, height,
+      painter.fillRect(mouse_edit_state.current_clock / scale.clockPerPx, 0, 1,
+                       height,
                        QColor::fromRgb(255, 255, 255, 128 * alphaMultiplier));
       break;
     case MouseEditState::Type::Select: {
       Interval interval(
           mouse_edit_state.clock_int(localState.m_quantize_clock) /
-          state.scale.clockPerPx);
+          scale.clockPerPx);
       drawSelection(painter, interval, height, selectionAlphaMultiplier);
     } break;
   }
@@ -244,20 +643,20 @@ void drawOngoingAction(const EditState &state, const LocalEditState &localState,
     const Input::State::On &v = state.m_input_state.value();
 
     for (const Interval &interval : v.clock_ints(nowNoWrap.value(), master))
-      drawGhostOnNote(painter, interval, state.scale, width, brush, v.on.vel,
-                      255, alphaMultiplier, true, v.on.key);
+      drawGhostOnNote(painter, interval, scale, width, brush, v.on.vel, 255,
+                      alphaMultiplier, true, v.on.key);
   }
 }
 
-static void drawCursor(const EditState &state, QPainter &painter,
-                       const QColor &color, const QString &username,
-                       qint64 uid) {
+static void drawCursor(const EditState &state, const Scale &scale,
+                       QPainter &painter, const QColor &color,
+                       const QString &username, qint64 uid) {
   if (!std::holds_alternative<MouseKeyboardEdit>(state.mouse_edit_state.kind))
     return;
   const auto &keyboard_edit_state =
       std::get<MouseKeyboardEdit>(state.mouse_edit_state.kind);
-  QPoint position(state.mouse_edit_state.current_clock / state.scale.clockPerPx,
-                  state.scale.pitchToY(keyboard_edit_state.current_pitch));
+  QPoint position(state.mouse_edit_state.current_clock / scale.clockPerPx,
+                  scale.pitchToY(keyboard_edit_state.current_pitch));
   drawCursor(position, painter, color, username, uid);
 }
 
@@ -265,18 +664,101 @@ double smoothDistance(double dy, double dx) {
   double r = dy * dy + dx * dx;
   return std::max(0.0, 1 / (r + 1));
 }
+
+// The part of a block that doesn't depend on the playhead or mouse, which is
+// what goes into the note tiles.
+struct UnlitBlock {
+  int unit_no;
+  int pitch;
+  int velocity;
+  Interval interval;
+  bool first;
+};
+
+static qint32 unlitAlpha(const NoteStyle &style, int unit_no) {
+  const NoteStyle::Unit &unit = style.units[unit_no];
+  if (unit.id == style.current_unit_id) return 255;
+  if (unit.visible) return 64;
+  return 0;
+}
+
+static QColor unlitColor(const NoteStyle &style, int unit_no, int velocity) {
+  const NoteStyle::Unit &unit = style.units[unit_no];
+  QColor color = brushes[unit.id % NUM_BRUSHES].toQColor(
+      velocity, false, unlitAlpha(style, unit_no));
+  if (!unit.played)
+    color.setHsl(0, color.saturation() * 0.3, color.lightness(), color.alpha());
+  return color;
+}
+
+static void drawUnlitBlock(QPainter &painter, const UnlitBlock &block,
+                           const NoteStyle &style, const Scale &scale) {
+  paintBlock(block.pitch, block.interval, painter,
+             unlitColor(style, block.unit_no, block.velocity), scale);
+  if (block.first)
+    paintHighlight(
+        block.pitch, block.interval.start, painter,
+        brushes[style.units[block.unit_no].id % NUM_BRUSHES].toQColor(
+            255, true, unlitAlpha(style, block.unit_no)),
+        scale);
+}
+
+// Zoomed out far enough, most blocks are a pixel or two wide and drawing them
+// one by one is mostly overdraw. Instead mark the columns each unit has a
+// note in on each row, and fill the runs. First-block highlights are left out
+// since they'd cover everything.
+static void drawUnlitSpans(QPainter &painter, const QRect &rect,
+                           const std::vector<UnlitBlock> &blocks,
+                           const NoteStyle &style, const Scale &scale) {
+  struct Row {
+    std::vector<bool> columns;
+    int velocity = 0;
+  };
+  std::map<std::pair<int, int>, Row> rows;
+  int width = rect.width();
+  for (const UnlitBlock &block : blocks) {
+    int start = block.interval.start / scale.clockPerPx - rect.left();
+    int end = block.interval.end / scale.clockPerPx - rect.left();
+    if (end < 0 || start >= width) continue;
+    start = clamp(start, 0, width - 1);
+    end = clamp(end, start + 1, width);
+    Row &row = rows[{block.unit_no, block.pitch}];
+    if (row.columns.empty()) row.columns.resize(width);
+    std::fill(row.columns.begin() + start, row.columns.begin() + end, true);
+    row.velocity = std::max(row.velocity, block.velocity);
+  }
+
+  for (const auto &[key, row] : rows) {
+    const auto &[unit_no, pitch] = key;
+    QColor color = unlitColor(style, unit_no, row.velocity);
+    for (int x = 0; x < width;) {
+      if (!row.columns[x]) {
+        ++x;
+        continue;
+      }
+      int run_end = x;
+      while (run_end < width && row.columns[run_end]) ++run_end;
+      paintAtXPitch(rect.left() + x, pitch, run_end - x, painter, color,
+                    scale);
+      x = run_end;
+    }
+  }
+}
+
+// Everything else: the lit-up rows and blocks of notes that are playing, which
+// are drawn over their unlit tile, and velocity tooltips and selections.
 void drawStateSegment(QPainter &painter, const DrawState &state,
                       const Interval &segment,
                       const std::optional<Interval> &selection,
                       const Interval &bounds, const Brush &brush, qint32 alpha,
                       const Scale &scale, qint32 current_clock,
                       const MouseEditState &mouse, bool drawTooltip, bool muted,
-                      int width) {
+                      bool drawPlayingRow, int width) {
   Interval on = state.ongoingOnEvent.value();
   Interval interval = interval_intersect(on, segment);
   bool playing = on.contains(current_clock);
   bool firstBlock = interval.start == on.start;
-  if (playing && firstBlock && !muted && alpha > 0)
+  if (drawPlayingRow && playing && firstBlock && !muted && alpha > 0)
     paintBlock(state.pitch.value, Interval{0, int(scale.clockPerPx * width)},
                painter,
                brush.toQColor(
@@ -284,13 +766,10 @@ void drawStateSegment(QPainter &painter, const DrawState &state,
                    16 * state.velocity.value / 128 * (alpha / 2 + 128) / 256),
                scale);
   if (interval_intersect(interval, bounds).empty()) return;
-  QColor color = brush.toQColor(state.velocity.value, playing && !muted, alpha);
-  if (muted)
-    color.setHsl(0, color.saturation() * 0.3, color.lightness(), color.alpha());
-  paintBlock(state.pitch.value, interval, painter, color, scale);
+  if (playing && !muted)
+    paintBlock(state.pitch.value, interval, painter,
+               brush.toQColor(state.velocity.value, true, alpha), scale);
   if (firstBlock) {
-    paintHighlight(state.pitch.value, interval.start, painter,
-                   brush.toQColor(255, true, alpha), scale);
     if (drawTooltip) {
       double alphaMultiplier = 0;
       if (std::holds_alternative<MouseKeyboardEdit>(mouse.kind)) {
@@ -321,37 +800,23 @@ void drawStateSegment(QPainter &painter, const DrawState &state,
   }
 }
 
-void KeyboardView::paintEvent(QPaintEvent *event) {
-  ++painted;
-  // if (painted > 10) return;
-  QPainter painter(this);
-  Interval clockBounds = {
-      qint32(event->rect().left() * m_client->editState().scale.clockPerPx) -
-          WINDOW_BOUND_SLACK,
-      qint32(event->rect().right() * m_client->editState().scale.clockPerPx) +
-          WINDOW_BOUND_SLACK};
-
-  painter.fillRect(0, 0, size().width(), size().height(), Qt::black);
+static void drawBackground(QPainter &painter, const QRect &rect,
+                           const pxtnMaster *master, const Scale &scale,
+                           bool dark) {
+  painter.fillRect(rect, Qt::black);
   // Draw white lines under background
-  QBrush beatBrush(QColor::fromRgb(128, 128, 128));
-  QBrush measureBrush(Qt::white);
-  for (int beat = 0; true; ++beat) {
-    bool isMeasureLine = (beat % m_pxtn->master->get_beat_num() == 0);
-    int x = m_pxtn->master->get_beat_clock() * beat /
-            m_client->editState().scale.clockPerPx;
-    if (x > size().width()) break;
-    painter.fillRect(x, 0, 1, size().height(),
-                     (isMeasureLine ? measureBrush : beatBrush));
-  }
+  drawBeatLines(painter, rect, master, scale.clockPerPx);
   // Draw key background
   QBrush rootNoteBrush(QColor::fromRgb(84, 76, 76));
   QBrush whiteNoteBrush(QColor::fromRgb(64, 64, 64));
   QBrush blackNoteBrush(QColor::fromRgb(32, 32, 32));
   QBrush black(Qt::black);
-  for (int row = 0; true; ++row) {
+  int firstRow =
+      std::max(0, int(rect.top() * scale.pitchPerPx / PITCH_PER_KEY) - 1);
+  for (int row = firstRow; true; ++row) {
     QBrush *brush;
 
-    if (m_dark)
+    if (dark)
       brush = &black;
     else {
       if (row == 39)
@@ -370,195 +835,266 @@ void KeyboardView::paintEvent(QPaintEvent *event) {
         }
     }
 
-    if (row * PITCH_PER_KEY / m_client->editState().scale.pitchPerPx >
-        size().height())
-      break;
-    int this_y = row * PITCH_PER_KEY / m_client->editState().scale.pitchPerPx;
+    if (row * PITCH_PER_KEY / scale.pitchPerPx > rect.bottom()) break;
+    int this_y = row * PITCH_PER_KEY / scale.pitchPerPx;
     // Because of rounding error, calculate height by subbing next from this
-    int next_y =
-        (row + 1) * PITCH_PER_KEY / m_client->editState().scale.pitchPerPx;
+    int next_y = (row + 1) * PITCH_PER_KEY / scale.pitchPerPx;
     int h = next_y - this_y - 1;
-    if (m_dark && row % 2 == 1) h += 1;
-    painter.fillRect(0, this_y, size().width(), h, *brush);
+    if (dark && row % 2 == 1) h += 1;
+    painter.fillRect(rect.left(), this_y, rect.width(), h, *brush);
   }
+}
+
+// Walks the events from [checkpoint] up to [end], calling [drawSegment] with
+// each block's unit, state and end. Blocks still going at [end] are drawn as if
+// nothing changed after it, which is fine as long as that's past the part
+// that's being drawn. [states] is scratch space, passed in so that its storage
+// can be reused from one walk to the next.
+template <typename DrawSegment>
+static void forEachSegment(const NoteEvents &events, qint32 start,
+                           qint32 end, std::vector<DrawState> &states,
+                           const DrawSegment &drawSegment) {
+  events.forEach(events.seek(start, states), end, [&](const EVERECORD *e) {
+    DrawState &state = states[e->unit_no];
+    // An on event ends the last block of the previous one, and a key event
+    // the current block of this one.
+    if ((e->kind == EVENTKIND_ON || e->kind == EVENTKIND_KEY) &&
+        state.ongoingOnEvent.has_value())
+      drawSegment(e->unit_no, state, e->clock);
+    state.apply(e);
+  });
+
+  // After all the events there might be some blocks that are pending a draw.
+  for (uint unit_no = 0; unit_no < states.size(); ++unit_no)
+    if (states[unit_no].ongoingOnEvent.has_value())
+      drawSegment(unit_no, states[unit_no],
+                  states[unit_no].ongoingOnEvent.value().end);
+}
+
+// Runs on a worker thread, so only uses what it's given.
+static void drawNoteTile(QPainter &painter, const QRect &rect,
+                         const NoteEvents &events, const NoteStyle &style,
+                         const Scale &scale) {
+  if (style.dark)
+    painter.setCompositionMode(QPainter::CompositionMode_Plus);
+  Interval bounds{
+      qint32(rect.left() * scale.clockPerPx) - WINDOW_BOUND_SLACK,
+      qint32(rect.right() * scale.clockPerPx) + WINDOW_BOUND_SLACK};
+  std::vector<UnlitBlock> blocks;
+  std::vector<DrawState> states;
+  forEachSegment(
+      events, bounds.start, bounds.end, states,
+      [&](int unit_no, const DrawState &state, qint32 segment_end) {
+        if (unlitAlpha(style, unit_no) == 0) return;
+        Interval on = state.ongoingOnEvent.value();
+        Interval interval =
+            interval_intersect(on, {state.pitch.clock, segment_end});
+        if (interval_intersect(interval, bounds).empty()) return;
+        blocks.push_back({unit_no, state.pitch.value, state.velocity.value,
+                          interval, interval.start == on.start});
+      });
+
+  if (style.spans)
+    drawUnlitSpans(painter, rect, blocks, style, scale);
+  else
+    for (const UnlitBlock &block : blocks)
+      drawUnlitBlock(painter, block, style, scale);
+}
+
+void KeyboardView::paintEvent(QPaintEvent *event) {
+  ++painted;
+  // if (painted > 10) return;
+  // Nothing that's drawn every frame should allocate. What only happens when
+  // something's changed is let through, along with what Qt does regardless.
+  NoAllocations no_allocations("painting the keyboard view");
+  m_profiler.beginFrame(event->rect(), m_profiler_rect);
+  QPainter painter;
+  QRect visible;
+  {
+    // The painter's state is allocated each time it's begun, and the visible
+    // region is built up each time it's asked for.
+    NoAllocations::Allow allow;
+    painter.begin(this);
+    visible = visibleRegion().boundingRect();
+  }
+  Interval clockBounds = {
+      qint32(event->rect().left() * m_client->editState().scale.clockPerPx) -
+          WINDOW_BOUND_SLACK,
+      qint32(event->rect().right() * m_client->editState().scale.clockPerPx) +
+          WINDOW_BOUND_SLACK};
+
+  const Scale &scale = m_client->editState().scale;
+  m_background.draw(
+      painter, event->rect(), visible,
+      {scale.clockPerPx, scale.pitchPerPx,
+       qreal(m_pxtn->master->get_beat_num()),
+       qreal(m_pxtn->master->get_beat_clock()), qreal(m_dark)},
+      [this, &scale](QPainter &painter, const QRect &rect) {
+        drawBackground(painter, rect, m_pxtn->master, scale, m_dark);
+      });
+  m_profiler.mark(FrameProfiler::Background);
 
-  // Draw FPS
-  QPen pen;
-  pen.setBrush(Qt::white);
-  painter.setPen(pen);
   {
     int elapsed = m_timer->elapsed();
     if (elapsed >= 2000) {
       m_timer->restart();
-      int fps = painted * 1000 / elapsed;
       painted = 0;
-      emit fpsUpdated(fps);
     }
   }
 
-  // Set up drawing structures that we'll use while iterating through events
-  std::vector<DrawState> drawStates;
-  for (int i = 0; i < m_pxtn->Unit_Num(); ++i) drawStates.emplace_back();
-
-  painter.setPen(Qt::blue);
-
   int clock = m_moo_clock->now();
+  m_playhead_x = clock / m_client->editState().scale.clockPerPx;
 
   // Draw the note blocks! Upon hitting an event, see if we are able to draw a
   // previous block.
   // TODO: Draw the current unit at the top.
   std::optional<Interval> selection = std::nullopt;
-  std::set<int> selected_unit_nos = selectedUnitNos();
+  const std::vector<bool> &selected_units = selectedUnits();
   if (m_dark)
     painter.setCompositionMode(QPainter::CompositionMode_Plus);
   else
     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
   if (m_client->editState().mouse_edit_state.selection.has_value())
     selection = m_client->editState().mouse_edit_state.selection.value();
-  for (const EVERECORD *e = m_pxtn->evels->get_Records(); e != nullptr;
-       e = e->next) {
-    // if (e->clock > clockBounds.end) break;
-    int unit_no = e->unit_no;
-    qint32 unit_id = m_client->unitIdMap().noToId(unit_no);
-    DrawState &state = drawStates[unit_no];
-    const Brush &brush = brushes[unit_id % NUM_BRUSHES];
-    bool matchingUnit = (unit_id == m_client->editState().m_current_unit_id);
-    std::optional<Interval> thisSelection = std::nullopt;
-    if (selection.has_value() &&
-        selected_unit_nos.find(unit_no) != selected_unit_nos.end())
-      thisSelection = selection;
-    int alpha;
-    if (matchingUnit)
-      alpha = 255;
-    else if (m_pxtn->Unit_Get(unit_no)->get_visible())
-      alpha = 64;
-    else
-      alpha = 0;
-    bool muted = !m_pxtn->Unit_Get(unit_no)->get_played();
-    switch (e->kind) {
-      case EVENTKIND_ON:
-        // Draw the last block of the previous on event if there's one to
-        // draw.
-        if (state.ongoingOnEvent.has_value())
-          drawStateSegment(painter, state, {state.pitch.clock, e->clock},
-                           thisSelection, clockBounds, brush, alpha,
-                           m_client->editState().scale, clock,
-                           m_client->editState().mouse_edit_state, matchingUnit,
-                           muted, width());
-
-        state.ongoingOnEvent.emplace(Interval{e->clock, e->value + e->clock});
-        break;
-      case EVENTKIND_VELOCITY:
-        state.velocity.set(e);
-        break;
-      case EVENTKIND_KEY:
-        // Maybe draw the previous segment of the current on event.
-        if (state.ongoingOnEvent.has_value()) {
-          drawStateSegment(painter, state, {state.pitch.clock, e->clock},
-                           thisSelection, clockBounds, brush, alpha,
-                           m_client->editState().scale, clock,
-                           m_client->editState().mouse_edit_state, matchingUnit,
-                           muted, width());
-          if (e->clock > state.ongoingOnEvent.value().end)
-            state.ongoingOnEvent.reset();
-        }
-        state.pitch.set(e);
-        break;
-      default:
-        break;
-    }
+
+  // The unlit notes come from the tiles, which might be a frame or so behind.
+  // Draw the rest over them.
+  std::shared_ptr<const NoteEvents> previous_events = m_note_events;
+  std::shared_ptr<const NoteEvents> events = noteEvents();
+  std::shared_ptr<const NoteStyle> style = noteStyle(*events, scale);
+  // Edits can start or stop notes at the playhead. Not from in here, since it
+  // schedules repaints.
+  if (events != previous_events) {
+    NoAllocations::Allow allow;
+    QMetaObject::invokeMethod(this, &KeyboardView::updatePlayingNotes,
+                              Qt::QueuedConnection);
   }
+  if (m_note_tiles.draw(
+          painter, event->rect(), visible,
+          {scale.clockPerPx, scale.pitchPerPx, qreal(scale.pitchOffset)},
+          m_note_generation))
+    m_note_tiles.render(
+        [events, style, scale](QPainter &painter, const QRect &rect) {
+          drawNoteTile(painter, rect, *events, *style, scale);
+        });
+
+  auto drawNotes = [&](qint32 start, qint32 end, const Interval &bounds,
+                       bool drawPlayingRows) {
+    forEachSegment(
+        *events, start, end, m_draw_states,
+        [&](int unit_no, const DrawState &state, qint32 segment_end) {
+          qint32 unit_id = m_client->unitIdMap().noToId(unit_no);
+          const Brush &brush = brushes[unit_id % NUM_BRUSHES];
+          bool matchingUnit =
+              (unit_id == m_client->editState().m_current_unit_id);
+          std::optional<Interval> thisSelection = std::nullopt;
+          if (selection.has_value() && selected_units[unit_no])
+            thisSelection = selection;
+          int alpha;
+          if (matchingUnit)
+            alpha = 255;
+          else if (m_pxtn->Unit_Get(unit_no)->get_visible())
+            alpha = 64;
+          else
+            alpha = 0;
+          bool muted = !m_pxtn->Unit_Get(unit_no)->get_played();
+          drawStateSegment(painter, state, {state.pitch.clock, segment_end},
+                           thisSelection, bounds, brush, alpha, scale, clock,
+                           m_client->editState().mouse_edit_state,
+                           matchingUnit, muted, drawPlayingRows, width());
+        });
+  };
 
-  // After all the events there might be some blocks that are pending a draw.
-  for (uint unit_no = 0; unit_no < drawStates.size(); ++unit_no) {
-    if (drawStates[unit_no].ongoingOnEvent.has_value()) {
-      qint32 unit_id = m_client->unitIdMap().noToId(unit_no);
-      DrawState &state = drawStates[unit_no];
-      const Brush &brush = brushes[unit_id % NUM_BRUSHES];
-      bool matchingUnit = (unit_id == m_client->editState().m_current_unit_id);
-      int alpha;
-      if (matchingUnit)
-        alpha = 255;
-      else if (m_pxtn->Unit_Get(unit_no)->get_visible())
-        alpha = 64;
-      else
-        alpha = 0;
-      bool muted = !m_pxtn->Unit_Get(unit_no)->get_played();
-      std::optional<Interval> thisSelection = std::nullopt;
-      if (selection.has_value() &&
-          selected_unit_nos.find(unit_no) != selected_unit_nos.end())
-        thisSelection = selection;
-      drawStateSegment(
-          painter, state, {state.pitch.clock, state.ongoingOnEvent.value().end},
-          thisSelection, clockBounds, brush, alpha, m_client->editState().scale,
-          clock, m_client->editState().mouse_edit_state, matchingUnit, muted,
-          width());
-
-      state.ongoingOnEvent.reset();
-    }
+  // The rows of notes playing at the playhead are lit up across the whole
+  // view, even if the note isn't in it. That happens when a note's first block
+  // is drawn, so walk from the start of the earliest one to the playhead.
+  {
+    qint32 start = clock;
+    events->seek(clock, m_draw_states);
+    for (const DrawState &state : m_draw_states)
+      if (state.ongoingOnEvent.has_value() &&
+          state.ongoingOnEvent.value().end > clock)
+        start = std::min(start, state.ongoingOnEvent.value().start);
+    drawNotes(start, clock, Interval{clock, clock}, true);
   }
+  drawNotes(clockBounds.start, clockBounds.end, clockBounds, false);
+  m_profiler.mark(FrameProfiler::Content);
 
   // Draw selections & ongoing edits / selections / seeks
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      EditState adjusted_state(remote_state.state.value());
-      bool same_unit = adjusted_state.m_current_unit_id ==
-                       m_client->editState().m_current_unit_id;
-      double alphaMultiplier = (same_unit ? 0.7 : 0.3);
-      double selectionAlphaMultiplier = (same_unit ? 0.5 : 0.3);
-      adjusted_state.scale = m_client->editState().scale;
-
-      // TODO: colour other's existing selections (or identify somehow. maybe
-      // name tag?)
-      drawExistingSelection(painter, adjusted_state.mouse_edit_state,
-                            adjusted_state.scale.clockPerPx, height(),
-                            selectionAlphaMultiplier);
-      drawOngoingAction(adjusted_state, LocalEditState(m_pxtn, adjusted_state),
-                        painter, width(), height(), std::nullopt,
-                        m_pxtn->master, alphaMultiplier,
-                        selectionAlphaMultiplier);
-    }
+  const std::vector<RemoteOverlay> &remotes = m_client->remoteOverlays();
+  qint32 current_unit_id = m_client->editState().m_current_unit_id;
+  for (const RemoteOverlay &remote : remotes) {
+    bool same_unit = remote.state.m_current_unit_id == current_unit_id;
+    double alphaMultiplier = (same_unit ? 0.7 : 0.3);
+    double selectionAlphaMultiplier = (same_unit ? 0.5 : 0.3);
+    // Their quantization, but positioned according to our scale.
+    LocalEditState local(remote.quantize_clock, remote.quantize_pitch, scale);
+
+    // TODO: colour other's existing selections (or identify somehow. maybe
+    // name tag?)
+    drawExistingSelection(painter, remote.state.mouse_edit_state,
+                          scale.clockPerPx, height(),
+                          selectionAlphaMultiplier);
+    drawOngoingAction(remote.state, local, painter, width(), height(),
+                      std::nullopt, m_pxtn->master, alphaMultiplier,
+                      selectionAlphaMultiplier);
   }
+  m_profiler.mark(FrameProfiler::Remote);
   drawExistingSelection(painter, m_client->editState().mouse_edit_state,
                         m_client->editState().scale.clockPerPx, size().height(),
                         1);
   drawOngoingAction(m_client->editState(), m_edit_state, painter, width(),
                     height(), m_moo_clock->nowNoWrap(), m_pxtn->master, 1, 1);
   painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+  m_profiler.mark(FrameProfiler::Other);
 
   // Draw cursors
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      EditState state = remote_state.state.value();
-      state.scale =
-          m_client->editState().scale;  // Position according to our scale
-      int unit_id = state.m_current_unit_id;
-      // Draw cursor
-      QColor color = Qt::white;
-      if (unit_id != m_client->editState().m_current_unit_id)
-        color = brushes[unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY,
-                                                        false, 128);
-      drawCursor(state, painter, color, remote_state.user, uid);
+  if (m_remote_rects_stale) m_remote_rects.clear();
+  for (const RemoteOverlay &remote : remotes) {
+    if (m_remote_rects_stale) {
+      NoAllocations::Allow allow;
+      m_remote_rects[remote.uid] =
+          remoteEditStateRect(remote.state, scale, remote.user, remote.uid);
     }
+    int unit_id = remote.state.m_current_unit_id;
+    QColor color = Qt::white;
+    if (unit_id != current_unit_id)
+      color = brushes[unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY, false,
+                                                      128);
+    drawCursor(remote.state, scale, painter, color, remote.user, remote.uid);
   }
+  m_remote_rects_stale = false;
+  m_profiler.mark(FrameProfiler::Remote);
   {
-    QString my_username = "";
+    QString my_username;
     auto it = m_client->remoteEditStates().find(m_client->following_uid());
     if (it != m_client->remoteEditStates().end()) my_username = it->second.user;
-    drawCursor(m_client->editState(), painter, Qt::white, my_username,
+    drawCursor(m_client->editState(), scale, painter, Qt::white, my_username,
                m_client->following_uid());
   }
+  m_profiler.mark(FrameProfiler::Other);
 
   drawLastSeek(painter, m_client, height(), false);
   drawCurrentPlayerPosition(painter, m_moo_clock, height(),
                             m_client->editState().scale.clockPerPx, false);
   drawRepeatAndEndBars(painter, m_moo_clock,
                        m_client->editState().scale.clockPerPx, height());
+  m_profiler.mark(FrameProfiler::Playhead);
+  m_profiler.endFrame();
+  if (FrameProfiler::enabled()) {
+    NoAllocations::Allow allow;
+    m_profiler_rect =
+        FrameProfiler::drawOverlay(painter, visible);
+  }
+  {
+    // Only records anything while tracing latency.
+    NoAllocations::Allow allow;
+    m_client->notePainted();
+  }
 
   // Simulate activity on a client
   if (m_test_activity) {
+    NoAllocations::Allow allow;
     m_client->changeEditState(
         [&](EditState &e) {
           double period = 60;
@@ -888,14 +1424,23 @@ void KeyboardView::mouseReleaseEvent(QMouseEvent *event) {
       false);
 }
 
-std::set<int> KeyboardView::selectedUnitNos() {
-  std::set<int> unit_nos;
+const std::vector<bool> &KeyboardView::selectedUnits() {
+  m_selected_units.assign(m_pxtn->Unit_Num(), false);
   auto unit_no =
       m_client->unitIdMap().idToNo(m_client->editState().m_current_unit_id);
-  if (unit_no.has_value()) unit_nos.insert(unit_no.value());
+  if (unit_no.has_value() && unit_no.value() < m_pxtn->Unit_Num())
+    m_selected_units[unit_no.value()] = true;
 
   for (int i = 0; i < m_pxtn->Unit_Num(); ++i)
-    if (m_pxtn->Unit_Get(i)->get_operated()) unit_nos.insert(i);
+    if (m_pxtn->Unit_Get(i)->get_operated()) m_selected_units[i] = true;
+  return m_selected_units;
+}
+
+std::set<int> KeyboardView::selectedUnitNos() {
+  std::set<int> unit_nos;
+  const std::vector<bool> &selected = selectedUnits();
+  for (uint i = 0; i < selected.size(); ++i)
+    if (selected[i]) unit_nos.insert(i);
   return unit_nos;
 }
 
@@ -980,4 +1525,17 @@ void KeyboardView::paste(bool preserveFollow) {
       preserveFollow);
 }
 
-void KeyboardView::toggleDark() { m_dark = !m_dark; }
+void KeyboardView::toggleProfiler() {
+  FrameProfiler::setEnabled(!FrameProfiler::enabled());
+  if (FrameProfiler::enabled())
+    m_profiler_refresh->start();
+  else
+    m_profiler_refresh->stop();
+  update(m_profiler_rect);
+  update(FrameProfiler::overlayRect(visibleRegion().boundingRect()));
+}
+
+void KeyboardView::toggleDark() {
+  m_dark = !m_dark;
+  update();
+}
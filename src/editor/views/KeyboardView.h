@@ -4,11 +4,17 @@
 #include <QAudioOutput>
 #include <QElapsedTimer>
 #include <QScrollArea>
+#include <QTimer>
 #include <QWidget>
+#include <memory>
 #include <optional>
 
 #include "../EditState.h"
 #include "Animation.h"
+#include "AsyncTileCache.h"
+#include "BackgroundCache.h"
+#include "EventCheckpoints.h"
+#include "FrameProfiler.h"
 #include "MooClock.h"
 #include "editor/PxtoneClient.h"
 #include "editor/audio/NotePreview.h"
@@ -22,9 +28,151 @@ struct LocalEditState {
   LocalEditState(const pxtnService *pxtn, const EditState &s) {
     update(pxtn, s);
   };
+  LocalEditState(qint32 quantize_clock, qint32 quantize_pitch,
+                 const Scale &scale)
+      : m_quantize_clock(quantize_clock),
+        m_quantize_pitch(quantize_pitch),
+        scale(scale) {}
   void update(const pxtnService *pxtn, const EditState &s);
 };
 
+struct LastEvent {
+  int clock;
+  int value;
+
+  LastEvent(int value) : clock(0), value(value) {}
+
+  void set(EVERECORD const *e) {
+    clock = e->clock;
+    value = e->value;
+  }
+};
+
+// What a unit's notes look like at some point in the event list.
+struct DrawState {
+  LastEvent pitch;
+  LastEvent velocity;
+  std::optional<Interval> ongoingOnEvent;
+
+  DrawState()
+      : pitch(EVENTDEFAULT_KEY),
+        velocity(EVENTDEFAULT_VELOCITY),
+        ongoingOnEvent(std::nullopt) {}
+  void apply(const EVERECORD *e);
+};
+
+// How a run of events changes a unit's DrawState, whatever it was before, so
+// that runs can be summed up once and chained together.
+struct DrawStateChange {
+  // The state after the run, starting from the default.
+  DrawState after;
+  bool pitch_set;
+  bool velocity_set;
+  bool on_set;
+
+  DrawStateChange() : pitch_set(false), velocity_set(false), on_set(false) {}
+  void apply(const EVERECORD *e);
+  void applyTo(DrawState &state) const;
+};
+
+// A stretch of the note events, with checkpoints relative to whatever the
+// state is at its start. It's never modified once built, so a stretch that an
+// edit didn't touch is shared between snapshots instead of copied again.
+struct NoteRegion {
+  // Linked up in order. The last one's next is null, even if there are more
+  // events in the next region.
+  std::vector<EVERECORD> records;
+  EventCheckpoints<DrawStateChange> changes;
+  // What the whole region does to each unit.
+  std::vector<DrawStateChange> total;
+  // How many of the records are ON events.
+  size_t ons;
+
+  NoteRegion(std::vector<EVERECORD> records, int unit_num);
+  const EVERECORD *first() const {
+    return records.empty() ? nullptr : records.data();
+  }
+};
+
+// A copy of the events that notes are drawn from, so that they can be drawn
+// on worker threads while the song keeps changing under them.
+struct NoteEvents {
+  // Where a walk over the events starts.
+  struct Position {
+    size_t region;
+    const EVERECORD *first;
+  };
+
+  const pxtnEvelist *evels;
+  uint32_t revision;
+  int unit_num;
+  // ON events per clock, from the first note event to the last. Says how
+  // crowded the notes are at a given zoom.
+  double ons_per_clock;
+
+  // Compares the ON, KEY and VELOCITY events against [previous], if there is
+  // one, and only copies the regions that have changed.
+  NoteEvents(const pxtnService *pxtn, const NoteEvents *previous);
+  // Sets [states] to each unit's state at the last checkpoint at or before
+  // [clock]. Reuses its storage, so doesn't allocate in the steady state.
+  Position seek(qint32 clock, std::vector<DrawState> &states) const;
+  // Calls [fn] on each event from [from] on, in order, until one is after
+  // [end].
+  template <typename Fn>
+  void forEach(Position from, qint32 end, const Fn &fn) const {
+    for (size_t r = from.region;;) {
+      for (const EVERECORD *e = from.first; e != nullptr; e = e->next) {
+        if (e->clock > end) return;
+        fn(e);
+      }
+      if (++r == m_regions.size()) return;
+      from.first = m_regions[r].events->first();
+    }
+  }
+
+ private:
+  struct Region {
+    // Every event in the region is at or after [start], and before the next
+    // region's.
+    qint32 start;
+    std::shared_ptr<const NoteRegion> events;
+    // Each unit's state before the region.
+    std::vector<DrawState> states;
+  };
+  std::vector<Region> m_regions;
+};
+
+// Everything besides the events that changes how the unlit notes look.
+struct NoteStyle {
+  struct Unit {
+    qint32 id;
+    bool visible;
+    bool played;
+  };
+  bool dark;
+  qint32 current_unit_id;
+  std::vector<Unit> units;
+  // Whether notes are crowded enough at this zoom to be drawn as spans rather
+  // than block by block. Decided for the whole view, not each tile, so that
+  // neighbouring tiles don't switch at different points.
+  bool spans;
+};
+
+// A note that's lit up by the playhead. Its row is lit up too, at the pitch it
+// starts at, which is either side of any key event at its start.
+struct PlayingNote {
+  int unit_no;
+  Interval on;
+  int pitch_before;
+  int pitch_after;
+
+  bool operator==(const PlayingNote &o) const {
+    return unit_no == o.unit_no && on.start == o.on.start &&
+           on.end == o.on.end && pitch_before == o.pitch_before &&
+           pitch_after == o.pitch_after;
+  }
+};
+
 class KeyboardView : public QWidget {
   Q_OBJECT
  public:
@@ -36,10 +184,12 @@ class KeyboardView : public QWidget {
   void ensurePlayheadFollowed();
  signals:
   void ensureVisibleX(int x, bool strict);
-  void fpsUpdated(qreal fps);
 
  public slots:
   void toggleTestActivity();
+  // Shows or hides the frame time overlay, and starts or stops profiling all
+  // the views.
+  void toggleProfiler();
   void selectAll(bool preserveFollow);
   void transposeSelection(Direction dir, bool wide, bool shift);
   void cutSelection();
@@ -56,8 +206,25 @@ class KeyboardView : public QWidget {
   void paintEvent(QPaintEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
   void refreshQuantSettings();
+  // Each frame while the playhead's moving, repaints where it was and is, and
+  // the notes it's started or stopped playing.
+  void updatePlayhead();
+  void updatePlayingNotes();
+  void updateRow(int pitch);
+  void updateRemoteEditState(qint64 uid);
+  QRect remoteEditStateRect(const EditState &state, const Scale &scale,
+                            const QString &username, qint64 uid);
+  // The current note events and style. A new style bumps [m_note_generation],
+  // since it changes every tile, as does a new event list. Edits to the events
+  // only invalidate the tiles over the clocks they touched.
+  std::shared_ptr<const NoteEvents> noteEvents();
+  std::shared_ptr<const NoteStyle> noteStyle(const NoteEvents &events,
+                                             const Scale &scale);
   QSize sizeHint() const override;
   std::set<int> selectedUnitNos();
+  // The same, indexed by unit no. Kept in a member so that it's not rebuilt
+  // from scratch on every paint.
+  const std::vector<bool> &selectedUnits();
   const pxtnService *m_pxtn;
   QElapsedTimer *m_timer;
   int painted;
@@ -67,6 +234,28 @@ class KeyboardView : public QWidget {
   Animation *m_anim;
   PxtoneClient *m_client;
   MooClock *m_moo_clock;
+  BackgroundCache m_background;
+  std::shared_ptr<const NoteEvents> m_note_events;
+  std::shared_ptr<const NoteStyle> m_note_style;
+  quint64 m_note_generation;
+  AsyncTileCache m_note_tiles;
+  // What's on screen, so that when it changes the old spot can be repainted.
+  std::vector<PlayingNote> m_playing_notes;
+  // Reused by each updatePlayingNotes, which runs every frame while playing.
+  std::vector<PlayingNote> m_next_playing_notes;
+  std::vector<DrawState> m_playing_states;
+  std::vector<std::pair<int, int>> m_start_pitches;
+  std::map<qint64, QRect> m_remote_rects;
+  // Whether remote states or our scale have changed since [m_remote_rects]
+  // was worked out.
+  bool m_remote_rects_stale;
+  int m_playhead_x;
+  // Reused by each paint.
+  std::vector<DrawState> m_draw_states;
+  std::vector<bool> m_selected_units;
+  FrameProfiler m_profiler;
+  QTimer *m_profiler_refresh;
+  QRect m_profiler_rect;
 
   bool m_test_activity;
 };
@@ -14,28 +14,49 @@ MeasureView::MeasureView(PxtoneClient *client, MooClock *moo_clock,
       m_client(client),
       m_anim(new Animation(this)),
       m_moo_clock(moo_clock),
-      m_audio_note_preview(nullptr) {
+      m_audio_note_preview(nullptr),
+      m_profiler("measure"),
+      m_playhead_x(0) {
   setFocusPolicy(Qt::NoFocus);
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
   updateGeometry();
   setMouseTracking(true);
-  connect(m_anim, &Animation::nextFrame, [this]() { update(); });
+  connect(m_anim, &Animation::nextFrame, this, &MeasureView::updatePlayhead);
   connect(m_client, &PxtoneClient::editStateChanged,
           [this](const EditState &s) {
             if (!(m_last_scale == s.scale)) updateGeometry();
             m_last_scale = s.scale;
+            update();
+          });
+  connect(m_client, &PxtoneClient::playStateChanged,
+          [this]() { m_anim->setRunning(true); });
+  connect(m_client->controller(), &PxtoneController::seeked,
+          [this]() { update(); });
+  connect(m_client->controller(), &PxtoneController::editedClocks,
+          [this](const Interval &clocks) {
+            update(clockRect(clocks, m_client->editState().scale.clockPerPx,
+                             height(), WINDOW_BOUND_SLACK));
           });
   connect(m_client->controller(), &PxtoneController::measureNumChanged, this,
           &QWidget::updateGeometry);
+  for (auto signal : {&PxtoneController::endRefresh,
+                      &PxtoneController::tempoBeatChanged,
+                      &PxtoneController::measureNumChanged})
+    connect(m_client->controller(), signal, [this]() { update(); });
+  // Short enough to repaint whole when someone else moves.
+  connect(m_client, &PxtoneClient::remoteEditStateChanged,
+          [this]() { update(); });
+  for (auto signal :
+       {&PxtoneClient::endRemoveUser, &PxtoneClient::endUserListRefresh})
+    connect(m_client, signal, [this]() { update(); });
 }
 
-void drawCursor(const EditState &state, QPainter &painter, const QColor &color,
-                const QString &username, qint64 uid) {
+void drawCursor(const EditState &state, qreal clockPerPx, QPainter &painter,
+                const QColor &color, const QString &username, qint64 uid) {
   if (!std::holds_alternative<MouseMeasureEdit>(state.mouse_edit_state.kind))
     return;
   int y = std::get<MouseMeasureEdit>(state.mouse_edit_state.kind).y;
-  QPoint position(state.mouse_edit_state.current_clock / state.scale.clockPerPx,
-                  y);
+  QPoint position(state.mouse_edit_state.current_clock / clockPerPx, y);
   drawCursor(position, painter, color, username, uid);
 }
 
@@ -96,10 +117,10 @@ constexpr int UNIT_EDIT_OFFSET = 2;
 constexpr int RIBBON_HEIGHT =
     MEASURE_NUM_BLOCK_HEIGHT + RULER_HEIGHT + SEPARATOR_OFFSET;
 constexpr int UNIT_EDIT_Y = RIBBON_HEIGHT + UNIT_EDIT_OFFSET;
-void drawOngoingAction(const EditState &state, QPainter &painter, int height,
-                       int quantizeClock, int clockPerMeas,
-                       std::optional<int> nowNoWrap, const pxtnMaster *master,
-                       double alphaMultiplier,
+void drawOngoingAction(const EditState &state, qreal clockPerPx,
+                       QPainter &painter, int height, int quantizeClock,
+                       int clockPerMeas, std::optional<int> nowNoWrap,
+                       const pxtnMaster *master, double alphaMultiplier,
                        double selectionAlphaMultiplier) {
   const MouseEditState &mouse_edit_state = state.mouse_edit_state;
 
@@ -113,8 +134,7 @@ void drawOngoingAction(const EditState &state, QPainter &painter, int height,
   };
 
   {
-    Interval interval(mouse_edit_state.clock_int(quantizeClock) /
-                      state.scale.clockPerPx);
+    Interval interval(mouse_edit_state.clock_int(quantizeClock) / clockPerPx);
     qint32 velocity = qint32(round(mouse_edit_state.base_velocity));
     switch (mouse_edit_state.type) {
       case MouseEditState::Type::SetOn:
@@ -135,18 +155,17 @@ void drawOngoingAction(const EditState &state, QPainter &painter, int height,
             int meas = half_meas / 2;
             int left_half = half_meas % 2 == 1;
             drawFlag(&painter, (left_half ? FlagType::Repeat : FlagType::Last),
-                     true, meas * clockPerMeas / state.scale.clockPerPx,
-                     FLAG_Y);
+                     true, meas * clockPerMeas / clockPerPx, FLAG_Y);
           } else
             drawVelAction(interval, velocity, 96);
         }
         break;
       }
       case MouseEditState::Type::Seek:
-        drawPlayhead(
-            painter, mouse_edit_state.current_clock / state.scale.clockPerPx,
-            height, QColor::fromRgb(255, 255, 255, 128 * alphaMultiplier),
-            true);
+        drawPlayhead(painter, mouse_edit_state.current_clock / clockPerPx,
+                     height,
+                     QColor::fromRgb(255, 255, 255, 128 * alphaMultiplier),
+                     true);
         break;
       case MouseEditState::Type::Select: {
         drawSelection(painter, interval, height, selectionAlphaMultiplier);
@@ -158,10 +177,21 @@ void drawOngoingAction(const EditState &state, QPainter &painter, int height,
     const Input::State::On &v = state.m_input_state.value();
 
     for (const Interval &interval : v.clock_ints(nowNoWrap.value(), master))
-      drawVelAction(interval / state.scale.clockPerPx, v.on.vel, 255);
+      drawVelAction(interval / clockPerPx, v.on.vel, 255);
   }
 }
 
+void MeasureView::updatePlayhead() {
+  int x = m_moo_clock->now() / m_client->editState().scale.clockPerPx;
+  if (x != m_playhead_x) {
+    update(playheadRect(m_playhead_x, height()));
+    update(playheadRect(x, height()));
+  }
+  // The current unit's notes light up as they play.
+  update(0, UNIT_EDIT_Y, width(), UNIT_EDIT_HEIGHT);
+  m_anim->setRunning(m_client->isPlaying());
+}
+
 QSize MeasureView::sizeHint() const {
   return QSize(one_over_last_clock(m_client->pxtn()) /
                    m_client->editState().scale.clockPerPx,
@@ -172,47 +202,68 @@ const static QBrush measureBrush(Qt::white);
 const static QBrush beatBrush(QColor::fromRgb(128, 128, 128));
 const static QBrush unitEditBrush(QColor::fromRgb(64, 0, 112));
 const static QBrush measureNumBlockBrush(QColor::fromRgb(96, 96, 96));
-void MeasureView::paintEvent(QPaintEvent *e) {
-  const pxtnService *pxtn = m_client->pxtn();
 
-  QPainter painter(this);
-  painter.fillRect(0, 0, width(), height(), Qt::black);
+static void drawBackground(QPainter &painter, const QRect &rect,
+                           const pxtnMaster *master, int activeMeas,
+                           qreal clockPerPx, int height) {
+  painter.fillRect(rect, Qt::black);
 
   // Draw white lines under background
-  // TODO: Dedup with keyboardview
-  const pxtnMaster *master = pxtn->master;
   int clockPerMeas = master->get_beat_num() * master->get_beat_clock();
-  int activeMeas = std::max(master->get_last_meas(), master->get_meas_num());
-  qreal activeWidth =
-      activeMeas * clockPerMeas / m_client->editState().scale.clockPerPx;
+  int activeWidth = std::clamp(int(activeMeas * clockPerMeas / clockPerPx),
+                               rect.left(), rect.right() + 1);
   int lastMeasureDraw = -MEASURE_NUM_BLOCK_WIDTH - 1;
-  painter.fillRect(0, MEASURE_NUM_BLOCK_HEIGHT, activeWidth, RULER_HEIGHT,
+  painter.fillRect(rect.left(), MEASURE_NUM_BLOCK_HEIGHT,
+                   activeWidth - rect.left(), RULER_HEIGHT,
                    QColor::fromRgb(128, 0, 0));
-  painter.fillRect(activeWidth, MEASURE_NUM_BLOCK_HEIGHT, width() - activeWidth,
-                   RULER_HEIGHT, QColor::fromRgb(64, 0, 0));
-  painter.fillRect(0,
+  painter.fillRect(activeWidth, MEASURE_NUM_BLOCK_HEIGHT,
+                   rect.right() + 1 - activeWidth, RULER_HEIGHT,
+                   QColor::fromRgb(64, 0, 0));
+  painter.fillRect(rect.left(),
                    MEASURE_NUM_BLOCK_HEIGHT + RULER_HEIGHT + SEPARATOR_OFFSET,
-                   width(), 1, beatBrush);
+                   rect.width(), 1, beatBrush);
+  // Which measures get a number block depends on the ones before, so this
+  // starts from the top of the song but only draws what reaches [rect].
   for (int beat = 0; true; ++beat) {
-    int x = beat * master->get_beat_clock() /
-            m_client->editState().scale.clockPerPx;
-    if (x > width()) break;
+    int x = beat * master->get_beat_clock() / clockPerPx;
+    if (x > rect.right()) break;
+    bool visible = x + MEASURE_NUM_BLOCK_WIDTH >= rect.left();
     if (beat % master->get_beat_num() == 0) {
       int measure = beat / master->get_beat_num();
-      painter.fillRect(x, MEASURE_NUM_BLOCK_HEIGHT, 1, size().height(),
-                       measureBrush);
+      if (visible)
+        painter.fillRect(x, MEASURE_NUM_BLOCK_HEIGHT, 1, height, measureBrush);
       if (x - lastMeasureDraw < MEASURE_NUM_BLOCK_WIDTH) continue;
       lastMeasureDraw = x;
+      if (!visible) continue;
       painter.fillRect(x, 0, 1, MEASURE_NUM_BLOCK_HEIGHT, measureBrush);
       painter.fillRect(x + 1, 0, MEASURE_NUM_BLOCK_WIDTH,
                        MEASURE_NUM_BLOCK_HEIGHT, measureNumBlockBrush);
       if (measure < activeMeas)
-        drawNum(&painter, x + 1, 1, MEASURE_NUM_BLOCK_WIDTH - 1,
-                beat / master->get_beat_num());
-    } else
-      painter.fillRect(x, MEASURE_NUM_BLOCK_HEIGHT + RULER_HEIGHT, 1, height(),
+        drawNum(&painter, x + 1, 1, MEASURE_NUM_BLOCK_WIDTH - 1, measure);
+    } else if (visible)
+      painter.fillRect(x, MEASURE_NUM_BLOCK_HEIGHT + RULER_HEIGHT, 1, height,
                        beatBrush);
   }
+}
+
+void MeasureView::paintEvent(QPaintEvent *e) {
+  m_profiler.beginFrame(e->rect());
+  const pxtnService *pxtn = m_client->pxtn();
+
+  QPainter painter(this);
+  const pxtnMaster *master = pxtn->master;
+  int clockPerMeas = master->get_beat_num() * master->get_beat_clock();
+  int activeMeas = std::max(master->get_last_meas(), master->get_meas_num());
+  qreal clockPerPx = m_client->editState().scale.clockPerPx;
+  m_background.draw(
+      painter, e->rect(), visibleRegion().boundingRect(),
+      {clockPerPx, qreal(master->get_beat_num()),
+       qreal(master->get_beat_clock()), qreal(activeMeas), qreal(height())},
+      [this, master, activeMeas, clockPerPx](QPainter &painter,
+                                             const QRect &rect) {
+        drawBackground(painter, rect, master, activeMeas, clockPerPx,
+                       height());
+      });
   drawFlag(&painter, FlagType::Top, false, 0, FLAG_Y);
   if (m_moo_clock->repeat_clock() > 0) {
     drawFlag(
@@ -225,6 +276,7 @@ void MeasureView::paintEvent(QPaintEvent *e) {
              m_moo_clock->last_clock() / m_client->editState().scale.clockPerPx,
              FLAG_Y);
   }
+  m_profiler.mark(FrameProfiler::Background);
 
   // Draw on events
 
@@ -271,63 +323,57 @@ void MeasureView::paintEvent(QPaintEvent *e) {
     }
     drawLastOn();
   }
+  m_profiler.mark(FrameProfiler::Content);
 
   drawLastSeek(painter, m_client, height(), true);
+  m_playhead_x = m_moo_clock->now() / clockPerPx;
   drawCurrentPlayerPosition(painter, m_moo_clock, height(),
                             m_client->editState().scale.clockPerPx, true);
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      EditState adjusted_state(remote_state.state.value());
-      bool same_unit = adjusted_state.m_current_unit_id ==
-                       m_client->editState().m_current_unit_id;
-      double alphaMultiplier = (same_unit ? 0.7 : 0.3);
-      double selectionAlphaMultiplier = (same_unit ? 0.5 : 0.3);
-      adjusted_state.scale = m_client->editState().scale;
-
-      drawExistingSelection(painter, adjusted_state.mouse_edit_state,
-                            adjusted_state.scale.clockPerPx, height(),
-                            selectionAlphaMultiplier);
-      drawOngoingAction(
-          adjusted_state, painter, height(),
-          m_client->quantizeClock(
-              quantizeXOptions[adjusted_state.m_quantize_clock_idx].second),
-          clockPerMeas, std::nullopt, m_client->pxtn()->master, alphaMultiplier,
-          selectionAlphaMultiplier);
-    }
+  m_profiler.mark(FrameProfiler::Playhead);
+  const std::vector<RemoteOverlay> &remotes = m_client->remoteOverlays();
+  for (const RemoteOverlay &remote : remotes) {
+    bool same_unit = remote.state.m_current_unit_id == unit_id;
+    double alphaMultiplier = (same_unit ? 0.7 : 0.3);
+    double selectionAlphaMultiplier = (same_unit ? 0.5 : 0.3);
+
+    drawExistingSelection(painter, remote.state.mouse_edit_state, clockPerPx,
+                          height(), selectionAlphaMultiplier);
+    drawOngoingAction(remote.state, clockPerPx, painter, height(),
+                      remote.quantize_clock, clockPerMeas, std::nullopt,
+                      master, alphaMultiplier, selectionAlphaMultiplier);
   }
+  m_profiler.mark(FrameProfiler::Remote);
   drawExistingSelection(painter, m_client->editState().mouse_edit_state,
                         m_client->editState().scale.clockPerPx, height(), 1);
-  drawOngoingAction(m_client->editState(), painter, height(),
+  drawOngoingAction(m_client->editState(), clockPerPx, painter, height(),
                     m_client->quantizeClock(), clockPerMeas,
                     m_moo_clock->nowNoWrap(), m_client->pxtn()->master, 1, 1);
+  m_profiler.mark(FrameProfiler::Other);
 
   // Draw cursors
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      EditState state = remote_state.state.value();
-      if (state.current_param_kind_idx() !=
-          m_client->editState().current_param_kind_idx())
-        continue;
-      state.scale =
-          m_client->editState().scale;  // Position according to our scale
-      int unit_id = state.m_current_unit_id;
-      QColor color = Qt::white;
-      if (unit_id != m_client->editState().m_current_unit_id)
-        color = brushes[unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY,
-                                                        false, 128);
-      drawCursor(state, painter, color, remote_state.user, uid);
-    }
+  int current_param_kind_idx = m_client->editState().current_param_kind_idx();
+  for (const RemoteOverlay &remote : remotes) {
+    if (remote.state.current_param_kind_idx() != current_param_kind_idx)
+      continue;
+    int remote_unit_id = remote.state.m_current_unit_id;
+    QColor color = Qt::white;
+    if (remote_unit_id != unit_id)
+      color = brushes[remote_unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY,
+                                                             false, 128);
+    // Positioned according to our scale.
+    drawCursor(remote.state, clockPerPx, painter, color, remote.user,
+               remote.uid);
   }
+  m_profiler.mark(FrameProfiler::Remote);
 
   {
     QString my_username = "";
     auto it = m_client->remoteEditStates().find(m_client->following_uid());
     if (it != m_client->remoteEditStates().end()) my_username = it->second.user;
-    drawCursor(m_client->editState(), painter, Qt::white, my_username,
-               m_client->following_uid());
+    drawCursor(m_client->editState(), clockPerPx, painter, Qt::white,
+               my_username, m_client->following_uid());
   }
+  m_profiler.endFrame();
 }
 
 static void updateStatePositions(EditState &edit_state,
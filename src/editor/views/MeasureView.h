@@ -5,6 +5,8 @@
 #include <QWidget>
 
 #include "Animation.h"
+#include "BackgroundCache.h"
+#include "FrameProfiler.h"
 #include "MooClock.h"
 #include "editor/PxtoneClient.h"
 #include "editor/audio/NotePreview.h"
@@ -17,6 +19,10 @@ class MeasureView : public QWidget {
   Scale m_last_scale;
   MooClock *m_moo_clock;
   std::unique_ptr<NotePreview> m_audio_note_preview;
+  BackgroundCache m_background;
+  FrameProfiler m_profiler;
+  // Where the playhead was last drawn.
+  int m_playhead_x;
 
   void paintEvent(QPaintEvent *event) override;
   void mousePressEvent(QMouseEvent *event) override;
@@ -24,6 +30,7 @@ class MeasureView : public QWidget {
   void mouseMoveEvent(QMouseEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
   QSize sizeHint() const override;
+  void updatePlayhead();
 
  public:
   explicit MeasureView(PxtoneClient *client, MooClock *moo_clock,
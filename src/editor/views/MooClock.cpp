@@ -1,70 +1,60 @@
 #include "MooClock.h"
 
+#include <algorithm>
+
+#include "editor/audio/AudioFormat.h"
+
+// How far past the output's last update to guess. Enough to cover the gaps
+// between updates, but not so much that the playhead runs off if the output
+// stalls.
+constexpr qint64 MAX_GUESS_USECS = 100000;
+
 MooClock::MooClock(PxtoneClient *client)
     : QObject(client),
       m_client(client),
-      m_prev_clock(0),
-      m_prev_moo_clock(0),
       m_this_seek(0),
-      m_this_seek_caught_up(false) {
+      m_this_seek_caught_up(false),
+      m_this_seek_byte(0),
+      m_last_processed_usecs(0),
+      m_played_usecs(0) {
+  m_since_processed.start();
   connect(m_client->controller(), &PxtoneController::seeked, [this](int clock) {
     m_this_seek = clock;
     m_this_seek_caught_up = false;
-    m_prev_clock = 0;
+    m_this_seek_byte = m_client->audioDevice()->bytesHandedOver();
   });
 }
 
 int MooClock::nowNoWrap() {
-  int clock = m_client->pxtn()->moo_get_now_clock(*m_client->moo());
-
-  // Some really hacky magic to get the playhead smoother given that
-  // there's a ton of buffering that makes it hard to actually tell where the
-  // playhead is accurately. We do this:
-  // 1. Subtract the buffer duration.
-  // 2. Track how long since the last (laggy) clock update and add.
-  // 3. Works most of the time, but leads to a wrong clock after a seek or at
-  // the end of a song, because it'll put the playhead before the repeat or
-  // the seek position.
-  // 4. To account for this, if we're before the current seek position, clamp
-  // to seek position. Also track if we've looped and render at the end of
-  // song instead of before repeat if so.
-  // 5. The tracking if we've looped or not is also necessary to tell if we've
-  // actually caught up to a seek.
-
-  // Additionally, to cover midi input, we can no longer tolerate the cursor
-  // flicking around occasionally. So, now we only allow nonmonotonic movement
-  // if the moo time changed.
-
-  int bytes_per_second = 4 * 44100;  // bytes in sample * bytes per second
-  if (m_prev_moo_clock != clock) {
-    m_prev_moo_clock = clock;
-    timeSinceLastClock.restart();
+  // As the output plays, its count only goes up, except when it's restarted.
+  qint64 usecs = m_client->audioState()->processedUSecs();
+  if (usecs != m_last_processed_usecs) {
+    if (usecs < m_last_processed_usecs) {
+      m_played_usecs = 0;
+      m_this_seek_byte = 0;
+    }
+    m_last_processed_usecs = usecs;
+    m_since_processed.restart();
   }
+  // Our guess since the last update might've been a bit ahead of it, so
+  // don't go back.
+  qint64 guess =
+      std::min(m_since_processed.nsecsElapsed() / 1000, MAX_GUESS_USECS);
+  m_played_usecs = std::max(m_played_usecs, usecs + guess);
+  QAudioFormat format = pxtoneAudioFormat();
+  qint64 byte = m_played_usecs * format.sampleRate() / 1000000 *
+                format.bytesPerFrame();
 
-  int64_t offset_from_buffer =
-      m_client->audioState()->bufferSize();  // - m_audio_output->bytesFree()
-
-  double estimated_buffer_offset =
-      -offset_from_buffer / double(bytes_per_second);
-  if (!m_client->isPlaying())
-    timeSinceLastClock.restart();
-  else
-    estimated_buffer_offset += timeSinceLastClock.elapsed() / 1000.0;
-  clock += (last_clock() - repeat_clock()) * m_client->moo()->num_loop;
-
-  const pxtnMaster *master = m_client->pxtn()->master;
-  clock += std::min(estimated_buffer_offset, 0.0) * master->get_beat_tempo() *
-           master->get_beat_clock() / 60;
-  // Forces monotonicity
-  if (clock < m_prev_clock)
-    clock = m_prev_clock;
-  else
-    m_prev_clock = clock;
+  if (byte >= m_this_seek_byte) m_this_seek_caught_up = true;
+  if (!m_this_seek_caught_up) return m_this_seek;
 
-  if (clock >= m_this_seek) m_this_seek_caught_up = true;
-  if (!m_this_seek_caught_up) clock = m_this_seek;
+  std::optional<PxtoneIODevice::Position> position =
+      m_client->audioDevice()->positionAt(byte);
+  if (position.has_value()) return position.value().clock;
 
-  return clock;
+  // Nothing's been played since the output started.
+  return m_client->pxtn()->moo_get_now_clock(*m_client->moo()) +
+         (last_clock() - repeat_clock()) * m_client->moo()->num_loop;
 }
 
 int MooClock::now() {
@@ -6,15 +6,22 @@
 
 #include "editor/PxtoneClient.h"
 
-// A bunch of things to give the illusion of a smooth playhead when there's a
-// buffer.
+// Where the playhead is in what's actually being heard, which is behind where
+// pxtone's rendered up to by however much is buffered.
 class MooClock : public QObject {
   Q_OBJECT
 
   PxtoneClient *m_client;
-  int m_prev_clock, m_prev_moo_clock, m_this_seek;
+  int m_this_seek;
   bool m_this_seek_caught_up;
-  QElapsedTimer timeSinceLastClock;
+  // What was handed to the output before the last seek. Until it's been
+  // played, the playhead waits at the seek.
+  qint64 m_this_seek_byte;
+  // The output only says how much it's played every so often, so in between,
+  // go by how long it's been since it last did.
+  qint64 m_last_processed_usecs;
+  QElapsedTimer m_since_processed;
+  qint64 m_played_usecs;
 
  public:
   explicit MooClock(PxtoneClient *client);
@@ -0,0 +1,32 @@
+#include "NoAllocations.h"
+
+#ifdef PTCOLLAB_CHECK_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+// What the innermost NoAllocations is checking, if any.
+static thread_local const char *forbidden = nullptr;
+static thread_local int allowed = 0;
+
+void *operator new(std::size_t size) {
+  if (forbidden != nullptr && allowed == 0) {
+    const char *what = forbidden;
+    // qFatal might allocate itself.
+    forbidden = nullptr;
+    qFatal("Allocated %zu bytes while %s", size, what);
+  }
+  if (size == 0) size = 1;
+  if (void *p = std::malloc(size)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+NoAllocations::NoAllocations(const char *what) : m_outer(forbidden) {
+  forbidden = what;
+}
+NoAllocations::~NoAllocations() { forbidden = m_outer; }
+NoAllocations::Allow::Allow() { ++allowed; }
+NoAllocations::Allow::~Allow() { --allowed; }
+#endif
@@ -0,0 +1,38 @@
+#ifndef NOALLOCATIONS_H
+#define NOALLOCATIONS_H
+
+#include <QtGlobal>
+
+// Forbids heap allocations on this thread while it's alive, so that a paint
+// can be held to not churning the heap. Only does anything in builds
+// configured with CONFIG+=check_allocations, which replaces operator new for
+// the whole program. There, an allocation that isn't under an Allow aborts
+// with [what], so a debugger stops right where it happened. That covers
+// standard containers and most of Qt's private data, but not the malloc'd
+// buffers behind QString and friends.
+class NoAllocations {
+ public:
+  // Lets this thread allocate again while it's alive, for work that only
+  // happens when something's changed, or that Qt does and we can't avoid.
+  class Allow {
+   public:
+#ifdef PTCOLLAB_CHECK_ALLOCATIONS
+    Allow();
+    ~Allow();
+#else
+    Allow() {}
+#endif
+  };
+
+#ifdef PTCOLLAB_CHECK_ALLOCATIONS
+  explicit NoAllocations(const char *what);
+  ~NoAllocations();
+
+ private:
+  const char *m_outer;
+#else
+  explicit NoAllocations(const char *) {}
+#endif
+};
+
+#endif  // NOALLOCATIONS_H
@@ -3,6 +3,7 @@
 #include <QPaintEvent>
 #include <QPainter>
 #include <QPainterPath>
+#include <algorithm>
 
 #include "ViewHelper.h"
 #include "editor/ComboOptions.h"
@@ -15,19 +16,47 @@ ParamView::ParamView(PxtoneClient *client, MooClock *moo_clock, QWidget *parent)
       m_moo_clock(moo_clock),
       m_audio_note_preview(nullptr),
       m_woice_menu(new QMenu(this)),
-      m_last_woice_menu_preview_id(-1) {
+      m_last_woice_menu_preview_id(-1),
+      m_profiler("param"),
+      m_playhead_x(0) {
   setFocusPolicy(Qt::StrongFocus);
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
   updateGeometry();
   setMouseTracking(true);
-  connect(m_anim, &Animation::nextFrame, [this]() { update(); });
+  connect(m_anim, &Animation::nextFrame, this, &ParamView::updatePlayhead);
   connect(m_client, &PxtoneClient::editStateChanged,
           [this](const EditState &s) {
             if (!(m_last_scale == s.scale)) updateGeometry();
             m_last_scale = s.scale;
+            update();
+          });
+  connect(m_client, &PxtoneClient::playStateChanged,
+          [this]() { m_anim->setRunning(true); });
+  connect(m_client->controller(), &PxtoneController::seeked,
+          [this]() { update(); });
+  connect(m_client->controller(), &PxtoneController::editedClocks,
+          [this](const Interval &clocks) {
+            update(clockRect(clocks, m_client->editState().scale.clockPerPx,
+                             height(), WINDOW_BOUND_SLACK));
           });
   connect(m_client->controller(), &PxtoneController::measureNumChanged, this,
           &QWidget::updateGeometry);
+  for (auto signal :
+       {&PxtoneController::endRefresh, &PxtoneController::tempoBeatChanged,
+        &PxtoneController::soloToggled})
+    connect(m_client->controller(), signal, [this]() { update(); });
+  for (auto signal :
+       {&PxtoneController::playedToggled, &PxtoneController::visibleToggled})
+    connect(m_client->controller(), signal, [this]() { update(); });
+  // Remote cursors could be anywhere in the param range, and the view isn't
+  // tall, so just repaint it.
+  connect(m_client, &PxtoneClient::remoteEditStateChanged,
+          [this]() { update(); });
+  for (auto signal :
+       {&PxtoneClient::endRemoveUser, &PxtoneClient::endUserListRefresh})
+    connect(m_client, signal, [this]() { update(); });
+  connect(m_client->clipboard(), &Clipboard::copyKindsSet,
+          [this]() { update(); });
   connect(m_woice_menu, &QMenu::hovered, [this](QAction *action) {
     bool ok = true;
     int id = action->data().toInt(&ok);
@@ -60,6 +89,15 @@ ParamView::ParamView(PxtoneClient *client, MooClock *moo_clock, QWidget *parent)
   });
 }
 
+void ParamView::updatePlayhead() {
+  int x = m_moo_clock->now() / m_client->editState().scale.clockPerPx;
+  if (x != m_playhead_x) {
+    update(playheadRect(m_playhead_x, height()));
+    update(playheadRect(x, height()));
+  }
+  m_anim->setRunning(m_client->isPlaying());
+}
+
 QSize ParamView::sizeHint() const {
   return QSize(one_over_last_clock(m_client->pxtn()) /
                    m_client->editState().scale.clockPerPx,
@@ -105,15 +143,15 @@ static qreal paramOfY(int y, EVENTKIND current_kind, int height, bool snap) {
   }
 }
 
-void drawCursor(const EditState &state, QPainter &painter, const QColor &color,
-                const QString &username, qint64 uid, EVENTKIND current_kind,
-                int height) {
+void drawCursor(const EditState &state, qreal clockPerPx, QPainter &painter,
+                const QColor &color, const QString &username, qint64 uid,
+                EVENTKIND current_kind, int height) {
   if (!std::holds_alternative<MouseParamEdit>(state.mouse_edit_state.kind))
     return;
   const auto &param_edit_state =
       std::get<MouseParamEdit>(state.mouse_edit_state.kind);
   QPoint position(
-      state.mouse_edit_state.current_clock / state.scale.clockPerPx,
+      state.mouse_edit_state.current_clock / clockPerPx,
       paramToY(param_edit_state.current_param, current_kind, height));
   drawCursor(position, painter, color, username, uid);
 }
@@ -172,6 +210,7 @@ struct Event {
 constexpr int32_t lineHeight = 4;
 constexpr int32_t lineWidth = 2;
 constexpr int32_t tailRowHeight = 8;
+constexpr int32_t stepSlackPx = 64;
 static void drawLastVoiceNoEvent(QPainter &painter, int height,
                                  const Event &last, const Event &curr,
                                  qreal clockPerPx, const QColor &onColor,
@@ -282,169 +321,189 @@ static void drawOngoingEdit(QPainter &painter, const MouseEditState &state,
     } break;
   }
 }
-void ParamView::paintEvent(QPaintEvent *event) {
-  const pxtnService *pxtn = m_client->pxtn();
-  Interval clockBounds = {
-      qint32(event->rect().left() * m_client->editState().scale.clockPerPx) -
-          WINDOW_BOUND_SLACK,
-      qint32(event->rect().right() * m_client->editState().scale.clockPerPx) +
-          WINDOW_BOUND_SLACK};
-  QPainter painter(this);
-  painter.fillRect(0, 0, size().width(), size().height(), Qt::black);
+
+static void drawBackground(QPainter &painter, const QRect &rect,
+                           const pxtnMaster *master, qreal clockPerPx,
+                           int height) {
+  painter.fillRect(rect, Qt::black);
 
   // Draw white lines under background
-  // TODO: Dedup with keyboardview
-  QBrush beatBrush(QColor::fromRgb(128, 128, 128));
-  QBrush measureBrush(Qt::white);
-  const pxtnMaster *master = pxtn->master;
-  for (int beat = 0; true; ++beat) {
-    bool isMeasureLine = (beat % master->get_beat_num() == 0);
-    int x = master->get_beat_clock() * beat /
-            m_client->editState().scale.clockPerPx;
-    if (x > size().width()) break;
-    painter.fillRect(x, 0, 1, size().height(),
-                     (isMeasureLine ? measureBrush : beatBrush));
-  }
+  drawBeatLines(painter, rect, master, clockPerPx);
 
   // Draw param background
   for (int i = 0; i < NUM_BACKGROUND_GAPS - 1; ++i) {
-    int this_y = BACKGROUND_GAPS[i] * size().height() / 0x80;
-    int next_y = BACKGROUND_GAPS[i + 1] * size().height() / 0x80;
-    painter.fillRect(0, this_y + 1, size().width(),
+    int this_y = BACKGROUND_GAPS[i] * height / 0x80;
+    int next_y = BACKGROUND_GAPS[i + 1] * height / 0x80;
+    painter.fillRect(rect.left(), this_y + 1, rect.width(),
                      std::max(1, next_y - this_y - 2), *GAP_COLORS[i]);
   }
+}
 
-  EVENTKIND current_kind =
-      paramOptions[m_client->editState().current_param_kind_idx()].second;
+void ParamSteps::refresh(const pxtnService *pxtn) {
+  if (pxtn->evels == m_evels && pxtn->evels->get_Revision() == m_revision &&
+      pxtn->Unit_Num() == m_unit_num)
+    return;
+  m_evels = pxtn->evels;
+  m_revision = pxtn->evels->get_Revision();
+  m_unit_num = pxtn->Unit_Num();
 
-  QPixmap thisUnit(event->rect().size());
-  thisUnit.fill(Qt::transparent);
-  int current_unit_no = 0;
+  for (auto &units : kinds) {
+    units.resize(m_unit_num);
+    for (auto &steps : units) steps.clear();
+  }
+  for (const EVERECORD *e = pxtn->evels->get_Records(); e != nullptr;
+       e = e->next) {
+    if (e->kind >= EVENTKIND_NUM || e->unit_no >= m_unit_num) continue;
+    std::vector<Step> &steps = kinds[e->kind][e->unit_no];
+    qint32 reach = e->clock;
+    // Tails are drawn as a bar from their clock, rather than up to it.
+    if (Evelist_Kind_IsTail(e->kind)) reach += e->value;
+    if (!steps.empty()) reach = std::max(reach, steps.back().reach);
+    steps.push_back({e->clock, e->value, reach});
+  }
+}
+
+void ParamView::paintEvent(QPaintEvent *event) {
+  m_profiler.beginFrame(event->rect());
+  const pxtnService *pxtn = m_client->pxtn();
   qreal clockPerPx = m_client->editState().scale.clockPerPx;
-  QPainter thisUnitPainter(&thisUnit);
-  {
-    thisUnitPainter.translate(-event->rect().topLeft());
-    std::vector<QColor> colors;
-    std::vector<Event> lastEvents;
-    std::vector<QPainter *> painters;
-    colors.reserve(m_client->pxtn()->Unit_Num());
-    painters.reserve(m_client->pxtn()->Unit_Num());
-    lastEvents.reserve(m_client->pxtn()->Unit_Num());
-    for (int i = 0; i < m_client->pxtn()->Unit_Num(); ++i) {
-      lastEvents.emplace_back(Event{-1000, DefaultKindValue(current_kind)});
-      int unit_id = m_client->unitIdMap().noToId(i);
-      colors.push_back(
-          brushes[nonnegative_modulo(unit_id, NUM_BRUSHES)].toQColor(108, false,
-                                                                     255));
-      int h, s, l, a;
-      colors.rbegin()->getHsl(&h, &s, &l, &a);
-      if (m_client->editState().m_current_unit_id != unit_id) {
-        if (m_client->pxtn()->Unit_Get(i)->get_visible())
-          a *= 0.3;
-        else
-          a *= 0;
-        painters.push_back(&painter);
-      } else {
-        painters.push_back(&thisUnitPainter);
-        current_unit_no = i;
-      }
-      colors.rbegin()->setHsl(h, s, l * 3 / 4, a);
-    }
+  Interval clockBounds = {
+      qint32(event->rect().left() * clockPerPx) - WINDOW_BOUND_SLACK,
+      qint32(event->rect().right() * clockPerPx) + WINDOW_BOUND_SLACK};
+  QPainter painter(this);
+  const pxtnMaster *master = pxtn->master;
+  m_background.draw(painter, event->rect(), visibleRegion().boundingRect(),
+                    {clockPerPx, qreal(master->get_beat_num()),
+                     qreal(master->get_beat_clock()), qreal(height())},
+                    [this, master, clockPerPx](QPainter &painter,
+                                               const QRect &rect) {
+                      drawBackground(painter, rect, master, clockPerPx,
+                                     height());
+                    });
+  m_profiler.mark(FrameProfiler::Background);
 
-    for (const EVERECORD *e = pxtn->evels->get_Records(); e != nullptr;
-         e = e->next) {
-      if (e->clock > clockBounds.end) break;
-      if (e->kind != current_kind) continue;
-      int unit_no = e->unit_no;
+  EVENTKIND current_kind =
+      paramOptions[m_client->editState().current_param_kind_idx()].second;
 
-      Event curr{e->clock, e->value};
-      if (current_kind != EVENTKIND_VOICENO)
-        drawLastEvent(*painters[unit_no], current_kind, height(),
-                      lastEvents[unit_no], curr, clockPerPx, colors[unit_no],
-                      unit_no - current_unit_no, m_client->pxtn()->Unit_Num());
-      else if (unit_no == current_unit_no)
-        drawLastVoiceNoEvent(*painters[unit_no], height(), lastEvents[unit_no],
-                             curr, clockPerPx, colors[unit_no],
-                             m_client->pxtn());
-      lastEvents[unit_no] = curr;
+  // Draw the current unit last, so that it's over the others along with its
+  // ongoing edits.
+  const NoIdMap &unit_ids = m_client->unitIdMap();
+  int unit_num = pxtn->Unit_Num();
+  qint32 current_unit_id = m_client->editState().m_current_unit_id;
+  int current_unit_no = unit_ids.idToNo(current_unit_id).value_or(0);
+  m_steps.refresh(pxtn);
+  // Group numbers are drawn to the right of their step, so start a bit before
+  // the view in case one of them pokes into it.
+  qint32 first_clock = (event->rect().left() - stepSlackPx) * clockPerPx;
+  auto drawUnit = [&](int unit_no) {
+    int unit_id = unit_ids.noToId(unit_no);
+    QColor color =
+        brushes[nonnegative_modulo(unit_id, NUM_BRUSHES)].toQColor(108, false,
+                                                                   255);
+    int h, s, l, a;
+    color.getHsl(&h, &s, &l, &a);
+    if (current_unit_id != unit_id) {
+      if (pxtn->Unit_Get(unit_no)->get_visible())
+        a *= 0.3;
+      else
+        a *= 0;
     }
-    for (int unit_no = 0; unit_no < m_client->pxtn()->Unit_Num(); ++unit_no) {
-      Event curr = lastEvents[unit_no];
-      curr.clock = (width() + 50) * clockPerPx;
+    color.setHsl(h, s, l * 3 / 4, a);
+    if (current_kind == EVENTKIND_VOICENO && unit_no != current_unit_no)
+      return;
+
+    auto drawStep = [&](const Event &last, const Event &curr) {
       if (current_kind != EVENTKIND_VOICENO)
-        drawLastEvent(*painters[unit_no], current_kind, height(),
-                      lastEvents[unit_no], curr, clockPerPx, colors[unit_no],
-                      unit_no - current_unit_no, m_client->pxtn()->Unit_Num());
-      else if (unit_no == current_unit_no)
-        drawLastVoiceNoEvent(*painters[unit_no], height(), lastEvents[unit_no],
-                             curr, clockPerPx, colors[unit_no],
-                             m_client->pxtn());
+        drawLastEvent(painter, current_kind, height(), last, curr, clockPerPx,
+                      color, unit_no - current_unit_no, unit_num);
+      else
+        drawLastVoiceNoEvent(painter, height(), last, curr, clockPerPx, color,
+                             pxtn);
+    };
+    const std::vector<ParamSteps::Step> &steps =
+        m_steps.kinds[current_kind][unit_no];
+    auto it = std::partition_point(steps.begin(), steps.end(),
+                                   [&](const ParamSteps::Step &step) {
+                                     return step.reach < first_clock;
+                                   });
+    Event last{-1000, DefaultKindValue(current_kind)};
+    if (it != steps.begin())
+      last = {std::prev(it)->clock, std::prev(it)->value};
+    for (; it != steps.end() && it->clock <= clockBounds.end; ++it) {
+      Event curr{it->clock, it->value};
+      drawStep(last, curr);
+      last = curr;
     }
-  }
+    drawStep(last, {qint32((width() + 50) * clockPerPx), last.value});
+  };
 
   // draw ongoing edit
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      const EditState &state = remote_state.state.value();
-      if (state.current_param_kind_idx() !=
-          m_client->editState().current_param_kind_idx())
-        continue;
-      QPainter *this_painter = &thisUnitPainter;
-      double alphaMultiplier = 0.7, selectionAlphaMultiplier = 0.5;
-      if (state.m_current_unit_id != m_client->editState().m_current_unit_id) {
-        alphaMultiplier = 0.3;
-        selectionAlphaMultiplier = 0.3;
-        this_painter = &painter;
-      }
-      int unit_no = m_client->unitIdMap()
-                        .idToNo(state.m_current_unit_id)
-                        .value_or(current_unit_no);
+  int current_param_kind_idx = m_client->editState().current_param_kind_idx();
+  const std::vector<RemoteOverlay> &remotes = m_client->remoteOverlays();
+  auto drawRemoteEdits = [&](bool same_unit) {
+    for (const RemoteOverlay &remote : remotes) {
+      const EditState &state = remote.state;
+      if (state.current_param_kind_idx() != current_param_kind_idx) continue;
+      if ((state.m_current_unit_id == current_unit_id) != same_unit) continue;
+      double alphaMultiplier = (same_unit ? 0.7 : 0.3);
+      double selectionAlphaMultiplier = (same_unit ? 0.5 : 0.3);
+      int unit_no =
+          unit_ids.idToNo(state.m_current_unit_id).value_or(current_unit_no);
       // TODO: be able to see others' param selections too.
-      drawOngoingEdit(*this_painter, state.mouse_edit_state, current_kind,
-                      m_client->quantizeClock(), clockPerPx, height(),
+      drawOngoingEdit(painter, state.mouse_edit_state, current_kind,
+                      remote.quantize_clock, clockPerPx, height(),
                       alphaMultiplier, selectionAlphaMultiplier,
                       unit_no - current_unit_no);
     }
-  }
-  painter.drawPixmap(event->rect(), thisUnit, thisUnit.rect());
+  };
+
+  for (int unit_no = 0; unit_no < unit_num; ++unit_no)
+    if (unit_ids.noToId(unit_no) != current_unit_id) drawUnit(unit_no);
+  m_profiler.mark(FrameProfiler::Content);
+  drawRemoteEdits(false);
+  m_profiler.mark(FrameProfiler::Remote);
+  if (current_unit_no < unit_num &&
+      unit_ids.noToId(current_unit_no) == current_unit_id)
+    drawUnit(current_unit_no);
+  m_profiler.mark(FrameProfiler::Content);
+  drawRemoteEdits(true);
+  m_profiler.mark(FrameProfiler::Remote);
 
   if (m_client->clipboard()->kindIsCopied(current_kind))
     drawExistingSelection(painter, m_client->editState().mouse_edit_state,
                           clockPerPx, size().height(), 1);
   drawOngoingEdit(painter, m_client->editState().mouse_edit_state, current_kind,
                   m_client->quantizeClock(), clockPerPx, height(), 1, 1, 0);
+  m_profiler.mark(FrameProfiler::Other);
 
   drawLastSeek(painter, m_client, height(), false);
+  m_playhead_x = m_moo_clock->now() / clockPerPx;
   drawCurrentPlayerPosition(painter, m_moo_clock, height(), clockPerPx, false);
   drawRepeatAndEndBars(painter, m_moo_clock, clockPerPx, height());
+  m_profiler.mark(FrameProfiler::Playhead);
 
   // Draw cursors
-  for (const auto &[uid, remote_state] : m_client->remoteEditStates()) {
-    if (uid == m_client->following_uid() || uid == m_client->uid()) continue;
-    if (remote_state.state.has_value()) {
-      EditState state = remote_state.state.value();
-      if (state.current_param_kind_idx() !=
-          m_client->editState().current_param_kind_idx())
-        continue;
-      state.scale =
-          m_client->editState().scale;  // Position according to our scale
-      int unit_id = state.m_current_unit_id;
-      QColor color = Qt::white;
-      if (unit_id != m_client->editState().m_current_unit_id)
-        color = brushes[unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY,
-                                                        false, 128);
-      drawCursor(state, painter, color, remote_state.user, uid, current_kind,
-                 height());
-    }
+  for (const RemoteOverlay &remote : remotes) {
+    if (remote.state.current_param_kind_idx() != current_param_kind_idx)
+      continue;
+    int unit_id = remote.state.m_current_unit_id;
+    QColor color = Qt::white;
+    if (unit_id != current_unit_id)
+      color = brushes[unit_id % NUM_BRUSHES].toQColor(EVENTMAX_VELOCITY, false,
+                                                      128);
+    // Positioned according to our scale.
+    drawCursor(remote.state, clockPerPx, painter, color, remote.user,
+               remote.uid, current_kind, height());
   }
+  m_profiler.mark(FrameProfiler::Remote);
   {
     QString my_username = "";
     auto it = m_client->remoteEditStates().find(m_client->following_uid());
     if (it != m_client->remoteEditStates().end()) my_username = it->second.user;
-    drawCursor(m_client->editState(), painter, Qt::white, my_username,
-               m_client->following_uid(), current_kind, height());
+    drawCursor(m_client->editState(), clockPerPx, painter, Qt::white,
+               my_username, m_client->following_uid(), current_kind, height());
   }
+  m_profiler.endFrame();
 }
 
 // TODO: DEDUP
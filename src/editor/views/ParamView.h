@@ -3,12 +3,38 @@
 
 #include <QMenu>
 #include <QWidget>
+#include <array>
+#include <vector>
 
 #include "Animation.h"
+#include "BackgroundCache.h"
+#include "FrameProfiler.h"
 #include "MooClock.h"
 #include "editor/PxtoneClient.h"
 #include "editor/audio/NotePreview.h"
 
+// Every unit's events of every kind, split out of the event list, so that a
+// paint can jump to the first one in view instead of walking the whole list.
+// Rebuilt (reusing its storage) whenever the list changes.
+struct ParamSteps {
+  struct Step {
+    qint32 clock;
+    qint32 value;
+    // The furthest clock that this or any earlier step of the unit draws up
+    // to, which only goes up, so it can be searched for the first in view.
+    qint32 reach;
+  };
+  // Indexed by kind, then unit no.
+  std::array<std::vector<std::vector<Step>>, EVENTKIND_NUM> kinds;
+
+  void refresh(const pxtnService *pxtn);
+
+ private:
+  const pxtnEvelist *m_evels = nullptr;
+  uint32_t m_revision = 0;
+  int m_unit_num = -1;
+};
+
 class ParamView : public QWidget {
   Q_OBJECT
 
@@ -20,6 +46,11 @@ class ParamView : public QWidget {
   QMenu *m_woice_menu;
   int m_last_woice_menu_preview_id;
   QElapsedTimer m_last_woice_menu_preview_time;
+  BackgroundCache m_background;
+  ParamSteps m_steps;
+  FrameProfiler m_profiler;
+  // Where the playhead was last drawn.
+  int m_playhead_x;
 
   void paintEvent(QPaintEvent *event) override;
   void mousePressEvent(QMouseEvent *event) override;
@@ -27,6 +58,7 @@ class ParamView : public QWidget {
   void mouseMoveEvent(QMouseEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
   QSize sizeHint() const override;
+  void updatePlayhead();
 
  public:
   explicit ParamView(PxtoneClient *client, MooClock *moo_clock,
@@ -1,13 +1,29 @@
 #include "ViewHelper.h"
 
+#include <QFontMetrics>
 #include <QWheelEvent>
+#include <algorithm>
 
 #include "editor/ComboOptions.h"
+#include "NoAllocations.h"
 #include "editor/Settings.h"
 #include "pxtone/pxtnEvelist.h"
 
+static QString cursorLabel(const QString &username, qint64 uid) {
+  return QString("%1 (%2)").arg(username).arg(uid);
+}
+
+const QFont &textFont() {
+  static QFont font("Sans serif", Settings::TextSize::get());
+  if (font.pointSize() != Settings::TextSize::get())
+    font.setPointSize(Settings::TextSize::get());
+  return font;
+}
+
 void drawCursor(const QPoint &position, QPainter &painter, const QColor &color,
                 const QString &username, qint64 uid) {
+  // Both the path and the label's layout are allocated each time.
+  NoAllocations::Allow allow;
   QPainterPath path;
   path.moveTo(position);
   path.lineTo(position + QPoint(8, 0));
@@ -15,9 +31,15 @@ void drawCursor(const QPoint &position, QPainter &painter, const QColor &color,
   path.closeSubpath();
   painter.fillPath(path, color);
   painter.setPen(color);
-  painter.setFont(QFont("Sans serif", Settings::TextSize::get()));
-  painter.drawText(position + QPoint(8, 13),
-                   QString("%1 (%2)").arg(username).arg(uid));
+  painter.setFont(textFont());
+  painter.drawText(position + QPoint(8, 13), cursorLabel(username, uid));
+}
+
+QRect cursorRect(const QPoint &position, const QString &username, qint64 uid) {
+  QRect text = QFontMetrics(textFont())
+                   .boundingRect(cursorLabel(username, uid))
+                   .translated(position + QPoint(8, 13));
+  return QRect(position, QSize(9, 9)).united(text).adjusted(-1, -1, 1, 1);
 }
 
 QColor halfWhite(QColor::fromRgb(255, 255, 255, 128));
@@ -28,6 +50,7 @@ void drawPlayhead(QPainter &painter, qint32 x, qint32 height, QColor color,
   int s = 0;
   if (drawHead) {
     s = 4;
+    NoAllocations::Allow allow;
     QPainterPath path;
     path.moveTo(x - s, 0);
     path.lineTo(x + s, 0);
@@ -38,6 +61,20 @@ void drawPlayhead(QPainter &painter, qint32 x, qint32 height, QColor color,
   painter.fillRect(x, s, 1, height, color);
 }
 
+QRect playheadRect(qint32 x, qint32 height) {
+  return QRect(x - 4, 0, 9, height);
+}
+
+QRect clockRect(const Interval &clocks, qreal clockPerPx, int height,
+                int margin) {
+  // Clocks can be unbounded, so keep clear of overflowing.
+  auto toX = [clockPerPx](qint32 clock) {
+    return int(std::clamp(clock / clockPerPx, -1e8, 1e8));
+  };
+  return QRect(QPoint(toX(clocks.start) - margin, 0),
+               QPoint(toX(clocks.end) + margin, height - 1));
+}
+
 void drawCurrentPlayerPosition(QPainter &painter, MooClock *moo_clock,
                                int height, qreal clockPerPx, bool drawHead) {
   QColor color =
@@ -65,6 +102,21 @@ void drawRepeatAndEndBars(QPainter &painter, const MooClock *moo_clock,
                    halfWhite);
 }
 
+void drawBeatLines(QPainter &painter, const QRect &rect,
+                   const pxtnMaster *master, qreal clockPerPx) {
+  QBrush beatBrush(QColor::fromRgb(128, 128, 128));
+  QBrush measureBrush(Qt::white);
+  int firstBeat =
+      std::max(0, int(rect.left() * clockPerPx / master->get_beat_clock()) - 1);
+  for (int beat = firstBeat; true; ++beat) {
+    bool isMeasureLine = (beat % master->get_beat_num() == 0);
+    int x = master->get_beat_clock() * beat / clockPerPx;
+    if (x > rect.right()) break;
+    painter.fillRect(x, rect.top(), 1, rect.height(),
+                     (isMeasureLine ? measureBrush : beatBrush));
+  }
+}
+
 void handleWheelEventWithModifier(QWheelEvent *event, PxtoneClient *client) {
   if (event->modifiers() & Qt::ControlModifier) {
     bool shift = event->modifiers() & Qt::ShiftModifier;
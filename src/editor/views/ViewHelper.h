@@ -7,16 +7,29 @@
 
 #include "MooClock.h"
 
+// The font for text in the views, at the current text size. It's kept rather
+// than made each time, since a new QFont is an allocation.
+extern const QFont &textFont();
 extern void drawCursor(const QPoint &position, QPainter &painter,
                        const QColor &color, const QString &username,
                        qint64 uid);
+// Where drawCursor draws, for repainting just that.
+extern QRect cursorRect(const QPoint &position, const QString &username,
+                        qint64 uid);
 extern void drawCurrentPlayerPosition(QPainter &painter, MooClock *moo_clock,
                                       int height, qreal clockPerPx,
                                       bool drawHead);
 extern void drawPlayhead(QPainter &painter, qint32 x, qint32 height,
                          QColor color, bool drawHead);
+extern QRect playheadRect(qint32 x, qint32 height);
+// A full-height strip over [clocks], [margin] px wider on each side.
+extern QRect clockRect(const Interval &clocks, qreal clockPerPx, int height,
+                       int margin);
 extern void drawLastSeek(QPainter &painter, const PxtoneClient *client,
                          qint32 height, bool drawHead);
+// The beat and measure lines under the keyboard and param views, in [rect].
+extern void drawBeatLines(QPainter &painter, const QRect &rect,
+                          const pxtnMaster *master, qreal clockPerPx);
 extern void drawRepeatAndEndBars(QPainter &painter, const MooClock *moo_clock,
                                  qreal clockPerPx, int height);
 extern void handleWheelEventWithModifier(QWheelEvent *event,
@@ -3,6 +3,7 @@
 #include <QFile>
 #include <QSettings>
 #include <QStyleFactory>
+#include <QThread>
 
 #include "editor/EditorWindow.h"
 #include "editor/Settings.h"
@@ -115,6 +116,65 @@ int main(int argc, char *argv[]) {
       QCoreApplication::translate("main", "Just run a server with no editor."));
   parser.addOption(headlessOption);
 
+  QCommandLineOption startAtOption(
+      QStringList() << "start-at",
+      QCoreApplication::translate(
+          "main", "With --headless, start playing a recording <secs> in."),
+      QCoreApplication::translate("main", "secs"));
+  parser.addOption(startAtOption);
+
+  QCommandLineOption playbackSpeedOption(
+      QStringList() << "playback-speed",
+      QCoreApplication::translate(
+          "main",
+          "With --headless, play a recording back at <speed> times real time, "
+          "or 'max' for as fast as possible."),
+      QCoreApplication::translate("main", "speed"));
+  parser.addOption(playbackSpeedOption);
+
+  QCommandLineOption threadsOption(
+      QStringList() << "threads",
+      QCoreApplication::translate(
+          "main",
+          "With --headless, handle connections on <n> threads (default: one "
+          "per core, 0 to use the main thread)."),
+      QCoreApplication::translate("main", "n"));
+  parser.addOption(threadsOption);
+
+  QCommandLineOption latencyOption(
+      QStringList() << "latency-json",
+      QCoreApplication::translate(
+          "main",
+          "Time how long actions take at each stage between clients and the "
+          "server, and periodically write the stats to <file>."),
+      QCoreApplication::translate("main", "file"));
+  parser.addOption(latencyOption);
+
+  QCommandLineOption profileFramesOption(
+      QStringList() << "profile-frames",
+      QCoreApplication::translate(
+          "main",
+          "Once the file's loaded, play it with the frame profiler on, then "
+          "write the frame times to <csv> and quit."),
+      QCoreApplication::translate("main", "csv"));
+  parser.addOption(profileFramesOption);
+
+  QCommandLineOption profileNotesOption(
+      QStringList() << "profile-notes",
+      QCoreApplication::translate(
+          "main",
+          "With --profile-frames, first replace the song's notes with <n> "
+          "generated ones, two events each."),
+      QCoreApplication::translate("main", "n"));
+  parser.addOption(profileNotesOption);
+
+  QCommandLineOption profileSecsOption(
+      QStringList() << "profile-secs",
+      QCoreApplication::translate(
+          "main", "With --profile-frames, play for <secs> (default: 10)."),
+      QCoreApplication::translate("main", "secs"));
+  parser.addOption(profileSecsOption);
+
   parser.addPositionalArgument(
       "file",
       QCoreApplication::translate("main", "Load this file when starting."),
@@ -186,11 +246,56 @@ int main(int argc, char *argv[]) {
   qInstallMessageHandler(messageHandler);
 
   if (parser.isSet(headlessOption)) {
-    BroadcastServer s(filename, host, port, recording_file);
+    int threads = QThread::idealThreadCount();
+    QString threadsStr = parser.value(threadsOption);
+    if (threadsStr != "") {
+      bool ok;
+      threads = threadsStr.toInt(&ok);
+      if (!ok || threads < 0) qFatal("Could not parse thread count");
+    }
+    BroadcastServer s(filename, host, port, recording_file, nullptr, 0, 0,
+                      threads);
+    QString startAtStr = parser.value(startAtOption);
+    if (startAtStr != "") {
+      bool ok;
+      double start_at = startAtStr.toDouble(&ok);
+      if (!ok) qFatal("Could not parse start time");
+      if (!s.seekRecording(start_at * 1000))
+        qFatal("Can only start partway into a .ptrec recording");
+    }
+    QString playbackSpeedStr = parser.value(playbackSpeedOption);
+    if (playbackSpeedStr != "") {
+      double speed = PLAYBACK_AS_FAST_AS_POSSIBLE;
+      if (playbackSpeedStr != "max") {
+        bool ok;
+        speed = playbackSpeedStr.toDouble(&ok);
+        if (!ok) qFatal("Could not parse playback speed");
+      }
+      if (!s.setPlaybackSpeed(speed))
+        qFatal("Can only set the playback speed of a .ptrec recording");
+    }
+    if (parser.isSet(latencyOption))
+      s.setLatencyStatsFile(parser.value(latencyOption));
     return a.exec();
   } else {
     EditorWindow w;
     w.show();
+    if (parser.isSet(latencyOption)) w.traceLatency(parser.value(latencyOption));
+    if (parser.isSet(profileFramesOption)) {
+      int notes = 0;
+      if (parser.isSet(profileNotesOption)) {
+        bool ok;
+        notes = parser.value(profileNotesOption).toInt(&ok);
+        if (!ok || notes < 0) qFatal("Could not parse --profile-notes");
+      }
+      double secs = 10;
+      if (parser.isSet(profileSecsOption)) {
+        bool ok;
+        secs = parser.value(profileSecsOption).toDouble(&ok);
+        if (!ok || secs <= 0) qFatal("Could not parse --profile-secs");
+      }
+      w.profileFrames(parser.value(profileFramesOption), notes, secs);
+    }
     if (startServerImmediately)
       w.hostDirectly(filename, host, port, recording_file, username);
     return a.exec();
@@ -1,6 +1,60 @@
 #include "AbstractServerSession.h"
 
+#include <QDebug>
+#include <QThread>
+#include <limits>
+
 AbstractServerSession::AbstractServerSession(qint64 uid, QObject *parent)
     : QObject(parent), m_uid(uid) {}
 
 qint64 AbstractServerSession::uid() const { return m_uid; }
+
+void AbstractServerSession::sendEncodedAction(const ServerAction &action,
+                                              const QByteArray &) {
+  sendAction(action);
+}
+
+OutboundQueueStats AbstractServerSession::outboundQueueStats() const {
+  return {};
+}
+
+void AbstractServerSession::setWoiceStore(const QString &dir) {
+  m_woice_store.emplace(dir, std::numeric_limits<qint64>::max());
+}
+
+void AbstractServerSession::sendWoice(const QByteArray &hash) {
+  if (QThread::currentThread() != thread()) {
+    QMetaObject::invokeMethod(
+        this, [this, hash]() { sendWoice(hash); }, Qt::QueuedConnection);
+    return;
+  }
+  std::optional<QByteArray> woice;
+  if (m_woice_store.has_value()) woice = m_woice_store->getTrusted(hash);
+  if (!woice.has_value())
+    qWarning() << "u" << uid() << "asked for unknown woice" << hash.toHex();
+  sendAction({uid(), WoiceData{hash, woice.value_or(QByteArray())}});
+}
+
+QList<ServerAction> AbstractServerSession::withWoices(
+    const QList<ServerAction> &history,
+    const QSet<QByteArray> &by_hash) const {
+  // Only detached from the server's copy if there's something to change.
+  QList<ServerAction> filled = history;
+  for (int i = 0; i < history.size(); ++i) {
+    const AddWoice *w = addedWoice(history.at(i));
+    if (w == nullptr || w->hash.isEmpty()) continue;
+    if (by_hash.contains(w->hash)) {
+      if (!w->data.isEmpty()) addedWoice(filled[i])->data.clear();
+      continue;
+    }
+    if (!w->data.isEmpty()) continue;
+    std::optional<QByteArray> data;
+    if (m_woice_store.has_value()) data = m_woice_store->getTrusted(w->hash);
+    if (!data.has_value()) {
+      qWarning() << "Stored woice" << w->hash.toHex() << "is missing";
+      continue;
+    }
+    addedWoice(filled[i])->data = data.value();
+  }
+  return filled;
+}
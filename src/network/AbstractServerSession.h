@@ -1,25 +1,65 @@
 #ifndef ABSTRACTSERVERSESSION_H
 #define ABSTRACTSERVERSESSION_H
 
+#include <QSet>
+#include <memory>
+#include <optional>
+
+#include "WoiceCache.h"
 #include "protocol/Data.h"
+#include "protocol/ProjectTransfer.h"
 #include "protocol/RemoteAction.h"
+
+// Snapshot of what's waiting to go out to a session's client.
+struct OutboundQueueStats {
+  int queued_messages = 0;
+  qint64 queued_bytes = 0;
+  // Largest [queued_bytes] seen over the session's life.
+  qint64 peak_bytes = 0;
+  // Unreliable messages that were replaced by a newer one before being sent.
+  qint64 collapsed = 0;
+};
+
 class AbstractServerSession : public QObject {
   Q_OBJECT
  public:
   AbstractServerSession(qint64 uid, QObject *parent);
-  virtual void sendHello(const QByteArray &file,
+  virtual void sendHello(const std::shared_ptr<const PreparedProject> &project,
                          const QList<ServerAction> &history,
                          const QMap<qint64, QString> &sessions) = 0;
   virtual void sendAction(const ServerAction &action) = 0;
+  // Same as sendAction, but lets a broadcast serialize [action] once for all
+  // sessions. [encoded] must be ServerSession::encode(action).
+  virtual void sendEncodedAction(const ServerAction &action,
+                                 const QByteArray &encoded);
   virtual QString username() const = 0;
+  // woiceHash()es of the woices the client said it has, which don't need
+  // sending in the hello. Set by the time receivedHello is emitted.
+  virtual QSet<QByteArray> cachedWoices() const { return {}; }
+  // Where the server keeps the data of added woices, which the history it
+  // hands over only has the hashes of. Set before the session moves threads.
+  void setWoiceStore(const QString &dir);
+  // Answers a FetchWoice. The woice is read on the session's own thread.
+  void sendWoice(const QByteArray &hash);
+  // Safe to call from any thread.
+  virtual OutboundQueueStats outboundQueueStats() const;
   qint64 uid() const;
  signals:
-  void receivedAction(const ClientAction &action, qint64 uid);
+  // [timing] is set if the client is tracing latency.
+  void receivedAction(const ClientAction &action, qint64 uid,
+                      const std::optional<ActionTiming> &timing);
   void receivedHello();
   void disconnected();
 
+ protected:
+  // [history] with the data of added woices filled back in from the store,
+  // except for those in [by_hash], which go by hash only.
+  QList<ServerAction> withWoices(const QList<ServerAction> &history,
+                                 const QSet<QByteArray> &by_hash) const;
+
  private:
   qint64 m_uid;
+  std::optional<WoiceCache> m_woice_store;
 };
 
 #endif  // ABSTRACTSERVERSESSION_H
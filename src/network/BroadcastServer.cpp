@@ -3,31 +3,40 @@
 #include <QDataStream>
 #include <QDateTime>
 #include <QFileInfo>
-#include <QMessageBox>
 #include <QTcpSocket>
 #include <QTimer>
+#include <cmath>
 
 #include "protocol/Hello.h"
+#include "protocol/Recording.h"
 
 const static QString NEXT_UID_KEY("next_uid");
-const static double playback_speed = 1;
+constexpr int BACKLOG_REPORT_INTERVAL_MS = 10000;
+constexpr int LATENCY_DUMP_INTERVAL_MS = 10000;
 const static qint64 offset = 0;
-
-constexpr qint64 RECORDING_VERSION = 1;
+// How long playback can hog the event loop before letting sockets etc. run.
+constexpr qint64 MAX_PLAYBACK_BATCH_MS = 20;
 
 BroadcastServer::BroadcastServer(std::optional<QString> filename,
                                  QHostAddress host, int port,
                                  std::optional<QString> save_history,
                                  QObject *parent, int delay_msec,
-                                 double drop_rate)
+                                 double drop_rate, int worker_threads)
     : QObject(parent),
       m_server(new QTcpServer(this)),
+      m_workers(nullptr),
       m_sessions(),
+      // It's all needed for as long as the session runs, so no size limit.
+      m_woice_store(m_woice_dir.path(), std::numeric_limits<qint64>::max()),
       m_next_uid(0),
       m_delay_msec(delay_msec),
       m_drop_rate(drop_rate),
       m_load_history(nullptr),
+      m_playback_from(0),
+      m_playback_speed(1),
+      m_played_actions(0),
       m_save_history(nullptr) {
+  QByteArray data;
   if (filename.has_value()) {
     QFile *file = new QFile(filename.value(), this);
     if (!file->open(QIODevice::ReadOnly | QIODevice::ExistingOnly))
@@ -35,60 +44,36 @@ BroadcastServer::BroadcastServer(std::optional<QString> filename,
 
     m_history_elapsed.restart();
     if (QFileInfo(filename.value()).suffix() == "ptrec") {
-      m_load_history = std::make_unique<QDataStream>(file);
-      qint64 protocol_version, recording_version;
-      *m_load_history >> protocol_version >> recording_version;
-      if (protocol_version != PROTOCOL_VERSION ||
-          recording_version != RECORDING_VERSION)
-        throw QString("Incompatible recording version. %1.%2 (%3.%4)")
-            .arg(protocol_version)
-            .arg(recording_version)
-            .arg(PROTOCOL_VERSION)
-            .arg(RECORDING_VERSION);
-      *m_load_history >> m_next_uid >> m_data;
+      m_load_history = std::make_unique<RecordingReader>(file);
+      m_next_uid = m_load_history->nextUid();
+      data = m_load_history->data();
 
       m_timer = new QTimer(this);
       m_timer->setSingleShot(true);
-      qint64 elapsed;
-      *m_load_history >> elapsed;
-      m_timer->start(elapsed / playback_speed + offset);
-      connect(m_timer, &QTimer::timeout, [this]() {
-        qint64 interval = 0;
-        while (interval <= 0) {
-          if (m_load_history->atEnd()) {
-            qWarning() << "Unexpected end of recording";
-            return;
-          }
-
-          ServerAction a;
-          *m_load_history >> a;
-          broadcastServerAction(a);
-
-          if (m_load_history->atEnd()) {
-            qDebug() << "At end of recording";
-            return;
-          }
-
-          qint64 next_elapsed;
-          *m_load_history >> next_elapsed;
-          interval = next_elapsed / playback_speed + offset -
-                     m_history_elapsed.elapsed();
-        }
-        m_timer->start(interval);
-      });
+      connect(m_timer, &QTimer::timeout, this,
+              &BroadcastServer::playRecording);
+      m_playback_clock.start();
+      m_playback_wall_time.start();
+      scheduleRecording();
     } else {
-      m_data = file->readAll();
+      data = file->readAll();
       file->deleteLater();
     }
   }
 
-  if (save_history.has_value()) {
-    QString name = save_history.value() + ".tmp";
-    QFile *file = new QFile(name, this);
-    m_save_history_filename = save_history.value();
-    if (!file->open(QIODevice::ReadWrite))
-      throw tr("Unable to open %1 for writing").arg(name);
-    m_save_history = std::make_unique<QDataStream>(file);
+  // Split and compressed up front so that it's done once rather than for each
+  // client that connects.
+  m_project = std::make_shared<const PreparedProject>(data);
+
+  if (save_history.has_value())
+    m_save_history = std::make_unique<RecordingWriter>(save_history.value(),
+                                                       m_next_uid, data);
+
+  if (worker_threads > 0) {
+    qRegisterMetaType<ClientAction>();
+    qRegisterMetaType<std::optional<ActionTiming>>();
+    m_workers = new SessionThreadPool(worker_threads, this);
+    qInfo() << "Handling sessions on" << m_workers->size() << "threads";
   }
 
   if (!m_server->listen(host, port))
@@ -98,10 +83,115 @@ BroadcastServer::BroadcastServer(std::optional<QString> filename,
           << m_server->serverPort();
   connect(m_server, &QTcpServer::newConnection, this,
           &BroadcastServer::newClient);
+
+  QTimer *backlog_timer = new QTimer(this);
+  connect(backlog_timer, &QTimer::timeout, this,
+          &BroadcastServer::reportBacklogs);
+  backlog_timer->start(BACKLOG_REPORT_INTERVAL_MS);
 }
 
 bool BroadcastServer::isReadingHistory() { return m_load_history != nullptr; }
 
+bool BroadcastServer::seekRecording(qint64 elapsed) {
+  if (!m_load_history) return false;
+  // Anyone already connected has seen the recording up to now, and there's
+  // no way to rewind them.
+  if (!m_sessions.empty()) {
+    qWarning() << "Cannot seek a recording with sessions connected";
+    return false;
+  }
+  m_timer->stop();
+  m_next_recorded.reset();
+  RecordingPosition position = m_load_history->seek(elapsed);
+  // Clients start from the checkpoint's project, if there was one.
+  if (position.data != m_project->data())
+    m_project = std::make_shared<const PreparedProject>(position.data);
+  m_history = std::move(position.history);
+  for (ServerAction &a : m_history) rememberWoice(a);
+  m_playback_from = elapsed;
+  m_playback_clock.restart();
+  qInfo() << "Seeked recording to" << elapsed << "ms," << m_history.size()
+          << "actions in history";
+  scheduleRecording();
+  return true;
+}
+
+bool BroadcastServer::setPlaybackSpeed(double speed) {
+  if (!m_load_history) return false;
+  if (!(speed > 0)) {
+    qWarning() << "Invalid playback speed" << speed;
+    return false;
+  }
+  if (m_next_recorded.has_value()) {
+    // Carry on from wherever playback has got to at the old speed.
+    qint64 next_elapsed = m_next_recorded->first;
+    if (std::isinf(m_playback_speed))
+      m_playback_from = next_elapsed;
+    else
+      m_playback_from = std::min(
+          next_elapsed,
+          m_playback_from +
+              qint64(m_playback_clock.elapsed() * m_playback_speed));
+    m_playback_clock.restart();
+    m_playback_speed = speed;
+    m_timer->start(std::max(qint64(0), playbackInterval(next_elapsed)));
+  } else
+    m_playback_speed = speed;
+  return true;
+}
+
+qint64 BroadcastServer::playbackInterval(qint64 recorded_elapsed) const {
+  return (recorded_elapsed - m_playback_from) / m_playback_speed + offset -
+         m_playback_clock.elapsed();
+}
+
+bool BroadcastServer::readNextRecorded() {
+  qint64 elapsed;
+  ServerAction a;
+  if (!m_load_history->next(elapsed, a)) {
+    qInfo() << "At end of recording. Played" << m_played_actions
+            << "actions in" << m_playback_wall_time.elapsed() << "ms";
+    emit playbackFinished();
+    return false;
+  }
+  m_next_recorded = std::make_pair(elapsed, a);
+  return true;
+}
+
+void BroadcastServer::scheduleRecording() {
+  if (!readNextRecorded()) return;
+  m_timer->start(
+      std::max(qint64(0), playbackInterval(m_next_recorded->first)));
+}
+
+void BroadcastServer::playRecording() {
+  // Play everything that's due in one go, without formatting each action for
+  // the log, which would otherwise dominate at high speeds.
+  QElapsedTimer batch_time;
+  batch_time.start();
+  int batch_size = 0;
+  while (m_next_recorded.has_value()) {
+    broadcastServerAction(m_next_recorded->second, false);
+    m_next_recorded.reset();
+    ++m_played_actions;
+    ++batch_size;
+
+    if (!readNextRecorded()) return;
+    qint64 interval = playbackInterval(m_next_recorded->first);
+    if (interval > 0) {
+      m_timer->start(interval);
+      break;
+    }
+    if (batch_time.elapsed() >= MAX_PLAYBACK_BATCH_MS) {
+      m_timer->start(0);
+      break;
+    }
+  }
+  if (batch_size > 1)
+    qDebug() << "Played back" << batch_size << "actions in"
+             << batch_time.elapsed() << "ms";
+}
+
 const std::list<AbstractServerSession *> &BroadcastServer::sessions() const {
   return m_sessions;
 }
@@ -117,27 +207,36 @@ BroadcastServer::~BroadcastServer() {
 
 void BroadcastServer::finalizeSaveHistory() {
   if (!m_save_history) return;
-  QFile final_file(m_save_history_filename);
-  if (!final_file.open(QIODevice::WriteOnly)) {
-    qWarning() << "Cannot open" << m_save_history_filename
-               << "for saving recording";
+  m_save_history->setNextUid(m_next_uid);
+  if (!m_save_history->finalize()) {
+    qWarning() << "Error finalizing recording";
     return;
   }
+  qDebug() << "Finalized save history successfully";
+}
 
-  QDataStream stream(&final_file);
-  stream << PROTOCOL_VERSION << RECORDING_VERSION << m_next_uid << m_data;
-
-  constexpr int SIZE = 4096;
-  char buf[SIZE];
-  m_save_history->device()->seek(0);
-  while (!m_save_history->atEnd()) {
-    int read_size = m_save_history->readRawData(buf, SIZE);
-    stream.writeRawData(buf, read_size);
+void BroadcastServer::reportBacklogs() {
+  for (const AbstractServerSession *s : m_sessions) {
+    OutboundQueueStats stats = s->outboundQueueStats();
+    if (stats.queued_messages == 0) continue;
+    qInfo() << "Outbound backlog for u" << s->uid() << ":"
+            << stats.queued_messages << "messages," << stats.queued_bytes
+            << "bytes (peak" << stats.peak_bytes << "bytes," << stats.collapsed
+            << "collapsed)";
   }
-  stream.device()->close();
-  m_save_history->device()->close();
-  QFile(m_save_history_filename + ".tmp").remove();
-  qDebug() << "Finalized save history successfully";
+}
+
+void BroadcastServer::setLatencyStatsFile(const QString &filename) {
+  m_latency_stats_file = filename;
+  QTimer *timer = new QTimer(this);
+  connect(timer, &QTimer::timeout, this, &BroadcastServer::writeLatencyStats);
+  timer->start(LATENCY_DUMP_INTERVAL_MS);
+}
+
+void BroadcastServer::writeLatencyStats() {
+  if (m_latency_stats.empty()) return;
+  if (!m_latency_stats.writeJson(m_latency_stats_file))
+    qWarning() << "Could not write latency stats to" << m_latency_stats_file;
 }
 
 int BroadcastServer::port() { return m_server->serverPort(); }
@@ -155,7 +254,19 @@ void BroadcastServer::newClient() {
   QTcpSocket *conn = m_server->nextPendingConnection();
   qInfo() << "New connection" << conn->peerAddress() << m_next_uid;
 
-  registerSession(new ServerSession(this, conn, m_next_uid++));
+  if (!m_workers) {
+    registerSession(new ServerSession(this, conn, m_next_uid++));
+    return;
+  }
+
+  // The socket has to move threads along with its session, so it can't stay
+  // parented to the TCP server. Connect everything up before moving it so
+  // that nothing it emits on the worker is missed.
+  conn->setParent(nullptr);
+  ServerSession *session = new ServerSession(nullptr, conn, m_next_uid++);
+  conn->setParent(session);
+  registerSession(session);
+  m_workers->adopt(session);
 }
 
 void BroadcastServer::registerSession(AbstractServerSession *session) {
@@ -163,28 +274,33 @@ void BroadcastServer::registerSession(AbstractServerSession *session) {
   // its state. Key things to be aware of:
   // 1. Don't send remote actions/edit state until received hello.
   // 2. Clean up properly on disconnect.
-  auto deleteOnDisconnect =
-      connect(session, &AbstractServerSession::disconnected, session,
-              &QObject::deleteLater);
-  connect(session, &AbstractServerSession::receivedHello,
-          [session, deleteOnDisconnect, this]() {
+  // 3. The session might live on a worker thread, in which case all of these
+  //    are queued onto ours (the one sequencing point) in the order they were
+  //    emitted. So connect everything up front rather than from within a
+  //    handler, which could miss signals emitted in the meantime.
+  session->setWoiceStore(m_woice_dir.path());
+  using Iterator = std::list<AbstractServerSession *>::iterator;
+  auto registered = std::make_shared<std::optional<Iterator>>();
+  connect(session, &AbstractServerSession::receivedHello, this,
+          [session, registered, this]() {
             broadcastNewSession(session->username(), session->uid());
             m_sessions.push_back(session);
-
             // Track iterator so we can delete it when it goes away
-            auto it = --m_sessions.end();
-            disconnect(deleteOnDisconnect);
-            connect(session, &AbstractServerSession::disconnected,
-                    [it, session, this]() {
-                      m_sessions.erase(it);
-                      broadcastDeleteSession(session->uid());
-                      session->deleteLater();
-                    });
-
-            session->sendHello(m_data, m_history, sessionMapping(m_sessions));
-            connect(session, &AbstractServerSession::receivedAction, this,
-                    &BroadcastServer::broadcastAction);
+            *registered = --m_sessions.end();
+            // Shared rather than copied. The session fills in the woices.
+            session->sendHello(m_project, m_history,
+                               sessionMapping(m_sessions));
+          });
+  connect(session, &AbstractServerSession::disconnected, this,
+          [session, registered, this]() {
+            if (registered->has_value()) {
+              m_sessions.erase(registered->value());
+              broadcastDeleteSession(session->uid());
+            }
+            session->deleteLater();
           });
+  connect(session, &AbstractServerSession::receivedAction, this,
+          &BroadcastServer::broadcastAction);
 }
 
 void BroadcastServer::connectLocalSession(LocalClientSession *client,
@@ -198,13 +314,56 @@ void BroadcastServer::connectLocalSession(LocalClientSession *client,
                                       m_server->serverPort()});
 }
 
-void BroadcastServer::broadcastServerAction(const ServerAction &a) {
-  if (a.shouldBeRecorded())
+void BroadcastServer::broadcastServerAction(const ServerAction &a, bool log) {
+  if (log && a.shouldBeRecorded())
     qDebug() << QDateTime::currentDateTime().toString("yyyy.MM.dd hh:mm:ss.zzz")
              << "Broadcast to" << m_sessions.size() << a;
-  for (AbstractServerSession *s : m_sessions) s->sendAction(a);
-  if (m_save_history) *m_save_history << m_history_elapsed.elapsed() << a;
-  if (a.shouldBeRecorded()) m_history.push_back(a);
+  if (!m_sessions.empty()) {
+    // Only traced actions need copying to stamp them.
+    std::optional<ServerAction> stamped;
+    if (a.timing.has_value()) {
+      stamped = a;
+      stamped->timing->server_sent = timingNowUs();
+      m_latency_stats.add("server.queue", stamped->timing->server_sent -
+                                              stamped->timing->server_received);
+    }
+    const ServerAction &out = stamped.has_value() ? stamped.value() : a;
+    QByteArray encoded = ServerSession::encode(out);
+    for (AbstractServerSession *s : m_sessions)
+      s->sendEncodedAction(out, encoded);
+    if (stamped.has_value())
+      m_latency_stats.add("server.fanout",
+                          timingNowUs() - stamped->timing->server_sent);
+  }
+  if (m_save_history) {
+    m_save_history->setNextUid(m_next_uid);
+    m_save_history->write(m_history_elapsed.elapsed(), a);
+  }
+  if (a.shouldBeRecorded()) {
+    m_history.push_back(a);
+    rememberWoice(m_history.back());
+  }
+}
+
+void BroadcastServer::rememberWoice(ServerAction &a) {
+  AddWoice *w = addedWoice(a);
+  if (w == nullptr || w->data.isEmpty() || w->hash.isEmpty()) return;
+  if (!m_woice_dir.isValid() ||
+      (!m_woice_store.contains(w->hash) &&
+       !m_woice_store.put(w->hash, w->data))) {
+    qWarning() << "Could not store woice" << w->hash.toHex()
+               << "on disk. Keeping it in memory.";
+    return;
+  }
+  w->data.clear();
+}
+
+void BroadcastServer::sendWoice(qint64 uid, const QByteArray &hash) {
+  for (AbstractServerSession *s : m_sessions)
+    if (s->uid() == uid) {
+      s->sendWoice(hash);
+      return;
+    }
 }
 
 #include <QRandomGenerator>
@@ -224,8 +383,22 @@ void BroadcastServer::broadcastUnreliable(const ServerAction &a) {
     broadcastServerAction(a);
 }
 
-void BroadcastServer::broadcastAction(const ClientAction &m, qint64 uid) {
-  broadcastUnreliable({uid, m});
+void BroadcastServer::broadcastAction(
+    const ClientAction &m, qint64 uid,
+    const std::optional<ActionTiming> &timing) {
+  if (const FetchWoice *f = std::get_if<FetchWoice>(&m)) {
+    sendWoice(uid, f->hash);
+    return;
+  }
+  const AddWoice *w = addedWoice(m);
+  if (w != nullptr && w->hash.isEmpty()) {
+    // Remote sessions hash woices on the way in, but local ones don't.
+    ClientAction hashed = m;
+    addedWoice(hashed)->hash = woiceHash(w->data);
+    broadcastUnreliable({uid, hashed, timing});
+    return;
+  }
+  broadcastUnreliable({uid, m, timing});
 }
 
 void BroadcastServer::broadcastNewSession(const QString &username, qint64 uid) {
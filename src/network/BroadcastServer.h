@@ -4,50 +4,105 @@
 #include <QElapsedTimer>
 #include <QFile>
 #include <QSettings>
+#include <QTemporaryDir>
 #include <QTcpServer>
 #include <QTimer>
+#include <limits>
+#include <map>
 
 #include "LocalServerSession.h"
 #include "ServerSession.h"
+#include "SessionThreadPool.h"
+#include "WoiceCache.h"
 #include "protocol/Data.h"
+#include "protocol/Recording.h"
 #include "protocol/RemoteAction.h"
+constexpr double PLAYBACK_AS_FAST_AS_POSSIBLE =
+    std::numeric_limits<double>::infinity();
+
 class BroadcastServer : public QObject {
   Q_OBJECT
  public:
   BroadcastServer(std::optional<QString> filename, QHostAddress host, int port,
                   std::optional<QString> save_history,
                   QObject *parent = nullptr, int delay_msec = 0,
-                  double drop_rate = 0);
+                  double drop_rate = 0, int worker_threads = 0);
   ~BroadcastServer();
   int port();
 
   QHostAddress address();
   bool isReadingHistory();
+  // Jumps playback of a loaded recording to [elapsed] ms in. Only possible
+  // before anyone's connected.
+  bool seekRecording(qint64 elapsed);
+  // Multiplier on how fast a loaded recording is played back. Pass
+  // PLAYBACK_AS_FAST_AS_POSSIBLE to not wait between actions at all. Can be
+  // changed at any point during playback.
+  bool setPlaybackSpeed(double speed);
+  // Periodically write the latency of actions from tracing clients to
+  // [filename] as JSON.
+  void setLatencyStatsFile(const QString &filename);
   const std::list<AbstractServerSession *> &sessions() const;
   void connectLocalSession(LocalClientSession *client, QString username);
 
+ signals:
+  // The last action of a loaded recording has been played.
+  void playbackFinished();
+
  private slots:
   void newClient();
+  void reportBacklogs();
+  void playRecording();
+  void writeLatencyStats();
 
  private:
-  void broadcastAction(const ClientAction &m, qint64 uid);
+  friend class BroadcastServerTest;
+  void broadcastAction(const ClientAction &m, qint64 uid,
+                       const std::optional<ActionTiming> &timing);
   void broadcastNewSession(const QString &username, qint64 uid);
   void broadcastDeleteSession(qint64 uid);
   void registerSession(AbstractServerSession *);
+  // Moves the data of a woice added in [a] to [m_woice_store].
+  void rememberWoice(ServerAction &a);
+  // Answers a FetchWoice from [uid]. The session reads the woice from
+  // [m_woice_store] on its own thread.
+  void sendWoice(qint64 uid, const QByteArray &hash);
   QTcpServer *m_server;
+  // Null when sessions just run on this object's thread.
+  SessionThreadPool *m_workers;
+  // Woice data is kept out of here, in [m_woice_store], since a long session
+  // can add a lot of woices and clients only need most of them when joining.
   QList<ServerAction> m_history;
   std::list<AbstractServerSession *> m_sessions;
-  QByteArray m_data;
+  std::shared_ptr<const PreparedProject> m_project;
+  // The data of every woice added in the history, on disk by hash. Also for
+  // clients that were only sent the hash and don't have it. Only written from
+  // here, but read from the sessions' threads.
+  QTemporaryDir m_woice_dir;
+  WoiceCache m_woice_store;
   int m_next_uid;
   int m_delay_msec;
   double m_drop_rate;
-  std::unique_ptr<QDataStream> m_load_history;
-  QString m_save_history_filename;
-  std::unique_ptr<QDataStream> m_save_history;
+  std::unique_ptr<RecordingReader> m_load_history;
+  // The next action to play back and when it was recorded.
+  std::optional<std::pair<qint64, ServerAction>> m_next_recorded;
+  // Where in the recording playback started.
+  qint64 m_playback_from;
+  double m_playback_speed;
+  // Real time since playback started from [m_playback_from].
+  QElapsedTimer m_playback_clock;
+  QElapsedTimer m_playback_wall_time;
+  qint64 m_played_actions;
+  std::unique_ptr<RecordingWriter> m_save_history;
   QElapsedTimer m_history_elapsed;
+  LatencyStats m_latency_stats;
+  QString m_latency_stats_file;
   QTimer *m_timer;
-  void broadcastServerAction(const ServerAction &a);
+  void broadcastServerAction(const ServerAction &a, bool log = true);
   void broadcastUnreliable(const ServerAction &a);
+  void scheduleRecording();
+  bool readNextRecorded();
+  qint64 playbackInterval(qint64 recorded_elapsed) const;
   void finalizeSaveHistory();
 };
 
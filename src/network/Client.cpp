@@ -3,8 +3,10 @@
 #include <QAbstractSocket>
 #include <QDateTime>
 #include <QHostAddress>
-#include <QMessageBox>
+#include <algorithm>
+#include <limits>
 
+#include "protocol/Frame.h"
 #include "protocol/Hello.h"
 
 QString HostAndPort::toString() { return QString("%1:%2").arg(host).arg(port); }
@@ -13,9 +15,8 @@ Client::Client(QObject *parent)
     : QObject(parent),
       m_socket(new QTcpSocket(this)),
       m_local(new LocalClientSession(this)),
-      m_write_stream((QIODevice *)m_socket),
-      m_read_stream((QIODevice *)m_socket),
-      m_received_hello(false) {
+      m_received_hello(false),
+      m_trace_latency(false) {
   connect(m_socket, &QTcpSocket::readyRead, this, &Client::tryToRead);
   connect(m_socket, &QTcpSocket::disconnected, this, &Client::handleDisconnect);
   connect(m_socket, &QTcpSocket::errorOccurred,
@@ -29,16 +30,21 @@ Client::Client(QObject *parent)
       m_local, &LocalClientSession::receivedHello,
       [this](qint64 uid, const QByteArray &file,
              const QList<ServerAction> &history,
-             const QMap<qint64, QString> &) { connected(file, history, uid); });
+             const QMap<qint64, QString> &) {
+        m_uid = uid;
+        connected(file, history, uid);
+      });
   connect(m_local, &LocalClientSession::receivedAction, this,
-          &Client::receivedAction);
-
-  m_write_stream.setVersion(QDataStream::Qt_5_5);
-  m_read_stream.setVersion(QDataStream::Qt_5_5);
+          &Client::receiveAction);
 }
 
 void Client::handleDisconnect() {
   m_received_hello = false;
+  m_woice_cache.setPinned({});
+  m_incoming.reset();
+  m_held.clear();
+  m_fetching.clear();
+  m_fetched.clear();
   emit disconnected(m_suppress_disconnect);
   m_suppress_disconnect = false;
 }
@@ -54,13 +60,22 @@ HostAndPort Client::currentlyConnectedTo() {
 void Client::connectToServer(QString hostname, quint16 port, QString username) {
   m_local->disconnect();
   m_socket->abort();
+  m_incoming.reset();
+  m_held.clear();
+  m_fetching.clear();
+  m_fetched.clear();
 
   // Guarded on connection in case the connection fails. In the past not having
   // this has caused me problems
   QMetaObject::Connection *const conn = new QMetaObject::Connection;
   *conn = connect(m_socket, &QTcpSocket::connected, [this, conn, username]() {
     qDebug() << "Sending hello to server";
-    m_write_stream << ClientHello(username);
+    QList<QByteArray> cached = m_woice_cache.hashes(MAX_HELLO_WOICE_HASHES);
+    // The server will leave these out, so they have to stay cached until
+    // we've got the whole project.
+    m_woice_cache.setPinned(QSet<QByteArray>(cached.begin(), cached.end()));
+    ClientHello hello(username, COMPRESSED_PROJECT, cached);
+    m_socket->write(makeFrame([&](QDataStream &out) { out << hello; }));
     disconnect(*conn);
     delete conn;
   });
@@ -84,26 +99,43 @@ void Client::disconnectFromServerSuppressSignal() {
   }
 }
 
+void Client::disconnectWithError(const QString &error) {
+  qWarning() << error << "Disconnecting.";
+  emit errorOccurred(error);
+  if (m_local->isConnected()) m_local->disconnect();
+  if (m_socket->state() == QAbstractSocket::ConnectedState)
+    m_socket->disconnectFromHost();
+}
+
 void Client::sendAction(const ClientAction &m) {
   if (clientActionShouldBeRecorded(m))
     qDebug() << QDateTime::currentDateTime().toString("yyyy.MM.dd hh:mm:ss.zzz")
              << "Sending" << m;
+  std::optional<qint64> sent_at;
+  if (m_trace_latency) sent_at = timingNowUs();
   if (m_local->isConnected())
-    m_local->sendAction(m);
+    m_local->sendAction(m, sent_at);
   else {
     // Sometimes if I try to write data to a socket that's not ready it
     // invalidates the socket forever. I think these two guards should prevent
     // it.
     if (m_socket->isValid() &&
         m_socket->state() == QTcpSocket::ConnectedState) {
-      m_write_stream << m;
+      // Like everyone else, we'll get this back by hash, so keep it to hand.
+      if (const AddWoice *w = addedWoice(m))
+        if (!m_woice_cache.put(woiceHash(w->data), w->data))
+          qWarning() << "Could not cache woice" << w->name;
+      m_socket->write(
+          makeFrame([&](QDataStream &out) { out << m << sent_at; }));
+      if (sent_at.has_value())
+        m_latency_stats.add("client.serialize",
+                            timingNowUs() - sent_at.value());
       if (m_socket->bytesToWrite() == 0) {
         qWarning() << "Client::sendAction didn't seem to fill write." << m;
         qWarning() << "Socket state: open(" << m_socket->isOpen()
                    << "), valid (" << m_socket->isValid() << "), state("
                    << m_socket->state() << "), error("
-                   << m_socket->errorString() << ")"
-                   << "), stream_status(" << m_write_stream.status() << ")";
+                   << m_socket->errorString() << ")";
       }
     } else {
       /*qDebug() << "Not sending action while socket is not ready" << m;
@@ -116,60 +148,256 @@ void Client::sendAction(const ClientAction &m) {
 
 qint64 Client::uid() { return m_uid; }
 
+void Client::setTraceLatency(bool trace) { m_trace_latency = trace; }
+
 void Client::tryToRead() {
   // qDebug() << "Client has bytes available" << m_socket->bytesAvailable();
-  // I got tripped up. tryToStart cannot be in the loop b/c that will cause it
-  // to loop infinitely. The way it's coded right now at least.
-  if (!m_received_hello) tryToStart();
-  if (m_received_hello)
-    while (!m_read_stream.atEnd()) {
-      m_read_stream.startTransaction();
-
-      ServerAction action;
-      try {
-        m_read_stream >> action;
-      } catch (const std::runtime_error &e) {
-        qWarning("Discarding unreadable server action. Error: %s. ", e.what());
-        m_read_stream.rollbackTransaction();
-        return;
-      }
-      if (!m_read_stream.commitTransaction()) {
-        // qDebug() << "Client::tryToRead: Past stream end, can't commit.";
-        return;
-      }
+  // Stop if a bad message made us disconnect.
+  while (m_socket->state() == QAbstractSocket::ConnectedState) {
+    std::optional<QByteArray> frame;
+    try {
+      frame = readFrame(m_socket, maxFrameSize());
+    } catch (const QString &e) {
+      qWarning() << "Bad frame from server:" << e;
+      emit errorOccurred(tr("Received garbage from the server."));
+      m_socket->abort();
+      return;
+    }
+    if (!frame.has_value()) break;
+    if (!m_received_hello) {
+      readStartFrame(frame.value());
+      continue;
+    }
 
-      if (action.shouldBeRecorded())
-        qDebug() << QDateTime::currentDateTime().toString(
-                        "yyyy.MM.dd hh:mm:ss.zzz")
-                 << "Received" << action;
+    QDataStream in(frame.value());
+    in.setVersion(QDataStream::Qt_5_5);
+    ServerAction action;
+    try {
+      in >> action >> action.timing;
+    } catch (const std::runtime_error &e) {
+      qWarning("Unreadable server action. Error: %s. ", e.what());
+      in.setStatus(QDataStream::ReadCorruptData);
+    }
+    // Skipping it would leave us out of sync with everyone else.
+    if (in.status() != QDataStream::Ok) {
+      disconnectWithError(tr("Received an unreadable action from the server."));
+      return;
+    }
+
+    if (action.shouldBeRecorded())
+      qDebug() << QDateTime::currentDateTime().toString(
+                      "yyyy.MM.dd hh:mm:ss.zzz")
+               << "Received" << action;
+
+    queueAction(action);
+  }
 
-      emit receivedAction(action);
+  if (m_incoming.has_value()) {
+    // What's buffered of the next frame counts too, so progress moves even
+    // while a big woice is coming in.
+    const IncomingProject &in = m_incoming.value();
+    emit helloProgress(
+        std::min(in.read_bytes + m_socket->bytesAvailable(), in.total_bytes),
+        in.total_bytes);
+  }
+}
+
+void Client::queueAction(const ServerAction &action) {
+  if (const WoiceData *d = std::get_if<WoiceData>(&action.action)) {
+    if (d->data.isEmpty() || woiceHash(d->data) != d->hash) {
+      qWarning() << "Could not fetch woice" << d->hash.toHex();
+      emit errorOccurred(tr("Could not get a woice from the server."));
+      m_socket->disconnectFromHost();
+      return;
     }
+    if (!m_woice_cache.put(d->hash, d->data))
+      qWarning() << "Could not cache woice" << d->hash.toHex();
+    m_fetching.erase(d->hash);
+    m_fetched[d->hash] = d->data;
+  } else {
+    m_held.push_back(action);
+    // Look it up (or start fetching it) now rather than when it gets to the
+    // front, so several fetches can be in flight at once.
+    resolveWoice(m_held.back());
+  }
+
+  while (!m_held.empty() && resolveWoice(m_held.front())) {
+    ServerAction a = std::move(m_held.front());
+    m_held.pop_front();
+    receiveAction(a);
+  }
+  if (m_held.empty()) m_fetched.clear();
+}
+
+// Fills in the data of a woice that was sent by hash. Returns false if it has
+// to be fetched first.
+bool Client::resolveWoice(ServerAction &action) {
+  AddWoice *w = addedWoice(action);
+  if (w == nullptr || !w->data.isEmpty()) return true;
+  auto fetched = m_fetched.find(w->hash);
+  if (fetched != m_fetched.end()) {
+    w->data = fetched->second;
+    return true;
+  }
+  if (m_fetching.count(w->hash) > 0) return false;
+  std::optional<QByteArray> cached = m_woice_cache.get(w->hash);
+  if (cached.has_value()) {
+    w->data = cached.value();
+    return true;
+  }
+  qInfo() << "Fetching woice" << w->name << w->hash.toHex();
+  m_fetching.insert(w->hash);
+  sendAction(FetchWoice{w->hash});
+  return false;
+}
+
+void Client::receiveAction(const ServerAction &action) {
+  // Only our own actions have timestamps we can make sense of.
+  if (action.timing.has_value() && action.uid == m_uid) {
+    const ActionTiming &t = action.timing.value();
+    m_latency_stats.add("client.round_trip", timingNowUs() - t.client_sent);
+    m_latency_stats.add("client.in_server", t.server_sent - t.server_received);
+  }
+  emit receivedAction(action);
 }
 
-void Client::tryToStart() {
-  // Get the file + history
-  qInfo() << "Getting initial data from server";
+// With a compressed hello the project follows in a frame per segment, so a
+// big project is unpacked as it arrives rather than all at the end. Then comes
+// a frame with the history.
+void Client::readStartFrame(const QByteArray &frame) {
+  QDataStream in(frame);
+  in.setVersion(QDataStream::Qt_5_5);
 
-  ServerHello hello;
-  QByteArray data;
+  if (!m_incoming.has_value()) {
+    // Get the file + history
+    qInfo() << "Getting initial data from server";
+    ServerHello hello;
+    in >> hello;
+    if (!hello.isValid()) {
+      failStart(
+          tr("Invalid hello response from server. Are you running the same version of ptcollab as the server?"));
+      return;
+    }
+    m_uid = hello.uid();
+
+    if (hello.features() & COMPRESSED_PROJECT) {
+      qint64 total_bytes;
+      quint32 segments;
+      in >> total_bytes >> segments;
+      m_incoming = IncomingProject{total_bytes, 0, segments, {}};
+      return;
+    }
+    QByteArray data;
+    QList<ServerAction> history;
+    // TODO: actually use sessions using the history state thing from before
+    QMap<qint64, QString> sessions;
+    in >> data >> history >> sessions;
+    if (in.status() != QDataStream::Ok) {
+      failStart(tr("Could not read the project sent by the server."));
+      return;
+    }
+    finishStart(data, history);
+    return;
+  }
+
+  IncomingProject &incoming = m_incoming.value();
+  incoming.read_bytes += FRAME_HEADER_SIZE + frame.size();
+  if (incoming.segments_left > 0) {
+    ProjectSegment segment;
+    in >> segment;
+    if (in.status() != QDataStream::Ok) {
+      failStart(tr("Could not read the project sent by the server."));
+      return;
+    }
+    if (!addSegment(segment)) return;
+    --incoming.segments_left;
+    return;
+  }
+
+  QByteArray compressed_state;
+  in >> compressed_state;
+  QByteArray state = qUncompress(compressed_state);
+  QDataStream state_stream(state);
+  state_stream.setVersion(QDataStream::Qt_5_5);
   QList<ServerAction> history;
-  // TODO: actually use sessions using the history state thing from before
   QMap<qint64, QString> sessions;
+  state_stream >> history >> sessions;
+  if (state_stream.status() != QDataStream::Ok) {
+    failStart(tr("Could not read the history sent by the server."));
+    return;
+  }
+  emit helloProgress(incoming.total_bytes, incoming.total_bytes);
+  QByteArray data = incoming.data;
+  m_incoming.reset();
+  finishStart(data, history);
+}
 
-  m_read_stream.startTransaction();
-  m_read_stream >> hello >> data >> history >> sessions;
-  if (!m_read_stream.commitTransaction()) return;
+// The project and history after a compressed hello can be any size, but no
+// bigger than the server said they'd be.
+quint32 Client::maxFrameSize() const {
+  if (!m_incoming.has_value())
+    return m_received_hello ? MAX_ACTION_FRAME_SIZE : MAX_HELLO_FRAME_SIZE;
+  const IncomingProject &in = m_incoming.value();
+  return quint32(std::clamp<qint64>(
+      in.total_bytes - in.read_bytes - FRAME_HEADER_SIZE, 0,
+      std::numeric_limits<quint32>::max()));
+}
 
-  if (!hello.isValid()) {
-    qWarning("Invalid hello response. Disconnecting.");
-    emit errorOccurred(
-        tr("Invalid hello response from server. Are you running the same version of ptcollab as the server?"));
-    m_socket->disconnectFromHost();
-    return;
+bool Client::addSegment(const ProjectSegment &segment) {
+  QByteArray &data = m_incoming.value().data;
+  switch (segment.kind) {
+    case ProjectSegment::DATA:
+      data.append(qUncompress(segment.compressed));
+      break;
+    case ProjectSegment::WOICE: {
+      QByteArray block = qUncompress(segment.compressed);
+      if (woiceHash(block) != segment.hash) {
+        failStart(tr("A woice sent by the server was damaged."));
+        return false;
+      }
+      if (!m_woice_cache.put(segment.hash, block))
+        qWarning() << "Could not cache woice" << segment.hash.toHex();
+      data.append(block);
+      break;
+    }
+    case ProjectSegment::CACHED_WOICE: {
+      std::optional<QByteArray> block = m_woice_cache.get(segment.hash);
+      if (!block.has_value()) {
+        // It was there when we said hello, so it must've been removed since.
+        failStart(tr("A cached woice went missing while connecting. Please "
+                     "try again."));
+        return false;
+      }
+      data.append(block.value());
+      break;
+    }
+  }
+  return true;
+}
+
+void Client::failStart(const QString &error) {
+  qWarning() << "Could not start session:" << error << "Disconnecting.";
+  m_incoming.reset();
+  emit errorOccurred(error);
+  m_socket->disconnectFromHost();
+}
+
+void Client::finishStart(const QByteArray &data,
+                         QList<ServerAction> history) {
+  // Woices in the history are only sent by hash if we said we had them.
+  for (ServerAction &a : history) {
+    AddWoice *w = addedWoice(a);
+    if (w == nullptr || !w->data.isEmpty()) continue;
+    std::optional<QByteArray> cached = m_woice_cache.get(w->hash);
+    if (!cached.has_value()) {
+      failStart(tr("A cached woice went missing while connecting. Please "
+                   "try again."));
+      return;
+    }
+    w->data = cached.value();
   }
-  m_uid = hello.uid();
 
+  m_woice_cache.setPinned({});
   qDebug() << "Received uid" << m_uid << "and history of size"
            << history.size();
 
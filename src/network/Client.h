@@ -2,8 +2,12 @@
 #define ACTIONCLIENT_H
 #include <QObject>
 #include <QTcpSocket>
+#include <deque>
+#include <map>
+#include <set>
 
 #include "BroadcastServer.h"
+#include "WoiceCache.h"
 #include "protocol/RemoteAction.h"
 #include "pxtone/pxtnDescriptor.h"
 
@@ -16,26 +20,57 @@ class Client : public QObject {
   void connectToServer(QString hostname, quint16 port, QString username);
   void connectToLocalServer(BroadcastServer *server, QString username);
   void disconnectFromServerSuppressSignal();
+  // For when something's gone wrong on our end that means we can't carry on
+  // with the session. Reports [error] and disconnects.
+  void disconnectWithError(const QString &error);
   void sendAction(const ClientAction &m);
   qint64 uid();
+  // Stamp outgoing actions so their progress through the server and back can
+  // be timed. Stats for each stage end up in latencyStats().
+  void setTraceLatency(bool trace);
+  bool isTracingLatency() const { return m_trace_latency; }
+  LatencyStats &latencyStats() { return m_latency_stats; }
  signals:
   void connected(const QByteArray &desc, const QList<ServerAction> &history,
                  qint64 uid);
   void disconnected(bool suppress);
   void receivedAction(const ServerAction &m);
   void errorOccurred(QString error);
+  // How much of the project etc. has arrived since the server's hello.
+  void helloProgress(qint64 received, qint64 total);
 
  private:
   QTcpSocket *m_socket;
   LocalClientSession *m_local;
-  // We have separate streams because QTBUG-63113 prevents writing if we're
-  // currently in the middle of a fragmented read.
-  QDataStream m_write_stream, m_read_stream;
   bool m_received_hello;
   bool m_suppress_disconnect;
   qint64 m_uid;
+  bool m_trace_latency;
+  LatencyStats m_latency_stats;
+  WoiceCache m_woice_cache;
+  // The project as it comes in, segment by segment, after a compressed hello.
+  struct IncomingProject {
+    qint64 total_bytes;
+    qint64 read_bytes;
+    quint32 segments_left;
+    QByteArray data;
+  };
+  std::optional<IncomingProject> m_incoming;
+  // Actions held back, in order, from the first one whose woice is being
+  // fetched, until it arrives.
+  std::deque<ServerAction> m_held;
+  std::set<QByteArray> m_fetching;
+  // Fetched woices that the held actions might need.
+  std::map<QByteArray, QByteArray> m_fetched;
   void tryToRead();
-  void tryToStart();
+  void queueAction(const ServerAction &action);
+  bool resolveWoice(ServerAction &action);
+  void receiveAction(const ServerAction &action);
+  void readStartFrame(const QByteArray &frame);
+  bool addSegment(const ProjectSegment &segment);
+  quint32 maxFrameSize() const;
+  void failStart(const QString &error);
+  void finishStart(const QByteArray &data, QList<ServerAction> history);
   void handleDisconnect();
 };
 
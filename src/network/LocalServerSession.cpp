@@ -6,10 +6,11 @@ LocalServerSession::LocalServerSession(QObject *parent, const QString &username,
                                        qint64 uid)
     : AbstractServerSession(uid, parent), m_username(username) {}
 
-void LocalServerSession::sendHello(const QByteArray &file,
-                                   const QList<ServerAction> &history,
-                                   const QMap<qint64, QString> &sessions) {
-  emit helloSent(file, history, sessions);
+void LocalServerSession::sendHello(
+    const std::shared_ptr<const PreparedProject> &project,
+    const QList<ServerAction> &history, const QMap<qint64, QString> &sessions) {
+  // Nothing to be gained by compressing in-process.
+  emit helloSent(project->data(), withWoices(history, {}), sessions);
 }
 
 void LocalServerSession::sendAction(const ServerAction &action) {
@@ -63,10 +64,16 @@ void LocalClientSession::sendHello() {
   });
 }
 
-void LocalClientSession::sendAction(const ClientAction &m) {
+void LocalClientSession::sendAction(const ClientAction &m,
+                                    std::optional<qint64> client_sent) {
   QTimer::singleShot(0, [=]() {
-    if (m_server_session != nullptr)
-      emit m_server_session->receivedAction(m, m_server_session->uid());
+    if (m_server_session != nullptr) {
+      std::optional<ActionTiming> timing;
+      if (client_sent.has_value())
+        timing = ActionTiming{client_sent.value(), timingNowUs(), 0};
+      emit m_server_session->receivedAction(m, m_server_session->uid(),
+                                            timing);
+    }
   });
 }
 
@@ -19,7 +19,8 @@ class LocalServerSession : public AbstractServerSession {
   Q_OBJECT
  public:
   LocalServerSession(QObject *parent, const QString &username, qint64 uid);
-  void sendHello(const QByteArray &file, const QList<ServerAction> &history,
+  void sendHello(const std::shared_ptr<const PreparedProject> &project,
+                 const QList<ServerAction> &history,
                  const QMap<qint64, QString> &sessions);
   void sendAction(const ServerAction &action);
   QString username() const;
@@ -43,7 +44,8 @@ class LocalClientSession : public QObject {
   void connectToServer(LocalServerSession *server_session,
                        const HostAndPort &connected_to);
   void sendHello();
-  void sendAction(const ClientAction &action);
+  void sendAction(const ClientAction &action,
+                  std::optional<qint64> client_sent = std::nullopt);
   qint64 uid() const;
 
   void disconnect();
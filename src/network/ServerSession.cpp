@@ -2,39 +2,127 @@
 
 #include <QDebug>
 #include <QHostAddress>
+#include <QThread>
 
+#include "protocol/Frame.h"
 #include "protocol/Hello.h"
 
+// Stop handing data to the socket once it has this much buffered. Beyond this
+// messages wait in the session's own queue, where they can be collapsed.
+constexpr qint64 SOCKET_HIGH_WATER_BYTES = 256 * 1024;
+// A client that's this far behind is disconnected rather than buffered for
+// indefinitely. It can reconnect and catch up from the history.
+constexpr qint64 MAX_OUTBOUND_BYTES = 32 * 1024 * 1024;
+
 ServerSession::ServerSession(QObject *parent, QTcpSocket *conn, qint64 uid)
     : AbstractServerSession(uid, parent),
       m_socket(conn),
-      m_write_stream((QIODevice *)conn),
-      m_read_stream((QIODevice *)conn),
       m_username(""),
-      m_received_hello(false) {
+      m_received_hello(false),
+      m_client_features(0),
+      m_outbound_messages(0),
+      m_outbound_bytes(0),
+      m_outbound_peak_bytes(0),
+      m_outbound_collapsed(0) {
   connect(m_socket, &QIODevice::readyRead, this, &ServerSession::readMessage);
+  connect(m_socket, &QIODevice::bytesWritten, this,
+          &ServerSession::flushOutbound);
   connect(m_socket, &QAbstractSocket::disconnected, [this]() {
     qDebug() << "Disconnected" << AbstractServerSession::uid();
+    clearOutbound();
     m_socket->deleteLater();
     // m_state = ServerSession::DISCONNECTED;
     m_socket = nullptr;
     emit disconnected();
   });
-  m_write_stream.setVersion(QDataStream::Qt_5_5);
-  m_read_stream.setVersion(QDataStream::Qt_5_5);
 }
 
 // TODO: Include history, sessions, data in hello as a 'server history state'
-void ServerSession::sendHello(const QByteArray &data,
-                              const QList<ServerAction> &history,
-                              const QMap<qint64, QString> &sessions) {
+void ServerSession::sendHello(
+    const std::shared_ptr<const PreparedProject> &project,
+    const QList<ServerAction> &history, const QMap<qint64, QString> &sessions) {
+  // The session may be owned by a worker thread (see SessionThreadPool), in
+  // which case the socket can only be touched from there.
+  if (QThread::currentThread() != thread()) {
+    QMetaObject::invokeMethod(
+        this, [this, project, history, sessions]() {
+          sendHello(project, history, sessions);
+        },
+        Qt::QueuedConnection);
+    return;
+  }
+  if (m_socket == nullptr) return;
   qInfo() << "Sending hello to " << m_socket->peerAddress();
 
-  m_write_stream << ServerHello(uid()) << data << history << sessions;
+  if (!(m_client_features & COMPRESSED_PROJECT)) {
+    m_socket->write(makeFrame([&](QDataStream &out) {
+      out << ServerHello(uid()) << project->data() << withWoices(history, {})
+          << sessions;
+    }));
+    return;
+  }
+
+  // Each segment is its own frame so the client can unpack them as they
+  // arrive. The history is compressed here, on the session's thread, since
+  // it's different for each client; the project's segments were compressed
+  // once for everyone.
+  QList<QByteArray> frames;
+  QList<ProjectSegment> segments = project->segmentsFor(m_cached_woices);
+  for (const ProjectSegment &s : segments)
+    frames.push_back(makeFrame([&](QDataStream &out) { out << s; }));
+  QByteArray state;
+  QDataStream state_stream(&state, QIODevice::WriteOnly);
+  state_stream.setVersion(QDataStream::Qt_5_5);
+  // Added woices the client has cached go by hash. The rest are read back from
+  // the server's store and sent in full, since there's no point in the client
+  // then asking for them one by one.
+  state_stream << withWoices(history, m_cached_woices) << sessions;
+  frames.push_back(
+      makeFrame([&](QDataStream &out) { out << qCompress(state); }));
+
+  // Sized up front so the client can show progress.
+  qint64 total_bytes = 0;
+  for (const QByteArray &f : frames) total_bytes += f.size();
+  qInfo() << "Hello is" << total_bytes << "bytes compressed, from"
+          << project->data().size() + state.size();
+  m_socket->write(makeFrame([&](QDataStream &out) {
+    out << ServerHello(uid(), COMPRESSED_PROJECT) << total_bytes
+        << quint32(segments.size());
+  }));
+  for (const QByteArray &f : frames) m_socket->write(f);
+}
+
+QByteArray ServerSession::encode(const ServerAction &a) {
+  const AddWoice *woice = addedWoice(a);
+  if (woice != nullptr && !woice->hash.isEmpty()) {
+    // Woices only go by hash. Clients fetch the ones they don't have.
+    ServerAction by_hash = a;
+    addedWoice(by_hash)->data.clear();
+    return makeFrame(
+        [&](QDataStream &out) { out << by_hash << by_hash.timing; });
+  }
+  return makeFrame([&](QDataStream &out) { out << a << a.timing; });
 }
 
 void ServerSession::sendAction(const ServerAction &a) {
-  // TODO: Do we also need a isValid and connected guard here?
+  sendEncodedAction(a, encode(a));
+}
+
+void ServerSession::sendEncodedAction(const ServerAction &a,
+                                      const QByteArray &encoded) {
+  if (QThread::currentThread() != thread()) {
+    QMetaObject::invokeMethod(
+        this, [this, a, encoded]() { writeEncoded(a, encoded); },
+        Qt::QueuedConnection);
+    return;
+  }
+  writeEncoded(a, encoded);
+}
+
+void ServerSession::writeEncoded(const ServerAction &a,
+                                 const QByteArray &encoded) {
+  // A queued write can land after the socket went away.
+  if (m_socket == nullptr) return;
 
   if (!m_socket->isValid() || m_socket->state() != QTcpSocket::ConnectedState) {
     qWarning() << "Trying to broadcast to a socket that's not ready?" << a;
@@ -43,64 +131,146 @@ void ServerSession::sendAction(const ServerAction &a) {
                << "), error(" << m_socket->errorString() << ")";
   }
 
-  // Testing writing to the socket directly
-  /* QByteArray arr;
-  QDataStream d(&arr, QIODevice::WriteOnly);
-  d << a;
-  qint64 written = m_socket->write(arr);
-  if (written < arr.length()) {
-    qWarning() << "ServerSession::sendAction for u" << m_uid
-               << "didn't write as much as expected.";
-    qWarning() << "Socket state: open(" << m_socket->isOpen() << "), valid ("
-               << m_socket->isValid() << "), state(" << m_socket->state()
-               << "), error(" << m_socket->errorString() << ")";
-  }*/
+  if (m_outbound.empty() &&
+      m_socket->bytesToWrite() < SOCKET_HIGH_WATER_BYTES) {
+    qint64 written = m_socket->write(encoded);
+    if (written < encoded.length()) {
+      qWarning() << "ServerSession::sendAction for u" << uid()
+                 << "didn't write as much as expected.";
+      qWarning() << "Socket state: open(" << m_socket->isOpen()
+                 << "), valid (" << m_socket->isValid() << "), state("
+                 << m_socket->state() << "), error("
+                 << m_socket->errorString() << ")";
+    }
+    return;
+  }
 
-  m_write_stream << a;
-  qint32 beforeFlush = m_socket->bytesToWrite();
-  if (beforeFlush == 0) {
-    qWarning() << "ServerSession::sendAction for u" << uid()
-               << "didn't seem to fill write buffer.";
-    qWarning() << "Socket state: open(" << m_socket->isOpen() << "), valid ("
-               << m_socket->isValid() << "), state(" << m_socket->state()
-               << "), error(" << m_socket->errorString() << ")"
-               << "), stream_status(" << m_write_stream.status() << ")";
+  std::optional<std::pair<qint64, size_t>> collapse_key;
+  if (!a.shouldBeRecorded())
+    if (const ClientAction *c = std::get_if<ClientAction>(&a.action))
+      collapse_key = std::make_pair(a.uid, c->index());
+
+  if (collapse_key.has_value()) {
+    auto it = m_collapsible.find(collapse_key.value());
+    if (it != m_collapsible.end()) {
+      m_outbound_bytes -= it->second->encoded.size();
+      --m_outbound_messages;
+      ++m_outbound_collapsed;
+      m_outbound.erase(it->second);
+      m_collapsible.erase(it);
+    }
+  }
+
+  m_outbound.push_back({encoded, collapse_key});
+  if (collapse_key.has_value())
+    m_collapsible[collapse_key.value()] = --m_outbound.end();
+  ++m_outbound_messages;
+  m_outbound_bytes += encoded.size();
+  if (m_outbound_bytes > m_outbound_peak_bytes)
+    m_outbound_peak_bytes = m_outbound_bytes.loadAcquire();
+
+  if (m_outbound_bytes > MAX_OUTBOUND_BYTES) {
+    qWarning() << "Session u" << uid() << "fell too far behind ("
+               << m_outbound_bytes.loadAcquire() << "bytes queued)."
+               << "Disconnecting.";
+    clearOutbound();
+    m_socket->abort();
   }
 }
 
+void ServerSession::flushOutbound() {
+  while (m_socket != nullptr && !m_outbound.empty() &&
+         m_socket->bytesToWrite() < SOCKET_HIGH_WATER_BYTES) {
+    const Outbound &o = m_outbound.front();
+    m_socket->write(o.encoded);
+    if (o.collapse_key.has_value()) m_collapsible.erase(o.collapse_key.value());
+    --m_outbound_messages;
+    m_outbound_bytes -= o.encoded.size();
+    m_outbound.pop_front();
+  }
+}
+
+void ServerSession::clearOutbound() {
+  m_outbound.clear();
+  m_collapsible.clear();
+  m_outbound_messages = 0;
+  m_outbound_bytes = 0;
+}
+
+OutboundQueueStats ServerSession::outboundQueueStats() const {
+  return {m_outbound_messages.loadAcquire(), m_outbound_bytes.loadAcquire(),
+          m_outbound_peak_bytes.loadAcquire(),
+          m_outbound_collapsed.loadAcquire()};
+}
+
 QString ServerSession::username() const { return m_username; }
 
+QSet<QByteArray> ServerSession::cachedWoices() const { return m_cached_woices; }
+
 void ServerSession::readMessage() {
-  while (!m_read_stream.atEnd()) {
+  while (m_socket != nullptr) {
+    std::optional<QByteArray> frame;
+    try {
+      // Until the hello there's no telling who's connected, so don't let them
+      // make us buffer much.
+      frame = readFrame(m_socket, m_received_hello ? MAX_ACTION_FRAME_SIZE
+                                                   : MAX_HELLO_FRAME_SIZE);
+    } catch (const QString &e) {
+      qWarning() << "Bad frame from" << uid() << m_username << e
+                 << "Disconnecting.";
+      m_socket->abort();
+      return;
+    }
+    if (!frame.has_value()) return;
+    QDataStream in(frame.value());
+    in.setVersion(QDataStream::Qt_5_5);
+
     if (!m_received_hello) {
-      m_read_stream.startTransaction();
       ClientHello m;
-      m_read_stream >> m;
-      if (!m_read_stream.commitTransaction()) return;
+      in >> m;
+      if (in.status() != QDataStream::Ok) {
+        qWarning() << "Unreadable hello from" << uid() << ". Disconnecting.";
+        m_socket->abort();
+        return;
+      }
       m_received_hello = true;
       m_username = m.username();
+      m_client_features = m.features() & COMPRESSED_PROJECT;
+      for (const QByteArray &hash :
+           m.cachedWoices().mid(0, MAX_HELLO_WOICE_HASHES))
+        m_cached_woices.insert(hash);
       emit receivedHello();
     } else {
-      m_read_stream.startTransaction();
       ClientAction action;
+      std::optional<qint64> client_sent;
       try {
-        m_read_stream >> action;
+        in >> action >> client_sent;
       } catch (const std::runtime_error &e) {
         qWarning(
             "Could not read client action from %lld (%s). Error: %s. "
             "Discarding",
             uid(), m_username.toStdString().c_str(), e.what());
-        m_read_stream.rollbackTransaction();
-        return;
+        continue;
+      }
+      if (in.status() != QDataStream::Ok) {
+        qWarning("Truncated client action from %lld (%s). Discarding", uid(),
+                 m_username.toStdString().c_str());
+        continue;
       }
-      if (!(m_read_stream.commitTransaction())) return;
 
       /*QString s;
       QTextStream ts(&s);
       ts << action;
       qDebug() << "Read from" << m_uid << "action" << s;*/
 
-      emit receivedAction(action, uid());
+      // Hashed here rather than trusting the client, and here rather than on
+      // the server's thread since woices can be big.
+      if (AddWoice *w = addedWoice(action)) w->hash = woiceHash(w->data);
+
+      std::optional<ActionTiming> timing;
+      if (client_sent.has_value())
+        timing = ActionTiming{client_sent.value(), timingNowUs(), 0};
+      emit receivedAction(action, uid(), timing);
     }
   }
 }
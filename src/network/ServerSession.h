@@ -1,9 +1,13 @@
 #ifndef SERVERSESSION_H
 #define SERVERSESSION_H
 
+#include <QAtomicInteger>
 #include <QDataStream>
 #include <QFile>
+#include <QSet>
 #include <QTcpSocket>
+#include <list>
+#include <map>
 
 #include "AbstractServerSession.h"
 #include "protocol/Data.h"
@@ -12,20 +16,47 @@ class ServerSession : public AbstractServerSession {
   Q_OBJECT
  public:
   ServerSession(QObject *parent, QTcpSocket *conn, qint64 uid);
-  void sendHello(const QByteArray &file, const QList<ServerAction> &history,
+  void sendHello(const std::shared_ptr<const PreparedProject> &project,
+                 const QList<ServerAction> &history,
                  const QMap<qint64, QString> &sessions);
   void sendAction(const ServerAction &action);
+  void sendEncodedAction(const ServerAction &action, const QByteArray &encoded);
   QString username() const;
+  QSet<QByteArray> cachedWoices() const;
+  OutboundQueueStats outboundQueueStats() const;
+  // An action as it goes over the wire: a frame of the action followed by its
+  // timing.
+  static QByteArray encode(const ServerAction &action);
 
  private slots:
   void readMessage();
 
  private:
+  void writeEncoded(const ServerAction &action, const QByteArray &encoded);
+  void flushOutbound();
+  void clearOutbound();
   QTcpSocket *m_socket;
-  QDataStream m_write_stream, m_read_stream;
   QString m_username;
   // State m_state;
   bool m_received_hello;
+  // From the client's hello.
+  quint32 m_client_features;
+  QSet<QByteArray> m_cached_woices;
+
+  // Messages held back while the socket's own write buffer is full. Reliable
+  // ones go out in order; an unreliable one (edit state, ping, play state)
+  // replaces any queued one from the same user of the same kind.
+  struct Outbound {
+    QByteArray encoded;
+    std::optional<std::pair<qint64, size_t>> collapse_key;
+  };
+  std::list<Outbound> m_outbound;
+  std::map<std::pair<qint64, size_t>, std::list<Outbound>::iterator>
+      m_collapsible;
+  // Written on the session's thread, read from anywhere for stats.
+  QAtomicInteger<int> m_outbound_messages;
+  QAtomicInteger<qint64> m_outbound_bytes, m_outbound_peak_bytes,
+      m_outbound_collapsed;
 };
 
 #endif  // SERVERSESSION_H
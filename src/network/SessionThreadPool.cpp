@@ -0,0 +1,52 @@
+#include "SessionThreadPool.h"
+
+#include <QDebug>
+
+SessionThreadPool::SessionThreadPool(int num_threads, QObject *parent)
+    : QObject(parent) {
+  for (int i = 0; i < std::max(1, num_threads); ++i) {
+    QThread *thread = new QThread(this);
+    thread->setObjectName(QString("session-worker-%1").arg(i));
+    QObject *context = new QObject;
+    context->moveToThread(thread);
+    connect(thread, &QThread::finished, context, &QObject::deleteLater);
+    thread->start();
+    m_workers.push_back({thread, context, std::make_shared<QAtomicInt>(0)});
+  }
+}
+
+SessionThreadPool::~SessionThreadPool() {
+  // Queued deletes (the contexts, and so every session still alive) are
+  // flushed when each thread finishes.
+  for (const Worker &w : m_workers) {
+    w.thread->quit();
+    w.thread->wait();
+  }
+}
+
+int SessionThreadPool::size() const { return m_workers.size(); }
+
+void SessionThreadPool::adopt(ServerSession *session) {
+  Worker *best = &m_workers.front();
+  for (Worker &w : m_workers)
+    if (w.num_sessions->loadAcquire() < best->num_sessions->loadAcquire())
+      best = &w;
+
+  std::shared_ptr<QAtomicInt> num_sessions = best->num_sessions;
+  num_sessions->ref();
+  connect(session, &QObject::destroyed, [num_sessions]() {
+    num_sessions->deref();
+  });
+
+  session->moveToThread(best->thread);
+  QObject *context = best->context;
+  QMetaObject::invokeMethod(
+      context,
+      [session, context]() {
+        session->setParent(context);
+        // Anything that arrived before the socket's notifier was moved over
+        // won't trigger another readyRead.
+        QMetaObject::invokeMethod(session, "readMessage");
+      },
+      Qt::QueuedConnection);
+}
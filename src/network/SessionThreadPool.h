@@ -0,0 +1,38 @@
+#ifndef SESSIONTHREADPOOL_H
+#define SESSIONTHREADPOOL_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QThread>
+#include <memory>
+#include <vector>
+
+#include "ServerSession.h"
+
+// A fixed set of worker threads that own the server's network sessions. Each
+// session is pinned to one worker for its whole life, so its socket reads,
+// deserialization and writes all happen there, while its signals are queued
+// back to the thread that owns the BroadcastServer.
+class SessionThreadPool : public QObject {
+  Q_OBJECT
+ public:
+  SessionThreadPool(int num_threads, QObject *parent = nullptr);
+  ~SessionThreadPool();
+  int size() const;
+
+  // [session] must have no parent and live on the calling thread. It's moved
+  // onto the least loaded worker, which then owns it.
+  void adopt(ServerSession *session);
+
+ private:
+  struct Worker {
+    QThread *thread;
+    // Lives on [thread] and parents that thread's sessions so they get
+    // cleaned up when the thread stops.
+    QObject *context;
+    std::shared_ptr<QAtomicInt> num_sessions;
+  };
+  std::vector<Worker> m_workers;
+};
+
+#endif  // SESSIONTHREADPOOL_H
@@ -0,0 +1,99 @@
+#include "WoiceCache.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "protocol/ProjectTransfer.h"
+
+// A SHA-1, hex encoded.
+constexpr int HASH_HEX_LENGTH = 40;
+
+WoiceCache::WoiceCache(const QString &dir, qint64 max_bytes)
+    : m_dir(dir), m_max_bytes(max_bytes) {}
+
+QString WoiceCache::defaultDir() {
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+         "/woices";
+}
+
+// The cached woices, most recently used first.
+QFileInfoList WoiceCache::entries() const {
+  QFileInfoList entries;
+  for (const QFileInfo &info :
+       QDir(m_dir).entryInfoList(QDir::Files, QDir::Time))
+    if (info.fileName().length() == HASH_HEX_LENGTH) entries.push_back(info);
+  return entries;
+}
+
+QList<QByteArray> WoiceCache::hashes(int max) const {
+  QList<QByteArray> hashes;
+  for (const QFileInfo &info : entries()) {
+    if (hashes.size() >= max) break;
+    hashes.push_back(QByteArray::fromHex(info.fileName().toLatin1()));
+  }
+  return hashes;
+}
+
+QString WoiceCache::path(const QByteArray &hash) const {
+  return m_dir + "/" + QString::fromLatin1(hash.toHex());
+}
+
+std::optional<QByteArray> WoiceCache::get(const QByteArray &hash) const {
+  QFile file(path(hash));
+  if (!file.open(QIODevice::ReadOnly)) return std::nullopt;
+  QByteArray block = file.readAll();
+  if (woiceHash(block) != hash) {
+    qWarning() << "Cached woice" << hash.toHex() << "is damaged. Removing.";
+    file.remove();
+    return std::nullopt;
+  }
+  if (!file.setFileTime(QDateTime::currentDateTime(),
+                        QFileDevice::FileModificationTime))
+    qWarning() << "Could not mark cached woice" << hash.toHex() << "as used";
+  return block;
+}
+
+std::optional<QByteArray> WoiceCache::getTrusted(
+    const QByteArray &hash) const {
+  QFile file(path(hash));
+  if (!file.open(QIODevice::ReadOnly)) return std::nullopt;
+  return file.readAll();
+}
+
+bool WoiceCache::put(const QByteArray &hash, const QByteArray &block) {
+  if (!QDir().mkpath(m_dir)) return false;
+  // Written to the side and renamed into place, so a reader never sees half a
+  // woice.
+  QSaveFile file(path(hash));
+  if (!file.open(QIODevice::WriteOnly)) return false;
+  file.write(block);
+  if (!file.commit()) return false;
+  evict();
+  return true;
+}
+
+bool WoiceCache::contains(const QByteArray &hash) const {
+  return QFile::exists(path(hash));
+}
+
+void WoiceCache::evict() {
+  // Pinned woices stay whatever, so they take up the budget first.
+  QFileInfoList unpinned;
+  qint64 total = 0;
+  for (const QFileInfo &info : entries()) {
+    if (m_pinned.contains(QByteArray::fromHex(info.fileName().toLatin1())))
+      total += info.size();
+    else
+      unpinned.push_back(info);
+  }
+  for (const QFileInfo &info : unpinned) {
+    total += info.size();
+    if (total <= m_max_bytes) continue;
+    if (!QFile::remove(info.filePath()))
+      qWarning() << "Could not remove cached woice" << info.fileName();
+  }
+}
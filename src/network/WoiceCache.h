@@ -0,0 +1,48 @@
+#ifndef WOICECACHE_H
+#define WOICECACHE_H
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <optional>
+
+// Woices we've been sent, kept on disk by woiceHash() so that reconnecting, or
+// joining another session that uses the same instruments, doesn't need them
+// sent again. Holds both woice blocks from project files (see
+// ProjectTransfer.h) and the files added with AddWoice.
+//
+// A file's modification time is when it was last used. Once the cache goes
+// over its size limit, the least recently used woices are removed.
+class WoiceCache {
+ public:
+  // Defaults to a directory under the application's cache location.
+  WoiceCache(const QString &dir = defaultDir(),
+             qint64 max_bytes = DEFAULT_MAX_BYTES);
+  static QString defaultDir();
+  static constexpr qint64 DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+  // Hashes of up to [max] of the most recently used woices, to tell the
+  // server about.
+  QList<QByteArray> hashes(int max) const;
+  // Checks the block still matches its hash, in case the file got damaged.
+  std::optional<QByteArray> get(const QByteArray &hash) const;
+  // Neither checks the hash nor marks the woice used. Only for a cache that
+  // nothing else writes to and that's never evicted, like the server's store.
+  std::optional<QByteArray> getTrusted(const QByteArray &hash) const;
+  bool put(const QByteArray &hash, const QByteArray &block);
+  bool contains(const QByteArray &hash) const;
+  // Woices that are never removed to make room, e.g. ones we've told the
+  // server we have.
+  void setPinned(const QSet<QByteArray> &hashes) { m_pinned = hashes; }
+
+ private:
+  QString path(const QByteArray &hash) const;
+  QFileInfoList entries() const;
+  void evict();
+  QString m_dir;
+  qint64 m_max_bytes;
+  QSet<QByteArray> m_pinned;
+};
+
+#endif  // WOICECACHE_H
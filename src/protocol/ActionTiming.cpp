@@ -0,0 +1,85 @@
+#include "ActionTiming.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <chrono>
+
+qint64 timingNowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Values below SUB_BUCKETS get a bucket each. Above that, each power of two
+// is split into SUB_BUCKETS by the bits after the leading one.
+static int bucketOf(quint64 v) {
+  using H = LatencyHistogram;
+  if (v < quint64(H::SUB_BUCKETS)) return int(v);
+  int exp = 63 - qCountLeadingZeroBits(v);
+  int sub = int(v >> (exp - H::SUB_BUCKET_BITS)) & (H::SUB_BUCKETS - 1);
+  return (exp - H::SUB_BUCKET_BITS + 1) * H::SUB_BUCKETS + sub;
+}
+
+static quint64 bucketUpperBound(int b) {
+  using H = LatencyHistogram;
+  if (b < H::SUB_BUCKETS) return quint64(b);
+  int exp = b / H::SUB_BUCKETS + H::SUB_BUCKET_BITS - 1;
+  quint64 sub = b % H::SUB_BUCKETS;
+  return ((H::SUB_BUCKETS + sub + 1) << (exp - H::SUB_BUCKET_BITS)) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sum(0), m_max(0) {
+  m_buckets.fill(0);
+}
+
+void LatencyHistogram::add(qint64 us) {
+  // Clocks can't go backwards, but a stray unset timestamp can.
+  us = std::max(us, qint64(0));
+  ++m_buckets[bucketOf(us)];
+  ++m_count;
+  m_sum += us;
+  m_max = std::max(m_max, us);
+}
+
+double LatencyHistogram::mean() const {
+  return m_count == 0 ? 0 : double(m_sum) / m_count;
+}
+
+qint64 LatencyHistogram::percentile(double p) const {
+  if (m_count == 0) return 0;
+  qint64 rank = std::max(qint64(1), qint64(p * m_count + 0.5));
+  qint64 seen = 0;
+  for (int b = 0; b < NUM_BUCKETS; ++b) {
+    seen += m_buckets[b];
+    if (seen >= rank) return std::min(qint64(bucketUpperBound(b)), m_max);
+  }
+  return m_max;
+}
+
+QJsonObject LatencyHistogram::toJson() const {
+  return {{"count", m_count},
+          {"mean_us", mean()},
+          {"p50_us", percentile(0.5)},
+          {"p90_us", percentile(0.9)},
+          {"p99_us", percentile(0.99)},
+          {"max_us", m_max}};
+}
+
+void LatencyStats::add(const QString &stage, qint64 us) {
+  m_stages[stage].add(us);
+}
+
+QJsonObject LatencyStats::toJson() const {
+  QJsonObject stages;
+  for (const auto &[stage, histogram] : m_stages)
+    stages.insert(stage, histogram.toJson());
+  return stages;
+}
+
+bool LatencyStats::writeJson(const QString &filename) const {
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+  return file.write(QJsonDocument(toJson()).toJson()) != -1;
+}
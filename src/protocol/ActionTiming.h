@@ -0,0 +1,73 @@
+#ifndef ACTIONTIMING_H
+#define ACTIONTIMING_H
+
+#include <QDataStream>
+#include <QJsonObject>
+#include <QMetaType>
+#include <array>
+#include <map>
+#include <optional>
+
+// Timestamps that follow an action from the client that sent it, through the
+// server and back out to everyone. Only clients that are tracing latency fill
+// these in, so other traffic just carries an empty optional.
+//
+// Each side only ever subtracts its own timestamps, so the client's and
+// server's clocks don't need to agree. All are in microseconds from
+// timingNowUs().
+struct ActionTiming {
+  // On the sending client's clock.
+  qint64 client_sent;
+  // On the server's clock: when the session read it off the socket and when
+  // it was handed to the sessions to go back out.
+  qint64 server_received;
+  qint64 server_sent;
+};
+inline QDataStream &operator<<(QDataStream &out, const ActionTiming &a) {
+  out << a.client_sent << a.server_received << a.server_sent;
+  return out;
+}
+inline QDataStream &operator>>(QDataStream &in, ActionTiming &a) {
+  in >> a.client_sent >> a.server_received >> a.server_sent;
+  return in;
+}
+Q_DECLARE_METATYPE(std::optional<ActionTiming>)
+
+// Monotonic, so only meaningful within one process.
+qint64 timingNowUs();
+
+// A log-scale histogram of durations in microseconds. Buckets are a quarter
+// of an octave wide, so percentiles are good to within ~20%.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  void add(qint64 us);
+  qint64 count() const { return m_count; }
+  qint64 max() const { return m_max; }
+  double mean() const;
+  // An upper bound on the [p]th percentile, for p in [0, 1].
+  qint64 percentile(double p) const;
+  QJsonObject toJson() const;
+
+  static constexpr int SUB_BUCKET_BITS = 2;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+ private:
+  std::array<qint64, NUM_BUCKETS> m_buckets;
+  qint64 m_count, m_sum, m_max;
+};
+
+// Histograms for each stage an action goes through, by name.
+class LatencyStats {
+ public:
+  void add(const QString &stage, qint64 us);
+  bool empty() const { return m_stages.empty(); }
+  QJsonObject toJson() const;
+  bool writeJson(const QString &filename) const;
+
+ private:
+  std::map<QString, LatencyHistogram> m_stages;
+};
+
+#endif  // ACTIONTIMING_H
@@ -0,0 +1,18 @@
+#include "Frame.h"
+
+#include <QtEndian>
+
+std::optional<QByteArray> readFrame(QIODevice *device, quint32 max_size) {
+  char header[FRAME_HEADER_SIZE];
+  if (device->peek(header, FRAME_HEADER_SIZE) < FRAME_HEADER_SIZE)
+    return std::nullopt;
+  quint32 size = qFromBigEndian<quint32>(header);
+  if (size > max_size)
+    throw QString("Frame of %1 bytes is over the limit of %2")
+        .arg(size)
+        .arg(max_size);
+  if (device->bytesAvailable() < FRAME_HEADER_SIZE + qint64(size))
+    return std::nullopt;
+  device->skip(FRAME_HEADER_SIZE);
+  return device->read(size);
+}
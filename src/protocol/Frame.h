@@ -0,0 +1,44 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QIODevice>
+#include <QtEndian>
+#include <optional>
+
+// Everything between a client and server goes in frames: a quint32 length
+// followed by that many bytes of message. The reader waits until a whole frame
+// has been buffered and deserializes it once. (Retrying a QDataStream
+// transaction each time part of a big message arrives is quadratic.)
+constexpr int FRAME_HEADER_SIZE = sizeof(quint32);
+
+// Caps on a frame's length, so that a peer can't make us buffer an arbitrary
+// amount just by announcing a big frame. Until the hello is done only small
+// messages are expected: a username and some woice hashes.
+constexpr quint32 MAX_HELLO_FRAME_SIZE = 1024 * 1024;
+// Woices are the biggest things in an action, and are limited to this when
+// they're added.
+constexpr qint64 MAX_WOICE_SIZE = 32 * 1024 * 1024;
+// Room for a woice plus the rest of the action, or a big paste.
+constexpr quint32 MAX_ACTION_FRAME_SIZE = 64 * 1024 * 1024;
+
+// A frame holding whatever [write] puts on the stream it's given.
+template <typename Write>
+QByteArray makeFrame(Write write) {
+  QByteArray frame;
+  QDataStream out(&frame, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_5_5);
+  out << quint32(0);
+  write(out);
+  // Fill in the length now that it's known.
+  qToBigEndian<quint32>(frame.size() - FRAME_HEADER_SIZE, frame.data());
+  return frame;
+}
+
+// Takes the next frame's message off [device] if all of it has arrived. Throws
+// a QString if the length is over [max_size], i.e. the stream is garbage or the
+// peer is misbehaving.
+std::optional<QByteArray> readFrame(QIODevice *device, quint32 max_size);
+
+#endif  // FRAME_H
@@ -6,10 +6,15 @@
 // communicate with each other
 constexpr char CLIENT_HELLO[] = "PTCOLLAB_CLIENT_HELLO";
 constexpr char SERVER_HELLO[] = "PTCOLLAB_SERVER_HELLO";
-const qint64 PROTOCOL_VERSION = 2;
+const qint64 PROTOCOL_VERSION = 8;
 
-ClientHello::ClientHello(const QString &username)
-    : hello(CLIENT_HELLO), version(PROTOCOL_VERSION), m_username(username) {}
+ClientHello::ClientHello(const QString &username, quint32 features,
+                         const QList<QByteArray> &cached_woices)
+    : hello(CLIENT_HELLO),
+      version(PROTOCOL_VERSION),
+      m_username(username),
+      m_features(features),
+      m_cached_woices(cached_woices) {}
 
 bool ClientHello::isValid() {
   return (hello == CLIENT_HELLO) && (version == PROTOCOL_VERSION);
@@ -18,15 +23,20 @@ bool ClientHello::isValid() {
 QString ClientHello::username() { return m_username; }
 
 QDataStream &operator<<(QDataStream &out, const ClientHello &m) {
-  return (out << m.hello << m.version << m.m_username);
+  return (out << m.hello << m.version << m.m_username << m.m_features
+              << m.m_cached_woices);
 }
 
 QDataStream &operator>>(QDataStream &in, ClientHello &m) {
-  return (in >> m.hello >> m.version >> m.m_username);
+  return (in >> m.hello >> m.version >> m.m_username >> m.m_features >>
+          m.m_cached_woices);
 }
 
-ServerHello::ServerHello(qint64 uid)
-    : hello(SERVER_HELLO), version(PROTOCOL_VERSION), m_uid(uid) {}
+ServerHello::ServerHello(qint64 uid, quint32 features)
+    : hello(SERVER_HELLO),
+      version(PROTOCOL_VERSION),
+      m_uid(uid),
+      m_features(features) {}
 
 bool ServerHello::isValid() {
   return (hello == SERVER_HELLO && version == PROTOCOL_VERSION && m_uid != -1);
@@ -36,10 +46,10 @@ qint64 ServerHello::uid() { return m_uid; }
 
 QDataStream &operator<<(QDataStream &out, const ServerHello &m) {
   // qDebug() << "Sending server hello" << m.hello << m.version << m.m_uid;
-  return (out << m.hello << m.version << m.m_uid);
+  return (out << m.hello << m.version << m.m_uid << m.m_features);
 }
 QDataStream &operator>>(QDataStream &in, ServerHello &m) {
-  (in >> m.hello >> m.version >> m.m_uid);
+  (in >> m.hello >> m.version >> m.m_uid >> m.m_features);
   // qDebug() << "Received server hello" << m.hello << m.version << m.m_uid;
   return in;
 }
@@ -2,18 +2,39 @@
 #define HELLO_H
 
 #include <QDataStream>
+#include <QList>
 extern const qint64 PROTOCOL_VERSION;
+
+// Optional parts of the protocol. The client asks for the ones it supports in
+// its hello, and the server's hello says which of those it's using.
+enum HelloFeature : quint32 {
+  // The project is sent as separately compressed segments, leaving out woices
+  // the client has cached. See ProjectTransfer.h.
+  COMPRESSED_PROJECT = 1 << 0,
+};
+
+// How many cached woices a client tells the server about, most recently used
+// first. Keeps the hello small (see MAX_HELLO_FRAME_SIZE) however big the
+// cache gets.
+constexpr int MAX_HELLO_WOICE_HASHES = 1024;
+
 // Two classes to encapsulate the data sent between client and server on initial
 // connection.
 class ClientHello {
   QString hello;
   qint64 version;
   QString m_username;
+  quint32 m_features;
+  // woiceHash()es of the woices the client already has.
+  QList<QByteArray> m_cached_woices;
 
  public:
-  ClientHello(const QString &username = "");
+  ClientHello(const QString &username = "", quint32 features = 0,
+              const QList<QByteArray> &cached_woices = {});
   bool isValid();
   QString username();
+  quint32 features() const { return m_features; }
+  const QList<QByteArray> &cachedWoices() const { return m_cached_woices; }
   friend QDataStream &operator<<(QDataStream &out, const ClientHello &m);
   friend QDataStream &operator>>(QDataStream &in, ClientHello &m);
 };
@@ -25,11 +46,13 @@ class ServerHello {
   QString hello;
   qint64 version;
   qint64 m_uid;
+  quint32 m_features;
 
  public:
-  ServerHello(qint64 uid = -1);
+  ServerHello(qint64 uid = -1, quint32 features = 0);
   bool isValid();
   qint64 uid();
+  quint32 features() const { return m_features; }
   friend QDataStream &operator<<(QDataStream &out, const ServerHello &m);
   friend QDataStream &operator>>(QDataStream &in, ServerHello &m);
 };
@@ -48,3 +48,31 @@ void NoIdMap::swapAdjacent(size_t no1, size_t no2) {
   m_id_to_no[m_no_to_id[no2]] = no2;
   m_id_to_no[m_no_to_id[no1]] = no1;
 }
+
+QDataStream &operator<<(QDataStream &out, const NoIdMap &m) {
+  out << qint32(m.m_next_id) << quint32(m.m_no_to_id.size());
+  for (qint32 id : m.m_no_to_id) out << id;
+  return out;
+}
+
+QDataStream &operator>>(QDataStream &in, NoIdMap &m) {
+  qint32 next_id;
+  quint32 size;
+  in >> next_id >> size;
+  std::vector<qint32> no_to_id;
+  std::map<qint32, size_t> id_to_no;
+  for (quint32 no = 0; no < size && in.status() == QDataStream::Ok; ++no) {
+    qint32 id;
+    in >> id;
+    if (id < 0 || id >= next_id || !id_to_no.emplace(id, no).second) {
+      in.setStatus(QDataStream::ReadCorruptData);
+      return in;
+    }
+    no_to_id.push_back(id);
+  }
+  if (in.status() != QDataStream::Ok) return in;
+  m.m_next_id = next_id;
+  m.m_no_to_id = std::move(no_to_id);
+  m.m_id_to_no = std::move(id_to_no);
+  return in;
+}
@@ -1,6 +1,7 @@
 #ifndef NOIDMAP_H
 #define NOIDMAP_H
 
+#include <QDataStream>
 #include <QObject>
 #include <map>
 #include <optional>
@@ -20,6 +21,9 @@ class NoIdMap {
   void swapAdjacent(size_t no1, size_t no2);
   // TODO: move unit
 
+  friend QDataStream &operator<<(QDataStream &out, const NoIdMap &m);
+  friend QDataStream &operator>>(QDataStream &in, NoIdMap &m);
+
  private:
   int m_next_id;
   std::map<qint32, size_t> m_id_to_no;
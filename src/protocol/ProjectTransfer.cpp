@@ -0,0 +1,131 @@
+#include "ProjectTransfer.h"
+
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <algorithm>
+
+QDataStream &operator<<(QDataStream &out, const ProjectSegment &s) {
+  out << quint8(s.kind);
+  if (s.kind != ProjectSegment::DATA) out << s.hash;
+  if (s.kind != ProjectSegment::CACHED_WOICE) out << s.compressed;
+  return out;
+}
+
+QDataStream &operator>>(QDataStream &in, ProjectSegment &s) {
+  quint8 kind;
+  in >> kind;
+  if (kind > ProjectSegment::CACHED_WOICE) {
+    in.setStatus(QDataStream::ReadCorruptData);
+    return in;
+  }
+  s.kind = ProjectSegment::Kind(kind);
+  s.hash.clear();
+  s.compressed.clear();
+  if (s.kind != ProjectSegment::DATA) in >> s.hash;
+  if (s.kind != ProjectSegment::CACHED_WOICE) in >> s.compressed;
+  return in;
+}
+
+QByteArray woiceHash(const QByteArray &block) {
+  return QCryptographicHash::hash(block, QCryptographicHash::Sha1);
+}
+
+// The layout of a v5 file (see pxtnService): a version code, the exe version
+// and a dummy, then blocks of an 8-byte tag, a little-endian int32 size and
+// that many bytes, up to an end block. The exception is the event block, whose
+// size is an overestimate (see pxtnEvelist::io_Write), so it has to be walked.
+constexpr int VERSION_SIZE = 16;
+constexpr int HEADER_SIZE = VERSION_SIZE + 2 * sizeof(quint16);
+constexpr int TAG_SIZE = 8;
+constexpr int BLOCK_HEADER_SIZE = TAG_SIZE + sizeof(qint32);
+static const QByteArray V5_VERSIONS[] = {"PTCOLLAGE-071119",
+                                         "PTTUNE--20071119"};
+static const QByteArray WOICE_TAGS[] = {"matePCM ", "matePTV ", "matePTN ",
+                                        "mateOGGV"};
+static const QByteArray EVENT_TAG = "Event V5";
+static const QByteArray END_TAG = "pxtoneND";
+
+// Returns the position after the varint at [pos], or -1 if it's cut off.
+static int skipVarint(const QByteArray &data, int pos) {
+  for (int i = 0; i < 5 && pos < data.size(); ++i)
+    if (!(data[pos++] & 0x80)) return pos;
+  return -1;
+}
+
+// Returns where the block at [pos] ends, or -1 if it's cut off.
+static int blockEnd(const QByteArray &data, int pos) {
+  const char *p = data.constData() + pos + TAG_SIZE;
+  qint32 size = qFromLittleEndian<qint32>(p);
+  if (data.mid(pos, TAG_SIZE) != EVENT_TAG) {
+    if (size < 0 || size > data.size() - pos - BLOCK_HEADER_SIZE) return -1;
+    return pos + BLOCK_HEADER_SIZE + size;
+  }
+
+  // The size is followed by the number of events, each a varint clock, unit
+  // no and kind bytes and a varint value.
+  pos += BLOCK_HEADER_SIZE;
+  if (pos + int(sizeof(qint32)) > data.size()) return -1;
+  qint32 events = qFromLittleEndian<qint32>(data.constData() + pos);
+  pos += sizeof(qint32);
+  for (qint32 i = 0; i < events; ++i) {
+    pos = skipVarint(data, pos);
+    if (pos == -1 || pos + 2 > data.size()) return -1;
+    pos = skipVarint(data, pos + 2);
+    if (pos == -1) return -1;
+  }
+  return pos;
+}
+
+std::vector<std::pair<bool, QByteArray>> splitProject(const QByteArray &data) {
+  std::vector<std::pair<bool, QByteArray>> pieces;
+  bool v5 = false;
+  for (const QByteArray &version : V5_VERSIONS)
+    v5 |= data.startsWith(version);
+  if (!v5 || data.size() < HEADER_SIZE) {
+    if (!data.isEmpty()) pieces.emplace_back(false, data);
+    return pieces;
+  }
+
+  // Anything we can't make sense of is left in a data piece, so joining the
+  // pieces back up always gives the original.
+  int data_start = 0, pos = HEADER_SIZE;
+  while (pos + BLOCK_HEADER_SIZE <= data.size()) {
+    QByteArray tag = data.mid(pos, TAG_SIZE);
+    int end = blockEnd(data, pos);
+    if (end == -1) break;
+    if (std::find(std::begin(WOICE_TAGS), std::end(WOICE_TAGS), tag) !=
+        std::end(WOICE_TAGS)) {
+      if (pos > data_start)
+        pieces.emplace_back(false, data.mid(data_start, pos - data_start));
+      pieces.emplace_back(true, data.mid(pos, end - pos));
+      data_start = end;
+    }
+    pos = end;
+    if (tag == END_TAG) break;
+  }
+  if (data_start < data.size())
+    pieces.emplace_back(false, data.mid(data_start));
+  return pieces;
+}
+
+PreparedProject::PreparedProject(const QByteArray &data) : m_data(data) {
+  for (const auto &[is_woice, bytes] : splitProject(data)) {
+    if (is_woice)
+      m_segments.push_back(
+          {ProjectSegment::WOICE, woiceHash(bytes), qCompress(bytes)});
+    else
+      m_segments.push_back({ProjectSegment::DATA, {}, qCompress(bytes)});
+  }
+}
+
+QList<ProjectSegment> PreparedProject::segmentsFor(
+    const QSet<QByteArray> &cached) const {
+  QList<ProjectSegment> segments;
+  for (const ProjectSegment &s : m_segments) {
+    if (s.kind == ProjectSegment::WOICE && cached.contains(s.hash))
+      segments.push_back({ProjectSegment::CACHED_WOICE, s.hash, {}});
+    else
+      segments.push_back(s);
+  }
+  return segments;
+}
@@ -0,0 +1,50 @@
+#ifndef PROJECTTRANSFER_H
+#define PROJECTTRANSFER_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QList>
+#include <QSet>
+#include <vector>
+
+// How the project is sent to a client that asks for a compressed hello.
+//
+// The file is cut at woice block boundaries into segments. Woices are usually
+// most of a project's size and are often shared between projects, so each is
+// keyed by a hash of its bytes and left out (sent as CACHED_WOICE) if the
+// client said it already has it. Each segment is compressed on its own, so the
+// client can decompress and report progress as they arrive. Concatenating the
+// segments' bytes gives back the original file exactly.
+struct ProjectSegment {
+  enum Kind : quint8 { DATA, WOICE, CACHED_WOICE };
+  Kind kind;
+  // For woices, woiceHash() of the block.
+  QByteArray hash;
+  // qCompress()ed bytes of the segment. Empty for a cached woice.
+  QByteArray compressed;
+};
+QDataStream &operator<<(QDataStream &out, const ProjectSegment &s);
+QDataStream &operator>>(QDataStream &in, ProjectSegment &s);
+
+QByteArray woiceHash(const QByteArray &block);
+
+// Splits a project file into its woice blocks and the data between them, as
+// (is_woice, bytes) pairs. Files in formats that we don't split come back as
+// one data piece.
+std::vector<std::pair<bool, QByteArray>> splitProject(const QByteArray &data);
+
+// A project that's been split and compressed once, to be sent to every client
+// that connects.
+class PreparedProject {
+ public:
+  explicit PreparedProject(const QByteArray &data);
+  const QByteArray &data() const { return m_data; }
+  // The segments to send to a client that has the woices in [cached].
+  QList<ProjectSegment> segmentsFor(const QSet<QByteArray> &cached) const;
+
+ private:
+  QByteArray m_data;
+  std::vector<ProjectSegment> m_segments;
+};
+
+#endif  // PROJECTTRANSFER_H
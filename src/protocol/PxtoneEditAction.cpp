@@ -1,6 +1,11 @@
 #include "PxtoneEditAction.h"
 
 #include <QDebug>
+#include <QtEndian>
+#include <limits>
+#include <stdexcept>
+
+#include "Frame.h"
 
 namespace Action {
 
@@ -126,6 +131,73 @@ std::list<Primitive> apply_and_get_undo(const std::list<Primitive> &actions,
   }
   return undo;
 }
+void Footprint::add(const Primitive &a) {
+  Interval affected;
+  std::visit(
+      overloaded{[&](const Add &b) {
+                   qint32 length = Evelist_Kind_IsTail(a.kind) ? b.value : 1;
+                   affected = {a.start_clock,
+                               a.start_clock + std::max(length, 1)};
+                 },
+                 [&](const Delete &b) {
+                   affected = {a.start_clock,
+                               std::max(b.end_clock, a.start_clock + 1)};
+                 },
+                 [&](const Shift &b) {
+                   if (Evelist_Kind_IsTail(a.kind))
+                     affected = {a.start_clock,
+                                 std::numeric_limits<qint32>::max()};
+                   else
+                     affected = {a.start_clock,
+                                 std::max(b.end_clock, a.start_clock + 1)};
+                 }},
+      a.type);
+
+  auto [it, inserted] =
+      m_bounds.try_emplace(std::make_pair(a.unit_id, a.kind), affected);
+  if (!inserted)
+    it->second = {std::min(it->second.start, affected.start),
+                  std::max(it->second.end, affected.end)};
+}
+
+void Footprint::add(const std::list<Primitive> &as) {
+  for (const Primitive &a : as) add(a);
+}
+
+void Footprint::add(const Footprint &other) {
+  for (const auto &[key, interval] : other.m_bounds) {
+    auto [it, inserted] = m_bounds.try_emplace(key, interval);
+    if (!inserted)
+      it->second = {std::min(it->second.start, interval.start),
+                    std::max(it->second.end, interval.end)};
+  }
+}
+
+Interval Footprint::clocks() const {
+  Interval clocks{std::numeric_limits<qint32>::max(),
+                  std::numeric_limits<qint32>::min()};
+  for (const auto &[key, interval] : m_bounds) {
+    clocks.start = std::min(clocks.start, interval.start);
+    clocks.end = std::max(clocks.end, Evelist_Kind_IsTail(key.second)
+                                          ? interval.end
+                                          : std::numeric_limits<qint32>::max());
+  }
+  return clocks;
+}
+
+bool Footprint::intersects(const Footprint &other) const {
+  const Footprint &smaller =
+      (m_bounds.size() <= other.m_bounds.size() ? *this : other);
+  const Footprint &larger = (&smaller == this ? other : *this);
+  for (const auto &[key, interval] : smaller.m_bounds) {
+    auto it = larger.m_bounds.find(key);
+    if (it != larger.m_bounds.end() &&
+        !interval_intersect(interval, it->second).empty())
+      return true;
+  }
+  return false;
+}
+
 QDataStream &operator<<(QDataStream &out, const Add &a) {
   return (out << a.value);
 }
@@ -152,4 +224,160 @@ QDataStream &operator>>(QDataStream &in, Primitive &a) {
   in >> a.unit_id >> a.start_clock >> a.type;
   return in;
 }
+
+// Compact encoding. See header for the rationale.
+enum CompactEncoding : quint8 { RAW, ZLIB };
+// Below this many bytes zlib's header overhead usually isn't worth it.
+constexpr int COMPRESS_THRESHOLD = 512;
+// A list is never compressed unless that makes it smaller, and uncompressed
+// it would have to fit in a frame, so nothing legitimate inflates past this.
+constexpr quint32 MAX_DECOMPRESSED_SIZE = MAX_ACTION_FRAME_SIZE;
+
+static quint64 zigzag(qint64 v) { return (quint64(v) << 1) ^ quint64(v >> 63); }
+static qint64 unzigzag(quint64 v) { return qint64(v >> 1) ^ -qint64(v & 1); }
+
+static void writeVarint(QByteArray &out, quint64 v) {
+  while (v >= 0x80) {
+    out.append(char((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.append(char(v));
+}
+static void writeSigned(QByteArray &out, qint64 v) {
+  writeVarint(out, zigzag(v));
+}
+
+namespace {
+struct CompactReader {
+  const QByteArray &data;
+  int pos;
+
+  bool atEnd() const { return pos >= data.size(); }
+  quint8 byte() {
+    if (atEnd()) throw std::runtime_error("truncated compact primitive list");
+    return quint8(data[pos++]);
+  }
+  quint64 varint() {
+    quint64 v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      quint8 b = byte();
+      v |= quint64(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) return v;
+    }
+    throw std::runtime_error("overlong varint in compact primitive list");
+  }
+  qint64 signedVarint() { return unzigzag(varint()); }
+};
+}  // namespace
+
+static QByteArray encodeRuns(const std::list<Primitive> &as) {
+  QByteArray out;
+  qint32 last_clock = 0;
+  for (auto run_start = as.begin(); run_start != as.end();) {
+    auto run_end = run_start;
+    quint64 run_length = 0;
+    while (run_end != as.end() && run_end->kind == run_start->kind &&
+           run_end->unit_id == run_start->unit_id) {
+      ++run_end;
+      ++run_length;
+    }
+
+    out.append(char(run_start->kind));
+    writeSigned(out, run_start->unit_id);
+    writeVarint(out, run_length);
+    for (auto it = run_start; it != run_end; ++it) {
+      const Primitive &a = *it;
+      out.append(char(a.type.index()));
+      writeSigned(out, qint64(a.start_clock) - last_clock);
+      last_clock = a.start_clock;
+      std::visit(overloaded{[&](const Add &b) { writeSigned(out, b.value); },
+                            [&](const Delete &b) {
+                              writeSigned(out,
+                                          qint64(b.end_clock) - a.start_clock);
+                            },
+                            [&](const Shift &b) {
+                              writeSigned(out,
+                                          qint64(b.end_clock) - a.start_clock);
+                              writeSigned(out, b.offset);
+                            }},
+                 a.type);
+    }
+    run_start = run_end;
+  }
+  return out;
+}
+
+static std::list<Primitive> decodeRuns(const QByteArray &data) {
+  std::list<Primitive> as;
+  CompactReader r{data, 0};
+  qint32 last_clock = 0;
+  while (!r.atEnd()) {
+    quint8 kind = r.byte();
+    if (kind >= EVENTKIND_NUM)
+      throw std::runtime_error("invalid event kind in compact primitive list");
+    qint32 unit_id = qint32(r.signedVarint());
+    quint64 run_length = r.varint();
+    for (quint64 i = 0; i < run_length; ++i) {
+      Primitive a{EVENTKIND(kind), unit_id, 0, Add{0}};
+      quint8 type = r.byte();
+      a.start_clock = qint32(last_clock + r.signedVarint());
+      last_clock = a.start_clock;
+      switch (type) {
+        case 0:
+          a.type = Add{qint32(r.signedVarint())};
+          break;
+        case 1:
+          a.type = Delete{qint32(a.start_clock + r.signedVarint())};
+          break;
+        case 2: {
+          qint32 end_clock = qint32(a.start_clock + r.signedVarint());
+          a.type = Shift{end_clock, qint32(r.signedVarint())};
+        } break;
+        default:
+          throw std::runtime_error("invalid variant index");
+      }
+      as.push_back(a);
+    }
+  }
+  return as;
+}
+
+QDataStream &writeCompact(QDataStream &out, const std::list<Primitive> &as) {
+  QByteArray payload = encodeRuns(as);
+  CompactEncoding encoding = RAW;
+  if (payload.size() > COMPRESS_THRESHOLD) {
+    QByteArray compressed = qCompress(payload);
+    if (compressed.size() < payload.size()) {
+      payload = compressed;
+      encoding = ZLIB;
+    }
+  }
+  out << quint8(encoding) << payload;
+  return out;
+}
+
+QDataStream &readCompact(QDataStream &in, std::list<Primitive> &as) {
+  quint8 encoding;
+  QByteArray payload;
+  in >> encoding >> payload;
+  if (in.status() != QDataStream::Ok) return in;
+  switch (encoding) {
+    case RAW:
+      break;
+    case ZLIB:
+      // qUncompress allocates however much the 4-byte big-endian size that
+      // qCompress writes first says, so check that before trusting it.
+      if (payload.size() < int(sizeof(quint32)) ||
+          qFromBigEndian<quint32>(payload.constData()) > MAX_DECOMPRESSED_SIZE)
+        throw std::runtime_error("bad size on compressed primitive list");
+      payload = qUncompress(payload);
+      if (payload.isEmpty())
+        throw std::runtime_error("could not decompress primitive list");
+      break;
+    default:
+      throw std::runtime_error("unknown primitive list encoding");
+  }
+  as = decodeRuns(payload);
+  return in;
+}
 }  // namespace Action
@@ -4,11 +4,13 @@
 #include <QDataStream>
 #include <QDebug>
 #include <QList>
+#include <map>
 #include <optional>
 #include <set>
 #include <vector>
 
 #include "NoIdMap.h"
+#include "editor/Interval.h"
 #include "protocol/SerializeVariant.h"
 #include "pxtone/pxtnService.h"
 
@@ -76,6 +78,45 @@ inline QTextStream &operator<<(QTextStream &out, const Primitive &a) {
 QDataStream &operator<<(QDataStream &out, const Primitive &a);
 QDataStream &operator>>(QDataStream &in, Primitive &a);
 
+// A more compact wire format for a list of primitives. Large pastes and
+// selection edits produce long runs of primitives with the same kind & unit
+// and nearby clocks, so consecutive primitives are grouped into runs sharing
+// (kind, unit_id), clocks are delta-encoded and all ints are zigzag varints.
+// Order is preserved since primitives aren't commutative. Payloads above a
+// size threshold are additionally zlib-compressed if that helps.
+//
+// Throws std::runtime_error on malformed (but complete) data, like the
+// variant deserializer.
+QDataStream &writeCompact(QDataStream &out, const std::list<Primitive> &as);
+QDataStream &readCompact(QDataStream &in, std::list<Primitive> &as);
+
+// Where in the project a list of primitives could have an effect. Kept as a
+// bounding clock interval per (unit, kind), so it's conservative. For tail
+// kinds (on events) an add covers the whole note, and a shift covers
+// everything after its start since it can lengthen notes.
+//
+// Used so that a remote action only needs to roll back the local uncommitted
+// actions if their footprints intersect. Note that to be safe, the footprint
+// of an applied action should include its undo as well, because e.g. deleting
+// part of a note also touches the rest of the note.
+class Footprint {
+ public:
+  Footprint() {}
+  Footprint(const std::list<Primitive> &as) { add(as); }
+  void add(const Primitive &a);
+  void add(const std::list<Primitive> &as);
+  void add(const Footprint &other);
+  bool intersects(const Footprint &other) const;
+  bool empty() const { return m_bounds.empty(); }
+  // The clocks over which the song could sound or look different. Kinds that
+  // aren't tails set a value that lasts until the next event of their kind, so
+  // their span runs on to the end.
+  Interval clocks() const;
+
+ private:
+  std::map<std::pair<qint32, EVENTKIND>, Interval> m_bounds;
+};
+
 // You have to compute the undo at the time the original action was applied in
 // the case of collaborative editing. You can't compute it beforehand.
 std::list<Primitive> apply_and_get_undo(const std::list<Primitive> &actions,
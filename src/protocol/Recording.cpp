@@ -0,0 +1,442 @@
+#include "Recording.h"
+
+#include <QDebug>
+#include <QTimer>
+
+#include "protocol/ProjectTransfer.h"
+
+constexpr qint64 RECORDING_VERSION = 3;
+// Version 1 bodies are just (elapsed, action) pairs without a record kind.
+constexpr qint64 OLDEST_RECORDING_VERSION = 1;
+
+// How actions are laid out in the body. Up to recording version 2 this went
+// by the wire protocol version, which was in the header instead. Most
+// protocol bumps don't change the actions though, so now the recording has
+// its own version for them. Bump it when the serialization of an action that
+// gets recorded changes, and keep reading the old one in readAction below.
+//   1: Protocol 2. EditActions were plain lists of primitives, and AddWoices
+//      had no hash.
+//   2: Protocols 3 to 5. EditActions are compact (see Action::writeCompact).
+//   3: Protocols 6 and 7, and recording version 3 on. AddWoices have a hash.
+constexpr qint64 ACTION_FORMAT = 3;
+
+// The action format of a recording with the given header, if we can read it.
+static std::optional<qint64> actionFormat(qint64 format_or_protocol,
+                                          qint64 recording_version) {
+  switch (recording_version) {
+    case 1:
+      // Version 1 was only ever written with protocol 2.
+      if (format_or_protocol == 2) return 1;
+      break;
+    case 2:
+      if (format_or_protocol >= 3 && format_or_protocol <= 5) return 2;
+      if (format_or_protocol >= 6 && format_or_protocol <= 7) return 3;
+      break;
+    case RECORDING_VERSION:
+      if (format_or_protocol >= 1 && format_or_protocol <= ACTION_FORMAT)
+        return format_or_protocol;
+      break;
+  }
+  return std::nullopt;
+}
+
+// How often a checkpoint is written, in recording time, at most.
+constexpr qint64 CHECKPOINT_INTERVAL_MS = 30000;
+// A checkpoint also waits until the actions since the last one take up at
+// least this much of the last one's size. Otherwise a project with big woices
+// would fill the file with copies of itself. Either way, a seek replays at
+// most about this much of a snapshot's worth of actions.
+constexpr double MIN_ACTIONS_PER_SNAPSHOT_BYTE = 0.25;
+// How often the writer flushes to disk, in real time.
+constexpr int FLUSH_INTERVAL_MS = 1000;
+// The next uid comes after the action format and recording versions.
+constexpr qint64 NEXT_UID_OFFSET = 2 * sizeof(qint64);
+
+// The last thing in a finalized file: the absolute offset of the index
+// followed by this magic number.
+constexpr quint32 INDEX_MAGIC = 0x50545249;  // 'PTRI'
+constexpr qint64 TRAILER_SIZE = sizeof(qint64) + sizeof(quint32);
+
+enum struct RecordKind : quint8 { ACTION = 0, CHECKPOINT = 1 };
+
+// Before format 3, only EditAction and AddWoice (also in ChangeWoice) were
+// laid out differently.
+static_assert(std::is_same_v<std::variant_alternative_t<0, ClientAction>,
+                             EditAction> &&
+                  std::is_same_v<std::variant_alternative_t<6, ClientAction>,
+                                 AddWoice> &&
+                  std::is_same_v<std::variant_alternative_t<8, ClientAction>,
+                                 ChangeWoice>,
+              "Old ClientAction indices have moved");
+
+static void readAction(QDataStream &in, EditAction &a, qint64 format) {
+  if (format >= 2) {
+    in >> a;
+    return;
+  }
+  quint64 size;
+  in >> a.idx >> size;
+  for (quint64 i = 0; i < size && in.status() == QDataStream::Ok; ++i) {
+    Action::Primitive p;
+    in >> p;
+    a.action.push_back(p);
+  }
+}
+
+static void readAction(QDataStream &in, AddWoice &a, qint64 format) {
+  if (format >= 3) {
+    in >> a;
+    return;
+  }
+  read_as_qint8(in, a.type);
+  in >> a.name >> a.data;
+  // Playback doesn't go through BroadcastServer::broadcastAction, which is
+  // what fills this in for live actions.
+  a.hash = woiceHash(a.data);
+}
+
+static void readAction(QDataStream &in, ClientAction &a, qint64 format) {
+  quint64 index;
+  in >> index;
+  switch (index) {
+    case 0: {
+      EditAction e;
+      readAction(in, e, format);
+      a = std::move(e);
+      break;
+    }
+    case 6: {
+      AddWoice w;
+      readAction(in, w, format);
+      a = std::move(w);
+      break;
+    }
+    case 8: {
+      ChangeWoice c;
+      in >> c.remove;
+      readAction(in, c.add, format);
+      a = std::move(c);
+      break;
+    }
+    default:
+      ::detail::variant_switch<std::variant_size_v<ClientAction> - 1>{}(
+          size_t(index), in, a);
+  }
+}
+
+static void readAction(QDataStream &in, ServerAction &a, qint64 format) {
+  if (format == ACTION_FORMAT) {
+    in >> a;
+    return;
+  }
+  quint64 index;
+  in >> a.uid >> index;
+  if (index == 0) {
+    ClientAction c;
+    readAction(in, c, format);
+    a.action = std::move(c);
+  } else
+    ::detail::variant_switch<std::variant_size_v<decltype(a.action)> - 1>{}(
+        size_t(index), in, a.action);
+}
+
+RecordingReader::RecordingReader(QIODevice *device)
+    : m_device(device), m_stream(device) {
+  qint64 format_or_protocol;
+  m_stream >> format_or_protocol >> m_version;
+  std::optional<qint64> format = actionFormat(format_or_protocol, m_version);
+  if (!format.has_value())
+    throw QString("Incompatible recording version. %1.%2 (%3.%4)")
+        .arg(format_or_protocol)
+        .arg(m_version)
+        .arg(ACTION_FORMAT)
+        .arg(RECORDING_VERSION);
+  m_action_format = format.value();
+  m_stream >> m_next_uid >> m_data;
+  if (m_stream.status() != QDataStream::Ok)
+    throw QString("Could not read recording header");
+
+  m_body_start = m_device->pos();
+  m_body_end = m_device->size();
+  if (m_version >= 2) {
+    bool indexed = readIndex();
+    if (m_version == 2)
+      // Its checkpoints don't have the project, so there's nothing to seek to.
+      m_index.clear();
+    else if (!indexed)
+      qWarning() << "Recording has no index. It may not have been closed "
+                    "properly. Seeking will be slow.";
+    m_stream.resetStatus();
+    m_device->seek(m_body_start);
+  }
+}
+
+bool RecordingReader::readIndex() {
+  if (m_body_end - m_body_start < TRAILER_SIZE) return false;
+  m_device->seek(m_body_end - TRAILER_SIZE);
+  qint64 index_offset;
+  quint32 magic;
+  m_stream >> index_offset >> magic;
+  if (m_stream.status() != QDataStream::Ok || magic != INDEX_MAGIC ||
+      index_offset < m_body_start ||
+      index_offset > m_body_end - TRAILER_SIZE)
+    return false;
+  m_device->seek(index_offset);
+  quint32 size;
+  m_stream >> size;
+  std::vector<RecordingCheckpoint> index;
+  for (quint32 i = 0; i < size && m_stream.status() == QDataStream::Ok; ++i) {
+    RecordingCheckpoint c;
+    m_stream >> c.elapsed >> c.offset;
+    // Version 2 also had the length of the history so far.
+    if (m_version == 2) {
+      qint32 history_size;
+      m_stream >> history_size;
+    }
+    index.push_back(c);
+  }
+  if (m_stream.status() != QDataStream::Ok) return false;
+  m_index = std::move(index);
+  m_body_end = index_offset;
+  return true;
+}
+
+bool RecordingReader::atEnd() const {
+  return m_device->pos() >= m_body_end || m_stream.atEnd();
+}
+
+bool RecordingReader::next(qint64 &elapsed, ServerAction &action) {
+  while (!atEnd()) {
+    m_stream >> elapsed;
+    if (m_version == 1) {
+      readAction(action);
+      return m_stream.status() == QDataStream::Ok;
+    }
+
+    quint8 kind;
+    m_stream >> kind;
+    switch (RecordKind(kind)) {
+      case RecordKind::ACTION:
+        readAction(action);
+        return m_stream.status() == QDataStream::Ok;
+      case RecordKind::CHECKPOINT:
+        if (m_version == 2) {
+          qint32 history_size;
+          m_stream >> history_size;
+        }
+        skipByteArray();
+        break;
+      default:
+        qWarning() << "Unknown record kind in recording" << kind;
+        return false;
+    }
+    if (m_stream.status() != QDataStream::Ok) return false;
+  }
+  return false;
+}
+
+void RecordingReader::readAction(ServerAction &action) {
+  ::readAction(m_stream, action, m_action_format);
+}
+
+// Snapshots can be big, so when they're not needed they're skipped over
+// rather than read in.
+void RecordingReader::skipByteArray() {
+  quint32 size;
+  m_stream >> size;
+  // A null QByteArray is written as just 0xFFFFFFFF.
+  if (m_stream.status() == QDataStream::Ok && size != 0xFFFFFFFF &&
+      !m_device->seek(m_device->pos() + size))
+    m_stream.setStatus(QDataStream::ReadPastEnd);
+}
+
+std::optional<ProjectSnapshot> RecordingReader::readCheckpoint() {
+  qint64 elapsed;
+  quint8 kind;
+  QByteArray compressed;
+  m_stream >> elapsed >> kind;
+  if (RecordKind(kind) != RecordKind::CHECKPOINT) return std::nullopt;
+  m_stream >> compressed;
+  if (m_stream.status() != QDataStream::Ok) return std::nullopt;
+
+  QByteArray encoded = qUncompress(compressed);
+  QDataStream in(encoded);
+  ProjectSnapshot snapshot;
+  in >> snapshot;
+  if (encoded.isEmpty() || in.status() != QDataStream::Ok) return std::nullopt;
+  return snapshot;
+}
+
+RecordingPosition RecordingReader::seek(qint64 elapsed) {
+  RecordingPosition position{m_data, {}};
+  qint64 resume_from = m_body_start;
+
+  // Start from the last checkpoint before the target, or an earlier one if
+  // that's corrupt.
+  for (auto c = m_index.rbegin(); c != m_index.rend(); ++c) {
+    if (c->elapsed > elapsed) continue;
+    m_device->seek(m_body_start + c->offset);
+    std::optional<ProjectSnapshot> snapshot = readCheckpoint();
+    if (!snapshot.has_value()) {
+      qWarning() << "Corrupt checkpoint in recording at" << c->elapsed;
+      m_stream.resetStatus();
+      continue;
+    }
+    position.data = snapshot->data;
+    position.history.push_back(
+        {-1, ControllerState{snapshot->controller_state}, std::nullopt});
+    for (auto s = snapshot->sessions.begin(); s != snapshot->sessions.end();
+         ++s)
+      position.history.push_back(
+          {s.key(), NewSession{s.value()}, std::nullopt});
+    resume_from = m_device->pos();
+    break;
+  }
+
+  // Then go the rest of the way one action at a time.
+  m_device->seek(resume_from);
+  while (!atEnd()) {
+    qint64 pos = m_device->pos();
+    qint64 next_elapsed;
+    ServerAction a;
+    if (!next(next_elapsed, a)) break;
+    if (next_elapsed > elapsed) {
+      m_device->seek(pos);
+      break;
+    }
+    if (a.shouldBeRecorded()) position.history.push_back(a);
+  }
+  return position;
+}
+
+RecordingWriter::RecordingWriter(const QString &filename, int next_uid,
+                                 const QByteArray &data)
+    : m_thread(new QThread),
+      m_context(new QObject),
+      m_file(new QFile(filename, m_context)),
+      m_next_uid(next_uid),
+      m_finalized(false),
+      m_snapshotter(nullptr),
+      m_last_checkpoint_elapsed(0),
+      m_bytes_since_checkpoint(0),
+      m_last_snapshot_size(data.size()) {
+  if (!m_file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+    delete m_context;
+    delete m_thread;
+    throw QString("Unable to open %1 for writing").arg(filename);
+  }
+  m_stream.setDevice(m_file);
+  m_stream << ACTION_FORMAT << RECORDING_VERSION << next_uid << data;
+  m_body_start = m_file->pos();
+
+  QTimer *flush_timer = new QTimer(m_context);
+  QObject::connect(flush_timer, &QTimer::timeout, m_context,
+                   [this]() { flush(); });
+  m_thread->setObjectName("recording-writer");
+  m_context->moveToThread(m_thread);
+  QObject::connect(m_thread, &QThread::finished, m_context,
+                   &QObject::deleteLater);
+  m_thread->start();
+  QMetaObject::invokeMethod(
+      flush_timer, [flush_timer]() { flush_timer->start(FLUSH_INTERVAL_MS); },
+      Qt::QueuedConnection);
+  // Loading the project can take a while, so it's done on the writer thread
+  // too. It's queued ahead of any writes.
+  QMetaObject::invokeMethod(
+      m_context, [this, data]() { startSnapshots(data); },
+      Qt::QueuedConnection);
+}
+
+RecordingWriter::~RecordingWriter() {
+  if (!m_finalized) finalize();
+  m_thread->quit();
+  m_thread->wait();
+  delete m_thread;
+}
+
+void RecordingWriter::write(qint64 elapsed, const ServerAction &a) {
+  if (m_finalized) return;
+  QMetaObject::invokeMethod(
+      m_context, [this, elapsed, a]() { writeRecord(elapsed, a); },
+      Qt::QueuedConnection);
+}
+
+void RecordingWriter::setNextUid(int next_uid) {
+  m_next_uid.storeRelease(next_uid);
+}
+
+void RecordingWriter::startSnapshots(const QByteArray &data) {
+  try {
+    m_snapshotter = std::make_unique<ProjectSnapshotter>(data);
+  } catch (const QString &e) {
+    qWarning() << e << "The recording won't have checkpoints.";
+  }
+}
+
+void RecordingWriter::writeRecord(qint64 elapsed, const ServerAction &a) {
+  qint64 start = m_file->pos();
+  m_stream << elapsed << quint8(RecordKind::ACTION) << a;
+  m_bytes_since_checkpoint += m_file->pos() - start;
+  if (m_snapshotter == nullptr) return;
+  if (a.shouldBeRecorded()) m_snapshotter->apply(a);
+  if (elapsed - m_last_checkpoint_elapsed >= CHECKPOINT_INTERVAL_MS &&
+      m_bytes_since_checkpoint >=
+          m_last_snapshot_size * MIN_ACTIONS_PER_SNAPSHOT_BYTE)
+    writeCheckpoint(elapsed);
+}
+
+void RecordingWriter::writeCheckpoint(qint64 elapsed) {
+  std::optional<ProjectSnapshot> snapshot = m_snapshotter->take();
+  if (!snapshot.has_value()) {
+    qWarning() << "Could not take a snapshot of the project. No more "
+                  "checkpoints will be written.";
+    m_snapshotter.reset();
+    return;
+  }
+  QByteArray encoded;
+  {
+    QDataStream out(&encoded, QIODevice::WriteOnly);
+    out << snapshot.value();
+  }
+  QByteArray compressed = qCompress(encoded);
+
+  qint64 offset = m_file->pos() - m_body_start;
+  m_stream << elapsed << quint8(RecordKind::CHECKPOINT) << compressed;
+  m_index.push_back({elapsed, offset});
+  m_last_checkpoint_elapsed = elapsed;
+  m_bytes_since_checkpoint = 0;
+  m_last_snapshot_size = compressed.size();
+}
+
+void RecordingWriter::flush() {
+  if (!m_file->isOpen()) return;
+  qint64 end = m_file->pos();
+  m_file->seek(NEXT_UID_OFFSET);
+  m_stream << qint32(m_next_uid.loadAcquire());
+  m_file->seek(end);
+  m_file->flush();
+}
+
+bool RecordingWriter::writeIndex() {
+  // It's finished with, and it has to go on this thread.
+  m_snapshotter.reset();
+  flush();
+  qint64 index_offset = m_file->pos();
+  m_stream << quint32(m_index.size());
+  for (const RecordingCheckpoint &c : m_index)
+    m_stream << c.elapsed << c.offset;
+  m_stream << index_offset << INDEX_MAGIC;
+  m_file->close();
+  return m_stream.status() == QDataStream::Ok;
+}
+
+bool RecordingWriter::finalize() {
+  if (m_finalized) return false;
+  m_finalized = true;
+  // Queued behind any writes that are still pending.
+  bool ok = false;
+  QMetaObject::invokeMethod(
+      m_context, [this, &ok]() { ok = writeIndex(); },
+      Qt::BlockingQueuedConnection);
+  return ok;
+}
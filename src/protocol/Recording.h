@@ -0,0 +1,127 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <QAtomicInt>
+#include <QDataStream>
+#include <QFile>
+#include <QIODevice>
+#include <QThread>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "editor/ProjectSnapshot.h"
+#include "protocol/RemoteAction.h"
+
+// A .ptrec recording is a header (action format & recording version, next uid
+// and the initial project) followed by a body of timestamped server actions.
+//
+// From version 2 on, the body is also interleaved with periodic checkpoints,
+// and the file ends with an index of those checkpoints. From version 3 on, a
+// checkpoint is a ProjectSnapshot, so playback can seek by loading the one
+// before the target and replaying just what comes after it. Version 2
+// checkpoints hold only the history since the previous one and are skipped.
+// Files without a usable index (versions 1 and 2, or a recording that didn't
+// get finalized) are read linearly.
+//
+// Up to version 2, the header had the wire protocol version rather than the
+// action format. Actions in older formats are converted to the current ones
+// as they're read.
+
+// Where a checkpoint is in the body.
+struct RecordingCheckpoint {
+  qint64 elapsed;
+  // Relative to the start of the body.
+  qint64 offset;
+};
+
+// Where playback carries on from after a seek.
+struct RecordingPosition {
+  // The project to start from: the recording's initial one, or the project of
+  // the checkpoint that was seeked to.
+  QByteArray data;
+  // The history to apply on top of [data]. After a checkpoint, it starts with
+  // the checkpoint's ControllerState and a NewSession for everyone who was
+  // connected at the time.
+  QList<ServerAction> history;
+};
+
+class RecordingReader {
+ public:
+  // Reads the header and index. Throws a QString if it's not a recording we
+  // can read. [device] must be open, seekable and outlive the reader.
+  RecordingReader(QIODevice *device);
+  qint64 version() const { return m_version; }
+  int nextUid() const { return m_next_uid; }
+  const QByteArray &data() const { return m_data; }
+  const std::vector<RecordingCheckpoint> &index() const { return m_index; }
+
+  bool atEnd() const;
+  // Reads the next action, skipping over checkpoints. Returns false at the
+  // end of the recording or if it's corrupt.
+  bool next(qint64 &elapsed, ServerAction &action);
+  // Positions the reader at the first action after [elapsed], returning the
+  // project and history (the actions that should be recorded) up to that
+  // point.
+  RecordingPosition seek(qint64 elapsed);
+
+ private:
+  // Returns whether there was one.
+  bool readIndex();
+  void readAction(ServerAction &action);
+  void skipByteArray();
+  std::optional<ProjectSnapshot> readCheckpoint();
+  QIODevice *m_device;
+  QDataStream m_stream;
+  qint64 m_version;
+  qint64 m_action_format;
+  int m_next_uid;
+  QByteArray m_data;
+  qint64 m_body_start, m_body_end;
+  std::vector<RecordingCheckpoint> m_index;
+};
+
+// Writes a recording as it happens. The header goes out up front and the
+// actions are written and periodically flushed from a background thread, so
+// if the process dies the file can still be played back up to the last flush.
+// For the checkpoints' snapshots, the writer thread also applies the actions
+// to its own copy of the project. If [data] isn't a project that can be
+// loaded, there are no checkpoints.
+class RecordingWriter {
+ public:
+  // Throws a QString if [filename] can't be opened.
+  RecordingWriter(const QString &filename, int next_uid,
+                  const QByteArray &data);
+  ~RecordingWriter();
+  void write(qint64 elapsed, const ServerAction &action);
+  // The next uid is the one header field that changes during a recording. It
+  // has a fixed place in the file, which is updated on each flush.
+  void setNextUid(int next_uid);
+  // Flushes everything and appends the index. Further writes are ignored.
+  bool finalize();
+
+ private:
+  // These all run on [m_thread].
+  void startSnapshots(const QByteArray &data);
+  void writeRecord(qint64 elapsed, const ServerAction &action);
+  void writeCheckpoint(qint64 elapsed);
+  void flush();
+  bool writeIndex();
+
+  QThread *m_thread;
+  // Lives on [m_thread]; parents the file and flush timer.
+  QObject *m_context;
+  QFile *m_file;
+  QDataStream m_stream;
+  QAtomicInt m_next_uid;
+  bool m_finalized;
+  qint64 m_body_start;
+  std::unique_ptr<ProjectSnapshotter> m_snapshotter;
+  qint64 m_last_checkpoint_elapsed;
+  // Bytes of actions written since the last checkpoint.
+  qint64 m_bytes_since_checkpoint;
+  qint64 m_last_snapshot_size;
+  std::vector<RecordingCheckpoint> m_index;
+};
+
+#endif  // RECORDING_H
@@ -5,9 +5,12 @@
 #include <QCryptographicHash>
 #include <QDataStream>
 #include <QDateTime>
+#include <QMetaType>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "protocol/ActionTiming.h"
 #include "protocol/Data.h"
 #include "protocol/PxtoneEditAction.h"
 #include "protocol/SerializeVariant.h"
@@ -22,21 +25,13 @@ struct EditAction {
   std::list<Action::Primitive> action;
 };
 inline QDataStream &operator<<(QDataStream &out, const EditAction &a) {
-  out << a.idx << quint64(a.action.size());
-  for (const auto &a : a.action) out << a;
-  return out;
+  out << a.idx;
+  return Action::writeCompact(out, a.action);
 }
 inline QDataStream &operator>>(QDataStream &in, EditAction &a) {
-  quint64 size;
-  in >> a.idx >> size;
+  in >> a.idx;
   if (in.status() != QDataStream::Ok) return in;
-  for (size_t i = 0; i < size; ++i) {
-    Action::Primitive action;
-    in >> action;
-    if (in.status() != QDataStream::Ok) return in;
-    a.action.push_back(action);
-  }
-  return in;
+  return Action::readCompact(in, a.action);
 }
 inline QTextStream &operator<<(QTextStream &out, const EditAction &a) {
   out << "EditAction(idx=" << a.idx << ", "
@@ -140,14 +135,17 @@ struct AddWoice {
   pxtnWOICETYPE type;
   QString name;
   QByteArray data;
+  // woiceHash(data), filled in by the server. Clients are sent just the hash
+  // and look the data up in their WoiceCache, fetching it if they have to.
+  QByteArray hash;
 };
 inline QDataStream &operator<<(QDataStream &out, const AddWoice &a) {
-  out << (qint8)a.type << a.name << a.data;
+  out << (qint8)a.type << a.name << a.data << a.hash;
   return out;
 }
 inline QDataStream &operator>>(QDataStream &in, AddWoice &a) {
   read_as_qint8(in, a.type);
-  in >> a.name >> a.data;
+  in >> a.name >> a.data >> a.hash;
   return in;
 }
 
@@ -467,17 +465,36 @@ inline QTextStream &operator<<(QTextStream &out, const WatchUser &a) {
   return out;
 }
 
+// Asks the server for the data of a woice that was sent by hash. The server
+// answers just the client that asked, with a WoiceData.
+struct FetchWoice {
+  QByteArray hash;
+};
+inline QDataStream &operator<<(QDataStream &out, const FetchWoice &a) {
+  out << a.hash;
+  return out;
+}
+inline QDataStream &operator>>(QDataStream &in, FetchWoice &a) {
+  in >> a.hash;
+  return in;
+}
+inline QTextStream &operator<<(QTextStream &out, const FetchWoice &a) {
+  out << "FetchWoice(" << a.hash.toHex() << ")";
+  return out;
+}
+
 using ClientAction =
     std::variant<EditAction, EditState, UndoRedo, AddUnit, RemoveUnit, MoveUnit,
                  AddWoice, RemoveWoice, ChangeWoice, TempoChange, BeatChange,
                  SetRepeatMeas, SetLastMeas, SetUnitName, Overdrive::Add,
                  Overdrive::Set, Overdrive::Remove, Delay::Set, Woice::Set,
-                 Ping, PlayState, WatchUser>;
+                 Ping, PlayState, WatchUser, FetchWoice>;
 inline bool clientActionShouldBeRecorded(const ClientAction &a) {
   bool ret;
   std::visit(overloaded{[&ret](const EditState &) { ret = false; },
                         [&ret](const Ping &) { ret = false; },
                         [&ret](const PlayState &) { ret = false; },
+                        [&ret](const FetchWoice &) { ret = false; },
                         [&ret](const auto &) { ret = true; }},
              a);
   return ret;
@@ -504,9 +521,53 @@ inline QTextStream &operator<<(QTextStream &out, const DeleteSession &) {
   out << "DeleteSession()";
   return out;
 }
+// The answer to a FetchWoice. [data] is empty if the server doesn't have it.
+struct WoiceData {
+  QByteArray hash;
+  QByteArray data;
+};
+inline QDataStream &operator<<(QDataStream &out, const WoiceData &a) {
+  out << a.hash << a.data;
+  return out;
+}
+inline QDataStream &operator>>(QDataStream &in, WoiceData &a) {
+  in >> a.hash >> a.data;
+  return in;
+}
+inline QTextStream &operator<<(QTextStream &out, const WoiceData &a) {
+  out << "WoiceData(" << a.hash.toHex() << ", data=(" << a.data.length()
+      << "))";
+  return out;
+}
+
+// What replaying the history builds up in a PxtoneController besides the
+// project file (see PxtoneController::saveState). When playback of a recording
+// starts from one of its checkpoints, the history starts with this instead of
+// with everything before the checkpoint.
+struct ControllerState {
+  QByteArray data;
+};
+inline QDataStream &operator<<(QDataStream &out, const ControllerState &a) {
+  out << a.data;
+  return out;
+}
+inline QDataStream &operator>>(QDataStream &in, ControllerState &a) {
+  in >> a.data;
+  return in;
+}
+inline QTextStream &operator<<(QTextStream &out, const ControllerState &a) {
+  out << "ControllerState(data=(" << a.data.length() << "))";
+  return out;
+}
+
 struct ServerAction {
   qint64 uid;
-  std::variant<ClientAction, NewSession, DeleteSession> action;
+  std::variant<ClientAction, NewSession, DeleteSession, WoiceData,
+               ControllerState>
+      action;
+  // Only sent over the wire alongside the action (see ServerSession::encode),
+  // so it's not in the history or recordings.
+  std::optional<ActionTiming> timing;
   bool shouldBeRecorded() const {
     // TODO: instead of using this to track history, have the broadcast server
     // update its own internal state (similar to the synchronizer) and return
@@ -515,6 +576,7 @@ struct ServerAction {
     std::visit(overloaded{[&ret](const ClientAction &a) {
                             ret = clientActionShouldBeRecorded(a);
                           },
+                          [&ret](const WoiceData &) { ret = false; },
                           [&ret](const auto &) { ret = true; }},
                action);
     return ret;
@@ -534,4 +596,24 @@ inline QTextStream &operator<<(QTextStream &out, const ServerAction &a) {
   return out;
 }
 
+// The woice that [a] adds, if it's an AddWoice or ChangeWoice.
+inline const AddWoice *addedWoice(const ClientAction &a) {
+  if (const AddWoice *w = std::get_if<AddWoice>(&a)) return w;
+  if (const ChangeWoice *c = std::get_if<ChangeWoice>(&a)) return &c->add;
+  return nullptr;
+}
+inline AddWoice *addedWoice(ClientAction &a) {
+  return const_cast<AddWoice *>(addedWoice(std::as_const(a)));
+}
+inline const AddWoice *addedWoice(const ServerAction &a) {
+  const ClientAction *c = std::get_if<ClientAction>(&a.action);
+  return c == nullptr ? nullptr : addedWoice(*c);
+}
+inline AddWoice *addedWoice(ServerAction &a) {
+  return const_cast<AddWoice *>(addedWoice(std::as_const(a)));
+}
+
+// Sessions on worker threads hand these to the server via queued signals.
+Q_DECLARE_METATYPE(ClientAction)
+
 #endif  // REMOTEACTION_H
@@ -0,0 +1,113 @@
+# Headless load generator: simulated users editing a project together on a
+# BroadcastServer. Shares the network, protocol, pxtone and controller sources
+# with the editor but needs nothing beyond QtCore and QtNetwork.
+
+TEMPLATE = app
+TARGET = ptloadtest
+
+INCLUDEPATH += .
+win32:INCLUDEPATH += ../deps/include
+macx:INCLUDEPATH += ../deps/include
+QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.14
+
+QT = core network
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += pxINCLUDE_OGGVORBIS
+
+HEADERS += \
+           ptloadtest/SimulatedUser.h \
+           editor/ActionLog.h \
+           editor/ComboOptions.h \
+           editor/EditState.h \
+           editor/Interval.h \
+           editor/ProjectSnapshot.h \
+           editor/PxtoneController.h \
+           network/AbstractServerSession.h \
+           network/BroadcastServer.h \
+           network/Client.h \
+           network/LocalServerSession.h \
+           network/ServerSession.h \
+           network/SessionThreadPool.h \
+           network/WoiceCache.h \
+           protocol/ActionTiming.h \
+           protocol/Data.h \
+           protocol/Frame.h \
+           protocol/Hello.h \
+           protocol/NoIdMap.h \
+           protocol/ProjectTransfer.h \
+           protocol/PxtoneEditAction.h \
+           protocol/Recording.h \
+           protocol/RemoteAction.h \
+           protocol/SerializeVariant.h \
+           pxtone/pxtn.h \
+           pxtone/pxtnDelay.h \
+           pxtone/pxtnDescriptor.h \
+           pxtone/pxtnError.h \
+           pxtone/pxtnEvelist.h \
+           pxtone/pxtnMaster.h \
+           pxtone/pxtnMax.h \
+           pxtone/pxtnMem.h \
+           pxtone/pxtnOverDrive.h \
+           pxtone/pxtnPulse_Frequency.h \
+           pxtone/pxtnPulse_Noise.h \
+           pxtone/pxtnPulse_NoiseBuilder.h \
+           pxtone/pxtnPulse_Oggv.h \
+           pxtone/pxtnPulse_Oscillator.h \
+           pxtone/pxtnPulse_PCM.h \
+           pxtone/pxtnService.h \
+           pxtone/pxtnText.h \
+           pxtone/pxtnUnit.h \
+           pxtone/pxtnWoice.h \
+           pxtone/pxtoneNoise.h
+SOURCES += \
+           ptloadtest/main.cpp \
+           ptloadtest/SimulatedUser.cpp \
+           editor/ActionLog.cpp \
+           editor/EditState.cpp \
+           editor/Interval.cpp \
+           editor/ProjectSnapshot.cpp \
+           editor/PxtoneController.cpp \
+           network/AbstractServerSession.cpp \
+           network/BroadcastServer.cpp \
+           network/Client.cpp \
+           network/LocalServerSession.cpp \
+           network/ServerSession.cpp \
+           network/SessionThreadPool.cpp \
+           network/WoiceCache.cpp \
+           protocol/ActionTiming.cpp \
+           protocol/Data.cpp \
+           protocol/Frame.cpp \
+           protocol/Hello.cpp \
+           protocol/NoIdMap.cpp \
+           protocol/ProjectTransfer.cpp \
+           protocol/PxtoneEditAction.cpp \
+           protocol/Recording.cpp \
+           protocol/RemoteAction.cpp \
+           pxtone/pxtnDelay.cpp \
+           pxtone/pxtnDescriptor.cpp \
+           pxtone/pxtnError.cpp \
+           pxtone/pxtnEvelist.cpp \
+           pxtone/pxtnMaster.cpp \
+           pxtone/pxtnMem.cpp \
+           pxtone/pxtnOverDrive.cpp \
+           pxtone/pxtnPulse_Frequency.cpp \
+           pxtone/pxtnPulse_Noise.cpp \
+           pxtone/pxtnPulse_NoiseBuilder.cpp \
+           pxtone/pxtnPulse_Oggv.cpp \
+           pxtone/pxtnPulse_Oscillator.cpp \
+           pxtone/pxtnPulse_PCM.cpp \
+           pxtone/pxtnService.cpp \
+           pxtone/pxtnService_moo.cpp \
+           pxtone/pxtnText.cpp \
+           pxtone/pxtnUnit.cpp \
+           pxtone/pxtnWoice.cpp \
+           pxtone/pxtnWoice_io.cpp \
+           pxtone/pxtnWoicePTV.cpp \
+           pxtone/pxtoneNoise.cpp
+
+!win32:LIBS += -logg -lvorbisfile
+win32:LIBS += -L"$$PWD/../deps/lib" -L"$$PWD/deps/lib" -llibogg_static -llibvorbisfile
+macx:LIBS += -L/usr/local/lib
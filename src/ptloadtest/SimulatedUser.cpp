@@ -0,0 +1,235 @@
+#include "SimulatedUser.h"
+
+#include <QCryptographicHash>
+#include <algorithm>
+
+static constexpr int TICK_MS = 10;
+// How long the mouse is held down for a note or param drag.
+static constexpr int MIN_GESTURE_TICKS = 5;
+static constexpr int MAX_GESTURE_TICKS = 60;
+static constexpr int QUANTIZE_DIVISIONS = 4;
+
+SimulatedUser::SimulatedUser(int index, const LoadRates &rates,
+                             const QElapsedTimer *clock, QObject *parent)
+    : QObject(parent),
+      m_client(new Client(this)),
+      m_controller(nullptr),
+      m_rates(rates),
+      m_clock(clock),
+      m_random(quint32(index)),
+      m_timer(new QTimer(this)),
+      m_username(QString("load-%1").arg(index)),
+      m_connected(false),
+      m_gesture_ticks(0),
+      m_undoable(0),
+      m_redoable(0),
+      m_sent_actions(0),
+      m_sent_edit_states(0),
+      m_received_actions(0) {
+  m_pxtn.init_collage(EVENT_MAX);
+  int channel_num = 2;
+  int sample_rate = 44100;
+  m_pxtn.set_destination_quality(channel_num, sample_rate);
+  m_controller = new PxtoneController(0, &m_pxtn, &m_moo_state, this);
+
+  connect(m_client, &Client::connected,
+          [this](const QByteArray &data, const QList<ServerAction> &history,
+                 qint64 uid) {
+            pxtnDescriptor desc;
+            desc.set_memory_r(data.constData(), data.size());
+            m_controller->loadDescriptor(desc);
+            m_controller->setUid(uid);
+            for (const ServerAction &a : history) receiveAction(a);
+            m_connected = true;
+            emit connected();
+          });
+  connect(m_client, &Client::disconnected, [this](bool) {
+    m_connected = false;
+    stop();
+    emit disconnected();
+  });
+  connect(m_client, &Client::errorOccurred, this,
+          &SimulatedUser::errorOccurred);
+  connect(m_client, &Client::receivedAction, this,
+          &SimulatedUser::receiveAction);
+  connect(m_timer, &QTimer::timeout, this, &SimulatedUser::tick);
+}
+
+void SimulatedUser::connectToServer(QString hostname, quint16 port) {
+  m_client->connectToServer(hostname, port, m_username);
+}
+
+void SimulatedUser::connectToLocalServer(BroadcastServer *server) {
+  m_client->connectToLocalServer(server, m_username);
+}
+
+void SimulatedUser::disconnectFromServer() {
+  stop();
+  m_client->disconnectFromServerSuppressSignal();
+}
+
+int SimulatedUser::numUnits() const {
+  return m_controller->unitIdMap().numUnits();
+}
+
+void SimulatedUser::start() {
+  if (!m_connected || numUnits() == 0) return;
+  m_edit_state.m_current_unit_id = m_controller->unitIdMap().noToId(0);
+  m_timer->start(TICK_MS);
+}
+
+void SimulatedUser::stop() {
+  m_timer->stop();
+  // Let go of the mouse so a half-finished gesture doesn't get sent later.
+  m_gesture_ticks = 0;
+  m_edit_state.mouse_edit_state.type = MouseEditState::Nothing;
+}
+
+bool SimulatedUser::happens(double rate_per_sec) {
+  return m_random.generateDouble() < rate_per_sec * TICK_MS / 1000;
+}
+
+void SimulatedUser::tick() {
+  MouseEditState &mouse = m_edit_state.mouse_edit_state;
+  qint32 clock_num = std::max(m_pxtn.master->get_clock_num(), 1);
+  // Wander around, roughly as fast as someone moving across a measure a
+  // second.
+  qint32 step = m_pxtn.master->get_beat_clock() * 4 * TICK_MS / 1000;
+  mouse.current_clock = std::clamp(
+      mouse.current_clock + m_random.bounded(-step, step + 1), 0, clock_num);
+
+  if (m_gesture_ticks > 0) {
+    if (std::holds_alternative<MouseParamEdit>(mouse.kind))
+      std::get<MouseParamEdit>(mouse.kind).current_param = std::clamp(
+          std::get<MouseParamEdit>(mouse.kind).current_param +
+              m_random.bounded(-4, 5),
+          0, 128);
+    if (--m_gesture_ticks == 0) endGesture();
+  } else {
+    mouse.start_clock = mouse.current_clock;
+    mouse.last_pitch = std::clamp(
+        mouse.last_pitch + m_random.bounded(-PITCH_PER_KEY, PITCH_PER_KEY + 1),
+        EVENTMIN_KEY, EVENTMAX_KEY);
+    if (happens(m_rates.notes))
+      startGesture(false);
+    else if (happens(m_rates.param_drags))
+      startGesture(true);
+    else if (happens(m_rates.undos))
+      undoOrRedo();
+  }
+
+  if (happens(m_rates.edit_states)) {
+    send(m_edit_state);
+    ++m_sent_edit_states;
+  }
+}
+
+void SimulatedUser::startGesture(bool param) {
+  MouseEditState &mouse = m_edit_state.mouse_edit_state;
+  m_edit_state.m_current_unit_id = m_controller->unitIdMap().noToId(
+      m_random.bounded(numUnits()));
+  mouse.type = MouseEditState::SetOn;
+  if (param) {
+    qint32 v = m_random.bounded(129);
+    mouse.kind = MouseParamEdit{v, v};
+  } else
+    mouse.kind = MouseKeyboardEdit{mouse.last_pitch, mouse.last_pitch};
+  m_gesture_ticks = m_random.bounded(MIN_GESTURE_TICKS, MAX_GESTURE_TICKS + 1);
+}
+
+// Makes the same edits as releasing the mouse in KeyboardView or ParamView.
+void SimulatedUser::endGesture() {
+  using namespace Action;
+  MouseEditState &mouse = m_edit_state.mouse_edit_state;
+  qint32 unit_id = m_edit_state.m_current_unit_id;
+  qint32 q = std::max(m_pxtn.master->get_beat_clock() / QUANTIZE_DIVISIONS, 1);
+  Interval clock_int(mouse.clock_int(q));
+  std::list<Primitive> actions;
+
+  if (std::holds_alternative<MouseParamEdit>(mouse.kind)) {
+    const MouseParamEdit &p = std::get<MouseParamEdit>(mouse.kind);
+    actions.push_back(
+        {EVENTKIND_VOLUME, unit_id, clock_int.start, Delete{clock_int.end}});
+    int steps = clock_int.length() / q;
+    for (int i = 0; i < steps; ++i) {
+      qint32 v = p.start_param + (p.current_param - p.start_param) * i /
+                                     std::max(steps - 1, 1);
+      actions.push_back(
+          {EVENTKIND_VOLUME, unit_id, clock_int.start + i * q, Add{v}});
+    }
+  } else {
+    const MouseKeyboardEdit &k = std::get<MouseKeyboardEdit>(mouse.kind);
+    for (EVENTKIND kind : {EVENTKIND_ON, EVENTKIND_VELOCITY, EVENTKIND_KEY})
+      actions.push_back({kind, unit_id, clock_int.start, Delete{clock_int.end}});
+    actions.push_back(
+        {EVENTKIND_ON, unit_id, clock_int.start, Add{clock_int.length()}});
+    actions.push_back({EVENTKIND_VELOCITY, unit_id, clock_int.start,
+                       Add{qint32(mouse.base_velocity)}});
+    actions.push_back(
+        {EVENTKIND_KEY, unit_id, clock_int.start, Add{k.start_pitch}});
+  }
+  mouse.type = MouseEditState::Nothing;
+
+  send(m_controller->applyLocalAction(actions));
+  ++m_undoable;
+  m_redoable = 0;
+}
+
+void SimulatedUser::undoOrRedo() {
+  bool undo = m_undoable > 0 && (m_redoable == 0 || m_random.bounded(2) == 0);
+  if (undo) {
+    --m_undoable;
+    ++m_redoable;
+    send(UndoRedo::UNDO);
+  } else if (m_redoable > 0) {
+    --m_redoable;
+    ++m_undoable;
+    send(UndoRedo::REDO);
+  }
+}
+
+void SimulatedUser::send(const ClientAction &a) {
+  if (clientActionShouldBeRecorded(a)) {
+    m_sent_at.push_back(m_clock->nsecsElapsed());
+    ++m_sent_actions;
+  }
+  m_client->sendAction(a);
+}
+
+void SimulatedUser::receiveAction(const ServerAction &a) {
+  ++m_received_actions;
+  if (a.uid == m_controller->uid() && a.shouldBeRecorded() &&
+      !m_sent_at.empty()) {
+    // The server forwards each session's actions in order, so echoes of our
+    // own recorded actions come back in the order they were sent.
+    m_latencies.push_back(m_clock->nsecsElapsed() - m_sent_at.front());
+    m_sent_at.pop_front();
+  }
+
+  // At the start of the history of a recording that was seeked.
+  if (std::holds_alternative<ControllerState>(a.action))
+    m_controller->applyProjectAction(a);
+  const ClientAction *s = std::get_if<ClientAction>(&a.action);
+  if (s == nullptr) return;
+  std::visit(overloaded{[this, &a](const EditAction &s) {
+                          m_controller->applyRemoteAction(s, a.uid);
+                        },
+                        [this, &a](const UndoRedo &s) {
+                          m_controller->applyUndoRedo(s, a.uid);
+                        },
+                        [](const auto &) {}},
+             *s);
+}
+
+QByteArray SimulatedUser::fingerprint() const {
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  QByteArray events;
+  QDataStream out(&events, QIODevice::WriteOnly);
+  out << qint32(m_pxtn.Unit_Num());
+  for (const EVERECORD *e = m_pxtn.evels->get_Records(); e != nullptr;
+       e = e->next)
+    out << qint32(e->clock) << quint8(e->unit_no) << quint8(e->kind)
+        << qint32(e->value);
+  hash.addData(events);
+  return hash.result();
+}
@@ -0,0 +1,88 @@
+#ifndef SIMULATEDUSER_H
+#define SIMULATEDUSER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <deque>
+#include <vector>
+
+#include "editor/EditState.h"
+#include "editor/PxtoneController.h"
+#include "network/Client.h"
+
+// How often, per second, a simulated user starts each kind of activity.
+struct LoadRates {
+  double edit_states;
+  double notes;
+  double param_drags;
+  double undos;
+};
+
+// A headless stand-in for someone using the editor. It keeps its own copy of
+// the project in a PxtoneController, and generates the same kinds of traffic
+// the views do: a stream of edit states as the mouse moves, note placements
+// and param drags (each a gesture of several edit states followed by an
+// edit), and undo / redo.
+class SimulatedUser : public QObject {
+  Q_OBJECT
+ public:
+  // [clock] is shared between users so latencies are comparable.
+  SimulatedUser(int index, const LoadRates &rates, const QElapsedTimer *clock,
+                QObject *parent = nullptr);
+  void connectToServer(QString hostname, quint16 port);
+  void connectToLocalServer(BroadcastServer *server);
+  void disconnectFromServer();
+  bool isConnected() const { return m_connected; }
+  int numUnits() const;
+
+  void start();
+  void stop();
+
+  // Recorded actions that have been sent but not echoed back yet.
+  size_t pending() const { return m_sent_at.size(); }
+  qint64 sentActions() const { return m_sent_actions; }
+  qint64 sentEditStates() const { return m_sent_edit_states; }
+  qint64 receivedActions() const { return m_received_actions; }
+  // Send to echo, in nanoseconds, for each recorded action.
+  const std::vector<qint64> &latencies() const { return m_latencies; }
+  // A hash of the events in this user's copy of the project.
+  QByteArray fingerprint() const;
+
+ signals:
+  void connected();
+  void disconnected();
+  void errorOccurred(QString error);
+
+ private:
+  void tick();
+  void startGesture(bool param);
+  void endGesture();
+  void undoOrRedo();
+  void send(const ClientAction &a);
+  void receiveAction(const ServerAction &a);
+  bool happens(double rate_per_sec);
+
+  Client *m_client;
+  pxtnService m_pxtn;
+  mooState m_moo_state;
+  PxtoneController *m_controller;
+  EditState m_edit_state;
+  LoadRates m_rates;
+  const QElapsedTimer *m_clock;
+  QRandomGenerator m_random;
+  QTimer *m_timer;
+  QString m_username;
+  bool m_connected;
+
+  // Ticks left in the current gesture, if there is one.
+  int m_gesture_ticks;
+  int m_undoable, m_redoable;
+
+  std::deque<qint64> m_sent_at;
+  std::vector<qint64> m_latencies;
+  qint64 m_sent_actions, m_sent_edit_states, m_received_actions;
+};
+
+#endif  // SIMULATEDUSER_H
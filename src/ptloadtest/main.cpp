@@ -0,0 +1,324 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "SimulatedUser.h"
+#include "network/BroadcastServer.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+// Simulates many people editing the same project at once, to see how the
+// server copes. By default a server is started in this process on its own
+// thread and the simulated users connect to it over loopback, so the server's
+// CPU time can be told apart from theirs. Reports how long recorded actions
+// took to be echoed back and whether everyone ended up with the same project.
+
+static constexpr int CONNECT_TIMEOUT_MS = 10000;
+static constexpr int DRAIN_TIMEOUT_MS = 10000;
+static constexpr int DRAIN_POLL_MS = 100;
+
+static bool verbose = false;
+static void messageHandler(QtMsgType type, const QMessageLogContext &,
+                           const QString &msg) {
+  // The server and clients log every recorded action at debug level.
+  if (type == QtDebugMsg && !verbose) return;
+  fprintf(stderr, "%s\n", qPrintable(msg));
+  if (type == QtFatalMsg) abort();
+}
+
+// CPU time in seconds, or negative if we can't tell on this platform.
+static double processCpuSecs() {
+#ifdef Q_OS_UNIX
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+  return -1;
+#endif
+}
+
+static double currentThreadCpuSecs() {
+#ifdef Q_OS_UNIX
+  timespec t;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0) return -1;
+  return t.tv_sec + t.tv_nsec / 1e9;
+#else
+  return -1;
+#endif
+}
+
+static double parseRate(const QCommandLineParser &parser,
+                        const QCommandLineOption &option) {
+  bool ok;
+  double v = parser.value(option).toDouble(&ok);
+  if (!ok || v < 0)
+    qFatal("Could not parse --%s", qPrintable(option.names().last()));
+  return v;
+}
+
+static double percentileMs(const std::vector<qint64> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+  return sorted[i] / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  a.setApplicationName("ptloadtest");
+  qInstallMessageHandler(messageHandler);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Simulate many users editing a project together and report how the "
+      "server copes.");
+  parser.addHelpOption();
+  parser.addPositionalArgument(
+      "file", "The project (or recording) for the server to load.", "[file]");
+
+  QCommandLineOption usersOption(QStringList() << "n"
+                                               << "users",
+                                 "Simulate <n> users (default: 8).", "n", "8");
+  parser.addOption(usersOption);
+  QCommandLineOption durationOption(
+      "duration", "Generate load for <secs> (default: 30).", "secs", "30");
+  parser.addOption(durationOption);
+  QCommandLineOption editStatesOption(
+      "edit-states", "Edit states (mouse moves) per user per second.", "rate",
+      "30");
+  parser.addOption(editStatesOption);
+  QCommandLineOption notesOption("notes",
+                                 "Notes placed per user per second.", "rate",
+                                 "0.5");
+  parser.addOption(notesOption);
+  QCommandLineOption paramDragsOption(
+      "param-drags", "Param drags per user per second.", "rate", "0.2");
+  parser.addOption(paramDragsOption);
+  QCommandLineOption undosOption(
+      "undos", "Undos / redos per user per second.", "rate", "0.1");
+  parser.addOption(undosOption);
+  QCommandLineOption threadsOption(
+      "threads",
+      "Handle server connections on <n> threads (default: one per core, 0 to "
+      "use the server thread).",
+      "n");
+  parser.addOption(threadsOption);
+  QCommandLineOption localOption(
+      "local",
+      "Connect users in-process instead of over loopback. Everything then "
+      "runs on one thread, so server CPU can't be separated out.");
+  parser.addOption(localOption);
+  QCommandLineOption connectOption(
+      "connect", "Load an already running server instead of starting one.",
+      "host:port");
+  parser.addOption(connectOption);
+  QCommandLineOption verboseOption("verbose", "Show debug logging.");
+  parser.addOption(verboseOption);
+
+  parser.process(a);
+  verbose = parser.isSet(verboseOption);
+
+  bool ok;
+  int num_users = parser.value(usersOption).toInt(&ok);
+  if (!ok || num_users <= 0) qFatal("Could not parse --users");
+  double duration = parser.value(durationOption).toDouble(&ok);
+  if (!ok || duration <= 0) qFatal("Could not parse --duration");
+  LoadRates rates{parseRate(parser, editStatesOption),
+                  parseRate(parser, notesOption),
+                  parseRate(parser, paramDragsOption),
+                  parseRate(parser, undosOption)};
+  int threads = QThread::idealThreadCount();
+  if (parser.isSet(threadsOption)) {
+    threads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threads < 0) qFatal("Could not parse --threads");
+  }
+  bool local = parser.isSet(localOption);
+
+  QString host = "127.0.0.1";
+  quint16 port = 0;
+  if (parser.isSet(connectOption)) {
+    if (local) qFatal("--local and --connect can't be used together");
+    QStringList parts = parser.value(connectOption).split(":");
+    if (parts.size() == 2) port = parts[1].toUShort(&ok);
+    if (parts.size() != 2 || !ok) qFatal("Could not parse --connect");
+    host = parts[0];
+  } else if (parser.positionalArguments().length() != 1) {
+    fprintf(stderr, "A project file is needed to start a server with.\n");
+    parser.showHelp(1);
+  }
+
+  // In TCP mode, the server gets its own thread so that everything else on
+  // the main thread is the users' doing.
+  BroadcastServer *server = nullptr;
+  QThread *server_thread = nullptr;
+  if (!parser.isSet(connectOption)) {
+    std::optional<QString> filename = parser.positionalArguments().at(0);
+    try {
+      server = new BroadcastServer(filename, QHostAddress::LocalHost, 0,
+                                   std::nullopt, nullptr, 0, 0, threads);
+    } catch (const QString &e) {
+      fprintf(stderr, "Could not start server: %s\n", qPrintable(e));
+      return 1;
+    } catch (const std::runtime_error &e) {
+      fprintf(stderr, "Could not start server: %s\n", e.what());
+      return 1;
+    }
+    port = server->port();
+    if (!local) {
+      server_thread = new QThread;
+      server_thread->setObjectName("server");
+      server->moveToThread(server_thread);
+      server_thread->start();
+    }
+  }
+
+  QElapsedTimer clock;
+  clock.start();
+  std::vector<std::unique_ptr<SimulatedUser>> users;
+  int num_connected = 0;
+  double start_process_cpu = 0, start_thread_cpu = 0;
+  QElapsedTimer run_time;
+  int exit_code = 0;
+
+  auto report = [&]() {
+    double wall = run_time.elapsed() / 1000.0;
+    double process_cpu = processCpuSecs() - start_process_cpu;
+    double thread_cpu = currentThreadCpuSecs() - start_thread_cpu;
+
+    qint64 sent = 0, edit_states = 0, received = 0, lost = 0;
+    std::vector<qint64> latencies;
+    std::map<QByteArray, int> fingerprints;
+    for (const auto &u : users) {
+      sent += u->sentActions();
+      edit_states += u->sentEditStates();
+      received += u->receivedActions();
+      lost += u->pending();
+      latencies.insert(latencies.end(), u->latencies().begin(),
+                       u->latencies().end());
+      ++fingerprints[u->fingerprint()];
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("%d users for %.1f s (%s)\n", num_users, wall,
+           local ? "in-process" : qPrintable(QString("%1:%2").arg(host).arg(port)));
+    printf("Sent %lld edits / undos and %lld edit states, received %lld "
+           "actions\n",
+           sent, edit_states, received);
+    printf("Echo latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms "
+           "(%zu samples)\n",
+           percentileMs(latencies, 0.5), percentileMs(latencies, 0.9),
+           percentileMs(latencies, 0.99),
+           latencies.empty() ? 0 : latencies.back() / 1e6, latencies.size());
+    if (lost > 0) {
+      printf("%lld edits were never echoed back\n", lost);
+      exit_code = 1;
+    }
+
+    if (server == nullptr)
+      printf("Server CPU: not measured for a remote server\n");
+    else if (process_cpu < 0 || thread_cpu < 0)
+      printf("Server CPU: not measurable on this platform\n");
+    else if (local)
+      printf("Server + users CPU: %.2f s (%.0f%% of a core)\n", process_cpu,
+             100 * process_cpu / wall);
+    else {
+      double server_cpu = process_cpu - thread_cpu;
+      printf("Server CPU: %.2f s (%.0f%% of a core), users: %.2f s\n",
+             server_cpu, 100 * server_cpu / wall, thread_cpu);
+    }
+
+    if (fingerprints.size() == 1)
+      printf("Converged: all %d users have the same project\n", num_users);
+    else {
+      printf("Diverged: %zu different versions of the project\n",
+             fingerprints.size());
+      exit_code = 1;
+    }
+  };
+
+  auto finish = [&]() {
+    report();
+    for (auto &u : users) u->disconnectFromServer();
+    a.exit(exit_code);
+  };
+
+  auto drain = [&]() {
+    // Wait for the echoes of everything that's been sent.
+    QElapsedTimer waited;
+    waited.start();
+    QTimer *poll = new QTimer(&a);
+    QObject::connect(poll, &QTimer::timeout, poll, [&, poll, waited]() {
+      bool drained = std::all_of(users.begin(), users.end(),
+                                 [](const auto &u) { return u->pending() == 0; });
+      if (drained || waited.elapsed() > DRAIN_TIMEOUT_MS) {
+        poll->stop();
+        finish();
+      }
+    });
+    poll->start(DRAIN_POLL_MS);
+  };
+
+  auto run = [&]() {
+    for (const auto &u : users)
+      if (u->numUnits() == 0) {
+        fprintf(stderr, "The project needs at least one unit to edit.\n");
+        a.exit(1);
+        return;
+      }
+    // Mostly the time to send and unpack the project and history.
+    printf("All %d users connected in %.2f s, generating load for %.0f s\n",
+           num_users, clock.elapsed() / 1000.0, duration);
+    start_process_cpu = processCpuSecs();
+    start_thread_cpu = currentThreadCpuSecs();
+    run_time.start();
+    for (auto &u : users) u->start();
+    QTimer::singleShot(duration * 1000, [&]() {
+      for (auto &u : users) u->stop();
+      drain();
+    });
+  };
+
+  for (int i = 0; i < num_users; ++i) {
+    users.push_back(std::make_unique<SimulatedUser>(i, rates, &clock));
+    SimulatedUser *u = users.back().get();
+    QObject::connect(u, &SimulatedUser::connected, [&]() {
+      if (++num_connected == num_users) run();
+    });
+    QObject::connect(u, &SimulatedUser::errorOccurred, [i](QString error) {
+      qWarning() << "User" << i << "connection error:" << error;
+    });
+    if (local)
+      u->connectToLocalServer(server);
+    else
+      u->connectToServer(host, port);
+  }
+  QTimer::singleShot(CONNECT_TIMEOUT_MS, [&]() {
+    if (num_connected < num_users) {
+      fprintf(stderr, "Only %d of %d users managed to connect\n",
+              num_connected, num_users);
+      a.exit(1);
+    }
+  });
+
+  int ret = a.exec();
+  users.clear();
+  if (server_thread != nullptr) {
+    QMetaObject::invokeMethod(server, [server]() { delete server; },
+                              Qt::BlockingQueuedConnection);
+    server_thread->quit();
+    server_thread->wait();
+    delete server_thread;
+  } else
+    delete server;
+  return ret;
+}
@@ -0,0 +1,94 @@
+# Offline replay / analysis of .ptrec recordings. Shares the protocol, pxtone
+# and controller sources with the editor but needs nothing beyond QtCore.
+
+TEMPLATE = app
+TARGET = ptrectool
+
+INCLUDEPATH += .
+win32:INCLUDEPATH += ../deps/include
+macx:INCLUDEPATH += ../deps/include
+QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.14
+
+QT = core
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += pxINCLUDE_OGGVORBIS
+
+HEADERS += \
+           editor/ActionLog.h \
+           editor/ComboOptions.h \
+           editor/EditState.h \
+           editor/Interval.h \
+           editor/ProjectSnapshot.h \
+           editor/PxtoneController.h \
+           protocol/ActionTiming.h \
+           protocol/Data.h \
+           protocol/Hello.h \
+           protocol/NoIdMap.h \
+           protocol/ProjectTransfer.h \
+           protocol/PxtoneEditAction.h \
+           protocol/Recording.h \
+           protocol/RemoteAction.h \
+           protocol/SerializeVariant.h \
+           pxtone/pxtn.h \
+           pxtone/pxtnDelay.h \
+           pxtone/pxtnDescriptor.h \
+           pxtone/pxtnError.h \
+           pxtone/pxtnEvelist.h \
+           pxtone/pxtnMaster.h \
+           pxtone/pxtnMax.h \
+           pxtone/pxtnMem.h \
+           pxtone/pxtnOverDrive.h \
+           pxtone/pxtnPulse_Frequency.h \
+           pxtone/pxtnPulse_Noise.h \
+           pxtone/pxtnPulse_NoiseBuilder.h \
+           pxtone/pxtnPulse_Oggv.h \
+           pxtone/pxtnPulse_Oscillator.h \
+           pxtone/pxtnPulse_PCM.h \
+           pxtone/pxtnService.h \
+           pxtone/pxtnText.h \
+           pxtone/pxtnUnit.h \
+           pxtone/pxtnWoice.h \
+           pxtone/pxtoneNoise.h
+SOURCES += \
+           ptrectool/main.cpp \
+           editor/ActionLog.cpp \
+           editor/EditState.cpp \
+           editor/Interval.cpp \
+           editor/ProjectSnapshot.cpp \
+           editor/PxtoneController.cpp \
+           protocol/ActionTiming.cpp \
+           protocol/Data.cpp \
+           protocol/Hello.cpp \
+           protocol/NoIdMap.cpp \
+           protocol/ProjectTransfer.cpp \
+           protocol/PxtoneEditAction.cpp \
+           protocol/Recording.cpp \
+           protocol/RemoteAction.cpp \
+           pxtone/pxtnDelay.cpp \
+           pxtone/pxtnDescriptor.cpp \
+           pxtone/pxtnError.cpp \
+           pxtone/pxtnEvelist.cpp \
+           pxtone/pxtnMaster.cpp \
+           pxtone/pxtnMem.cpp \
+           pxtone/pxtnOverDrive.cpp \
+           pxtone/pxtnPulse_Frequency.cpp \
+           pxtone/pxtnPulse_Noise.cpp \
+           pxtone/pxtnPulse_NoiseBuilder.cpp \
+           pxtone/pxtnPulse_Oggv.cpp \
+           pxtone/pxtnPulse_Oscillator.cpp \
+           pxtone/pxtnPulse_PCM.cpp \
+           pxtone/pxtnService.cpp \
+           pxtone/pxtnService_moo.cpp \
+           pxtone/pxtnText.cpp \
+           pxtone/pxtnUnit.cpp \
+           pxtone/pxtnWoice.cpp \
+           pxtone/pxtnWoice_io.cpp \
+           pxtone/pxtnWoicePTV.cpp \
+           pxtone/pxtoneNoise.cpp
+
+!win32:LIBS += -logg -lvorbisfile
+win32:LIBS += -L"$$PWD/../deps/lib" -L"$$PWD/deps/lib" -llibogg_static -llibvorbisfile
+macx:LIBS += -L/usr/local/lib
@@ -0,0 +1,179 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <map>
+
+#include "editor/PxtoneController.h"
+#include "protocol/Recording.h"
+
+// Replays a .ptrec recording through the same PxtoneController the editor
+// uses, as fast as possible and with no GUI, to find out which kinds of
+// actions are expensive. Can also write out the project at any point.
+
+// In the same order as ClientAction's alternatives.
+static const char *const CLIENT_ACTION_NAMES[] = {
+    "EditAction", "EditState", "UndoRedo", "AddUnit", "RemoveUnit", "MoveUnit",
+    "AddWoice", "RemoveWoice", "ChangeWoice", "TempoChange", "BeatChange",
+    "SetRepeatMeas", "SetLastMeas", "SetUnitName", "Overdrive::Add",
+    "Overdrive::Set", "Overdrive::Remove", "Delay::Set", "Woice::Set", "Ping",
+    "PlayState", "WatchUser", "FetchWoice"};
+static_assert(std::size(CLIENT_ACTION_NAMES) ==
+                  std::variant_size_v<ClientAction>,
+              "Every ClientAction needs a name");
+
+static QString actionName(const ServerAction &a) {
+  QString name;
+  std::visit(overloaded{[&name](const ClientAction &s) {
+                          name = CLIENT_ACTION_NAMES[s.index()];
+                        },
+                        [&name](const NewSession &) { name = "NewSession"; },
+                        [&name](const DeleteSession &) {
+                          name = "DeleteSession";
+                        },
+                        [&name](const WoiceData &) { name = "WoiceData"; },
+                        [&name](const ControllerState &) {
+                          name = "ControllerState";
+                        }},
+             a.action);
+  return name;
+}
+
+struct ActionStats {
+  qint64 count = 0;
+  qint64 bytes = 0;
+  qint64 max_bytes = 0;
+  qint64 apply_nsecs = 0;
+  qint64 max_apply_nsecs = 0;
+};
+
+static qint64 encodedSize(const ServerAction &a) {
+  QByteArray encoded;
+  QDataStream stream(&encoded, QIODevice::WriteOnly);
+  stream << a;
+  return encoded.size();
+}
+
+static bool writeProject(pxtnService &pxtn, const QString &filename) {
+  FILE *f = fopen(filename.toStdString().c_str(), "wb");
+  if (f == nullptr) return false;
+  pxtnDescriptor desc;
+  int version_from_pxtn_service = 5;
+  bool ok = desc.set_file_w(f) &&
+            pxtn.write(&desc, false, version_from_pxtn_service) == pxtnOK;
+  fclose(f);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  a.setApplicationName("ptrectool");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Replay a pxtone collab recording offline and report how long each kind "
+      "of action takes to apply.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("recording", "The .ptrec file to replay.");
+
+  QCommandLineOption outputOption(
+      QStringList() << "o"
+                    << "output",
+      "Write the project as of the end of the replay to this .ptcop file.",
+      "file");
+  parser.addOption(outputOption);
+
+  QCommandLineOption untilOption(
+      QStringList() << "until",
+      "Stop replaying <secs> into the recording. With --output, this writes a "
+      "snapshot of the project at that point.",
+      "secs");
+  parser.addOption(untilOption);
+
+  parser.process(a);
+  if (parser.positionalArguments().length() != 1) parser.showHelp(1);
+
+  qint64 until = std::numeric_limits<qint64>::max();
+  if (parser.isSet(untilOption)) {
+    bool ok;
+    until = parser.value(untilOption).toDouble(&ok) * 1000;
+    if (!ok) qFatal("Could not parse --until");
+  }
+
+  QFile file(parser.positionalArguments().at(0));
+  if (!file.open(QIODevice::ReadOnly)) {
+    fprintf(stderr, "Could not open %s\n", qPrintable(file.fileName()));
+    return 1;
+  }
+
+  pxtnService pxtn;
+  mooState moo_state;
+  pxtn.init_collage(EVENT_MAX);
+  int channel_num = 2;
+  int sample_rate = 44100;
+  pxtn.set_destination_quality(channel_num, sample_rate);
+  // A uid nobody has, so every action is treated as someone else's.
+  PxtoneController controller(-1, &pxtn, &moo_state, nullptr);
+
+  try {
+    RecordingReader reader(&file);
+    pxtnDescriptor desc;
+    desc.set_memory_r(reader.data().constData(), reader.data().size());
+    if (!controller.loadDescriptor(desc)) {
+      fprintf(stderr, "Could not load the recording's initial project\n");
+      return 1;
+    }
+
+    std::map<QString, ActionStats> stats;
+    QElapsedTimer total_time, action_time;
+    total_time.start();
+    qint64 elapsed, replayed_until = 0, num_actions = 0;
+    ServerAction action;
+    while (reader.next(elapsed, action) && elapsed <= until) {
+      replayed_until = elapsed;
+      action_time.start();
+      controller.applyProjectAction(action);
+      qint64 nsecs = action_time.nsecsElapsed();
+
+      ActionStats &s = stats[actionName(action)];
+      qint64 bytes = encodedSize(action);
+      ++s.count;
+      s.bytes += bytes;
+      s.max_bytes = std::max(s.max_bytes, bytes);
+      s.apply_nsecs += nsecs;
+      s.max_apply_nsecs = std::max(s.max_apply_nsecs, nsecs);
+      ++num_actions;
+    }
+    qint64 total_msecs = total_time.elapsed();
+
+    printf("Replayed %lld actions (%.1f s of recording) in %lld ms",
+           num_actions, replayed_until / 1000.0, total_msecs);
+    if (total_msecs > 0)
+      printf(", %.0f actions/s", num_actions * 1000.0 / total_msecs);
+    printf("\n\n%-18s %9s %12s %10s %12s %12s\n", "action", "count",
+           "total bytes", "max bytes", "mean apply", "max apply");
+    for (const auto &[name, s] : stats)
+      printf("%-18s %9lld %12lld %10lld %10.1fus %10.1fus\n",
+             qPrintable(name), s.count, s.bytes, s.max_bytes,
+             s.apply_nsecs / 1000.0 / s.count, s.max_apply_nsecs / 1000.0);
+  } catch (const QString &e) {
+    fprintf(stderr, "%s\n", qPrintable(e));
+    return 1;
+  } catch (const std::runtime_error &e) {
+    fprintf(stderr, "Corrupt recording: %s\n", e.what());
+    return 1;
+  }
+
+  if (parser.isSet(outputOption)) {
+    QString output = parser.value(outputOption);
+    if (!writeProject(pxtn, output)) {
+      fprintf(stderr, "Could not write %s\n", qPrintable(output));
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include "ActionLogTest.h"
+
+#include <QRandomGenerator>
+#include <QThread>
+#include <QtTest>
+
+#include "editor/ActionLog.h"
+
+using namespace Action;
+
+// A list of [n] adds whose values don't compress well, so the size of the
+// spilled entry follows the number of primitives.
+static std::list<Primitive> randomReverse(QRandomGenerator &random, int n) {
+  std::list<Primitive> as;
+  for (int i = 0; i < n; ++i)
+    as.push_back({EVENTKIND_VOLUME, 0, i * 10,
+                  Add{qint32(random.bounded(1 << 20))}});
+  return as;
+}
+
+// Primitives have no ==, so compare them by their serialization.
+static QByteArray encode(const std::list<Primitive> &as) {
+  QByteArray bytes;
+  QDataStream out(&bytes, QIODevice::WriteOnly);
+  for (const Primitive &a : as) out << a;
+  return bytes;
+}
+
+void ActionLogTest::spillsAndLoadsBack() {
+  QRandomGenerator random(1);
+  ActionLog log(1);
+  std::vector<std::list<Primitive>> reverses;
+  for (int i = 0; i < 10; ++i) {
+    reverses.push_back(randomReverse(random, 4));
+    log.push(0, i, reverses.back());
+  }
+  // Only the newest entry is left.
+  QCOMPARE(log.residentPrimitives(), size_t(4));
+  QVERIFY(log.spillFileSize() > 0);
+
+  QVERIFY(log.loadFrom(0));
+  for (int i = 0; i < 10; ++i)
+    QCOMPARE(encode(log.at(i).reverse), encode(reverses[i]));
+  log.trim();
+  QCOMPARE(log.residentPrimitives(), size_t(4));
+}
+
+void ActionLogTest::loadsOnlyWhatAnUndoNeeds() {
+  QRandomGenerator random(7);
+  ActionLog log(1);
+  std::vector<std::list<Primitive>> reverses;
+  // User 0's entries, then user 1's, then one that stays resident.
+  for (int i = 0; i < 11; ++i) {
+    reverses.push_back(randomReverse(random, 4));
+    log.push(i < 5 ? 0 : i < 10 ? 1 : 2, i, reverses.back());
+  }
+  log.flip(9);
+  log.flip(8);
+  log.trim();
+  for (int i = 0; i < 10; ++i) QVERIFY(log.m_entries[i].spilled);
+
+  // Undoing user 0's last entry temporarily undoes user 1's and 2's done
+  // ones, but not their undone ones or anything before it.
+  QVERIFY(log.lastDone(0) == std::optional<size_t>(4));
+  QVERIFY(log.loadForUndo(4));
+  for (int i = 0; i < 11; ++i)
+    QCOMPARE(log.m_entries[i].spilled, i < 4 || i == 8 || i == 9);
+  for (int i = 4; i < 8; ++i)
+    QCOMPARE(encode(log.at(i).reverse), encode(reverses[i]));
+}
+
+void ActionLogTest::reusesSpillSpace() {
+  QRandomGenerator random(2);
+  ActionLog log(1);
+  for (int i = 0; i < 10; ++i) log.push(0, i, randomReverse(random, 4));
+
+  // Like undoing and redoing: reverses are loaded, replaced with ones of the
+  // same size, and spilled again. Which entry stays resident can change, so
+  // start counting once every entry has been spilled once.
+  auto roundTrip = [&] {
+    QVERIFY(log.loadFrom(0));
+    for (int i = 0; i < 10; ++i) {
+      std::list<Primitive> &reverse = log.at(i).reverse;
+      for (Primitive &a : reverse) std::get<Add>(a.type).value ^= 1;
+    }
+    log.trim();
+  };
+  roundTrip();
+  qint64 size = log.spillFileSize();
+  QVERIFY(size > 0);
+  for (int round = 0; round < 20; ++round) {
+    roundTrip();
+    QCOMPARE(log.spillFileSize(), size);
+  }
+}
+
+void ActionLogTest::compactsSpillFile() {
+  constexpr int ENTRIES = 100;
+  constexpr int GROWTH = 200;
+  constexpr int ROUNDS = 20;
+  QRandomGenerator random(3);
+  ActionLog log(1);
+  std::vector<std::list<Primitive>> reverses;
+  for (int i = 0; i < ENTRIES; ++i) {
+    reverses.push_back(randomReverse(random, GROWTH));
+    log.push(0, i, reverses.back());
+  }
+
+  // Every round each reverse outgrows its space, so without compaction the
+  // file would end up holding every round's copy.
+  qint64 first_round_size = log.spillFileSize();
+  for (int round = 0; round < ROUNDS; ++round) {
+    QVERIFY(log.loadFrom(0));
+    for (int i = 0; i < ENTRIES; ++i) {
+      std::list<Primitive> more = randomReverse(random, GROWTH);
+      reverses[i].insert(reverses[i].end(), more.begin(), more.end());
+      log.at(i).reverse = reverses[i];
+    }
+    log.trim();
+  }
+  qint64 last_round_size = first_round_size * (ROUNDS + 1);
+  qint64 unbounded = last_round_size * (ROUNDS + 2) / 2;
+  QVERIFY2(log.spillFileSize() < unbounded / 4,
+           qPrintable(QString("%1 bytes").arg(log.spillFileSize())));
+
+  QVERIFY(log.loadFrom(0));
+  for (int i = 0; i < ENTRIES; ++i)
+    QCOMPARE(encode(log.at(i).reverse), encode(reverses[i]));
+}
+
+void ActionLogTest::failedReadBackIsReported() {
+  QRandomGenerator random(4);
+  ActionLog log(1);
+  for (int i = 0; i < 10; ++i) log.push(0, i, randomReverse(random, 4));
+  QVERIFY(log.spillFileSize() > 0);
+  QVERIFY(log.m_spill_file->resize(0));
+
+  QTest::ignoreMessage(QtWarningMsg,
+                       QRegularExpression("Could not read back action log"));
+  QVERIFY(!log.loadFrom(0));
+
+  // The spill file can't be trusted any more, so new entries stay in memory.
+  for (int i = 10; i < 20; ++i) log.push(0, i, randomReverse(random, 4));
+  QCOMPARE(log.spillFileSize(), qint64(0));
+  QCOMPARE(log.residentPrimitives(), size_t(4 * 11));
+}
+
+// Like a history replay, which builds the log on its own thread and hands it
+// over to the editor's.
+void ActionLogTest::movesSpillFileToThread() {
+  ActionLog log(1);
+  QThread *worker = QThread::create([&log]() {
+    QRandomGenerator random(5);
+    for (int i = 0; i < 10; ++i) log.push(0, i, randomReverse(random, 4));
+    log.moveToThread(QCoreApplication::instance()->thread());
+  });
+  worker->start();
+  QVERIFY(worker->wait(5000));
+  delete worker;
+
+  QVERIFY(log.m_spill_file != nullptr);
+  QCOMPARE(log.m_spill_file->thread(), QThread::currentThread());
+  QVERIFY(log.loadFrom(0));
+}
+
+// For checkpoint snapshots. Spilled entries have to be loaded to be written.
+void ActionLogTest::writesAndReadsTail() {
+  QRandomGenerator random(6);
+  ActionLog log(1);
+  std::vector<std::list<Primitive>> reverses;
+  for (qint64 uid : {0, 0, 1, 1, 0}) {
+    reverses.push_back(randomReverse(random, 4));
+    log.push(uid, qint64(reverses.size()), reverses.back());
+  }
+  // User 1 undoes their last entry, and user 0 their last two.
+  log.flip(3);
+  log.flip(4);
+  log.flip(1);
+
+  QByteArray tail;
+  {
+    QDataStream out(&tail, QIODevice::WriteOnly);
+    QVERIFY(log.writeTail(out, 3));
+  }
+  ActionLog read;
+  QDataStream in(tail);
+  QVERIFY(read.readTail(in));
+
+  // Entries 2 to 4 of the original, with their states and reverses.
+  QCOMPARE(read.size(), size_t(3));
+  QCOMPARE(read.lastDone(1), std::optional<size_t>(0));
+  QCOMPARE(read.firstUndone(1), std::optional<size_t>(1));
+  QCOMPARE(encode(read.at(0).reverse), encode(reverses[2]));
+  QCOMPARE(encode(read.at(1).reverse), encode(reverses[3]));
+  QCOMPARE(read.at(1).idx, qint64(4));
+  // User 0's next redo would be entry 1, which didn't make it, so their redos
+  // are gone rather than starting from the wrong entry.
+  QCOMPARE(read.state(2), LoggedAction::GONE);
+  QCOMPARE(read.firstUndone(0), std::optional<size_t>());
+  QCOMPARE(read.lastDone(0), std::optional<size_t>());
+}
@@ -0,0 +1,18 @@
+#ifndef ACTIONLOGTEST_H
+#define ACTIONLOGTEST_H
+
+#include <QObject>
+
+class ActionLogTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void spillsAndLoadsBack();
+  void loadsOnlyWhatAnUndoNeeds();
+  void reusesSpillSpace();
+  void compactsSpillFile();
+  void failedReadBackIsReported();
+  void movesSpillFileToThread();
+  void writesAndReadsTail();
+};
+
+#endif  // ACTIONLOGTEST_H
@@ -0,0 +1,15 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QtTest>
+
+// Tests that take a while to measure how fast something is. They're skipped
+// unless PTTEST_BENCHMARKS is set, so that `make check` stays quick, e.g.
+//   PTTEST_BENCHMARKS=1 ./pttest
+#define SKIP_UNLESS_BENCHMARKING()                               \
+  do {                                                           \
+    if (!qEnvironmentVariableIsSet("PTTEST_BENCHMARKS"))         \
+      QSKIP("A benchmark. Set PTTEST_BENCHMARKS to run it.");    \
+  } while (false)
+
+#endif  // BENCHMARK_H
@@ -0,0 +1,61 @@
+#include "BroadcastServerTest.h"
+
+#include <QtTest>
+
+#include "network/BroadcastServer.h"
+#include "network/Client.h"
+
+static const AddWoice *findAddedWoice(const QList<ServerAction> &history) {
+  for (const ServerAction &a : history)
+    if (const AddWoice *w = addedWoice(a)) return w;
+  return nullptr;
+}
+
+void BroadcastServerTest::keepsWoicesOutOfHistory() {
+  BroadcastServer server(std::nullopt, QHostAddress::LocalHost, 0,
+                         std::nullopt);
+  Client alice(nullptr);
+  alice.connectToLocalServer(&server, "alice");
+  QByteArray data(100000, 'w');
+  alice.sendAction(AddWoice{pxtnWOICE_PTV, "drum", data, {}});
+  QTRY_VERIFY(findAddedWoice(server.m_history) != nullptr);
+
+  // The server only holds on to the hash...
+  const AddWoice *stored = findAddedWoice(server.m_history);
+  QCOMPARE(stored->hash, woiceHash(data));
+  QVERIFY(stored->data.isEmpty());
+
+  // ...but someone joining later without it still gets it in full.
+  Client bob(nullptr);
+  std::optional<QList<ServerAction>> history;
+  connect(&bob, &Client::connected,
+          [&](const QByteArray &, const QList<ServerAction> &h, qint64) {
+            history = h;
+          });
+  bob.connectToLocalServer(&server, "bob");
+  QTRY_VERIFY(history.has_value());
+  const AddWoice *sent = findAddedWoice(history.value());
+  QVERIFY(sent != nullptr);
+  QCOMPARE(sent->name, QString("drum"));
+  QCOMPARE(sent->data, data);
+}
+
+void BroadcastServerTest::sessionReadsFetchedWoice() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  WoiceCache store(dir.path());
+  QByteArray data(1000, 'w');
+  QVERIFY(store.put(woiceHash(data), data));
+
+  LocalServerSession session(nullptr, "alice", 0);
+  session.setWoiceStore(dir.path());
+  std::optional<ServerAction> sent;
+  connect(&session, &LocalServerSession::actionSent,
+          [&](const ServerAction &a) { sent = a; });
+  session.sendWoice(woiceHash(data));
+  QVERIFY(sent.has_value());
+  const WoiceData *d = std::get_if<WoiceData>(&sent->action);
+  QVERIFY(d != nullptr);
+  QCOMPARE(d->hash, woiceHash(data));
+  QCOMPARE(d->data, data);
+}
@@ -0,0 +1,13 @@
+#ifndef BROADCASTSERVERTEST_H
+#define BROADCASTSERVERTEST_H
+
+#include <QObject>
+
+class BroadcastServerTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void keepsWoicesOutOfHistory();
+  void sessionReadsFetchedWoice();
+};
+
+#endif  // BROADCASTSERVERTEST_H
@@ -0,0 +1,184 @@
+#include "CompactEncodingTest.h"
+
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QtTest>
+#include <cstring>
+#include <limits>
+
+#include "Benchmark.h"
+#include "protocol/PxtoneEditAction.h"
+
+using namespace Action;
+using Primitives = std::list<Primitive>;
+Q_DECLARE_METATYPE(Primitives)
+
+// The first byte writeCompact writes. Mirrors the enum in PxtoneEditAction.cpp.
+enum Encoding : quint8 { RAW, ZLIB };
+constexpr int NO_EXPECTATION = -1;
+
+// The format EditActions were sent in before writeCompact. It's also a handy
+// canonical form to compare decoded lists by.
+static QByteArray oldFormat(const Primitives &as) {
+  QByteArray bytes;
+  QDataStream out(&bytes, QIODevice::WriteOnly);
+  out << quint64(as.size());
+  for (const Primitive &a : as) out << a;
+  return bytes;
+}
+
+static qint32 floatBits(float f) {
+  qint32 bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+// A single run of [n] adds at clock 0, each 3 bytes. With the 4 bytes of run
+// header (n >= 128 makes the length varint 2 bytes) that's 4 + 3n bytes of
+// payload, which is compressed if it's over 512.
+static Primitives addRun(int n) {
+  Primitives as;
+  for (int i = 0; i < n; ++i)
+    as.push_back({EVENTKIND_VELOCITY, 0, 0, Add{i % 64}});
+  return as;
+}
+
+// A typical paste: notes with velocities on a few units.
+static Primitives paste(int units, int notes) {
+  Primitives as;
+  for (int u = 0; u < units; ++u)
+    for (int i = 0; i < notes; ++i) {
+      qint32 clock = i * 240;
+      as.push_back({EVENTKIND_ON, u, clock, Add{120}});
+      as.push_back({EVENTKIND_VELOCITY, u, clock, Add{104}});
+      as.push_back({EVENTKIND_KEY, u, clock, Add{0x4000 + i % 12 * 0x100}});
+    }
+  return as;
+}
+
+void CompactEncodingTest::roundTrips_data() {
+  constexpr qint32 MIN = std::numeric_limits<qint32>::min();
+  constexpr qint32 MAX = std::numeric_limits<qint32>::max();
+  QTest::addColumn<Primitives>("actions");
+  QTest::addColumn<int>("encoding");
+
+  QTest::newRow("empty") << Primitives{} << int(RAW);
+  QTest::newRow("single add")
+      << Primitives{{EVENTKIND_ON, 0, 0, Add{480}}} << int(RAW);
+  QTest::newRow("negative clocks")
+      << Primitives{{EVENTKIND_ON, 0, -480, Add{-1}},
+                    {EVENTKIND_ON, 0, -960, Delete{-480}},
+                    {EVENTKIND_ON, -1, -10, Shift{-5, -3}}}
+      << int(RAW);
+  QTest::newRow("huge clocks")
+      << Primitives{{EVENTKIND_KEY, MAX, MAX, Add{MIN}},
+                    {EVENTKIND_KEY, MIN, MIN, Delete{MAX}},
+                    {EVENTKIND_KEY, MAX, MAX, Shift{MIN, MIN}},
+                    {EVENTKIND_KEY, 0, MIN, Shift{MAX, MAX}},
+                    {EVENTKIND_KEY, 0, MAX, Delete{MIN}}}
+      << int(RAW);
+  {
+    // Runs of length 1, the worst case for the run grouping.
+    Primitives as;
+    for (int i = 0; i < 100; ++i)
+      as.push_back({i % 2 ? EVENTKIND_ON : EVENTKIND_VELOCITY, (i / 2) % 2,
+                    i * 120, Add{i}});
+    QTest::newRow("alternating kinds and units") << as << NO_EXPECTATION;
+  }
+  QTest::newRow("float values")
+      << Primitives{{EVENTKIND_TUNING, 0, 0, Add{floatBits(1.5f)}},
+                    {EVENTKIND_TUNING, 0, 480, Add{floatBits(-0.001f)}},
+                    {EVENTKIND_TUNING, 0, 960,
+                     Add{floatBits(std::numeric_limits<float>::max())}},
+                    {EVENTKIND_TUNING, 0, 1440,
+                     Add{floatBits(std::numeric_limits<float>::quiet_NaN())}}}
+      << int(RAW);
+  QTest::newRow("just below compression threshold") << addRun(169) << int(RAW);
+  QTest::newRow("just above compression threshold")
+      << addRun(170) << int(ZLIB);
+  QTest::newRow("paste") << paste(4, 250) << NO_EXPECTATION;
+}
+
+void CompactEncodingTest::roundTrips() {
+  QFETCH(Primitives, actions);
+  QFETCH(int, encoding);
+
+  QByteArray encoded;
+  {
+    QDataStream out(&encoded, QIODevice::WriteOnly);
+    writeCompact(out, actions);
+  }
+  if (encoding != NO_EXPECTATION) QCOMPARE(int(quint8(encoded[0])), encoding);
+
+  Primitives decoded;
+  QDataStream in(encoded);
+  readCompact(in, decoded);
+  QCOMPARE(in.status(), QDataStream::Ok);
+  QVERIFY(in.atEnd());
+  QByteArray old = oldFormat(actions);
+  QCOMPARE(oldFormat(decoded), old);
+
+  qInfo("%s: %d primitives, %d bytes (old format %d bytes, %.1f%%)",
+        QTest::currentDataTag(), int(actions.size()), encoded.size(),
+        old.size(), 100.0 * encoded.size() / old.size());
+}
+
+// A few bytes that claim to inflate to 4 GB shouldn't get that allocated.
+void CompactEncodingTest::rejectsHugeDecompressedSize() {
+  QByteArray payload(sizeof(quint32), 0);
+  qToBigEndian<quint32>(std::numeric_limits<quint32>::max(), payload.data());
+  payload.append(qCompress(QByteArray(16, 'x')).mid(sizeof(quint32)));
+  QByteArray encoded;
+  {
+    QDataStream out(&encoded, QIODevice::WriteOnly);
+    out << quint8(ZLIB) << payload;
+  }
+
+  Primitives decoded;
+  QDataStream in(encoded);
+  bool threw = false;
+  try {
+    readCompact(in, decoded);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  QVERIFY(threw);
+}
+
+void CompactEncodingTest::benchmarkEncodeDecode_data() {
+  QTest::addColumn<Primitives>("actions");
+  QTest::addColumn<int>("repeats");
+  QTest::newRow("paste") << paste(4, 250) << 1000;
+  QTest::newRow("big paste") << paste(16, 5000) << 10;
+}
+
+void CompactEncodingTest::benchmarkEncodeDecode() {
+  SKIP_UNLESS_BENCHMARKING();
+  QFETCH(Primitives, actions);
+  QFETCH(int, repeats);
+
+  QElapsedTimer timer;
+  timer.start();
+  QByteArray encoded;
+  for (int i = 0; i < repeats; ++i) {
+    encoded.clear();
+    QDataStream out(&encoded, QIODevice::WriteOnly);
+    writeCompact(out, actions);
+  }
+  qint64 encode_ms = std::max(timer.restart(), qint64(1));
+  Primitives decoded;
+  for (int i = 0; i < repeats; ++i) {
+    QDataStream in(encoded);
+    readCompact(in, decoded);
+    QCOMPARE(in.status(), QDataStream::Ok);
+  }
+  qint64 decode_ms = std::max(timer.elapsed(), qint64(1));
+  QCOMPARE(oldFormat(decoded), oldFormat(actions));
+
+  double primitives = double(actions.size()) * repeats;
+  qInfo("%s: %d primitives x %d. Encoded in %lld ms (%.0f primitives/s), "
+        "decoded in %lld ms (%.0f primitives/s)",
+        QTest::currentDataTag(), int(actions.size()), repeats, encode_ms,
+        primitives * 1000 / encode_ms, decode_ms,
+        primitives * 1000 / decode_ms);
+}
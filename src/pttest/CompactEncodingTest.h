@@ -0,0 +1,16 @@
+#ifndef COMPACTENCODINGTEST_H
+#define COMPACTENCODINGTEST_H
+
+#include <QObject>
+
+class CompactEncodingTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void roundTrips_data();
+  void roundTrips();
+  void rejectsHugeDecompressedSize();
+  void benchmarkEncodeDecode_data();
+  void benchmarkEncodeDecode();
+};
+
+#endif  // COMPACTENCODINGTEST_H
@@ -0,0 +1,161 @@
+#include "ControllerConvergenceTest.h"
+
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QtTest>
+#include <deque>
+#include <memory>
+
+#include "editor/PxtoneController.h"
+
+// Simulates a few clients editing the same project through a server that
+// delivers actions to them at random times, so that remote actions often
+// arrive while local ones are pending. Each client keeps two copies of the
+// project: one whose controller skips the rollback when a remote action
+// doesn't interact with the pending local ones, and one whose controller
+// always rolls back. After every step they have to have the same events.
+
+using namespace Action;
+
+static constexpr int NUM_CLIENTS = 3;
+static constexpr int NUM_UNITS = 2;
+static constexpr int STEPS = 3000;
+// Edits land on a grid over a few measures, so that some overlap and some
+// don't.
+static constexpr qint32 QUANTUM = 120;
+static constexpr qint32 CLOCK_RANGE = 480 * 4 * 8;
+
+namespace {
+struct Replica {
+  pxtnService pxtn;
+  mooState moo_state;
+  std::unique_ptr<PxtoneController> controller;
+
+  Replica(qint64 uid, bool always_roll_back) {
+    pxtn.init_collage(EVENT_MAX);
+    for (int i = 0; i < NUM_UNITS; ++i) pxtn.Unit_AddNew();
+    controller =
+        std::make_unique<PxtoneController>(uid, &pxtn, &moo_state, nullptr);
+    controller->setAlwaysRollBack(always_roll_back);
+  }
+
+  QByteArray events() const {
+    QByteArray events;
+    QDataStream out(&events, QIODevice::WriteOnly);
+    for (const EVERECORD *e = pxtn.evels->get_Records(); e != nullptr;
+         e = e->next)
+      out << qint32(e->clock) << quint8(e->unit_no) << quint8(e->kind)
+          << qint32(e->value);
+    return events;
+  }
+};
+
+struct SimulatedClient {
+  qint64 uid;
+  Replica fast, slow;
+  // Sent, but not received by the server yet.
+  std::deque<ClientAction> outbox;
+  // How much of the server's broadcast this client has received.
+  size_t received;
+
+  SimulatedClient(qint64 uid)
+      : uid(uid), fast(uid, false), slow(uid, true), received(0) {}
+};
+}  // namespace
+
+// The same kinds of edits the views make.
+static std::list<Primitive> randomEdit(QRandomGenerator &random) {
+  qint32 unit = random.bounded(NUM_UNITS);
+  qint32 start = random.bounded(CLOCK_RANGE / QUANTUM) * QUANTUM;
+  qint32 end = start + random.bounded(1, 9) * QUANTUM;
+  std::list<Primitive> as;
+  switch (random.bounded(4)) {
+    case 0:  // Note
+      for (EVENTKIND kind : {EVENTKIND_ON, EVENTKIND_VELOCITY, EVENTKIND_KEY})
+        as.push_back({kind, unit, start, Delete{end}});
+      as.push_back({EVENTKIND_ON, unit, start, Add{end - start}});
+      as.push_back({EVENTKIND_VELOCITY, unit, start, Add{104}});
+      as.push_back({EVENTKIND_KEY, unit, start,
+                    Add{EVENTDEFAULT_KEY + random.bounded(-12, 13) * 0x100}});
+      break;
+    case 1:  // Param drag
+      as.push_back({EVENTKIND_VOLUME, unit, start, Delete{end}});
+      for (qint32 c = start; c < end; c += QUANTUM)
+        as.push_back({EVENTKIND_VOLUME, unit, c, Add{random.bounded(129)}});
+      break;
+    case 2:  // Erase, which can cut notes short
+      for (EVENTKIND kind : {EVENTKIND_ON, EVENTKIND_VELOCITY, EVENTKIND_KEY})
+        as.push_back({kind, unit, start, Delete{end}});
+      break;
+    case 3:  // Transpose
+      as.push_back({EVENTKIND_KEY, unit, start,
+                    Shift{end, random.bounded(-2, 3) * 0x100}});
+      break;
+  }
+  return as;
+}
+
+void ControllerConvergenceTest::initTestCase() {
+  // Undos and redos are logged at debug level.
+  QLoggingCategory::setFilterRules("default.debug=false");
+}
+
+void ControllerConvergenceTest::cleanupTestCase() {
+  QLoggingCategory::setFilterRules("");
+}
+
+void ControllerConvergenceTest::fastPathMatchesRollback_data() {
+  QTest::addColumn<quint32>("seed");
+  for (quint32 seed = 1; seed <= 8; ++seed)
+    QTest::newRow(qPrintable(QString("seed %1").arg(seed))) << seed;
+}
+
+void ControllerConvergenceTest::fastPathMatchesRollback() {
+  QFETCH(quint32, seed);
+  QRandomGenerator random(seed);
+  std::vector<std::unique_ptr<SimulatedClient>> clients;
+  for (int i = 0; i < NUM_CLIENTS; ++i)
+    clients.push_back(std::make_unique<SimulatedClient>(i));
+  // Everything the server has broadcast, in order.
+  std::vector<ServerAction> broadcast;
+
+  auto step = [&](SimulatedClient &c, int choice) {
+    if (choice < 4) {
+      std::list<Primitive> edit = randomEdit(random);
+      EditAction sent = c.fast.controller->applyLocalAction(edit);
+      if (c.slow.controller->applyLocalAction(edit).idx != sent.idx)
+        return false;
+      c.outbox.push_back(sent);
+    } else if (choice < 5)
+      c.outbox.push_back(random.bounded(2) ? UNDO : REDO);
+    else if (choice < 7) {
+      if (c.outbox.empty()) return true;
+      broadcast.push_back({c.uid, c.outbox.front(), std::nullopt});
+      c.outbox.pop_front();
+    } else {
+      if (c.received == broadcast.size()) return true;
+      const ServerAction &a = broadcast[c.received++];
+      c.fast.controller->applyProjectAction(a);
+      c.slow.controller->applyProjectAction(a);
+    }
+    return c.fast.events() == c.slow.events();
+  };
+
+  for (int i = 0; i < STEPS; ++i) {
+    SimulatedClient &c = *clients[random.bounded(NUM_CLIENTS)];
+    int choice = random.bounded(10);
+    QVERIFY2(step(c, choice), qPrintable(QString("Client %1 diverged at step "
+                                                 "%2 (choice %3)")
+                                             .arg(c.uid)
+                                             .arg(i)
+                                             .arg(choice)));
+  }
+
+  // Let everything arrive.
+  for (auto &c : clients)
+    while (!c->outbox.empty()) QVERIFY(step(*c, 5));
+  for (auto &c : clients) {
+    while (c->received < broadcast.size()) QVERIFY(step(*c, 9));
+    QCOMPARE(c->fast.events(), c->slow.events());
+  }
+}
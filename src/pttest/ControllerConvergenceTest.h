@@ -0,0 +1,15 @@
+#ifndef CONTROLLERCONVERGENCETEST_H
+#define CONTROLLERCONVERGENCETEST_H
+
+#include <QObject>
+
+class ControllerConvergenceTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void fastPathMatchesRollback_data();
+  void fastPathMatchesRollback();
+};
+
+#endif  // CONTROLLERCONVERGENCETEST_H
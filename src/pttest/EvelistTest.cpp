@@ -0,0 +1,31 @@
+#include "EvelistTest.h"
+
+#include <QtTest>
+
+#include "pxtone/pxtnEvelist.h"
+
+// A delete that starts in the middle of a note doesn't cut any records, it
+// only shortens the note. Views cache what they draw by revision, so this
+// still has to count as a change.
+
+void EvelistTest::deleteTrimmingATailChangesRevision() {
+  pxtnEvelist evels;
+  QVERIFY(evels.Allocate(16));
+  QVERIFY(evels.Record_Add_i(0, 0, EVENTKIND_ON, 480));
+  uint32_t revision = evels.get_Revision();
+
+  QCOMPARE(evels.Record_Delete(240, 960, 0, EVENTKIND_ON), 1);
+  QCOMPARE(evels.get_Records()->value, 240);
+  QVERIFY(evels.get_Revision() != revision);
+}
+
+void EvelistTest::deleteOfAllKindsTrimmingATailChangesRevision() {
+  pxtnEvelist evels;
+  QVERIFY(evels.Allocate(16));
+  QVERIFY(evels.Record_Add_i(0, 0, EVENTKIND_ON, 480));
+  uint32_t revision = evels.get_Revision();
+
+  QCOMPARE(evels.Record_Delete(240, 960, 0), 1);
+  QCOMPARE(evels.get_Records()->value, 240);
+  QVERIFY(evels.get_Revision() != revision);
+}
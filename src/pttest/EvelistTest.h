@@ -0,0 +1,13 @@
+#ifndef EVELISTTEST_H
+#define EVELISTTEST_H
+
+#include <QObject>
+
+class EvelistTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void deleteTrimmingATailChangesRevision();
+  void deleteOfAllKindsTrimmingATailChangesRevision();
+};
+
+#endif  // EVELISTTEST_H
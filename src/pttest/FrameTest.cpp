@@ -0,0 +1,102 @@
+#include "FrameTest.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "Benchmark.h"
+#include "network/BroadcastServer.h"
+#include "network/Client.h"
+#include "protocol/Frame.h"
+
+// About the size of a project with a few long samples in it.
+constexpr int HELLO_PROJECT_SIZE = 50 * 1024 * 1024;
+
+void FrameTest::initTestCase() {
+  // Keeps the client's woice cache out of the real one.
+  QStandardPaths::setTestModeEnabled(true);
+}
+
+void FrameTest::waitsForWholeFrame() {
+  QByteArray frame =
+      makeFrame([](QDataStream &out) { out << QByteArray(1000, 'x'); });
+  QBuffer buffer;
+  QVERIFY(buffer.open(QIODevice::ReadOnly));
+  // Handed over a bit at a time, like a socket would.
+  for (int i = 0; i < frame.size() - 100; i += 100) {
+    buffer.buffer().append(frame.mid(i, 100));
+    QVERIFY(!readFrame(&buffer, MAX_HELLO_FRAME_SIZE).has_value());
+  }
+  buffer.buffer() = frame;
+  std::optional<QByteArray> message = readFrame(&buffer, MAX_HELLO_FRAME_SIZE);
+  QVERIFY(message.has_value());
+  QDataStream in(message.value());
+  in.setVersion(QDataStream::Qt_5_5);
+  QByteArray contents;
+  in >> contents;
+  QCOMPARE(contents, QByteArray(1000, 'x'));
+  QVERIFY(buffer.atEnd());
+}
+
+void FrameTest::rejectsFramesOverLimit() {
+  // Just the header is enough for the limit to apply.
+  QByteArray header(FRAME_HEADER_SIZE, 0);
+  qToBigEndian<quint32>(MAX_HELLO_FRAME_SIZE + 1, header.data());
+  QBuffer buffer(&header);
+  QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+  bool threw = false;
+  try {
+    readFrame(&buffer, MAX_HELLO_FRAME_SIZE);
+  } catch (const QString &) {
+    threw = true;
+  }
+  QVERIFY(threw);
+  // Once the hello's done it's a reasonable size, so keep waiting for it.
+  QVERIFY(!readFrame(&buffer, MAX_ACTION_FRAME_SIZE).has_value());
+}
+
+// A client connecting to a server with a big project. Loopback delivers the
+// hello in socket-buffer-sized chunks, so a reader that reparsed the whole
+// message on each one would take minutes instead of seconds.
+void FrameTest::helloInSmallChunks() {
+  SKIP_UNLESS_BENCHMARKING();
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  // Not a real project, so it's sent as one incompressible segment.
+  QByteArray project(HELLO_PROJECT_SIZE, Qt::Uninitialized);
+  QRandomGenerator random(1);
+  random.fillRange(reinterpret_cast<quint32 *>(project.data()),
+                   project.size() / sizeof(quint32));
+  QString filename = dir.filePath("big.ptcop");
+  {
+    QFile file(filename);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(project), qint64(project.size()));
+  }
+
+  BroadcastServer server(filename, QHostAddress::LocalHost, 0, std::nullopt);
+  Client client(nullptr);
+  std::optional<QByteArray> received;
+  qint64 ms = 0;
+  QElapsedTimer timer;
+  connect(&client, &Client::connected,
+          [&](const QByteArray &data, const QList<ServerAction> &, qint64) {
+            ms = timer.elapsed();
+            received = data;
+          });
+  QSignalSpy errors(&client, &Client::errorOccurred);
+  timer.start();
+  client.connectToServer("127.0.0.1", server.port(), "big");
+  QTRY_VERIFY_WITH_TIMEOUT(received.has_value(), 60 * 1000);
+  QCOMPARE(errors.count(), 0);
+  QVERIFY(received.value() == project);
+  ms = std::max(ms, qint64(1));
+  qInfo("Received a %d MB hello in %lld ms (%.1f MB/s)",
+        HELLO_PROJECT_SIZE / 1024 / 1024, ms,
+        HELLO_PROJECT_SIZE / 1024.0 / 1024.0 * 1000.0 / ms);
+}
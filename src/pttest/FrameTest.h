@@ -0,0 +1,15 @@
+#ifndef FRAMETEST_H
+#define FRAMETEST_H
+
+#include <QObject>
+
+class FrameTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void initTestCase();
+  void waitsForWholeFrame();
+  void rejectsFramesOverLimit();
+  void helloInSmallChunks();
+};
+
+#endif  // FRAMETEST_H
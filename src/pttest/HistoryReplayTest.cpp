@@ -0,0 +1,119 @@
+#include "HistoryReplayTest.h"
+
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QtEndian>
+#include <QtTest>
+
+#include "Benchmark.h"
+#include "editor/HistoryReplay.h"
+
+// About as long as the history of a song a few people have worked on for an
+// evening.
+constexpr int BENCHMARK_ACTIONS = 50000;
+
+// A short 8-bit mono WAV, the simplest woice there is to make.
+static QByteArray wav() {
+  constexpr quint32 SAMPLES = 1000, SAMPLE_RATE = 11025;
+  QByteArray data;
+  auto put = [&data](auto v) {
+    char bytes[sizeof(v)];
+    qToLittleEndian(v, bytes);
+    data.append(bytes, sizeof(v));
+  };
+  data.append("RIFF");
+  put(quint32(36 + SAMPLES));
+  data.append("WAVEfmt ");
+  put(quint32(16));
+  put(quint16(1));  // PCM
+  put(quint16(1));  // Channels
+  put(SAMPLE_RATE);
+  put(SAMPLE_RATE);  // Bytes per second
+  put(quint16(1));   // Block size
+  put(quint16(8));   // Bits per sample
+  data.append("data");
+  put(SAMPLES);
+  for (quint32 i = 0; i < SAMPLES; ++i) data.append(char(128 + i % 50));
+  return data;
+}
+
+// A session where someone added a unit and then [notes] notes to it, one
+// edit each.
+static QList<ServerAction> history(int notes) {
+  QList<ServerAction> history;
+  history.push_back(
+      {0, ClientAction{AddWoice{pxtnWOICE_PCM, "tone", wav(), {}}}});
+  history.push_back({0, ClientAction{AddUnit{0, "tone", "unit"}}});
+  for (int i = 0; i < notes; ++i) {
+    qint32 clock = i * 120;
+    std::list<Action::Primitive> edit{
+        {EVENTKIND_ON, 0, clock, Action::Add{120}},
+        {EVENTKIND_VELOCITY, 0, clock, Action::Add{104}},
+        {EVENTKIND_KEY, 0, clock, Action::Add{0x4000 + i % 12 * 0x100}}};
+    history.push_back({0, ClientAction{EditAction{i, edit}}});
+  }
+  return history;
+}
+
+namespace {
+// What the editor swaps the replayed project into.
+struct Editor {
+  pxtnService pxtn;
+  mooState moo_state;
+  std::unique_ptr<PxtoneController> controller;
+
+  Editor() {
+    pxtn.init_collage(EVENT_MAX);
+    pxtn.set_destination_quality(2, 44100);
+    controller =
+        std::make_unique<PxtoneController>(1, &pxtn, &moo_state, nullptr);
+  }
+};
+}  // namespace
+
+// Starts [replay] and waits for it to finish. Returns how long that took, or
+// -1 if it didn't.
+static qint64 runReplay(HistoryReplay &replay) {
+  QElapsedTimer timer;
+  timer.start();
+  QSignalSpy finished(&replay, &HistoryReplay::finished);
+  replay.start();
+  if (!finished.wait(120 * 1000)) return -1;
+  return timer.elapsed();
+}
+
+void HistoryReplayTest::replaysAndAdopts() {
+  constexpr int NOTES = 100;
+  Editor editor;
+  HistoryReplay r(QByteArray(), history(NOTES), 1, &editor.pxtn, nullptr);
+  QVERIFY(runReplay(r) >= 0);
+  QVERIFY(r.succeeded());
+
+  editor.controller->adoptProject(*r.controller());
+  QCOMPARE(editor.pxtn.Unit_Num(), 1);
+  QCOMPARE(editor.pxtn.Woice_Num(), 1);
+  QCOMPARE(editor.pxtn.evels->get_Count(0, EVENTKIND_ON), NOTES);
+  QCOMPARE(editor.pxtn.evels->get_Count(0, EVENTKIND_KEY), NOTES);
+}
+
+void HistoryReplayTest::benchmarkReplay() {
+  SKIP_UNLESS_BENCHMARKING();
+  Editor editor;
+  HistoryReplay r(QByteArray(), history(BENCHMARK_ACTIONS), 1, &editor.pxtn,
+                  nullptr);
+  qint64 replay_ms = runReplay(r);
+  QVERIFY(replay_ms >= 0);
+  QVERIFY(r.succeeded());
+  replay_ms = std::max(replay_ms, qint64(1));
+
+  QElapsedTimer timer;
+  timer.start();
+  editor.controller->adoptProject(*r.controller());
+  qint64 adopt_ms = timer.elapsed();
+  QCOMPARE(editor.pxtn.evels->get_Count(0, EVENTKIND_ON), BENCHMARK_ACTIONS);
+
+  int actions = BENCHMARK_ACTIONS + 2;
+  qInfo("Replayed %d actions in %lld ms (%.0f actions/s), adopted the "
+        "project in %lld ms",
+        actions, replay_ms, actions * 1000.0 / replay_ms, adopt_ms);
+}
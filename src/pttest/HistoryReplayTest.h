@@ -0,0 +1,13 @@
+#ifndef HISTORYREPLAYTEST_H
+#define HISTORYREPLAYTEST_H
+
+#include <QObject>
+
+class HistoryReplayTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void replaysAndAdopts();
+  void benchmarkReplay();
+};
+
+#endif  // HISTORYREPLAYTEST_H
@@ -0,0 +1,64 @@
+#include "PlaybackTest.h"
+
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QtTest>
+
+#include "Benchmark.h"
+#include "network/BroadcastServer.h"
+#include "protocol/Recording.h"
+
+// Enough for playback to take a while, with edits about the size of a
+// typical note.
+constexpr int BENCHMARK_ACTIONS = 200000;
+constexpr int PRIMITIVES_PER_EDIT = 4;
+
+void PlaybackTest::init() { QVERIFY(m_dir.isValid()); }
+
+// Writes a recording of [actions] edits from one user, [interval_ms] apart.
+QString PlaybackTest::writeRecording(int actions, qint64 interval_ms) {
+  QString filename =
+      m_dir.filePath(QString("%1.ptrec").arg(QTest::currentTestFunction()));
+  RecordingWriter writer(filename, 1, QByteArray("not a real project"));
+  writer.write(0, {0, NewSession{"alice"}});
+  for (int i = 0; i < actions; ++i) {
+    std::list<Action::Primitive> edit;
+    for (int j = 0; j < PRIMITIVES_PER_EDIT; ++j)
+      edit.push_back({EVENTKIND_VELOCITY, 0, i * 480 + j * 10,
+                      Action::Add{100}});
+    writer.write(i * interval_ms, {0, ClientAction{EditAction{i, edit}}});
+  }
+  writer.finalize();
+  return filename;
+}
+
+void PlaybackTest::changesSpeedMidPlayback() {
+  // An hour between each, so at 1x only the first plays.
+  QString filename = writeRecording(10, 60 * 60 * 1000);
+  BroadcastServer server(filename, QHostAddress::LocalHost, 0, std::nullopt);
+  QSignalSpy finished(&server, &BroadcastServer::playbackFinished);
+  QVERIFY(!finished.wait(200));
+
+  QVERIFY(server.setPlaybackSpeed(PLAYBACK_AS_FAST_AS_POSSIBLE));
+  QVERIFY(finished.wait(5000));
+
+  // Speeds that don't make sense are refused.
+  QVERIFY(!server.setPlaybackSpeed(0));
+  QVERIFY(!server.setPlaybackSpeed(-1));
+}
+
+// Not a QBENCHMARK since playback can only be run once per recording. The
+// recording is 1ms per action, so real time would take minutes.
+void PlaybackTest::benchmarkMaxSpeed() {
+  SKIP_UNLESS_BENCHMARKING();
+  QString filename = writeRecording(BENCHMARK_ACTIONS, 1);
+  QElapsedTimer timer;
+  timer.start();
+  BroadcastServer server(filename, QHostAddress::LocalHost, 0, std::nullopt);
+  QVERIFY(server.setPlaybackSpeed(PLAYBACK_AS_FAST_AS_POSSIBLE));
+  QSignalSpy finished(&server, &BroadcastServer::playbackFinished);
+  QVERIFY(finished.wait(120 * 1000));
+  qint64 ms = std::max(timer.elapsed(), qint64(1));
+  qInfo("Played back %d actions in %lld ms (%.0f actions/s)",
+        BENCHMARK_ACTIONS + 1, ms, (BENCHMARK_ACTIONS + 1) * 1000.0 / ms);
+}
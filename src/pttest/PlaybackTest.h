@@ -0,0 +1,19 @@
+#ifndef PLAYBACKTEST_H
+#define PLAYBACKTEST_H
+
+#include <QObject>
+#include <QTemporaryDir>
+
+class PlaybackTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void init();
+  void changesSpeedMidPlayback();
+  void benchmarkMaxSpeed();
+
+ private:
+  QString writeRecording(int actions, qint64 interval_ms);
+  QTemporaryDir m_dir;
+};
+
+#endif  // PLAYBACKTEST_H
@@ -0,0 +1,254 @@
+#include "RecordingTest.h"
+
+#include <QBuffer>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "editor/PxtoneController.h"
+#include "protocol/ProjectTransfer.h"
+#include "protocol/Recording.h"
+
+// testdata/v1.ptrec is a version 1 recording, written with protocol 2 the way
+// BroadcastServer used to write them. It's checked in rather than generated so
+// that it keeps testing the old layout no matter what happens to the current
+// serializers. Next uid 2, data "not a real project", and then:
+//   0ms   NewSession("alice")
+//   100ms EditAction(idx 0, [on u0 @480 +480, velocity u0 @480 +100])
+//   200ms AddWoice(PTV, "drum", "woice one")
+//   300ms ChangeWoice(remove 1 "drum", add OGGV "bass" "woice two")
+//   400ms TempoChange(150)
+//   500ms DeleteSession
+// all from uid 0.
+static const char *V1_FIXTURE = ":/testdata/v1.ptrec";
+
+template <typename T>
+static const T &clientAction(const ServerAction &a) {
+  return std::get<T>(std::get<ClientAction>(a.action));
+}
+
+void RecordingTest::readsVersion1() {
+  QFile file(V1_FIXTURE);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  RecordingReader reader(&file);
+  QCOMPARE(reader.version(), qint64(1));
+  QCOMPARE(reader.nextUid(), 2);
+  QCOMPARE(reader.data(), QByteArray("not a real project"));
+  QVERIFY(reader.index().empty());
+
+  qint64 elapsed;
+  ServerAction a;
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(0));
+  QCOMPARE(a.uid, qint64(0));
+  QCOMPARE(std::get<NewSession>(a.action).username, QString("alice"));
+
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(100));
+  const EditAction &edit = clientAction<EditAction>(a);
+  QCOMPARE(edit.idx, qint64(0));
+  QCOMPARE(int(edit.action.size()), 2);
+  const Action::Primitive &on = edit.action.front();
+  QCOMPARE(on.kind, EVENTKIND_ON);
+  QCOMPARE(on.unit_id, 0);
+  QCOMPARE(on.start_clock, 480);
+  QCOMPARE(std::get<Action::Add>(on.type).value, 480);
+  const Action::Primitive &velocity = edit.action.back();
+  QCOMPARE(velocity.kind, EVENTKIND_VELOCITY);
+  QCOMPARE(std::get<Action::Add>(velocity.type).value, 100);
+
+  // Protocol 2 woices have no hash, so the reader fills it in.
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(200));
+  const AddWoice &add = clientAction<AddWoice>(a);
+  QCOMPARE(add.type, pxtnWOICE_PTV);
+  QCOMPARE(add.name, QString("drum"));
+  QCOMPARE(add.data, QByteArray("woice one"));
+  QCOMPARE(add.hash, woiceHash(add.data));
+
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(300));
+  const ChangeWoice &change = clientAction<ChangeWoice>(a);
+  QCOMPARE(change.remove.id, 1);
+  QCOMPARE(change.remove.name, QString("drum"));
+  QCOMPARE(change.add.type, pxtnWOICE_OGGV);
+  QCOMPARE(change.add.name, QString("bass"));
+  QCOMPARE(change.add.data, QByteArray("woice two"));
+  QCOMPARE(change.add.hash, woiceHash(change.add.data));
+
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(400));
+  QCOMPARE(clientAction<TempoChange>(a).tempo, 150);
+
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(500));
+  QVERIFY(std::holds_alternative<DeleteSession>(a.action));
+
+  QVERIFY(reader.atEnd());
+  QVERIFY(!reader.next(elapsed, a));
+}
+
+void RecordingTest::seeksVersion1() {
+  QFile file(V1_FIXTURE);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  RecordingReader reader(&file);
+  RecordingPosition position = reader.seek(250);
+  QCOMPARE(position.data, QByteArray("not a real project"));
+  const QList<ServerAction> &history = position.history;
+  QCOMPARE(history.size(), 3);
+  QVERIFY(std::holds_alternative<NewSession>(history[0].action));
+  QCOMPARE(clientAction<EditAction>(history[1]).action.size(), size_t(2));
+  QCOMPARE(clientAction<AddWoice>(history[2]).name, QString("drum"));
+
+  qint64 elapsed;
+  ServerAction a;
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(300));
+  QCOMPARE(clientAction<ChangeWoice>(a).add.name, QString("bass"));
+}
+
+void RecordingTest::rejectsVersion1WithNewerProtocol() {
+  // Version 1 never had anything but protocol 2 in it, so anything else is
+  // more likely to be corruption than a file we could make sense of.
+  QFile file(V1_FIXTURE);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  QByteArray bytes = file.readAll();
+  bytes[7] = 3;
+  QBuffer buffer(&bytes);
+  QVERIFY(buffer.open(QIODevice::ReadOnly));
+  bool threw = false;
+  try {
+    RecordingReader reader(&buffer);
+  } catch (const QString &) {
+    threw = true;
+  }
+  QVERIFY(threw);
+}
+
+// A version 2 recording made with protocol 5, before the recording had its
+// own action format. Its AddWoice has no hash, and it has to be read anyway.
+void RecordingTest::readsVersion2WithOlderProtocol() {
+  QByteArray bytes;
+  {
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out << qint64(5) << qint64(2) << qint32(3) << QByteArray("project");
+    // ServerAction(uid 1, ClientAction(AddWoice(PTV, "drum", "woice")))
+    out << qint64(100) << quint8(0) << qint64(1) << quint64(0) << quint64(6)
+        << qint8(pxtnWOICE_PTV) << QString("drum") << QByteArray("woice");
+    out << qint64(200) << quint8(0) << qint64(1) << quint64(0) << quint64(9)
+        << qint32(140);
+  }
+  QBuffer buffer(&bytes);
+  QVERIFY(buffer.open(QIODevice::ReadOnly));
+  RecordingReader reader(&buffer);
+  QCOMPARE(reader.version(), qint64(2));
+  QCOMPARE(reader.nextUid(), 3);
+
+  qint64 elapsed;
+  ServerAction a;
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, qint64(100));
+  const AddWoice &add = clientAction<AddWoice>(a);
+  QCOMPARE(add.name, QString("drum"));
+  QCOMPARE(add.data, QByteArray("woice"));
+  QCOMPARE(add.hash, woiceHash(add.data));
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(clientAction<TempoChange>(a).tempo, 140);
+  QVERIFY(!reader.next(elapsed, a));
+}
+
+void RecordingTest::roundTripsCurrentVersion() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString filename = dir.filePath("current.ptrec");
+
+  constexpr int COUNT = 10;
+  constexpr qint64 SPACING = 20000;
+  {
+    // An empty project is a new one, which the writer can take snapshots of.
+    RecordingWriter writer(filename, 1, QByteArray());
+    writer.write(0, {0, NewSession{"bob"}, std::nullopt});
+    for (int i = 1; i < COUNT; ++i)
+      writer.write(i * SPACING,
+                   {0, ClientAction{TempoChange{100 + i}}, std::nullopt});
+    writer.setNextUid(5);
+    QVERIFY(writer.finalize());
+  }
+
+  QFile file(filename);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  RecordingReader reader(&file);
+  QCOMPARE(reader.version(), qint64(3));
+  QCOMPARE(reader.nextUid(), 5);
+  QCOMPARE(reader.data(), QByteArray());
+  QVERIFY(!reader.index().empty());
+
+  // Checkpoints are skipped over.
+  qint64 elapsed;
+  ServerAction a;
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(std::get<NewSession>(a.action).username, QString("bob"));
+  for (int i = 1; i < COUNT; ++i) {
+    QVERIFY(reader.next(elapsed, a));
+    QCOMPARE(elapsed, i * SPACING);
+    QCOMPARE(clientAction<TempoChange>(a).tempo, 100 + i);
+  }
+  QVERIFY(!reader.next(elapsed, a));
+}
+
+void RecordingTest::seeksFromCheckpoint() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString filename = dir.filePath("checkpoints.ptrec");
+
+  constexpr int COUNT = 200;
+  constexpr qint64 SPACING = 1000;
+  {
+    RecordingWriter writer(filename, 2, QByteArray());
+    writer.write(0, {0, NewSession{"bob"}, std::nullopt});
+    writer.write(0, {1, NewSession{"carol"}, std::nullopt});
+    writer.write(SPACING / 2, {1, DeleteSession{}, std::nullopt});
+    for (int i = 1; i <= COUNT; ++i)
+      writer.write(i * SPACING,
+                   {0, ClientAction{TempoChange{100 + i}}, std::nullopt});
+    QVERIFY(writer.finalize());
+  }
+
+  QFile file(filename);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  RecordingReader reader(&file);
+  QVERIFY(reader.index().size() > 1);
+  constexpr int TARGET = 150;
+  RecordingPosition position = reader.seek(TARGET * SPACING + SPACING / 2);
+
+  // It starts from a checkpoint, with whoever was connected then, rather than
+  // from the start.
+  const QList<ServerAction> &history = position.history;
+  QVERIFY(!position.data.isEmpty());
+  QVERIFY(history.size() > 2);
+  QVERIFY(history.size() < TARGET);
+  QVERIFY(std::holds_alternative<ControllerState>(history[0].action));
+  QCOMPARE(history[1].uid, qint64(0));
+  QCOMPARE(std::get<NewSession>(history[1].action).username, QString("bob"));
+  QCOMPARE(clientAction<TempoChange>(history.last()).tempo, 100 + TARGET);
+
+  // And the project it gives is the same as if it had all been replayed.
+  pxtnService pxtn;
+  mooState moo_state;
+  pxtn.init_collage(1000);
+  pxtn.set_destination_quality(2, 44100);
+  PxtoneController controller(-1, &pxtn, &moo_state, nullptr);
+  pxtnDescriptor desc;
+  desc.set_memory_r(position.data.constData(), position.data.size());
+  QVERIFY(controller.loadDescriptor(desc));
+  bool lost = false;
+  connect(&controller, &PxtoneController::historyLost,
+          [&lost]() { lost = true; });
+  for (const ServerAction &a : history) controller.applyProjectAction(a);
+  QVERIFY(!lost);
+  QCOMPARE(pxtn.master->get_beat_tempo(), float(100 + TARGET));
+
+  qint64 elapsed;
+  ServerAction a;
+  QVERIFY(reader.next(elapsed, a));
+  QCOMPARE(elapsed, (TARGET + 1) * SPACING);
+}
@@ -0,0 +1,17 @@
+#ifndef RECORDINGTEST_H
+#define RECORDINGTEST_H
+
+#include <QObject>
+
+class RecordingTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void readsVersion1();
+  void seeksVersion1();
+  void rejectsVersion1WithNewerProtocol();
+  void readsVersion2WithOlderProtocol();
+  void roundTripsCurrentVersion();
+  void seeksFromCheckpoint();
+};
+
+#endif  // RECORDINGTEST_H
@@ -0,0 +1,74 @@
+#include "WoiceCacheTest.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "network/WoiceCache.h"
+#include "protocol/ProjectTransfer.h"
+
+constexpr int BLOCK_SIZE = 1000;
+
+static QByteArray block(char c) { return QByteArray(BLOCK_SIZE, c); }
+
+// Recency is by file modification time, so make sure each use gets its own.
+static void nextUse() { QTest::qSleep(50); }
+
+static bool put(WoiceCache &cache, char c) {
+  nextUse();
+  return cache.put(woiceHash(block(c)), block(c));
+}
+
+static bool has(const WoiceCache &cache, char c) {
+  return cache.get(woiceHash(block(c))).has_value();
+}
+
+void WoiceCacheTest::evictsLeastRecentlyUsed() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  WoiceCache cache(dir.path(), 3 * BLOCK_SIZE);
+  QVERIFY(put(cache, 'a'));
+  QVERIFY(put(cache, 'b'));
+  QVERIFY(put(cache, 'c'));
+  nextUse();
+  QVERIFY(has(cache, 'a'));
+
+  QVERIFY(put(cache, 'd'));
+  QVERIFY(!has(cache, 'b'));
+  nextUse();
+  QVERIFY(has(cache, 'a'));
+  QVERIFY(has(cache, 'c'));
+  QVERIFY(has(cache, 'd'));
+}
+
+void WoiceCacheTest::keepsPinnedWoices() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  WoiceCache cache(dir.path(), 2 * BLOCK_SIZE);
+  QVERIFY(put(cache, 'a'));
+  QVERIFY(put(cache, 'b'));
+  cache.setPinned({woiceHash(block('a'))});
+
+  // 'a' is the oldest but pinned, so 'b' makes way instead.
+  QVERIFY(put(cache, 'c'));
+  QVERIFY(has(cache, 'a'));
+  QVERIFY(!has(cache, 'b'));
+  QVERIFY(has(cache, 'c'));
+
+  cache.setPinned({});
+  QVERIFY(put(cache, 'd'));
+  QCOMPARE(cache.hashes(10).size(), 2);
+}
+
+void WoiceCacheTest::listsMostRecentlyUsedHashes() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  WoiceCache cache(dir.path());
+  for (char c : {'a', 'b', 'c', 'd'}) QVERIFY(put(cache, c));
+  nextUse();
+  QVERIFY(has(cache, 'b'));
+
+  QList<QByteArray> hashes = cache.hashes(2);
+  QCOMPARE(hashes.size(), 2);
+  QCOMPARE(hashes.at(0), woiceHash(block('b')));
+  QCOMPARE(hashes.at(1), woiceHash(block('d')));
+}
@@ -0,0 +1,14 @@
+#ifndef WOICECACHETEST_H
+#define WOICECACHETEST_H
+
+#include <QObject>
+
+class WoiceCacheTest : public QObject {
+  Q_OBJECT
+ private slots:
+  void evictsLeastRecentlyUsed();
+  void keepsPinnedWoices();
+  void listsMostRecentlyUsedHashes();
+};
+
+#endif  // WOICECACHETEST_H
@@ -0,0 +1,40 @@
+#include <QCoreApplication>
+#include <QtTest>
+
+#include "ActionLogTest.h"
+#include "BroadcastServerTest.h"
+#include "CompactEncodingTest.h"
+#include "ControllerConvergenceTest.h"
+#include "EvelistTest.h"
+#include "FrameTest.h"
+#include "HistoryReplayTest.h"
+#include "PlaybackTest.h"
+#include "RecordingTest.h"
+#include "WoiceCacheTest.h"
+
+// Runs each test class in turn. Options (e.g. -v2, -o) are passed on to all of
+// them. Exits with the total number of failed tests.
+
+template <typename T>
+static int run(int argc, char *argv[]) {
+  T test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication a(argc, argv);
+  a.setApplicationName("pttest");
+
+  int failed = 0;
+  failed += run<ActionLogTest>(argc, argv);
+  failed += run<BroadcastServerTest>(argc, argv);
+  failed += run<CompactEncodingTest>(argc, argv);
+  failed += run<ControllerConvergenceTest>(argc, argv);
+  failed += run<EvelistTest>(argc, argv);
+  failed += run<FrameTest>(argc, argv);
+  failed += run<HistoryReplayTest>(argc, argv);
+  failed += run<PlaybackTest>(argc, argv);
+  failed += run<RecordingTest>(argc, argv);
+  failed += run<WoiceCacheTest>(argc, argv);
+  return failed;
+}
@@ -12,6 +12,7 @@ const char* EVENTKIND_names[EVENTKIND_NUM] = {
     "EVENTKIND_PAN_TIME"};
 
 void pxtnEvelist::Release() {
+  _revision++;
   if (_eves) free(_eves);
   _eves = NULL;
   _start = NULL;
@@ -19,6 +20,7 @@ void pxtnEvelist::Release() {
 }
 
 pxtnEvelist::pxtnEvelist() {
+  _revision = 0;
   _eves = NULL;
   _start = NULL;
   _eve_allocated_num = 0;
@@ -29,6 +31,7 @@ pxtnEvelist::pxtnEvelist() {
 pxtnEvelist::~pxtnEvelist() { pxtnEvelist::Release(); }
 
 void pxtnEvelist::Clear() {
+  _revision++;
   if (_eves) memset(_eves, 0, sizeof(EVERECORD) * _eve_allocated_num);
   _start = NULL;
 }
@@ -171,6 +174,8 @@ int32_t pxtnEvelist::get_Value(int32_t clock, uint8_t unit_no,
   return val;
 }
 
+uint32_t pxtnEvelist::get_Revision() const { return _revision; }
+
 const EVERECORD* pxtnEvelist::get_Records() const {
   if (!_eves) return NULL;
   return _start;
@@ -179,6 +184,7 @@ const EVERECORD* pxtnEvelist::get_Records() const {
 void pxtnEvelist::_rec_set(EVERECORD* p_rec, EVERECORD* prev, EVERECORD* next,
                            int32_t clock, uint8_t unit_no, uint8_t kind,
                            int32_t value) {
+  _revision++;
   if (prev)
     prev->next = p_rec;
   else
@@ -217,6 +223,7 @@ static int32_t _ComparePriority(uint8_t kind1, uint8_t kind2) {
 }
 
 void pxtnEvelist::_rec_cut(EVERECORD* p_rec) {
+  _revision++;
   if (p_rec->prev)
     p_rec->prev->next = p_rec->next;
   else
@@ -320,6 +327,7 @@ bool pxtnEvelist::Record_Add_i(int32_t clock, uint8_t unit_no, uint8_t kind,
 
 int32_t pxtnEvelist::Record_Delete(int32_t clock1, int32_t clock2,
                                    uint8_t unit_no, uint8_t kind) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -348,6 +356,7 @@ int32_t pxtnEvelist::Record_Delete(int32_t clock1, int32_t clock2,
 
 int32_t pxtnEvelist::Record_Delete(int32_t clock1, int32_t clock2,
                                    uint8_t unit_no) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -373,6 +382,7 @@ int32_t pxtnEvelist::Record_Delete(int32_t clock1, int32_t clock2,
 }
 
 int32_t pxtnEvelist::Record_UnitNo_Miss(uint8_t unit_no) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -390,6 +400,7 @@ int32_t pxtnEvelist::Record_UnitNo_Miss(uint8_t unit_no) {
 }
 
 int32_t pxtnEvelist::Record_UnitNo_Set(uint8_t unit_no) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -401,6 +412,7 @@ int32_t pxtnEvelist::Record_UnitNo_Set(uint8_t unit_no) {
 }
 
 int32_t pxtnEvelist::Record_UnitNo_Replace(uint8_t old_u, uint8_t new_u) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -434,6 +446,7 @@ int32_t pxtnEvelist::Record_UnitNo_Replace(uint8_t old_u, uint8_t new_u) {
 int32_t pxtnEvelist::Record_Value_Set(int32_t clock1, int32_t clock2,
                                       uint8_t unit_no, uint8_t kind,
                                       int32_t value) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -450,6 +463,7 @@ int32_t pxtnEvelist::Record_Value_Set(int32_t clock1, int32_t clock2,
 }
 
 int32_t pxtnEvelist::BeatClockOperation(int32_t rate) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -466,6 +480,7 @@ int32_t pxtnEvelist::BeatClockOperation(int32_t rate) {
 int32_t pxtnEvelist::Record_Value_Change(int32_t clock1, int32_t clock2,
                                          uint8_t unit_no, uint8_t kind,
                                          int32_t value) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -521,6 +536,7 @@ int32_t pxtnEvelist::Record_Value_Change(int32_t clock1, int32_t clock2,
 }
 
 int32_t pxtnEvelist::Record_Value_Omit(uint8_t kind, int32_t value) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -541,6 +557,7 @@ int32_t pxtnEvelist::Record_Value_Omit(uint8_t kind, int32_t value) {
 
 int32_t pxtnEvelist::Record_Value_Replace(uint8_t kind, int32_t old_value,
                                           int32_t new_value) {
+  _revision++;
   if (!_eves) return 0;
 
   int32_t count = 0;
@@ -577,6 +594,7 @@ int32_t pxtnEvelist::Record_Value_Replace(uint8_t kind, int32_t old_value,
 
 int32_t pxtnEvelist::Record_Clock_Shift(int32_t clock, int32_t shift,
                                         uint8_t unit_no) {
+  _revision++;
   if (!_eves) return 0;
   if (!_start) return 0;
   if (!shift) return 0;
@@ -663,6 +681,7 @@ void pxtnEvelist::Linear_Add_f(int32_t clock, uint8_t unit_no, uint8_t kind,
 }
 
 void pxtnEvelist::Linear_End(bool b_connect) {
+  _revision++;
   if (_eves[0].kind != EVENTKIND_NULL) _start = &_eves[0];
 
   if (b_connect) {
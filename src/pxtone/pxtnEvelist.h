@@ -67,6 +67,7 @@ class pxtnEvelist {
   int32_t _linear;
 
   EVERECORD *_p_x4x_rec;
+  uint32_t _revision;
 
   void _rec_set(EVERECORD *p_rec, EVERECORD *prev, EVERECORD *next,
                 int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value);
@@ -90,6 +91,9 @@ class pxtnEvelist {
   int32_t get_Count(int32_t clock1, int32_t clock2, uint8_t unit_no) const;
   int32_t get_Value(int32_t clock, uint8_t unit_no, uint8_t kind) const;
 
+  // Changes whenever the records do, so that views can tell when something
+  // they've derived from them is stale.
+  uint32_t get_Revision() const;
   const EVERECORD *get_Records() const;
 
   bool Record_Add_i(int32_t clock, uint8_t unit_no, uint8_t kind,
@@ -9,6 +9,7 @@
 #include "./pxtnService.h"
 
 #include <algorithm>
+#include <utility>
 
 #include "./pxtn.h"
 
@@ -218,18 +219,44 @@ pxtnERR pxtnService::tones_ready(mooState &moo_state) {
   if (!_b_init) return pxtnERR_INIT;
 
   pxtnERR res = pxtnERR_VOID;
+  delays_ready(moo_state);
+
+  for (int32_t i = 0; i < _woice_num; i++) {
+    res = _woices[i]->Tone_Ready(_ptn_bldr, _dst_sps);
+    if (res != pxtnOK) return res;
+  }
+  return pxtnOK;
+}
+
+void pxtnService::delays_ready(mooState &moo_state) const {
   int32_t beat_num = master->get_beat_num();
   float beat_tempo = master->get_beat_tempo();
 
   moo_state.delays.clear();
   for (size_t i = 0; i < _delays.size(); i++)
     moo_state.delays.emplace_back(_delays[i], beat_num, beat_tempo, _dst_sps);
+}
 
-  for (int32_t i = 0; i < _woice_num; i++) {
-    res = _woices[i]->Tone_Ready(_ptn_bldr, _dst_sps);
-    if (res != pxtnOK) return res;
-  }
-  return pxtnOK;
+bool pxtnService::swap_project(pxtnService &other) {
+  if (!_b_init || !other._b_init || _b_edit != other._b_edit) return false;
+
+  std::swap(_b_fix_evels_num, other._b_fix_evels_num);
+  std::swap(text, other.text);
+  std::swap(master, other.master);
+  std::swap(evels, other.evels);
+  std::swap(_delay_max, other._delay_max);
+  _delays.swap(other._delays);
+  std::swap(_ovdrv_max, other._ovdrv_max);
+  _ovdrvs.swap(other._ovdrvs);
+  std::swap(_woice_max, other._woice_max);
+  std::swap(_woice_num, other._woice_num);
+  std::swap(_woices, other._woices);
+  std::swap(_unit_max, other._unit_max);
+  std::swap(_unit_num, other._unit_num);
+  std::swap(_units, other._units);
+  std::swap(_group_num, other._group_num);
+  std::swap(_moo_b_valid_data, other._moo_b_valid_data);
+  return true;
 }
 
 void mooState::tones_clear() {
@@ -195,12 +195,17 @@ class pxtnService {
 
   pxtnERR write(pxtnDescriptor *p_doc, bool bTune, uint16_t exe_ver);
   pxtnERR read(pxtnDescriptor *p_doc);
+  // Swaps the song (units, woices, events, effects etc.) with [other]'s,
+  // leaving the output settings alone. Both must have been inited the same
+  // way. Woice tones come along ready, but delay tones need delays_ready.
+  bool swap_project(pxtnService &other);
 
   bool AdjustMeasNum();
 
   int32_t get_last_error_id() const;
 
   pxtnERR tones_ready(mooState &moo_state);
+  void delays_ready(mooState &moo_state) const;
 
   int32_t Group_Num() const;
 